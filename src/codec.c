@@ -0,0 +1,264 @@
+/*
+ *  SERUtils - A command line utility for processing SER movie files
+ *  Copyright (C) 2020  Giuseppe Fabio Nicotra <artix2 at gmail dot com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Lossless frame codec used by compressed movies (see SERArchiveWriter
+ * in ser.c). Every sample is predicted from the previous sample of the
+ * same channel (and of the same CFA color for Bayer frames) on the same
+ * row, or from the sample above it for the first samples of every row.
+ * The prediction residual is zigzag encoded, so that small negative and
+ * positive values both become small unsigned values, and residuals are
+ * bit-packed in blocks of CODEC_BLOCK_SAMPLES samples, every block using
+ * the least number of bits needed by its greatest residual.
+ * Low bits that are zero in every sample of a 16-bit frame (ie. 12-bit
+ * data stored in the most significant bits) are shifted out before
+ * encoding.
+ * Frames that cannot be compressed are stored as they are, so encoded
+ * frames are never more than one byte bigger than raw frames.
+ *
+ * Encoded frame layout:
+ *
+ *   method                 1 byte (CODEC_METHOD_*)
+ *   CODEC_METHOD_STORED:
+ *     raw frame data       CodecGetFrameSize bytes
+ *   CODEC_METHOD_PACKED:
+ *     shift                1 byte
+ *     blocks               1 byte (bit width) + packed residuals, every
+ *                          block starting on a byte boundary. */
+
+#include <string.h>
+#include "codec.h"
+
+/* Zigzag encoded residuals of 16-bit samples need 17 bits */
+#define CODEC_MAX_BITS          17
+
+typedef struct {
+    uint8_t *p;
+    uint64_t acc;
+    int bits;
+} BitWriter;
+
+static inline uint32_t loadSample(const uint8_t *data, size_t i, int bps,
+    int big_endian)
+{
+    if (bps == 1) return data[i];
+    data += i * 2;
+    if (big_endian) return ((uint32_t) data[0] << 8) | data[1];
+    return data[0] | ((uint32_t) data[1] << 8);
+}
+
+static inline void storeSample(uint8_t *data, size_t i, uint32_t value,
+    int bps, int big_endian)
+{
+    if (bps == 1) {
+        data[i] = (uint8_t) value;
+        return;
+    }
+    data += i * 2;
+    if (big_endian) {
+        data[0] = (uint8_t) (value >> 8);
+        data[1] = (uint8_t) value;
+    } else {
+        data[0] = (uint8_t) value;
+        data[1] = (uint8_t) (value >> 8);
+    }
+}
+
+static inline uint32_t zigzagEncode(int32_t delta) {
+    uint32_t v = (uint32_t) delta << 1;
+    return (delta < 0 ? ~v : v);
+}
+
+static inline int32_t zigzagDecode(uint32_t v) {
+    int32_t half = (int32_t) (v >> 1);
+    return ((v & 1) ? -half - 1 : half);
+}
+
+static int getBitWidth(uint32_t value) {
+    int width = 0;
+    while (value) {
+        width++;
+        value >>= 1;
+    }
+    return width;
+}
+
+static inline void putBits(BitWriter *bw, uint32_t value, int bits) {
+    bw->acc |= (uint64_t) value << bw->bits;
+    bw->bits += bits;
+    while (bw->bits >= 8) {
+        *(bw->p++) = (uint8_t) bw->acc;
+        bw->acc >>= 8;
+        bw->bits -= 8;
+    }
+}
+
+static void writeBlock(BitWriter *bw, const uint32_t *residuals, int count) {
+    uint32_t bits = 0;
+    int i;
+    for (i = 0; i < count; i++) bits |= residuals[i];
+    int width = getBitWidth(bits);
+    *(bw->p++) = (uint8_t) width;
+    if (width > 0) {
+        for (i = 0; i < count; i++) putBits(bw, residuals[i], width);
+    }
+    if (bw->bits > 0) *(bw->p++) = (uint8_t) bw->acc;
+    bw->acc = 0;
+    bw->bits = 0;
+}
+
+/* Unpack `count` residuals of the block starting at `*p`, then move `*p`
+ * to the next block. Return 0 if the block is not valid. */
+static int readBlock(const uint8_t **p, const uint8_t *end,
+    uint32_t *residuals, int count)
+{
+    const uint8_t *q = *p;
+    if (q >= end) return 0;
+    int width = *(q++), i;
+    if (width > CODEC_MAX_BITS) return 0;
+    size_t bytes = (((size_t) count * width) + 7) / 8;
+    if ((size_t) (end - q) < bytes) return 0;
+    if (width == 0) {
+        memset(residuals, 0, count * sizeof(*residuals));
+    } else {
+        uint64_t acc = 0, mask = (1u << width) - 1;
+        int bits = 0;
+        for (i = 0; i < count; i++) {
+            while (bits < width) {
+                acc |= (uint64_t) *(q++) << bits;
+                bits += 8;
+            }
+            residuals[i] = (uint32_t) (acc & mask);
+            acc >>= width;
+            bits -= width;
+        }
+    }
+    *p += 1 + bytes;
+    return 1;
+}
+
+/* Size of the raw frame described by `format` */
+size_t CodecGetFrameSize(const CodecFrameFormat *format) {
+    return (size_t) format->width * format->height * format->planes *
+        format->bytes_per_sample;
+}
+
+/* Size of the buffer needed by CodecEncodeFrame to encode a frame in the
+ * worst case. */
+size_t CodecGetMaxEncodedSize(const CodecFrameFormat *format) {
+    size_t samples = (size_t) format->width * format->height * format->planes,
+           blocks = (samples + CODEC_BLOCK_SAMPLES - 1) / CODEC_BLOCK_SAMPLES,
+           packed = 2 + (blocks *
+               (1 + ((CODEC_BLOCK_SAMPLES * CODEC_MAX_BITS) + 7) / 8)),
+           stored = 1 + CodecGetFrameSize(format);
+    return (packed > stored ? packed : stored);
+}
+
+/* Encode the raw frame `src` into `dst`, whose size must be at least
+ * CodecGetMaxEncodedSize. Return the size of the encoded frame. */
+size_t CodecEncodeFrame(const CodecFrameFormat *format, const void *src,
+    void *dst)
+{
+    const uint8_t *s = src;
+    uint8_t *d = dst;
+    int bps = format->bytes_per_sample, be = format->big_endian, shift = 0;
+    size_t size = CodecGetFrameSize(format),
+           row_samples = (size_t) format->width * format->planes,
+           step = format->planes * (format->bayer ? 2 : 1),
+           up = row_samples * (format->bayer ? 2 : 1),
+           samples = row_samples * format->height, i, x;
+    uint32_t residuals[CODEC_BLOCK_SAMPLES];
+    int count = 0;
+    if (bps == 2) {
+        uint32_t bits = 0;
+        for (i = 0; i < samples; i++) bits |= loadSample(s, i, bps, be);
+        if (bits != 0) {
+            while (!(bits & 1)) {
+                bits >>= 1;
+                shift++;
+            }
+        }
+    }
+    d[0] = CODEC_METHOD_PACKED;
+    d[1] = (uint8_t) shift;
+    BitWriter bw = {d + 2, 0, 0};
+    for (i = 0, x = 0; i < samples; i++, x++) {
+        if (x == row_samples) x = 0;
+        uint32_t value = loadSample(s, i, bps, be) >> shift, pred = 0;
+        if (x >= step) pred = loadSample(s, i - step, bps, be) >> shift;
+        else if (i >= up) pred = loadSample(s, i - up, bps, be) >> shift;
+        residuals[count++] = zigzagEncode((int32_t) value - (int32_t) pred);
+        if (count == CODEC_BLOCK_SAMPLES) {
+            writeBlock(&bw, residuals, count);
+            count = 0;
+            /* Give up as soon as it gets bigger than the raw frame */
+            if ((size_t) (bw.p - d) > size) goto store;
+        }
+    }
+    if (count > 0) writeBlock(&bw, residuals, count);
+    size_t encoded = bw.p - d;
+    if (encoded <= size) return encoded;
+store:
+    d[0] = CODEC_METHOD_STORED;
+    memcpy(d + 1, s, size);
+    return size + 1;
+}
+
+/* Decode the encoded frame `src` (`size` bytes) into `dst`, whose size
+ * must be at least CodecGetFrameSize. Return 1 on success, 0 if encoded
+ * data is not valid. */
+int CodecDecodeFrame(const CodecFrameFormat *format, const void *src,
+    size_t size, void *dst)
+{
+    const uint8_t *s = src, *end = s + size;
+    uint8_t *d = dst;
+    int bps = format->bytes_per_sample, be = format->big_endian;
+    size_t frame_size = CodecGetFrameSize(format),
+           row_samples = (size_t) format->width * format->planes,
+           step = format->planes * (format->bayer ? 2 : 1),
+           up = row_samples * (format->bayer ? 2 : 1),
+           samples = row_samples * format->height, i, x;
+    uint32_t residuals[CODEC_BLOCK_SAMPLES];
+    int count = 0, next = 0;
+    if (size < 1) return 0;
+    if (s[0] == CODEC_METHOD_STORED) {
+        if (size != frame_size + 1) return 0;
+        memcpy(d, s + 1, frame_size);
+        return 1;
+    }
+    if (s[0] != CODEC_METHOD_PACKED || size < 2) return 0;
+    int shift = s[1];
+    if (shift >= 8 * bps) return 0;
+    int32_t maxval = (bps == 1 ? 0xFF : 0xFFFF) >> shift;
+    const uint8_t *p = s + 2;
+    for (i = 0, x = 0; i < samples; i++, x++) {
+        if (x == row_samples) x = 0;
+        if (next == count) {
+            count = CODEC_BLOCK_SAMPLES;
+            if (samples - i < (size_t) count) count = (int) (samples - i);
+            if (!readBlock(&p, end, residuals, count)) return 0;
+            next = 0;
+        }
+        uint32_t pred = 0;
+        if (x >= step) pred = loadSample(d, i - step, bps, be) >> shift;
+        else if (i >= up) pred = loadSample(d, i - up, bps, be) >> shift;
+        int32_t value = (int32_t) pred + zigzagDecode(residuals[next++]);
+        if (value < 0 || value > maxval) return 0;
+        storeSample(d, i, (uint32_t) value << shift, bps, be);
+    }
+    return (p == end);
+}
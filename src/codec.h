@@ -0,0 +1,49 @@
+/*
+ *  SERUtils - A command line utility for processing SER movie files
+ *  Copyright (C) 2020  Giuseppe Fabio Nicotra <artix2 at gmail dot com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SER_CODEC_H__
+#define __SER_CODEC_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Encoded frames start with one of these methods */
+#define CODEC_METHOD_STORED     0
+#define CODEC_METHOD_PACKED     1
+
+/* Residuals are bit-packed in blocks of CODEC_BLOCK_SAMPLES samples,
+ * every block having its own bit width. */
+#define CODEC_BLOCK_SAMPLES     64
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    int planes;
+    int bytes_per_sample;
+    int bayer;          /* Predict from samples of the same CFA color */
+    int big_endian;     /* Byte order of 16-bit samples */
+} CodecFrameFormat;
+
+size_t CodecGetFrameSize(const CodecFrameFormat *format);
+size_t CodecGetMaxEncodedSize(const CodecFrameFormat *format);
+size_t CodecEncodeFrame(const CodecFrameFormat *format, const void *src,
+                        void *dst);
+int    CodecDecodeFrame(const CodecFrameFormat *format, const void *src,
+                        size_t size, void *dst);
+
+#endif /* __SER_CODEC_H__ */
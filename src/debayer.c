@@ -0,0 +1,367 @@
+/*
+ *  SERUtils - A command line utility for processing SER movie files
+ *  Copyright (C) 2020  Giuseppe Fabio Nicotra <artix2 at gmail dot com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Debayering (demosaicing) engine: converts Bayer mosaics (RGGB, GRBG,
+ * GBRG and BGGR) to interleaved RGB images having the same sample size.
+ * Two methods are available:
+ *
+ *  - SER_DEBAYER_BILINEAR: every missing color is the average of the
+ *    nearest samples of that color. Rows are processed by SIMD kernels
+ *    (see simd.c).
+ *  - SER_DEBAYER_EDGE_AWARE: green is interpolated along the direction of
+ *    the smallest gradient (with laplacian correction, as in
+ *    Hamilton-Adams), then red and blue are interpolated on color
+ *    differences (R - G and B - G), which greatly reduces color fringes
+ *    on edges.
+ *
+ * Images are split in bands of rows that are processed in parallel.
+ * Pixels outside the image are mirrored, which preserves the Bayer
+ * pattern on the borders. */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "ser.h"
+#include "log.h"
+#include "simd.h"
+#include "debayer.h"
+
+typedef struct {
+    const void *src;
+    void *dst;
+    uint32_t width;
+    uint32_t height;
+    uint32_t from; /* First row of the band */
+    uint32_t to; /* Last row of the band + 1 */
+    int bytes_per_sample;
+    int red_x; /* Column of red samples in every 2x2 cell */
+    int red_y; /* Row of red samples in every 2x2 cell */
+    int method;
+    long maxval; /* Maximum sample value */
+    int ok;
+} DebayerBand;
+
+static int getRedPosition(uint32_t color_id, int *red_x, int *red_y) {
+    switch (color_id) {
+        case COLOR_BAYER_RGGB: *red_x = 0; *red_y = 0; return 1;
+        case COLOR_BAYER_GRBG: *red_x = 1; *red_y = 0; return 1;
+        case COLOR_BAYER_GBRG: *red_x = 0; *red_y = 1; return 1;
+        case COLOR_BAYER_BGGR: *red_x = 1; *red_y = 1; return 1;
+    }
+    return 0;
+}
+
+/* Mirror coordinates falling outside [0, n) */
+static inline long reflect(long i, long n) {
+    if (i < 0) i = -i;
+    if (i >= n) i = (2 * n) - 2 - i;
+    if (i < 0) i = 0;
+    return i;
+}
+
+/* Get the color channel (0 for red, 2 for blue) of non green samples of
+ * row `y` and the parity of the columns holding them. */
+static inline void getRowColor(DebayerBand *band, long y, int *channel,
+    int *parity)
+{
+    if ((y & 1) == band->red_y) {
+        *channel = 0;
+        *parity = band->red_x;
+    } else {
+        *channel = 2;
+        *parity = 1 - band->red_x;
+    }
+}
+
+static inline uint32_t getSample(const void *row, long x, int bps) {
+    if (bps == 1) return ((const uint8_t *) row)[x];
+    return ((const uint16_t *) row)[x];
+}
+
+static inline void setSample(void *row, long x, int bps, uint32_t value) {
+    if (bps == 1) ((uint8_t *) row)[x] = (uint8_t) value;
+    else ((uint16_t *) row)[x] = (uint16_t) value;
+}
+
+#define AVG(a, b) (((a) + (b) + 1) >> 1)
+
+static inline uint32_t clampSample(long value, long maxval) {
+    if (value < 0) return 0;
+    if (value > maxval) return (uint32_t) maxval;
+    return (uint32_t) value;
+}
+
+/* Bilinear demosaicing of the single pixel `x` of row `cur`, whose
+ * neighbours may fall outside the image. It gives the same result as the
+ * SIMD row kernels (see SIMDDebayerBilinearRow). */
+static void bilinearPixel(DebayerBand *band, const void *up, const void *cur,
+    const void *dn, void *dst, long x, int channel, int parity)
+{
+    int bps = band->bytes_per_sample;
+    long w = band->width, xl = reflect(x - 1, w), xr = reflect(x + 1, w);
+    uint32_t C = getSample(cur, x, bps),
+             H = AVG(getSample(cur, xl, bps), getSample(cur, xr, bps)),
+             V = AVG(getSample(up, x, bps), getSample(dn, x, bps)),
+             K, G, O;
+    if ((x & 1) == parity) {
+        K = C;
+        G = AVG(H, V);
+        O = AVG(AVG(getSample(up, xl, bps), getSample(up, xr, bps)),
+                AVG(getSample(dn, xl, bps), getSample(dn, xr, bps)));
+    } else {
+        K = H;
+        G = C;
+        O = V;
+    }
+    setSample(dst, (x * 3) + channel, bps, K);
+    setSample(dst, (x * 3) + 1, bps, G);
+    setSample(dst, (x * 3) + (2 - channel), bps, O);
+}
+
+static void debayerBandBilinear(DebayerBand *band) {
+    int bps = band->bytes_per_sample;
+    long w = band->width, h = band->height, y;
+    size_t row_size = w * bps;
+    const char *src = band->src;
+    char *dst = band->dst;
+    for (y = band->from; y < (long) band->to; y++) {
+        int channel, parity;
+        const char *cur = src + (y * row_size),
+                   *up = src + (reflect(y - 1, h) * row_size),
+                   *dn = src + (reflect(y + 1, h) * row_size);
+        char *out = dst + (y * row_size * 3);
+        getRowColor(band, y, &channel, &parity);
+        if (w < 3) {
+            long x;
+            for (x = 0; x < w; x++)
+                bilinearPixel(band, up, cur, dn, out, x, channel, parity);
+            continue;
+        }
+        bilinearPixel(band, up, cur, dn, out, 0, channel, parity);
+        SIMDDebayerBilinearRow(up, cur, dn, out, 1, w - 1, bps, channel,
+            parity);
+        bilinearPixel(band, up, cur, dn, out, w - 1, channel, parity);
+    }
+}
+
+/* Interpolate green for the whole row `y` (mirrored if outside the
+ * image) of a 16-bit mosaic, along the direction of the smallest
+ * gradient. */
+static void interpolateGreenRow(DebayerBand *band, const uint16_t *src,
+    long y, uint16_t *green, long maxval)
+{
+    long w = band->width, h = band->height, x;
+    int channel, parity;
+    y = reflect(y, h);
+    getRowColor(band, y, &channel, &parity);
+    const uint16_t *cur = src + (y * w),
+                   *up = src + (reflect(y - 1, h) * w),
+                   *dn = src + (reflect(y + 1, h) * w),
+                   *up2 = src + (reflect(y - 2, h) * w),
+                   *dn2 = src + (reflect(y + 2, h) * w);
+    for (x = 0; x < w; x++) {
+        long c = cur[x];
+        if ((x & 1) != parity) {
+            green[x] = (uint16_t) c;
+            continue;
+        }
+        long l = cur[reflect(x - 1, w)], r = cur[reflect(x + 1, w)],
+             l2 = cur[reflect(x - 2, w)], r2 = cur[reflect(x + 2, w)],
+             u = up[x], d = dn[x], u2 = up2[x], d2 = dn2[x];
+        long lap_h = (2 * c) - l2 - r2, lap_v = (2 * c) - u2 - d2,
+             grad_h = labs(l - r) + labs(lap_h),
+             grad_v = labs(u - d) + labs(lap_v),
+             gh = ((2 * (l + r)) + lap_h) / 4,
+             gv = ((2 * (u + d)) + lap_v) / 4, g;
+        if (grad_h < grad_v) g = gh;
+        else if (grad_v < grad_h) g = gv;
+        else g = (gh + gv) / 2;
+        green[x] = (uint16_t) clampSample(g, maxval);
+    }
+}
+
+/* Edge-aware demosaicing of a band of a 16-bit mosaic. `maxval` is the
+ * maximum sample value. */
+static int debayerBandEdgeAware(DebayerBand *band, const uint16_t *src,
+    uint16_t *dst, long maxval)
+{
+    long w = band->width, y, x;
+    long rows = (band->to - band->from) + 2;
+    /* Green plane of the band, plus one row above and one below it */
+    uint16_t *green = malloc(rows * w * sizeof(*green));
+    if (green == NULL) return 0;
+    for (y = 0; y < rows; y++) {
+        interpolateGreenRow(band, src, (long) band->from - 1 + y,
+            green + (y * w), maxval);
+    }
+    for (y = band->from; y < (long) band->to; y++) {
+        int channel, parity;
+        long gy = (y - band->from) + 1, h = band->height;
+        const uint16_t *cur = src + (y * w),
+                       *up = src + (reflect(y - 1, h) * w),
+                       *dn = src + (reflect(y + 1, h) * w),
+                       *gcur = green + (gy * w),
+                       *gup = green + ((gy - 1) * w),
+                       *gdn = green + ((gy + 1) * w);
+        uint16_t *out = dst + (y * w * 3);
+        getRowColor(band, y, &channel, &parity);
+        for (x = 0; x < w; x++) {
+            long xl = reflect(x - 1, w), xr = reflect(x + 1, w),
+                 c = cur[x], g = gcur[x], k, o;
+            if ((x & 1) == parity) {
+                /* Red or blue sample: the other color is on diagonals */
+                long diff = (up[xl] - gup[xl]) + (up[xr] - gup[xr]) +
+                            (dn[xl] - gdn[xl]) + (dn[xr] - gdn[xr]);
+                k = c;
+                o = g + (diff / 4);
+            } else {
+                /* Green sample: row color on the left and on the right,
+                 * the other color above and below. */
+                k = c + (((cur[xl] - gcur[xl]) + (cur[xr] - gcur[xr])) / 2);
+                o = c + (((up[x] - gup[x]) + (dn[x] - gdn[x])) / 2);
+            }
+            uint16_t *px = out + (x * 3);
+            px[channel] = (uint16_t) clampSample(k, maxval);
+            px[1] = (uint16_t) g;
+            px[2 - channel] = (uint16_t) clampSample(o, maxval);
+        }
+    }
+    free(green);
+    return 1;
+}
+
+static void *debayerBand(void *arg) {
+    DebayerBand *band = arg;
+    if (band->method == SER_DEBAYER_EDGE_AWARE) {
+        band->ok = debayerBandEdgeAware(band, band->src, band->dst,
+            band->maxval);
+    } else {
+        debayerBandBilinear(band);
+        band->ok = 1;
+    }
+    return NULL;
+}
+
+static int getDebayerJobs(int jobs, uint32_t height) {
+    if (jobs <= 0) {
+        jobs = 1;
+#if IS_UNIX
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        if (ncpu > 0) jobs = (int) ncpu;
+#endif
+    }
+    if (jobs > DEBAYER_MAX_JOBS) jobs = DEBAYER_MAX_JOBS;
+    uint32_t max_jobs = height / DEBAYER_MIN_BAND_ROWS;
+    if (max_jobs == 0) max_jobs = 1;
+    if ((uint32_t) jobs > max_jobs) jobs = (int) max_jobs;
+    return jobs;
+}
+
+/* Return 1 if mosaics having the `color_id` pattern can be debayered.
+ * Only RGB mosaics are supported (not CMY ones). */
+int DebayerIsSupported(uint32_t color_id) {
+    int red_x, red_y;
+    return getRedPosition(color_id, &red_x, &red_y);
+}
+
+/* Demosaic the `width` x `height` Bayer mosaic `src` (whose pattern is
+ * `color_id`) into `dst`, that must be 3 times the size of `src`, as
+ * interleaved RGB. Samples are 8-bit if `bytes_per_sample` is 1, 16-bit
+ * otherwise (host byte order), both in `src` and `dst`.
+ * `method` is SER_DEBAYER_BILINEAR or SER_DEBAYER_EDGE_AWARE and `jobs`
+ * the maximum number of threads (0 means the number of online CPUs).
+ * Return 1 on success, 0 otherwise. */
+int DebayerImage(const void *src, void *dst, uint32_t width, uint32_t height,
+    int bytes_per_sample, uint32_t color_id, int method, int jobs)
+{
+    DebayerBand bands[DEBAYER_MAX_JOBS];
+    pthread_t threads[DEBAYER_MAX_JOBS];
+    int started[DEBAYER_MAX_JOBS];
+    int red_x = 0, red_y = 0, i, ok = 1;
+    void *wide_src = NULL, *wide_dst = NULL;
+    if (width == 0 || height == 0) return 0;
+    if (!getRedPosition(color_id, &red_x, &red_y)) {
+        SERLogErr(LOG_TAG_ERR "Unsupported Bayer pattern: %s\n",
+            SERGetColorString(color_id));
+        return 0;
+    }
+    if (method != SER_DEBAYER_BILINEAR && method != SER_DEBAYER_EDGE_AWARE) {
+        SERLogErr(LOG_TAG_ERR "Invalid debayering method: %d\n", method);
+        return 0;
+    }
+    size_t count = (size_t) width * height;
+    if (method == SER_DEBAYER_EDGE_AWARE && bytes_per_sample == 1) {
+        /* The edge-aware method works on 16-bit samples: 8-bit mosaics
+         * are widened and the result is narrowed back. */
+        wide_src = malloc(count * sizeof(uint16_t));
+        wide_dst = malloc(count * 3 * sizeof(uint16_t));
+        if (wide_src == NULL || wide_dst == NULL) {
+            SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+            ok = 0;
+            goto cleanup;
+        }
+        size_t j;
+        for (j = 0; j < count; j++)
+            ((uint16_t *) wide_src)[j] = ((const uint8_t *) src)[j];
+    }
+    jobs = getDebayerJobs(jobs, height);
+    uint32_t rows_per_band = height / jobs, y = 0;
+    for (i = 0; i < jobs; i++) {
+        DebayerBand *band = bands + i;
+        band->src = (wide_src != NULL ? wide_src : src);
+        band->dst = (wide_dst != NULL ? wide_dst : dst);
+        band->width = width;
+        band->height = height;
+        band->from = y;
+        y += rows_per_band;
+        if (i == jobs - 1) y = height;
+        band->to = y;
+        band->bytes_per_sample = bytes_per_sample;
+        if (wide_src != NULL) band->bytes_per_sample = 2;
+        band->red_x = red_x;
+        band->red_y = red_y;
+        band->method = method;
+        band->maxval = (bytes_per_sample == 1 ? 0xFF : 0xFFFF);
+        band->ok = 0;
+    }
+    /* The first band is processed by the calling thread, as well as the
+     * bands whose thread could not be started. */
+    for (i = 1; i < jobs; i++) {
+        started[i] =
+            (pthread_create(threads + i, NULL, debayerBand, bands + i) == 0);
+    }
+    debayerBand(bands);
+    for (i = 1; i < jobs; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+        else debayerBand(bands + i);
+    }
+    for (i = 0; i < jobs; i++) {
+        if (!bands[i].ok) ok = 0;
+    }
+    if (ok && wide_dst != NULL) {
+        /* Edge-aware results are already clamped to 8 bits */
+        size_t j;
+        for (j = 0; j < count * 3; j++)
+            ((uint8_t *) dst)[j] = (uint8_t) ((uint16_t *) wide_dst)[j];
+    }
+    if (!ok) SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+cleanup:
+    if (wide_src != NULL) free(wide_src);
+    if (wide_dst != NULL) free(wide_dst);
+    return ok;
+}
@@ -0,0 +1,35 @@
+/*
+ *  SERUtils - A command line utility for processing SER movie files
+ *  Copyright (C) 2020  Giuseppe Fabio Nicotra <artix2 at gmail dot com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SER_DEBAYER_H__
+#define __SER_DEBAYER_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Rows are split in bands processed in parallel: bands are never smaller
+ * than DEBAYER_MIN_BAND_ROWS rows. */
+#define DEBAYER_MIN_BAND_ROWS   32
+#define DEBAYER_MAX_JOBS        16
+
+int DebayerIsSupported(uint32_t color_id);
+int DebayerImage(const void *src, void *dst, uint32_t width, uint32_t height,
+                 int bytes_per_sample, uint32_t color_id, int method,
+                 int jobs);
+
+#endif /* __SER_DEBAYER_H__ */
@@ -0,0 +1,225 @@
+/*
+ *  SERUtils - A command line utility for processing SER movie files
+ *  Copyright (C) 2020  Giuseppe Fabio Nicotra <artix2 at gmail dot com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Data written through a DirectIOWriter is collected into an aligned
+ * buffer, that is written with O_DIRECT every DIRECT_IO_BUFFER_SIZE bytes,
+ * so that it never goes through the page cache. The unaligned tail of the
+ * file is written without O_DIRECT when the writer gets closed.
+ * If O_DIRECT is not supported (by the platform or by the file system),
+ * the buffer is written as usual and its pages are dropped from the cache
+ * (POSIX_FADV_DONTNEED) as soon as they've been written back.
+ * Data is written sequentially, starting from the current offset of the
+ * file descriptor, that must not be used by anything else until the
+ * writer gets closed. */
+
+#if defined(__linux__)
+#define _GNU_SOURCE /* O_DIRECT and sync_file_range */
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "directio.h"
+
+struct DirectIOWriter {
+    int fd;
+    int direct;         /* O_DIRECT enabled */
+    int failed;
+    char *buf;          /* DIRECT_IO_ALIGNMENT aligned */
+    size_t used;
+    off_t offset;       /* File offset of `buf` */
+    off_t pending;      /* No O_DIRECT: offset of data not dropped yet */
+};
+
+static char *free_buffers[DIRECT_IO_MAX_BUFFERS];
+static int free_buffers_count = 0;
+static pthread_mutex_t free_buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int setDirectFlag(int fd, int enabled) {
+#if defined(O_DIRECT)
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) return 0;
+    if (enabled) flags |= O_DIRECT;
+    else flags &= ~O_DIRECT;
+    return (fcntl(fd, F_SETFL, flags) == 0);
+#else
+    (void) fd;
+    return !enabled;
+#endif
+}
+
+/* Drop the pages written before `offset` from the page cache. Pages must
+ * have been written back before they can be dropped, so the writeback of
+ * `size` bytes starting from `offset` (just written) is started now, and
+ * the previous range is waited for. */
+static void dropWrittenData(DirectIOWriter *writer, off_t offset,
+    off_t size)
+{
+#if defined(__linux__)
+    if (size > 0)
+        sync_file_range(writer->fd, offset, size, SYNC_FILE_RANGE_WRITE);
+    if (writer->pending < offset) {
+        off_t len = offset - writer->pending;
+        sync_file_range(writer->fd, writer->pending, len,
+            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+            SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(writer->fd, writer->pending, len, POSIX_FADV_DONTNEED);
+        writer->pending = offset;
+    }
+#elif defined(POSIX_FADV_DONTNEED)
+    if (size > 0) {
+        fdatasync(writer->fd);
+        posix_fadvise(writer->fd, offset, size, POSIX_FADV_DONTNEED);
+    }
+    writer->pending = offset + size;
+#else
+    (void) writer;
+    (void) offset;
+    (void) size;
+#endif
+}
+
+static int writeData(DirectIOWriter *writer, const char *p, size_t size) {
+    size_t totwritten = 0;
+    while (totwritten < size) {
+        ssize_t n = pwrite(writer->fd, p + totwritten, size - totwritten,
+                           writer->offset + (off_t) totwritten);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EINVAL && writer->direct && totwritten == 0) {
+            /* O_DIRECT accepted by fcntl, but not by the file system */
+            writer->direct = 0;
+            if (!setDirectFlag(writer->fd, 0)) break;
+            continue;
+        }
+        if (n <= 0) break;
+        totwritten += n;
+    }
+    if (totwritten != size) return 0;
+    if (!writer->direct) dropWrittenData(writer, writer->offset, size);
+    writer->offset += size;
+    return 1;
+}
+
+/* Write buffered data. Unless `final` is 1, only the aligned part of the
+ * buffer is written when using O_DIRECT, the rest is kept buffered. */
+static int flushWriter(DirectIOWriter *writer, int final) {
+    size_t size = writer->used, aligned;
+    if (writer->failed) return 0;
+    if (writer->direct && !final) size -= size % DIRECT_IO_ALIGNMENT;
+    aligned = size;
+    if (writer->direct) aligned -= size % DIRECT_IO_ALIGNMENT;
+    if (aligned > 0 && !writeData(writer, writer->buf, aligned)) goto fail;
+    if (aligned < size) {
+        /* Unaligned tail of the file */
+        writer->direct = 0;
+        if (!setDirectFlag(writer->fd, 0) ||
+            !writeData(writer, writer->buf + aligned, size - aligned))
+            goto fail;
+    }
+    writer->used -= size;
+    if (writer->used > 0)
+        memmove(writer->buf, writer->buf + size, writer->used);
+    /* Drop the last written range too */
+    if (final && !writer->direct) dropWrittenData(writer, writer->offset, 0);
+    return 1;
+fail:
+    writer->failed = 1;
+    return 0;
+}
+
+/* Create a writer for the file descriptor `fd`, opened for writing.
+ * Return NULL if out of memory. */
+DirectIOWriter *DirectIOWriterOpen(int fd) {
+    DirectIOWriter *writer = calloc(1, sizeof(*writer));
+    if (writer == NULL) return NULL;
+    writer->fd = fd;
+    writer->offset = lseek(fd, 0, SEEK_CUR);
+    if (writer->offset < 0) writer->offset = 0;
+    writer->pending = writer->offset;
+    pthread_mutex_lock(&free_buffers_lock);
+    if (free_buffers_count > 0)
+        writer->buf = free_buffers[--free_buffers_count];
+    pthread_mutex_unlock(&free_buffers_lock);
+    if (writer->buf == NULL &&
+        posix_memalign((void **) &(writer->buf), DIRECT_IO_ALIGNMENT,
+                       DIRECT_IO_BUFFER_SIZE) != 0)
+    {
+        free(writer);
+        return NULL;
+    }
+    /* The offset must be aligned too */
+    writer->direct = ((writer->offset % DIRECT_IO_ALIGNMENT) == 0 &&
+                      setDirectFlag(fd, 1));
+    return writer;
+}
+
+/* Same as fwrite(buf, 1, size, file). Return the number of bytes written,
+ * that is less than `size` only if data could not be written to the
+ * file. */
+size_t DirectIOWriterWrite(DirectIOWriter *writer, const void *buf,
+    size_t size)
+{
+    const char *p = buf;
+    size_t totwritten = 0;
+    if (writer->failed) return 0;
+    while (totwritten < size) {
+        size_t n = DIRECT_IO_BUFFER_SIZE - writer->used;
+        if (n > size - totwritten) n = size - totwritten;
+        memcpy(writer->buf + writer->used, p + totwritten, n);
+        writer->used += n;
+        totwritten += n;
+        if (writer->used == DIRECT_IO_BUFFER_SIZE && !flushWriter(writer, 0))
+            return 0;
+    }
+    return totwritten;
+}
+
+/* Offset of the next byte that will be written */
+uint64_t DirectIOWriterTell(DirectIOWriter *writer) {
+    return (uint64_t) writer->offset + writer->used;
+}
+
+/* Write buffered data and release the writer (the file descriptor is left
+ * open). Return 1 if every byte has been written, 0 otherwise. */
+int DirectIOWriterClose(DirectIOWriter *writer) {
+    if (writer == NULL) return 0;
+    int ok = flushWriter(writer, 1);
+    if (writer->direct) setDirectFlag(writer->fd, 0);
+    /* Leave the descriptor where a plain write would have left it */
+    if (lseek(writer->fd, writer->offset, SEEK_SET) < 0) ok = 0;
+    pthread_mutex_lock(&free_buffers_lock);
+    if (free_buffers_count < DIRECT_IO_MAX_BUFFERS) {
+        free_buffers[free_buffers_count++] = writer->buf;
+        writer->buf = NULL;
+    }
+    pthread_mutex_unlock(&free_buffers_lock);
+    if (writer->buf != NULL) free(writer->buf);
+    free(writer);
+    return ok;
+}
+
+/* Free the buffers kept for reuse */
+void DirectIOFreeBuffers() {
+    pthread_mutex_lock(&free_buffers_lock);
+    while (free_buffers_count > 0) free(free_buffers[--free_buffers_count]);
+    pthread_mutex_unlock(&free_buffers_lock);
+}
@@ -0,0 +1,42 @@
+/*
+ *  SERUtils - A command line utility for processing SER movie files
+ *  Copyright (C) 2020  Giuseppe Fabio Nicotra <artix2 at gmail dot com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SER_DIRECTIO_H__
+#define __SER_DIRECTIO_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Output files written through a DirectIOWriter don't fill the page
+ * cache (see directio.c). */
+
+#define DIRECT_IO_ALIGNMENT     4096
+#define DIRECT_IO_BUFFER_SIZE   (8 * 1024 * 1024)
+/* Buffers of closed writers kept for reuse */
+#define DIRECT_IO_MAX_BUFFERS   8
+
+typedef struct DirectIOWriter DirectIOWriter;
+
+DirectIOWriter *DirectIOWriterOpen(int fd);
+size_t          DirectIOWriterWrite(DirectIOWriter *writer, const void *buf,
+                                    size_t size);
+uint64_t        DirectIOWriterTell(DirectIOWriter *writer);
+int             DirectIOWriterClose(DirectIOWriter *writer);
+void            DirectIOFreeBuffers();
+
+#endif /* __SER_DIRECTIO_H__ */
@@ -20,13 +20,23 @@
 #include <string.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <errno.h>
 #include "log.h"
 #include "fits.h"
+#if defined (__unix__) || (defined (__APPLE__) && defined (__MACH__))
+    #define FITS_USE_WRITEV 1
+    #include <sys/types.h>
+    #include <sys/uio.h>
+#else
+    #define FITS_USE_WRITEV 0
+#endif
 
 #define FITS_HDU_MIN_SIZE       2880
 #define FITS_KEYWORD_LINE_SIZE  80
 #define FITS_KEYWORD_MAX_LEN    8
 
+static const unsigned char fits_padding[FITS_HDU_MIN_SIZE] = {0};
+
 static int isEmptyString(char *str, size_t len) {
     if (str == NULL) return 1;
     if (len == 0) len = strlen(str);
@@ -105,43 +115,37 @@ void FITSReleaseHeaderUnit(FITSHeaderUnit *hdr) {
     free(hdr);
 }
 
-int FITSHeaderAdd(FITSHeaderUnit *header, char *keyword, char *comment,
-    char *valuefmt, ...)
-{
-    assert(header != NULL);
-    if (keyword == NULL) {
-        fprintf(stderr, "FITSHeaderAdd: keyword required\n");
-        return 0;
-    }
-    size_t kwlen, vlen = 0, clen = 0, totlen = 0, oplen = 0, i,
-           max_vlen = 0, max_clen = 0, equals_len = 1, slash_len = 3,
-           avail_len = FITS_KEYWORD_LINE_SIZE - FITS_KEYWORD_MAX_LEN;
-    char value[255];
+static int checkFITSKeyword(char *keyword, size_t *kwlen) {
     char invalid_c = 0;
-    kwlen = strlen(keyword);
-    if (kwlen == 0 || isEmptyString(keyword, kwlen)) {
+    size_t len = strlen(keyword);
+    if (len == 0 || isEmptyString(keyword, len)) {
         fprintf(stderr, "FITSHeaderAdd: keyword is empty\n");
         return 0;
-    } else if (!isValidFITSKeyword(keyword, kwlen, &invalid_c)) {
+    } else if (!isValidFITSKeyword(keyword, len, &invalid_c)) {
         fprintf(stderr, "Invalid FITS keyword '%s': keyword must contain only "
             "uppercase characters (A-Z) or digits (0-9). Invalid char: "
             "'%c'\n", keyword, invalid_c);
         return 0;
-    } else if (kwlen > FITS_KEYWORD_MAX_LEN) {
+    } else if (len > FITS_KEYWORD_MAX_LEN) {
         fprintf(stderr, "WARN: keyword '%s' length %zu > %d, truncating...\n",
-            keyword, kwlen, FITS_KEYWORD_MAX_LEN);
-        kwlen = FITS_KEYWORD_MAX_LEN;
+            keyword, len, FITS_KEYWORD_MAX_LEN);
+        len = FITS_KEYWORD_MAX_LEN;
     }
-    size_t count = header->count + 1;
-    if (!makeRoomForFITSHeader(header, count)) return 0;
-    unsigned char *hdrptr =
-        header->header + (header->count * FITS_KEYWORD_LINE_SIZE);
-    unsigned char *linestart = hdrptr;
+    *kwlen = len;
+    return 1;
+}
+
+/* Write a whole 80 chars keyword line (card) to `linestart`. */
+static void writeFITSKeyword(unsigned char *linestart, char *keyword,
+    size_t kwlen, char *comment, char *valuefmt, va_list ap)
+{
+    size_t vlen = 0, clen = 0, totlen = 0, oplen = 0, i,
+           max_vlen = 0, max_clen = 0, equals_len = 1, slash_len = 3,
+           avail_len = FITS_KEYWORD_LINE_SIZE - FITS_KEYWORD_MAX_LEN;
+    char value[255];
+    unsigned char *hdrptr = linestart;
     if (valuefmt != NULL) {
-        va_list ap;
-        va_start(ap, valuefmt);
         vlen = vsnprintf(value, 255, valuefmt, ap);
-        va_end(ap);
         if (vlen > 0) oplen += equals_len; /* sizeof "=" */
     }
     if (comment != NULL) {
@@ -191,10 +195,65 @@ int FITSHeaderAdd(FITSHeaderUnit *header, char *keyword, char *comment,
     }
     padlen = (FITS_KEYWORD_LINE_SIZE - (hdrptr - linestart));
     for (i = 0; i < padlen; i++) *(hdrptr++) = ' ';
+}
+
+int FITSHeaderAdd(FITSHeaderUnit *header, char *keyword, char *comment,
+    char *valuefmt, ...)
+{
+    assert(header != NULL);
+    if (keyword == NULL) {
+        fprintf(stderr, "FITSHeaderAdd: keyword required\n");
+        return 0;
+    }
+    size_t kwlen = 0;
+    if (!checkFITSKeyword(keyword, &kwlen)) return 0;
+    size_t count = header->count + 1;
+    if (!makeRoomForFITSHeader(header, count)) return 0;
+    unsigned char *linestart =
+        header->header + (header->count * FITS_KEYWORD_LINE_SIZE);
+    va_list ap;
+    va_start(ap, valuefmt);
+    writeFITSKeyword(linestart, keyword, kwlen, comment, valuefmt, ap);
+    va_end(ap);
     header->count = count;
     return 1;
 }
 
+/* Rewrite the line of an already added keyword, leaving the rest of the
+ * header untouched. This allows to build a header once and use it as a
+ * template for many images that only differ by a few values (ie. the
+ * observation date). Returns 0 if the keyword is not in the header. */
+int FITSHeaderUpdate(FITSHeaderUnit *header, char *keyword, char *comment,
+    char *valuefmt, ...)
+{
+    assert(header != NULL);
+    if (keyword == NULL) {
+        fprintf(stderr, "FITSHeaderUpdate: keyword required\n");
+        return 0;
+    }
+    size_t kwlen = 0;
+    if (!checkFITSKeyword(keyword, &kwlen)) return 0;
+    uint32_t i;
+    unsigned char *linestart = NULL;
+    for (i = 0; i < header->count; i++) {
+        unsigned char *line = header->header + (i * FITS_KEYWORD_LINE_SIZE);
+        if (memcmp(line, keyword, kwlen) != 0) continue;
+        if (kwlen < FITS_KEYWORD_MAX_LEN && line[kwlen] != ' ') continue;
+        linestart = line;
+        break;
+    }
+    if (linestart == NULL) {
+        fprintf(stderr, "FITSHeaderUpdate: keyword '%s' not found\n",
+            keyword);
+        return 0;
+    }
+    va_list ap;
+    va_start(ap, valuefmt);
+    writeFITSKeyword(linestart, keyword, kwlen, comment, valuefmt, ap);
+    va_end(ap);
+    return 1;
+}
+
 void *FITSCreateDataUnit(void *srcdata, size_t size, size_t *unit_size) {
     if (srcdata == NULL || size == 0) return NULL;
     size_t units = (size / FITS_HDU_MIN_SIZE);
@@ -213,3 +272,76 @@ void *FITSCreateDataUnit(void *srcdata, size_t size, size_t *unit_size) {
     memset(fillptr, 0, fillsize);
     return data;
 }
+
+size_t FITSGetDataUnitPadding(size_t size) {
+    size_t rem = (size % FITS_HDU_MIN_SIZE);
+    if (rem == 0) return 0;
+    return FITS_HDU_MIN_SIZE - rem;
+}
+
+/* Write the zero padding needed to fill the last 2880 bytes block of a
+ * data unit of `size` bytes that has been written by the caller. */
+int FITSWriteDataPadding(FILE *file, size_t size) {
+    size_t padsize = FITSGetDataUnitPadding(size);
+    if (padsize == 0) return 1;
+    return (fwrite(fits_padding, 1, padsize, file) == padsize);
+}
+
+/* Write header unit and data unit to file. Data is written directly from
+ * `data` and the zero padding needed to fill the last 2880 bytes block
+ * comes from a static buffer, so that the data unit never has to be
+ * copied (see FITSCreateDataUnit). On UNIX systems everything is written
+ * with a single vectored write. */
+int FITSWriteFile(FILE *file, FITSHeaderUnit *hdr, const void *data,
+    size_t size)
+{
+    size_t padsize = FITSGetDataUnitPadding(size);
+    assert(hdr != NULL && hdr->header != NULL);
+#if FITS_USE_WRITEV
+    struct iovec iov[3];
+    int iovcnt = 0, fd = fileno(file);
+    size_t tot = hdr->size;
+    iov[iovcnt].iov_base = hdr->header;
+    iov[iovcnt++].iov_len = hdr->size;
+    if (data != NULL && size > 0) {
+        iov[iovcnt].iov_base = (void *) data;
+        iov[iovcnt++].iov_len = size;
+        tot += size;
+    }
+    if (padsize > 0) {
+        iov[iovcnt].iov_base = (void *) fits_padding;
+        iov[iovcnt++].iov_len = padsize;
+        tot += padsize;
+    }
+    if (fflush(file) != 0) return 0;
+    struct iovec *vec = iov;
+    size_t totwritten = 0;
+    while (totwritten < tot) {
+        ssize_t nwritten = writev(fd, vec, iovcnt);
+        if (nwritten < 0 && errno == EINTR) continue;
+        if (nwritten <= 0) break;
+        totwritten += nwritten;
+        /* Skip fully written buffers and adjust the partially written
+         * one, if any. */
+        while (iovcnt > 0 && (size_t) nwritten >= vec->iov_len) {
+            nwritten -= vec->iov_len;
+            vec++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            vec->iov_base = (char *) vec->iov_base + nwritten;
+            vec->iov_len -= nwritten;
+        }
+    }
+    return (totwritten == tot);
+#else
+    if (fwrite(hdr->header, 1, hdr->size, file) != hdr->size) return 0;
+    if (data != NULL && size > 0) {
+        if (fwrite(data, 1, size, file) != size) return 0;
+    }
+    if (padsize > 0) {
+        if (fwrite(fits_padding, 1, padsize, file) != padsize) return 0;
+    }
+    return 1;
+#endif
+}
@@ -19,8 +19,12 @@
 #ifndef __FITS_H__
 #define __FITS_H__
 
+/* Length of a date in FITS format: YYYY-MM-DDThh:mm:ss.sss */
+#define FITS_DATE_LEN   23
+
 #define FITSHeaderEnd(header) (FITSHeaderAdd(header, "END", NULL, NULL))
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 
@@ -35,5 +39,11 @@ void            FITSReleaseHeaderUnit(FITSHeaderUnit *hdr);
 void           *FITSCreateDataUnit(void *srcdata, size_t size, size_t *unitsz);
 int FITSHeaderAdd(FITSHeaderUnit *header, char *keyword, char *comment,
     char *valuefmt, ...);
+int FITSHeaderUpdate(FITSHeaderUnit *header, char *keyword, char *comment,
+    char *valuefmt, ...);
+size_t          FITSGetDataUnitPadding(size_t size);
+int             FITSWriteDataPadding(FILE *file, size_t size);
+int             FITSWriteFile(FILE *file, FITSHeaderUnit *hdr,
+                              const void *data, size_t size);
 
 #endif /* __FITS_H__ */
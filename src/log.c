@@ -19,10 +19,16 @@
 #include <stdarg.h>
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
 #include "log.h"
 
 int SERLogUseColors = 0;
 int SERLogLevel = LOG_LEVEL_ERR;
+int SERLogProgressRate = LOG_DEFAULT_PROGRESS_RATE;
+int SERLogProgressFD = -1;
 
 static int get_terminal_columns() {
     static int __term_columns = -1;
@@ -99,14 +105,123 @@ void SERPrintFieldValuePair(char *field, const char *field_format, ...) {
     printf("\n");
 }
 
-void SERLogProgress(char *what, int current, int tot) {
+/* Progress engine.
+ * Progress of the current task is redrawn at most SERLogProgressRate
+ * times per second (the last step of a task is always drawn), showing
+ * throughput and ETA, and it's also written as JSON lines to
+ * SERLogProgressFD if it's not negative, ie:
+ *
+ *   {"task":"Writing frames","done":10,"total":100,"percent":10.0,
+ *    "bytes":1048576,"mb_s":12.5,"elapsed":0.08,"eta":0.72}
+ *
+ * A new task starts whenever `what` changes or `current` goes back.
+ * Progress is kept in a single static state, so threads sharing a task
+ * must serialize their calls. */
+
+typedef struct {
+    char what[LOG_MAX_PROGRESS_TASK];
+    int current;
+    int tot;
+    double start;
+    double last_draw;
+} ProgressState;
+
+static ProgressState progress_state = {"", 0, 0, 0, -1};
+
+static double getMonotonicTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static void formatETA(char *buf, size_t size, double eta) {
+    long secs = (long) (eta + 0.5);
+    if (secs >= 3600) {
+        snprintf(buf, size, "%ld:%02ld:%02ld", secs / 3600, (secs / 60) % 60,
+                 secs % 60);
+    } else snprintf(buf, size, "%ld:%02ld", secs / 60, secs % 60);
+}
+
+static void writeProgressJSON(char *what, int current, int tot,
+    uint64_t bytes, double perc, double mb_s, double elapsed, double eta)
+{
+    char line[LOG_MAX_PROGRESS_TASK + 256];
+    int len = snprintf(line, sizeof(line), "{\"task\":\"");
+    char *c;
+    for (c = what; *c && len < (int) sizeof(line) - 192; c++) {
+        if (*c == '"' || *c == '\\') line[len++] = '\\';
+        line[len++] = (*c < 0x20 ? ' ' : *c);
+    }
+    len += snprintf(line + len, sizeof(line) - len,
+        "\",\"done\":%d,\"total\":%d,\"percent\":%.1f,\"bytes\":%" PRIu64
+        ",\"mb_s\":%.2f,\"elapsed\":%.2f,\"eta\":%.2f}\n",
+        current, tot, perc, bytes, mb_s, elapsed, (eta < 0 ? 0 : eta));
+    char *p = line;
+    while (len > 0) {
+        ssize_t nwritten = write(SERLogProgressFD, p, len);
+        if (nwritten < 0) {
+            if (errno == EINTR) continue;
+            /* Stop streaming to a broken descriptor */
+            SERLogProgressFD = -1;
+            return;
+        }
+        p += nwritten;
+        len -= nwritten;
+    }
+}
+
+/* Log progress of `current` out of `tot` steps, `bytes` being the amount
+ * of data processed so far (0 if unknown). */
+void SERLogProgressBytes(char *what, int current, int tot, uint64_t bytes) {
     static int max_len = -1;
-    if (max_len < 0) max_len = get_terminal_columns() - 1;
-    int perc = ((float)(current / (float) tot)) * 100, i, r;
-    int len = printf("\r%s: %d/%d (%d%%)", what, current, tot, perc);
-    r = max_len - len;
-    if (r > 0) {
-        for (i = 0; i < r; i++) printf(" ");
+    ProgressState *state = &progress_state;
+    double now = getMonotonicTime();
+    if (max_len < 0) {
+        max_len = get_terminal_columns() - 1;
+        if (max_len >= LOG_MAX_PROGRESS_LINE) max_len = LOG_MAX_PROGRESS_LINE - 1;
+    }
+    if (current < state->current || tot != state->tot ||
+        strncmp(state->what, what, sizeof(state->what) - 1) != 0)
+    {
+        strncpy(state->what, what, sizeof(state->what) - 1);
+        state->what[sizeof(state->what) - 1] = '\0';
+        state->tot = tot;
+        state->start = now;
+        state->last_draw = -1;
+    }
+    state->current = current;
+    int last = (current >= tot);
+    if (!last && state->last_draw >= 0 && SERLogProgressRate > 0 &&
+        (now - state->last_draw) < (1.0 / SERLogProgressRate)) return;
+    state->last_draw = now;
+    double elapsed = now - state->start,
+           perc = (tot > 0 ? ((double) current / tot) * 100 : 100),
+           mb_s = (elapsed > 0 ? (bytes / (1024.0 * 1024.0)) / elapsed : 0),
+           eta = -1;
+    if (current > 0 && elapsed > 0 && !last)
+        eta = elapsed * ((double) (tot - current) / current);
+    if (SERLogProgressFD >= 0)
+        writeProgressJSON(what, current, tot, bytes, perc, mb_s, elapsed, eta);
+    char line[LOG_MAX_PROGRESS_LINE], eta_str[32];
+    int len = snprintf(line, sizeof(line), "\r%s: %d/%d (%d%%)", what,
+                       current, tot, (int) perc);
+    if (bytes > 0 && mb_s > 0 && len < max_len) {
+        len += snprintf(line + len, sizeof(line) - len, " %.1f MB/s", mb_s);
     }
+    if (eta >= 0 && len < max_len) {
+        formatETA(eta_str, sizeof(eta_str), eta);
+        len += snprintf(line + len, sizeof(line) - len, " ETA %s", eta_str);
+    }
+    if (len >= (int) sizeof(line)) len = sizeof(line) - 1;
+    /* Pad the line with spaces in order to clear the previous one */
+    if (len < max_len) {
+        memset(line + len, ' ', max_len - len);
+        len = max_len;
+    }
+    fwrite(line, 1, len, stdout);
     fflush(stdout);
 }
+
+void SERLogProgress(char *what, int current, int tot) {
+    SERLogProgressBytes(what, current, tot, 0);
+}
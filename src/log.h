@@ -19,6 +19,8 @@
 #ifndef __SER_LOG_H__
 #define __SER_LOG_H__
 
+#include <stdint.h>
+
 #define LOG_LEVEL_INFO          0
 #define LOG_LEVEL_NOTICE        1
 #define LOG_LEVEL_SUCCESS       2
@@ -35,6 +37,10 @@
 #define LOG_JUSTIFY_LEFT    2
 #define LOG_JUSTIFY_FIELD   LOG_JUSTIFY_RIGHT
 
+#define LOG_MAX_PROGRESS_TASK       64
+#define LOG_MAX_PROGRESS_LINE       256
+#define LOG_DEFAULT_PROGRESS_RATE   10 /* Max progress redraws per second */
+
 #define LOG_COLOR_RED       31
 #define LOG_COLOR_GREEN     32
 #define LOG_COLOR_YELLOW    33
@@ -52,9 +58,12 @@
 
 extern int SERLogUseColors;
 extern int SERLogLevel;
+extern int SERLogProgressRate; /* 0 redraws progress on every call */
+extern int SERLogProgressFD;   /* JSON lines progress stream, -1 if none */
 
 void SERLog(int level, const char* format, ...);
 void SERPrintHeader(char *str);
 void SERLogProgress(char *what, int current, int tot);
+void SERLogProgressBytes(char *what, int current, int tot, uint64_t bytes);
 
 #endif /*__SER_LOG_H__ */
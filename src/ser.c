@@ -19,17 +19,34 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/errno.h>
 #include "log.h"
 #include "ser.h"
+#include "simd.h"
+#include "debayer.h"
+#include "codec.h"
+
+#if IS_UNIX
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
 
 #define NANOSEC_PER_SEC     1000000000
 #define MICROSEC_PER_SEC    1000000
 #define TIMEUNITS_PER_SEC   (NANOSEC_PER_SEC / 100)
 #define SECS_UNTIL_UNIXTIME 62135596800
 
+/* Size of the chunks used to copy the tail of movies into compressed
+ * movies */
+#define ARCHIVE_COPY_SIZE   (1024 * 1024)
+
+/* Max. size of the reads of SERReadFrames: frames are converted after
+ * every read, while they're still in the CPU cache. */
+#define READ_FRAMES_CHUNK_SIZE  (4 * 1024 * 1024)
+
 /* Utils */
 
 static void swapint16(void *n) {
@@ -77,6 +94,100 @@ static void swapMovieHeader(SERHeader *header) {
     swapint64(&header->ulDateTime_UTC);
 }
 
+/* I/O statistics */
+
+int SERCollectMovieStats = 0;
+
+/* Counters can be updated by different threads reading the same movie */
+#if defined(__GNUC__)
+#define statsAdd(var, val) __atomic_fetch_add(&(var), (val), __ATOMIC_RELAXED)
+#else
+#define statsAdd(var, val) ((var) += (val))
+#endif
+
+static uint64_t getNanoseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * NANOSEC_PER_SEC) + ts.tv_nsec;
+}
+
+/* Start collecting I/O statistics of `movie`, if not already enabled.
+ * Return 0 if out-of-memory. */
+int SEREnableMovieStats(SERMovie *movie) {
+    if (movie->stats != NULL) return 1;
+    movie->stats = calloc(1, sizeof(SERMovieStats));
+    return (movie->stats != NULL);
+}
+
+/* Set the phase (SER_STATS_PHASE_*) following I/O gets accounted to.
+ * The phase is SER_STATS_PHASE_OPEN while SEROpenMovie is running, and
+ * SER_STATS_PHASE_COPY after that. */
+void SERSetMovieStatsPhase(SERMovie *movie, int phase) {
+    if (phase >= 0 && phase < SER_STATS_PHASES) movie->stats_phase = phase;
+}
+
+/* Get the start time of an operation that will be recorded by
+ * SERRecordMovieStats, or 0 if statistics are not enabled, so that no
+ * clock is read at all in that case. */
+uint64_t SERMovieStatsClock(SERMovie *movie) {
+    if (movie->stats == NULL) return 0;
+    return getNanoseconds();
+}
+
+/* Account `calls` operations of type `op` (SER_STATS_READ, etc.) that
+ * transferred `bytes` bytes and that started at `start` (see
+ * SERMovieStatsClock, 0 if duration is not relevant) to the current
+ * phase. It does nothing if statistics are not enabled, so it can also
+ * be used by callers writing movie data (ie. serutils). */
+void SERRecordMovieStats(SERMovie *movie, int op, uint64_t calls,
+    size_t bytes, uint64_t start)
+{
+    SERMovieStats *stats = movie->stats;
+    if (stats == NULL) return;
+    uint64_t elapsed = (start > 0 ? getNanoseconds() - start : 0);
+    SERIOStats *io = &(stats->phases[movie->stats_phase]);
+    switch (op) {
+    case SER_STATS_READ:
+        statsAdd(io->reads, calls);
+        statsAdd(io->bytes_read, bytes);
+        statsAdd(io->read_time, elapsed);
+        break;
+    case SER_STATS_SEEK:
+        statsAdd(io->seeks, calls);
+        break;
+    case SER_STATS_WRITE:
+        statsAdd(io->writes, calls);
+        statsAdd(io->bytes_written, bytes);
+        statsAdd(io->write_time, elapsed);
+        break;
+    case SER_STATS_CONVERT:
+        statsAdd(io->convert_time, elapsed);
+        break;
+    }
+}
+
+/* Copy I/O statistics of `movie`, per phase and total, into `stats`.
+ * Return 0 if statistics are not enabled (see SERCollectMovieStats and
+ * SEREnableMovieStats). */
+int SERGetMovieStats(SERMovie *movie, SERMovieStats *stats) {
+    int i;
+    if (movie->stats == NULL) return 0;
+    memset(stats, 0, sizeof(*stats));
+    for (i = 0; i < SER_STATS_PHASES; i++) {
+        SERIOStats *src = &(movie->stats->phases[i]), *tot = &(stats->total);
+        stats->phases[i] = *src;
+        tot->bytes_read += src->bytes_read;
+        tot->bytes_written += src->bytes_written;
+        tot->reads += src->reads;
+        tot->seeks += src->seeks;
+        tot->writes += src->writes;
+        tot->read_time += src->read_time;
+        tot->convert_time += src->convert_time;
+        tot->write_time += src->write_time;
+    }
+    return 1;
+}
+
 /* Helpers */
 
 static FILE *openMovieFileForReading(SERMovie *movie, char **err) {
@@ -94,6 +205,15 @@ static FILE *openMovieFileForReading(SERMovie *movie, char **err) {
     return video;
 }
 
+/* Index of a compressed movie (see openArchive) */
+struct SERArchive {
+    SERArchiveHeader header;    /* In host byte order (but movieHeader) */
+    uint64_t *index;            /* uiFrameCount + 1 frame offsets */
+    uint64_t filesize;          /* Size of the compressed movie file */
+    uint64_t frames_end;        /* Offset of the tail in the original movie */
+    CodecFrameFormat format;
+};
+
 static int parseHeader(SERMovie *movie) {
     if (movie->header != NULL) return 1;
     movie->header = malloc(sizeof(SERHeader));
@@ -101,6 +221,13 @@ static int parseHeader(SERMovie *movie) {
         fprintf(stderr, "Out-of-memory: failed to allocate movie header\n");
         return 0;
     }
+    if (movie->archive != NULL) {
+        /* Compressed movies contain a copy of the original header */
+        memcpy(movie->header, &(movie->archive->header.movieHeader),
+            sizeof(SERHeader));
+        if (IS_BIG_ENDIAN) swapMovieHeader(movie->header);
+        return 1;
+    }
     if (movie->file == NULL) {
         char *err = NULL;
         if (openMovieFileForReading(movie, &err) == NULL) {
@@ -112,7 +239,9 @@ static int parseHeader(SERMovie *movie) {
     size_t hdrsize = sizeof(SERHeader);
     size_t totread = 0, nread = 0;
     char *hdrptr = (char *) movie->header;
-    fseek(movie->file, 0, SEEK_SET);
+    uint64_t start = SERMovieStatsClock(movie);
+    fseeko(movie->file, 0, SEEK_SET);
+    SERRecordMovieStats(movie, SER_STATS_SEEK, 1, 0, 0);
     while (totread < hdrsize) {
         nread = fread((void *) hdrptr, 1, hdrsize, movie->file);
         if (nread <= 0) {
@@ -123,20 +252,385 @@ static int parseHeader(SERMovie *movie) {
         totread += nread;
         hdrptr += nread;
     }
+    SERRecordMovieStats(movie, SER_STATS_READ, 1, hdrsize, start);
     if (IS_BIG_ENDIAN) swapMovieHeader(movie->header);
     /*printf("Read %lu header bytes\n\n", totread);*/
     return 1;
 }
 
-static uint16_t getTruncatedUInt16(uint16_t value, uint32_t pixel_size) {
-    if (pixel_size >= 16) return value;
-    uint32_t lshift = 16 - pixel_size,
-             rshift = pixel_size - lshift;
-    return (value << lshift) + (value >> rshift);
+struct SERFramePool {
+    pthread_mutex_t lock;
+    SERFrame *frames[SER_FRAME_POOL_SIZE];
+    int count;
+    /* The pool is referenced by its movie and by every frame taken from it,
+     * so that frames can still be safely released after closing the movie.
+     */
+    int refcount;
+    int closed;
+};
+
+static SERFramePool *createFramePool(void) {
+    SERFramePool *pool = malloc(sizeof(*pool));
+    if (pool == NULL) return NULL;
+    memset(pool, 0, sizeof(*pool));
+    if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+        free(pool);
+        return NULL;
+    }
+    pool->refcount = 1;
+    return pool;
+}
+
+static void freeFrame(SERFrame *frame) {
+    if (frame->data != NULL) free(frame->data);
+    free(frame);
+}
+
+/* Drop a reference to the pool. The pool must be locked by the caller,
+ * and it gets unlocked (and freed if this was the last reference). */
+static void unrefFramePool(SERFramePool *pool) {
+    if (--pool->refcount > 0) {
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    int i;
+    for (i = 0; i < pool->count; i++) freeFrame(pool->frames[i]);
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+/* Take a frame (with a data buffer of `size` bytes) from movie's pool,
+ * or allocate a new one if the pool is empty. */
+static SERFrame *getPoolFrame(SERMovie *movie, size_t size) {
+    SERFramePool *pool = movie->frame_pool;
+    SERFrame *frame = NULL;
+    if (pool != NULL) {
+        pthread_mutex_lock(&pool->lock);
+        if (pool->count > 0) frame = pool->frames[--pool->count];
+        pool->refcount++;
+        pthread_mutex_unlock(&pool->lock);
+    }
+    if (frame != NULL && frame->size != size) {
+        freeFrame(frame);
+        frame = NULL;
+    }
+    if (frame == NULL) {
+        frame = malloc(sizeof(*frame));
+        if (frame != NULL) memset(frame, 0, sizeof(*frame));
+        if (frame != NULL) frame->data = malloc(size);
+        if (frame == NULL || frame->data == NULL) {
+            if (frame != NULL) free(frame);
+            if (pool != NULL) {
+                pthread_mutex_lock(&pool->lock);
+                unrefFramePool(pool);
+            }
+            return NULL;
+        }
+        frame->size = size;
+    }
+    frame->pool = pool;
+    return frame;
+}
+
+/* Read `size` bytes of movie's file, starting from `offset`, into `buf`.
+ * Data is read by using positional reads, so that the file position is
+ * never changed and different threads can read from the same file
+ * concurrently. Return 1 on success, 0 otherwise. */
+static int readFileData(SERMovie *movie, void *buf, size_t size,
+    uint64_t offset)
+{
+    size_t totread = 0;
+    char *p = (char *) buf;
+    uint64_t start = SERMovieStatsClock(movie), calls = 0;
+#if IS_UNIX
+    int fd = fileno(movie->file);
+    while (totread < size) {
+        ssize_t nread = pread(fd, p + totread, size - totread,
+                              (off_t) (offset + totread));
+        calls++;
+        if (nread < 0 && errno == EINTR) continue;
+        if (nread <= 0) break;
+        totread += nread;
+    }
+#ifdef POSIX_FADV_DONTNEED
+    if (movie->noreuse && totread > 0) {
+        posix_fadvise(fd, (off_t) offset, (off_t) totread,
+            POSIX_FADV_DONTNEED);
+    }
+#endif
+#else
+    /* No positional reads available: seek and read are serialized
+     * through the frame pool lock. */
+    SERFramePool *pool = movie->frame_pool;
+    if (pool != NULL) pthread_mutex_lock(&pool->lock);
+    SERRecordMovieStats(movie, SER_STATS_SEEK, 1, 0, 0);
+    if (fseeko(movie->file, (off_t) offset, SEEK_SET) == 0) {
+        while (totread < size) {
+            size_t nread = fread(p + totread, 1, size - totread, movie->file);
+            calls++;
+            if (nread <= 0) break;
+            totread += nread;
+        }
+    }
+    if (pool != NULL) pthread_mutex_unlock(&pool->lock);
+#endif
+    SERRecordMovieStats(movie, SER_STATS_READ, calls, totread, start);
+    return (totread == size);
+}
+
+/* Compressed movies */
+
+static void swapArchiveHeader(SERArchiveHeader *header) {
+    swapint32(&(header->uiVersion));
+    swapint32(&(header->uiFlags));
+    swapint32(&(header->uiFrameCount));
+    swapint64(&(header->ulMovieSize));
+    swapint64(&(header->ulTailOffset));
+    swapint64(&(header->ulTailSize));
+    swapint64(&(header->ulIndexOffset));
+}
+
+static CodecFrameFormat getArchiveFormat(SERHeader *header, uint32_t flags) {
+    CodecFrameFormat format;
+    uint32_t color = header->uiColorID;
+    format.width = header->uiImageWidth;
+    format.height = header->uiImageHeight;
+    format.planes = SERGetNumberOfPlanes(header);
+    format.bytes_per_sample = (header->uiPixelDepth <= 8 ? 1 : 2);
+    format.bayer = (color >= COLOR_BAYER_RGGB && color < COLOR_RGB);
+    format.big_endian = ((flags & SER_ARCHIVE_BIG_ENDIAN_SAMPLES) != 0);
+    return format;
+}
+
+static void releaseArchive(SERArchive *archive) {
+    if (archive == NULL) return;
+    if (archive->index != NULL) free(archive->index);
+    free(archive);
+}
+
+/* Load the header and the index of a compressed movie into
+ * movie->archive. Return 1 if the movie has been loaded or if it is not
+ * a compressed movie, 0 if the compressed movie is not valid. */
+static int openArchive(SERMovie *movie) {
+    SERArchiveHeader header;
+    SERArchive *archive = NULL;
+    char *err = NULL;
+    uint32_t i;
+    fseeko(movie->file, 0, SEEK_END);
+    off_t filesize = ftello(movie->file);
+    fseeko(movie->file, 0, SEEK_SET);
+    SERRecordMovieStats(movie, SER_STATS_SEEK, 2, 0, 0);
+    if (filesize < (off_t) sizeof(header)) return 1;
+    if (!readFileData(movie, &header, sizeof(header), 0)) return 1;
+    if (memcmp(header.sFileID, SER_ARCHIVE_FILE_ID, sizeof(header.sFileID)))
+        return 1;
+    if (IS_BIG_ENDIAN) swapArchiveHeader(&header);
+    if (header.uiVersion != SER_ARCHIVE_VERSION) {
+        err = "unsupported compressed movie version";
+        goto fail;
+    }
+    SERHeader movie_header = header.movieHeader;
+    if (IS_BIG_ENDIAN) swapMovieHeader(&movie_header);
+    archive = calloc(1, sizeof(*archive));
+    if (archive == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    archive->header = header;
+    archive->filesize = (uint64_t) filesize;
+    archive->format = getArchiveFormat(&movie_header, header.uiFlags);
+    uint32_t count = header.uiFrameCount;
+    uint64_t frame_size = SERGetFrameSize(&movie_header),
+             frames_end = sizeof(SERHeader) + (count * frame_size),
+             index_size = (count + 1) * sizeof(uint64_t);
+    archive->frames_end = frames_end;
+    if ((frame_size == 0 && count > 0) ||
+        count > movie_header.uiFrameCount ||
+        frames_end + header.ulTailSize != header.ulMovieSize ||
+        header.ulTailOffset + header.ulTailSize > (uint64_t) filesize ||
+        header.ulIndexOffset + index_size > (uint64_t) filesize)
+    {
+        err = "invalid compressed movie header";
+        goto fail;
+    }
+    archive->index = malloc(index_size);
+    if (archive->index == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    if (!readFileData(movie, archive->index, index_size,
+        header.ulIndexOffset))
+    {
+        err = "failed to read compressed movie index";
+        goto fail;
+    }
+    size_t max_size = CodecGetMaxEncodedSize(&(archive->format));
+    for (i = 0; i <= count; i++) {
+        if (IS_BIG_ENDIAN) swapint64(archive->index + i);
+        uint64_t offset = archive->index[i];
+        int valid = (offset >= sizeof(header) &&
+                     offset <= header.ulTailOffset);
+        if (valid && i > 0) {
+            uint64_t prev = archive->index[i - 1];
+            valid = (offset > prev && offset - prev <= max_size);
+        }
+        if (!valid) {
+            err = "invalid compressed movie index";
+            goto fail;
+        }
+    }
+    movie->archive = archive;
+    return 1;
+fail:
+    SERLogErr(LOG_TAG_ERR "%s\n", err);
+    releaseArchive(archive);
+    return 0;
+}
+
+/* Read and decode frame `frame_idx` of a compressed movie into `dst`. */
+static int decodeArchiveFrame(SERMovie *movie, uint32_t frame_idx,
+    void *dst)
+{
+    SERArchive *archive = movie->archive;
+    uint64_t offset = archive->index[frame_idx],
+             size = archive->index[frame_idx + 1] - offset;
+    void *data = malloc(size);
+    if (data == NULL) {
+        SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+        return 0;
+    }
+    int ok = readFileData(movie, data, size, offset);
+    uint64_t start = SERMovieStatsClock(movie);
+    if (ok && !(ok = CodecDecodeFrame(&(archive->format), data, size, dst)))
+        SERLogErr(LOG_TAG_ERR "Invalid compressed frame %d\n", frame_idx);
+    SERRecordMovieStats(movie, SER_STATS_CONVERT, 1, size, start);
+    free(data);
+    return ok;
+}
+
+/* Same as `readMovieData`, for compressed movies: `offset` and `size`
+ * refer to the original movie. Header and tail are copied as they are,
+ * while frames are decoded. */
+static int readArchiveData(SERMovie *movie, void *buf, size_t size,
+    uint64_t offset)
+{
+    SERArchive *archive = movie->archive;
+    size_t hdrsize = sizeof(SERHeader),
+           frame_size = CodecGetFrameSize(&(archive->format));
+    char *p = (char *) buf, *frame = NULL;
+    int ok = 1;
+    if (offset + size > movie->filesize) return 0;
+    while (size > 0 && ok) {
+        size_t n = size;
+        if (offset < hdrsize) {
+            if (n > hdrsize - offset) n = hdrsize - offset;
+            memcpy(p, (char *) &(archive->header.movieHeader) + offset, n);
+        } else if (offset < archive->frames_end) {
+            uint32_t frame_idx = (offset - hdrsize) / frame_size;
+            size_t start = (offset - hdrsize) % frame_size;
+            if (n > frame_size - start) n = frame_size - start;
+            if (n == frame_size) ok = decodeArchiveFrame(movie, frame_idx, p);
+            else {
+                /* Part of a frame: decode the whole frame aside */
+                if (frame == NULL) frame = malloc(frame_size);
+                if (frame == NULL) {
+                    SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+                    ok = 0;
+                } else ok = decodeArchiveFrame(movie, frame_idx, frame);
+                if (ok) memcpy(p, frame + start, n);
+            }
+        } else {
+            ok = readFileData(movie, p, n, archive->header.ulTailOffset +
+                (offset - archive->frames_end));
+        }
+        p += n;
+        offset += n;
+        size -= n;
+    }
+    if (frame != NULL) free(frame);
+    return ok;
+}
+
+/* Map the range of the original movie starting at `offset` (`size`
+ * bytes) to the range of the compressed movie file containing it. */
+static void getArchiveFileRange(SERMovie *movie, uint64_t *offset,
+    uint64_t *size)
+{
+    SERArchive *archive = movie->archive;
+    size_t hdrsize = sizeof(SERHeader),
+           frame_size = CodecGetFrameSize(&(archive->format));
+    uint64_t range[2] = {*offset, *offset + *size};
+    int i;
+    for (i = 0; i < 2; i++) {
+        uint64_t pos = range[i];
+        if (pos < hdrsize) pos = archive->index[0];
+        else if (pos < archive->frames_end) {
+            uint64_t idx = (pos - hdrsize) / frame_size;
+            /* Round the end of the range up to the end of its frame */
+            if (i == 1 && (pos - hdrsize) % frame_size) idx++;
+            pos = archive->index[idx];
+        } else {
+            pos = archive->header.ulTailOffset + (pos - archive->frames_end);
+        }
+        range[i] = pos;
+    }
+    *offset = range[0];
+    *size = (range[1] > range[0] ? range[1] - range[0] : 0);
+}
+
+/* Read `size` bytes of the movie, starting from `offset`, into `buf`.
+ * Mapped movies are read from their mapping, compressed movies get
+ * decoded, other movies are read by `readFileData`. Different threads
+ * can read from the same movie concurrently.
+ * Return 1 on success, 0 otherwise. */
+static int readMovieData(SERMovie *movie, void *buf, size_t size,
+    uint64_t offset)
+{
+    if (movie->mapped_data != NULL) {
+        if (offset + size > movie->mapped_size) return 0;
+        uint64_t start = SERMovieStatsClock(movie);
+        memcpy(buf, (char *) movie->mapped_data + offset, size);
+        SERRecordMovieStats(movie, SER_STATS_READ, 1, size, start);
+        return 1;
+    }
+    if (movie->archive != NULL)
+        return readArchiveData(movie, buf, size, offset);
+    return readFileData(movie, buf, size, offset);
+}
+
+/* Convert `size` bytes of raw frame data from `src` to `dst`, by fixing
+ * byte order (depending on `big_endian`), pixel depth and channel order
+ * (RGB). Source and destination can be the same buffer.
+ * See simd.c for conversion kernels. */
+static void convertFramePixels(SERMovie *movie, const void *src, void *dst,
+    size_t size, int big_endian)
+{
+    int planes = SERGetNumberOfPlanes(movie->header),
+        depth = (int) movie->header->uiPixelDepth,
+        same_endianess = (big_endian == SERIsBigEndian(movie)),
+        reverse_channels = (movie->header->uiColorID != COLOR_RGB);
+    uint64_t start = SERMovieStatsClock(movie);
+    SIMDConvertPixels(src, dst, size, depth, planes, reverse_channels,
+        !same_endianess);
+    SERRecordMovieStats(movie, SER_STATS_CONVERT, 1, size, start);
 }
 
 /* Library functions */
 
+/* Convert `size` bytes of raw frame data of `movie` from `src` to `dst`
+ * (that can be the same buffer), the same way `SERGetFramePixels` does:
+ * pixels are stored in host byte order if `big_endian` is equal to
+ * IS_BIG_ENDIAN, pixel values are scaled to 8 or 16 bits and channels
+ * are stored in RGB order.
+ * It can be used to convert frames read by `SERGetFrameInto` or returned
+ * by a SERFrameIterator. */
+void SERConvertFramePixels(SERMovie *movie, const void *src, void *dst,
+    size_t size, int big_endian)
+{
+    convertFramePixels(movie, src, dst, size, big_endian);
+}
+
 char *SERGetColorString(uint32_t colorID) {
     switch (colorID) {
         case COLOR_MONO: return "MONO";
@@ -164,6 +658,13 @@ time_t SERVideoTimeToUnixtime(uint64_t video_t, uint32_t *usec) {
     return seconds;
 }
 
+/* Convert Unixtime (plus `usec` microseconds) to SER datetime. */
+uint64_t SERUnixtimeToVideoTime(time_t unixtime, uint32_t usec) {
+    uint64_t seconds = (uint64_t) unixtime + SECS_UNTIL_UNIXTIME;
+    return (seconds * TIMEUNITS_PER_SEC) +
+        ((uint64_t) usec * (TIMEUNITS_PER_SEC / MICROSEC_PER_SEC));
+}
+
 /* Get the number of planes (channels) specified in the movie header.
  * "Mono" movies have one plane and RGB movies have three channels. */
 int SERGetNumberOfPlanes(SERHeader *header) {
@@ -183,62 +684,73 @@ int SERGetBytesPerPixel(SERHeader *header) {
 /* Get the number of bytes for every single frame. */
 size_t SERGetFrameSize(SERHeader *header) {
     int bytes_per_px = SERGetBytesPerPixel(header);
-    return header->uiImageWidth * header->uiImageHeight * bytes_per_px;
+    return (size_t) header->uiImageWidth * header->uiImageHeight *
+        bytes_per_px;
 }
 
 /* Get the offset, in bytes, of the frame `frame_idx` relative to the
  * movie file (`frame_idx` starts from zero). */
-long SERGetFrameOffset(SERHeader *header, int frame_idx) {
-    return sizeof(SERHeader) + (frame_idx * SERGetFrameSize(header));
+uint64_t SERGetFrameOffset(SERHeader *header, uint32_t frame_idx) {
+    return sizeof(SERHeader) +
+        ((uint64_t) frame_idx * SERGetFrameSize(header));
 }
 
 /* Get the offset, in bytes, of tbhe movie's trailer containing frame
  * timestamps. */
-long SERGetTrailerOffset(SERHeader *header) {
+uint64_t SERGetTrailerOffset(SERHeader *header) {
     uint32_t frame_idx = header->uiFrameCount;
     return SERGetFrameOffset(header, frame_idx);
 }
 
+/* Release a frame returned by `SERGetFrame`. Frames are not immediately
+ * freed: up to SER_FRAME_POOL_SIZE frames are kept by their movie and
+ * reused by next `SERGetFrame` calls, until the movie gets closed. */
 void SERReleaseFrame(SERFrame *frame) {
     if (frame == NULL) return;
-    if (frame->data != NULL) free(frame->data);
-    free(frame);
+    SERFramePool *pool = frame->pool;
+    if (pool == NULL) {
+        freeFrame(frame);
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (!pool->closed && pool->count < SER_FRAME_POOL_SIZE) {
+        pool->frames[pool->count++] = frame;
+        frame = NULL;
+    }
+    unrefFramePool(pool);
+    if (frame != NULL) freeFrame(frame);
 }
 
-/* Get a single frame from the movie. The returned frame is a pointer to
- * an allocated SERFrame strcuture containing both frame's metadata and
- * frame's raw data. It's up to you to release the frame by using the
- * `SERReleaseFrame` function.
- * Frame index `frame_idx` parameter starts from zero.
- * If frame is not found (ie. if `frame_idx` is beyond the number of
- * movie's frames, return NULL. */
-SERFrame *SERGetFrame(SERMovie *movie, uint32_t frame_idx) {
-    SERFrame *frame = NULL;
-    assert(movie->header != NULL);
+/* Check that frame `frame_idx` is fully contained into the movie file and
+ * store its offset into `offset`. Return 1 on success, 0 otherwise. */
+static int getFrameDataOffset(SERMovie *movie, uint32_t frame_idx,
+    uint64_t *offset)
+{
     if (frame_idx >= SERGetFrameCount(movie)) {
         SERLogErr(LOG_TAG_ERR "Frame index %d beyond movie frames (%d)\n",
             frame_idx, SERGetFrameCount(movie));
-        return NULL;
-    }
-    frame = malloc(sizeof(*frame));
-    if (frame == NULL) {
-        SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
-        return NULL;
+        return 0;
     }
-    memset(frame, 0, sizeof(*frame));
-    frame->size = SERGetFrameSize(movie->header);
-    size_t offset_start = sizeof(SERHeader) + (frame_idx * frame->size);
-    size_t offset_end = offset_start + frame->size;
+    size_t frame_size = SERGetFrameSize(movie->header);
+    uint64_t offset_start = SERGetFrameOffset(movie->header, frame_idx),
+             offset_end = offset_start + frame_size;
     if (movie->filesize < offset_start) {
         SERLogErr(LOG_TAG_ERR
             "Missing frame at index %d, movie frames incomplete\n",
             frame_idx
         );
-        goto fail;
+        return 0;
     } else if (movie->filesize < offset_end) {
-        SERLogErr(LOG_TAG_ERR, "Incomplete data for frame %d\n", frame_idx);
-        goto fail;
+        SERLogErr(LOG_TAG_ERR "Incomplete data for frame %d\n", frame_idx);
+        return 0;
     }
+    *offset = offset_start;
+    return 1;
+}
+
+/* Fill frame's metadata (everything but `data`). */
+static void initFrame(SERMovie *movie, SERFrame *frame, uint32_t frame_idx) {
+    frame->size = SERGetFrameSize(movie->header);
     frame->id = frame_idx + 1;
     frame->index = frame_idx;
     frame->datetime = SERGetFrameDate(movie, frame_idx);
@@ -250,32 +762,171 @@ SERFrame *SERGetFrame(SERMovie *movie, uint32_t frame_idx) {
     frame->colorID = movie->header->uiColorID;
     frame->width = movie->header->uiImageWidth;
     frame->height = movie->header->uiImageHeight;
-    frame->data = malloc(frame->size);
-    if (frame->data == NULL) {
+}
+
+/* Get a single frame from the movie. The returned frame is a pointer to
+ * an allocated SERFrame strcuture containing both frame's metadata and
+ * frame's raw data. It's up to you to release the frame by using the
+ * `SERReleaseFrame` function.
+ * Frame index `frame_idx` parameter starts from zero.
+ * If frame is not found (ie. if `frame_idx` is beyond the number of
+ * movie's frames, return NULL. */
+SERFrame *SERGetFrame(SERMovie *movie, uint32_t frame_idx) {
+    SERFrame *frame = NULL;
+    uint64_t offset_start = 0;
+    assert(movie->header != NULL);
+    if (!getFrameDataOffset(movie, frame_idx, &offset_start)) return NULL;
+    frame = getPoolFrame(movie, SERGetFrameSize(movie->header));
+    if (frame == NULL) {
         SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
-        goto fail;
+        return NULL;
     }
-    if (fseek(movie->file, offset_start, SEEK_SET) < 0) {
-        SERLogErr(LOG_TAG_ERR, "Failed to read frame %d\n", frame_idx);
-        goto fail;
+    initFrame(movie, frame, frame_idx);
+    if (!readMovieData(movie, frame->data, frame->size, offset_start)) {
+        SERLogErr(LOG_TAG_ERR "Failed to read frame %d\n", frame_idx);
+        SERReleaseFrame(frame);
+        return NULL;
     }
-    size_t nread = 0, totread = 0, remain = frame->size;
-    char *p = (char *) frame->data;
-    while (totread < frame->size) {
-        nread = fread(p, 1, remain, movie->file);
-        if (nread <= 0) break;
-        totread += nread;
-        remain -= nread;
-        p += nread;
+    return frame;
+}
+
+/* Read raw data of a single frame into the caller-provided buffer `buf`,
+ * whose size (`bufsize`) must be at least the movie's frame size (see
+ * `SERGetFrameSize`). No memory is allocated.
+ * Frame index `frame_idx` parameter starts from zero.
+ * Return 1 on success, 0 otherwise. */
+int SERGetFrameInto(SERMovie *movie, uint32_t frame_idx, void *buf,
+    size_t bufsize)
+{
+    uint64_t offset_start = 0;
+    assert(movie->header != NULL);
+    size_t size = SERGetFrameSize(movie->header);
+    if (bufsize < size) {
+        SERLogErr(LOG_TAG_ERR "Buffer too small for frame %d: %zu < %zu\n",
+            frame_idx, bufsize, size);
+        return 0;
     }
-    if (totread != frame->size) {
-        SERLogErr(LOG_TAG_ERR, "Failed to read frame %d\n", frame_idx);
-        goto fail;
+    if (!getFrameDataOffset(movie, frame_idx, &offset_start)) return 0;
+    if (!readMovieData(movie, buf, size, offset_start)) {
+        SERLogErr(LOG_TAG_ERR "Failed to read frame %d\n", frame_idx);
+        return 0;
     }
-    return frame;
-fail:
-    if (frame != NULL) SERReleaseFrame(frame);
-    return NULL;
+    return 1;
+}
+
+/* Read `size` bytes of raw data of a single frame, starting from
+ * `offset` bytes from the beginning of the frame, into `buf`. This allows
+ * to read only a tile of a frame (ie. a band of rows).
+ * Return 1 on success, 0 otherwise. */
+int SERGetFramePartInto(SERMovie *movie, uint32_t frame_idx, size_t offset,
+    size_t size, void *buf)
+{
+    uint64_t offset_start = 0;
+    assert(movie->header != NULL);
+    if (offset + size > SERGetFrameSize(movie->header)) {
+        SERLogErr(LOG_TAG_ERR "Invalid part of frame %d: %zu-%zu\n",
+            frame_idx, offset, offset + size);
+        return 0;
+    }
+    if (!getFrameDataOffset(movie, frame_idx, &offset_start)) return 0;
+    if (!readMovieData(movie, buf, size, offset_start + offset)) {
+        SERLogErr(LOG_TAG_ERR "Failed to read frame %d\n", frame_idx);
+        return 0;
+    }
+    return 1;
+}
+
+static void prefetchMovieData(SERMovie *movie, uint64_t offset,
+    uint64_t size);
+
+/* Read the `width` x `height` region of a frame whose top-left corner is
+ * at `x`, `y` into `dst`, that must hold width * height pixels (rows are
+ * stored contiguously, with the byte order of the movie).
+ * Rows outside of the region are never read: every row of the region is
+ * read with a single positional read (or copied from the mapping of
+ * mapped movies), and the whole region with a single read if it spans
+ * the whole frame width. Frames of compressed movies must be fully
+ * decoded, so they're decoded once and then cropped.
+ * Return 1 on success, 0 otherwise. */
+int SERGetFrameROI(SERMovie *movie, uint32_t frame_idx, uint32_t x,
+    uint32_t y, uint32_t width, uint32_t height, void *dst)
+{
+    SERHeader *header = movie->header;
+    uint64_t offset_start = 0;
+    assert(header != NULL);
+    if (width == 0 || height == 0 || x >= header->uiImageWidth ||
+        y >= header->uiImageHeight || width > header->uiImageWidth - x ||
+        height > header->uiImageHeight - y)
+    {
+        SERLogErr(LOG_TAG_ERR "Invalid frame region: %u,%u %ux%u\n", x, y,
+            width, height);
+        return 0;
+    }
+    size_t bpp = SERGetBytesPerPixel(header),
+           row_size = (size_t) header->uiImageWidth * bpp,
+           roi_row_size = (size_t) width * bpp,
+           first = (size_t) y * row_size + (size_t) x * bpp;
+    char *d = dst;
+    uint32_t i;
+    if (width == header->uiImageWidth) {
+        return SERGetFramePartInto(movie, frame_idx, first,
+            roi_row_size * height, dst);
+    }
+    if (movie->archive != NULL) {
+        size_t frame_size = SERGetFrameSize(header);
+        char *frame = malloc(frame_size);
+        if (frame == NULL) {
+            SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+            return 0;
+        }
+        int ok = SERGetFrameInto(movie, frame_idx, frame, frame_size);
+        if (ok) {
+            for (i = 0; i < height; i++) {
+                memcpy(d + (size_t) i * roi_row_size,
+                    frame + first + (size_t) i * row_size, roi_row_size);
+            }
+        }
+        free(frame);
+        return ok;
+    }
+    if (!getFrameDataOffset(movie, frame_idx, &offset_start)) return 0;
+    offset_start += first;
+    /* Ask for the whole band of rows at once, instead of letting every
+     * row read wait for its own small read. */
+    prefetchMovieData(movie, offset_start,
+        (uint64_t) (height - 1) * row_size + roi_row_size);
+    for (i = 0; i < height; i++) {
+        if (!readMovieData(movie, d + (size_t) i * roi_row_size,
+            roi_row_size, offset_start + (uint64_t) i * row_size))
+        {
+            SERLogErr(LOG_TAG_ERR "Failed to read frame %d\n", frame_idx);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Get a zero-copy view of a single frame of a movie opened with
+ * `SEROpenMovieMapped`. The caller-provided `frame` structure gets filled
+ * with frame's metadata and its `data` pointer will point straight into
+ * the movie's mapping, so no memory is allocated nor copied.
+ * The view is read-only and it remains valid until the movie gets closed.
+ * Do not call `SERReleaseFrame` on it.
+ * Return 1 on success, 0 if the movie is not mapped or if the frame is
+ * not found. */
+int SERGetFrameView(SERMovie *movie, uint32_t frame_idx, SERFrame *frame) {
+    uint64_t offset_start = 0;
+    assert(movie->header != NULL);
+    assert(frame != NULL);
+    if (movie->mapped_data == NULL) {
+        SERLogErr(LOG_TAG_ERR "Movie is not memory-mapped\n");
+        return 0;
+    }
+    if (!getFrameDataOffset(movie, frame_idx, &offset_start)) return 0;
+    memset(frame, 0, sizeof(*frame));
+    initFrame(movie, frame, frame_idx);
+    frame->data = (char *) movie->mapped_data + offset_start;
+    return 1;
 }
 
 /* Retrieve a single pixel from a single frame. Set `big_endian` to 1
@@ -311,7 +962,7 @@ int SERGetFramePixel(SERMovie *movie, SERFrame *frame, uint32_t x, uint32_t y,
     int is_rgb = (frame->colorID >= COLOR_RGB);
     if (channel_size == 1) {
         /* 1-8 bit frames */
-        uint8_t r, g, b;
+        uint8_t r = 0, g = 0, b = 0;
         if (frame->colorID == COLOR_RGB) {
             r = *((uint8_t *) data++);
             g = *((uint8_t *) data++);
@@ -328,7 +979,7 @@ int SERGetFramePixel(SERMovie *movie, SERFrame *frame, uint32_t x, uint32_t y,
         }
     } else {
         /* 9-16 bit frames */
-        uint16_t r, g, b, val;
+        uint16_t r = 0, g = 0, b = 0, val;
         uint32_t lshift = 0, rshift = 0;
         if (frame->pixelDepth < 16) {
             lshift = 16 - frame->pixelDepth;
@@ -382,143 +1033,484 @@ void *SERGetFramePixels(SERMovie *movie, uint32_t frame_idx, int big_endian,
 {
     void *pixels = NULL;
     assert(size != NULL);
-    *size = 0;
-    SERFrame *frame = SERGetFrame(movie, frame_idx);
-    if (frame == NULL) goto fail;
     *size = SERGetFrameSize(movie->header);
     if (*size == 0) goto fail;
     pixels = malloc(*size);
-    if (pixels == NULL) goto fail;
-    memset(pixels, 0, *size);
-    int channels = SERGetNumberOfPlanes(movie->header),
-        depth = (int) frame->pixelDepth,
-        chsize = (depth > 8 ? 2 : 1),
-        same_endianess = (big_endian == SERIsBigEndian(movie)),
-        is_mono = (channels == 1);
-    if (chsize == 1) {
-        /* 8-bit image */
-        if (is_mono) memcpy(pixels, frame->data, *size);
-        else {
-            uint8_t c1, c2, c3, r, g, b;
-            uint8_t *read_ptr = frame->data, *write_ptr = pixels;
-            size_t written = 0;
-            while (written < *size) {
-                c1 = *(read_ptr++);
-                c2 = *(read_ptr++);
-                c3 = *(read_ptr++);
-                if (frame->colorID == COLOR_RGB) {
-                    r = c1, g = c2, b = c3;
-                } else {
-                    b = c1, g = c2, r = c3;
-                }
-                *(write_ptr++) = r;
-                *(write_ptr++) = g;
-                *(write_ptr++) = b;
-                written += 3;
-            }
-        }
-    } else {
-        /* 8-16 bit image */
-        uint16_t *read_ptr = frame->data, *write_ptr = pixels;
-        size_t written = 0;
-        if (is_mono) {
-            uint16_t pixel;
-            while (written < *size) {
-                pixel = *(read_ptr++);
-                /* Swap bytes if movie endianness (declared in movie's header)
-                 * differs from output endianness (depending on `big_endian`
-                 * argument. */
-                if (!same_endianess) swapint16(&pixel);
-                if (depth < 16) pixel = getTruncatedUInt16(pixel, depth);
-                *(write_ptr++) = pixel;
-                written += 2;
-            }
-        } else {
-            uint16_t c1, c2, c3, r, g, b;
-            while (written < *size) {
-                c1 = *(read_ptr++);
-                c2 = *(read_ptr++);
-                c3 = *(read_ptr++);
-                /* Swap bytes if movie endianness (declared in movie's header)
-                 * differs from output endianness (depending on `big_endian`
-                 * argument. */
-                if (!same_endianess) {
-                    swapint16(&c1);
-                    swapint16(&c2);
-                    swapint16(&c3);
-                }
-                if (depth < 16) {
-                    c1 = getTruncatedUInt16(c1, depth);
-                    c2 = getTruncatedUInt16(c2, depth);
-                    c3 = getTruncatedUInt16(c3, depth);
-                }
-                if (frame->colorID == COLOR_RGB) {
-                    r = c1, g = c2, b = c3;
-                } else {
-                    b = c1, g = c2, r = c3;
-                }
-                *(write_ptr++) = r;
-                *(write_ptr++) = g;
-                *(write_ptr++) = b;
-                written += (3 * 2);
-            }
-        }
+    if (pixels == NULL) {
+        SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+        goto fail;
     }
-    SERReleaseFrame(frame);
+    if (!SERGetFramePixelsInto(movie, frame_idx, big_endian, pixels, *size))
+        goto fail;
     return pixels;
 fail:
     *size = 0;
-    if (frame != NULL) SERReleaseFrame(frame);
     if (pixels != NULL) free(pixels);
     return NULL;
 }
 
-/* Read frame's timestamp from movie's trailer (if movie has one).
- * Timestamp is represented in SER movie format, that is nanoseconds
- * since 1st January of year 1 b.c. / 100.
- * Frame index (`idx`) starts from 0.
- * Use SERVideoTimeToUnixtime to convert returned timestamp to unixtime.
- * If movie has no trailer or if the specified frame is not defined in movie's
- * trailer, return zero. */
-uint64_t SERGetFrameDate(SERMovie *movie, long idx) {
-    uint64_t date = 0;
-    SERHeader *header = movie->header;
-    if (header == NULL && !parseHeader(movie)) {
-        return date;
-    }
-    if (idx >= header->uiFrameCount) return date;
-    long offset = SERGetTrailerOffset(header);
-    offset += (idx * sizeof(uint64_t));
-    fseek(movie->file, offset, SEEK_SET);
-    char *ptr = (char *) &date;
-    size_t nread = 0;
-    while (nread < sizeof(date)) {
-        nread = fread(ptr, 1, sizeof(date), movie->file);
-        if (nread <= 0) break;
+/* Same as `SERGetFramePixels`, but pixels are stored into the
+ * caller-provided `dst` buffer, whose size (`dstsize`) must be at least
+ * the movie's frame size (see `SERGetFrameSize`). No memory is allocated.
+ * Return 1 on success, 0 otherwise. */
+int SERGetFramePixelsInto(SERMovie *movie, uint32_t frame_idx, int big_endian,
+    void *dst, size_t dstsize)
+{
+    uint64_t offset_start = 0;
+    assert(movie->header != NULL);
+    size_t size = SERGetFrameSize(movie->header);
+    if (size == 0) return 0;
+    if (dstsize < size) {
+        SERLogErr(LOG_TAG_ERR "Buffer too small for frame %d: %zu < %zu\n",
+            frame_idx, dstsize, size);
+        return 0;
     }
-    if (IS_BIG_ENDIAN && date > 0) swapint64(&date);
-    return date;
-}
-
-uint64_t SERGetFirstFrameDate(SERMovie *movie) {
-    return SERGetFrameDate(movie, 0);
-}
-
-uint64_t SERGetLastFrameDate(SERMovie *movie) {
-    if (movie->header == NULL && !parseHeader(movie)) return 0;
-    long idx = SERGetFrameCount(movie) - 1;
-    return SERGetFrameDate(movie, idx);
+    if (!getFrameDataOffset(movie, frame_idx, &offset_start)) return 0;
+    if (movie->mapped_data != NULL) {
+        /* Convert straight from the mapping */
+        const char *src = (char *) movie->mapped_data + offset_start;
+        SERRecordMovieStats(movie, SER_STATS_READ, 1, size, 0);
+        convertFramePixels(movie, src, dst, size, big_endian);
+        return 1;
+    }
+    if (!readMovieData(movie, dst, size, offset_start)) {
+        SERLogErr(LOG_TAG_ERR "Failed to read frame %d\n", frame_idx);
+        return 0;
+    }
+    convertFramePixels(movie, dst, dst, size, big_endian);
+    return 1;
 }
 
-SERHeader *SERDuplicateHeader(SERHeader *srcheader) {
-    SERHeader *dup = malloc(sizeof(*srcheader));
-    if (dup == NULL) return NULL;
-    memcpy(dup, srcheader, sizeof(*srcheader));
-    return dup;
+/* Convert raw frame data of `movie` as convertFramePixels does, but
+ * store the channels of RGB frames into three planes. */
+static void convertFramePixelsToPlanes(SERMovie *movie, const void *src,
+    void *dst, size_t size, int big_endian)
+{
+    int depth = (int) movie->header->uiPixelDepth,
+        same_endianess = (big_endian == SERIsBigEndian(movie)),
+        reverse_channels = (movie->header->uiColorID != COLOR_RGB);
+    size_t count = size / SERGetBytesPerPixel(movie->header);
+    uint64_t start = SERMovieStatsClock(movie);
+    SIMDConvertPixelsToPlanes(src, dst, count, depth, reverse_channels,
+        !same_endianess);
+    SERRecordMovieStats(movie, SER_STATS_CONVERT, 1, size, start);
 }
 
-int SERCountMovieWarnings(int warnings) {
-    size_t len = sizeof(warnings), i;
+/* Read `count` frames starting from `from` into the caller-provided `dst`
+ * array, converting pixels as `SERGetFramePixels` does, so that a whole
+ * (frames, height, width[, channels]) array can be filled with a single
+ * call. No memory is allocated, but a frame buffer for planar RGB frames.
+ * Frame `i` is stored at `dst` + i * `dst_stride` (0 means
+ * `SERGetFrameSize`, that is contiguous frames).
+ * With SER_LAYOUT_PLANAR, channels of RGB frames are stored as three
+ * planes (R, G, B) of width * height samples; it has no effect on mono
+ * and Bayer frames.
+ * Contiguous frames are read directly into `dst` with as few reads as
+ * possible and converted in place, while frames of mapped movies are
+ * converted straight from the mapping.
+ * Return 1 on success, 0 otherwise. */
+int SERReadFrames(SERMovie *movie, uint32_t from, uint32_t count,
+    int layout, int big_endian, void *dst, size_t dst_stride)
+{
+    SERHeader *header = movie->header;
+    uint64_t offset_start = 0, last_offset = 0;
+    assert(header != NULL);
+    size_t frame_size = SERGetFrameSize(header);
+    if (frame_size == 0) return 0;
+    if (layout != SER_LAYOUT_INTERLEAVED && layout != SER_LAYOUT_PLANAR) {
+        SERLogErr(LOG_TAG_ERR "Invalid frame layout: %d\n", layout);
+        return 0;
+    }
+    if (dst_stride == 0) dst_stride = frame_size;
+    if (dst_stride < frame_size) {
+        SERLogErr(LOG_TAG_ERR "Frame stride too small: %zu < %zu\n",
+            dst_stride, frame_size);
+        return 0;
+    }
+    if (count == 0) return 1;
+    if (count > SERGetFrameCount(movie) ||
+        from > SERGetFrameCount(movie) - count)
+    {
+        SERLogErr(LOG_TAG_ERR "Frames %u-%u beyond movie frames (%u)\n",
+            from, from + count - 1, SERGetFrameCount(movie));
+        return 0;
+    }
+    /* Frames are stored contiguously: if the last one is complete, every
+     * frame is. */
+    if (!getFrameDataOffset(movie, from, &offset_start) ||
+        !getFrameDataOffset(movie, from + count - 1, &last_offset))
+        return 0;
+    int planar = (layout == SER_LAYOUT_PLANAR &&
+                  SERGetNumberOfPlanes(header) == 3);
+    char *d = dst, *frame = NULL;
+    uint32_t i;
+    if (movie->mapped_data != NULL) {
+        /* Convert straight from the mapping */
+        const char *src = (char *) movie->mapped_data + offset_start;
+        SERRecordMovieStats(movie, SER_STATS_READ, count,
+            (uint64_t) count * frame_size, 0);
+        for (i = 0; i < count; i++) {
+            const char *s = src + (size_t) i * frame_size;
+            char *f = d + (size_t) i * dst_stride;
+            if (planar) convertFramePixelsToPlanes(movie, s, f, frame_size,
+                big_endian);
+            else convertFramePixels(movie, s, f, frame_size, big_endian);
+        }
+        return 1;
+    }
+    if (!planar && dst_stride == frame_size) {
+        uint32_t frames_per_read = READ_FRAMES_CHUNK_SIZE / frame_size;
+        if (frames_per_read == 0) frames_per_read = 1;
+        for (i = 0; i < count; i += frames_per_read) {
+            uint32_t frames = count - i;
+            if (frames > frames_per_read) frames = frames_per_read;
+            size_t size = (size_t) frames * frame_size;
+            char *f = d + (size_t) i * frame_size;
+            if (!readMovieData(movie, f, size,
+                offset_start + (uint64_t) i * frame_size)) goto read_fail;
+            convertFramePixels(movie, f, f, size, big_endian);
+        }
+        return 1;
+    }
+    if (planar) {
+        /* Channels cannot be split in place */
+        frame = malloc(frame_size);
+        if (frame == NULL) {
+            SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+            return 0;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        char *f = d + (size_t) i * dst_stride, *buf = (planar ? frame : f);
+        if (!readMovieData(movie, buf, frame_size,
+            offset_start + (uint64_t) i * frame_size)) goto read_fail;
+        if (planar) convertFramePixelsToPlanes(movie, buf, f, frame_size,
+            big_endian);
+        else convertFramePixels(movie, f, f, frame_size, big_endian);
+    }
+    if (frame != NULL) free(frame);
+    return 1;
+read_fail:
+    if (frame != NULL) free(frame);
+    SERLogErr(LOG_TAG_ERR "Failed to read frames %u-%u\n", from,
+        from + count - 1);
+    return 0;
+}
+
+/* Return 1 if frames of `movie` are Bayer mosaics that can be converted
+ * to RGB by SERGetFrameRGB & co. (RGGB, GRBG, GBRG and BGGR). */
+int SERCanDebayer(SERMovie *movie) {
+    return DebayerIsSupported(movie->header->uiColorID);
+}
+
+/* Size of a debayered (RGB) frame of a Bayer movie */
+size_t SERGetFrameRGBSize(SERHeader *header) {
+    return SERGetFrameSize(header) * 3;
+}
+
+/* Convert the Bayer frame `pixels` of `movie`, as returned by
+ * `SERGetFramePixels` in host byte order, to RGB into `dst`, whose size
+ * must be at least `SERGetFrameRGBSize`. `method` is one of SER_DEBAYER_*
+ * and pixels are stored into `dst` in big endian order if `big_endian` is
+ * not zero. Return 1 on success, 0 otherwise. */
+int SERDebayerFramePixels(SERMovie *movie, const void *pixels, void *dst,
+    int method, int big_endian)
+{
+    SERHeader *header = movie->header;
+    int bytes_per_sample = SERGetBytesPerPixel(header);
+    uint64_t start = SERMovieStatsClock(movie);
+    if (!DebayerImage(pixels, dst, header->uiImageWidth,
+        header->uiImageHeight, bytes_per_sample, header->uiColorID, method,
+        0)) return 0;
+    if (bytes_per_sample > 1 && big_endian != IS_BIG_ENDIAN) {
+        SIMDConvertPixels(dst, dst, SERGetFrameRGBSize(header), 16, 1, 0,
+            1);
+    }
+    SERRecordMovieStats(movie, SER_STATS_CONVERT, 1,
+        SERGetFrameRGBSize(header), start);
+    return 1;
+}
+
+/* Same as `SERGetFramePixelsInto`, but the Bayer frame is converted to
+ * RGB (see SERDebayerFramePixels). `dstsize` must be at least
+ * `SERGetFrameRGBSize`. Return 1 on success, 0 otherwise. */
+int SERGetFrameRGBInto(SERMovie *movie, uint32_t frame_idx, int method,
+    int big_endian, void *dst, size_t dstsize)
+{
+    size_t size = SERGetFrameSize(movie->header);
+    if (size == 0) return 0;
+    if (!SERCanDebayer(movie)) {
+        SERLogErr(LOG_TAG_ERR "Cannot debayer %s frames\n",
+            SERGetColorString(movie->header->uiColorID));
+        return 0;
+    }
+    if (dstsize < size * 3) {
+        SERLogErr(LOG_TAG_ERR "Buffer too small for frame %d: %zu < %zu\n",
+            frame_idx, dstsize, size * 3);
+        return 0;
+    }
+    void *mosaic = malloc(size);
+    if (mosaic == NULL) {
+        SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+        return 0;
+    }
+    int ok = SERGetFramePixelsInto(movie, frame_idx, IS_BIG_ENDIAN, mosaic,
+        size);
+    if (ok) ok = SERDebayerFramePixels(movie, mosaic, dst, method,
+        big_endian);
+    free(mosaic);
+    return ok;
+}
+
+/* Same as `SERGetFramePixels`, but the Bayer frame is demosaiced with
+ * `method` (SER_DEBAYER_*): the returned buffer contains interleaved RGB
+ * pixels having the same sample size as the original frame and its size
+ * is stored into `size`. Return NULL on errors. */
+void *SERGetFrameRGB(SERMovie *movie, uint32_t frame_idx, int method,
+    int big_endian, size_t *size)
+{
+    void *pixels = NULL;
+    assert(size != NULL);
+    *size = SERGetFrameRGBSize(movie->header);
+    if (*size == 0) goto fail;
+    pixels = malloc(*size);
+    if (pixels == NULL) {
+        SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+        goto fail;
+    }
+    if (!SERGetFrameRGBInto(movie, frame_idx, method, big_endian, pixels,
+        *size)) goto fail;
+    return pixels;
+fail:
+    *size = 0;
+    if (pixels != NULL) free(pixels);
+    return NULL;
+}
+
+/* Read the whole trailer into movie->frame_dates, byte-swapping dates
+ * if needed. Frames whose date is missing from the trailer (ie. if the
+ * trailer is incomplete) are not counted in movie->frame_dates_count.
+ * Return 1 if the trailer has been loaded (even if empty), 0 on errors. */
+static int loadFrameDates(SERMovie *movie) {
+    if (movie->frame_dates_loaded) return 1;
+    SERHeader *header = movie->header;
+    if (header == NULL && !parseHeader(movie)) return 0;
+    header = movie->header;
+    movie->frame_dates_loaded = 1;
+    movie->frame_dates_count = 0;
+    if (!SERMovieHasTrailer(movie)) return 1;
+    uint64_t offset = SERGetTrailerOffset(header),
+             count = (movie->filesize - offset) / sizeof(uint64_t);
+    if (count > header->uiFrameCount) count = header->uiFrameCount;
+    if (count == 0) return 1;
+    size_t size = count * sizeof(uint64_t);
+    uint64_t *dates = malloc(size);
+    if (dates == NULL) {
+        SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+        return 0;
+    }
+    if (!readMovieData(movie, dates, size, offset)) {
+        SERLogErr(LOG_TAG_ERR "Failed to read frame dates\n");
+        free(dates);
+        return 0;
+    }
+    if (IS_BIG_ENDIAN) {
+        size_t i;
+        for (i = 0; i < count; i++) swapint64(dates + i);
+    }
+    movie->frame_dates = dates;
+    movie->frame_dates_count = count;
+    return 1;
+}
+
+/* Get frame's timestamp from movie's trailer (if movie has one).
+ * Timestamp is represented in SER movie format, that is nanoseconds
+ * since 1st January of year 1 b.c. / 100.
+ * Frame index (`idx`) starts from 0.
+ * Use SERVideoTimeToUnixtime to convert returned timestamp to unixtime.
+ * If movie has no trailer or if the specified frame is not defined in movie's
+ * trailer, return zero. */
+uint64_t SERGetFrameDate(SERMovie *movie, long idx) {
+    if (!loadFrameDates(movie)) return 0;
+    if (idx < 0 || idx >= movie->header->uiFrameCount) return 0;
+    if ((uint32_t) idx >= movie->frame_dates_count) return 0;
+    return movie->frame_dates[idx];
+}
+
+/* Get all the frame timestamps contained in movie's trailer, so that they
+ * can be scanned without calling SERGetFrameDate for every frame.
+ * The number of available timestamps is stored into `count` (it can be
+ * less than the frame count if the trailer is incomplete).
+ * The returned array is owned by the movie and it must not be freed.
+ * Return NULL if the movie has no trailer. */
+const uint64_t *SERGetFrameDates(SERMovie *movie, uint32_t *count) {
+    assert(count != NULL);
+    *count = 0;
+    if (!loadFrameDates(movie)) return NULL;
+    *count = movie->frame_dates_count;
+    if (*count == 0) return NULL;
+    return movie->frame_dates;
+}
+
+/* Frame date index */
+
+struct SERDateIndex {
+    uint32_t ordered;   /* Leading frames having valid and ordered dates */
+    uint32_t count;     /* Number of indexed frames */
+    /* Indexed frames sorted by date, or NULL if every date in the trailer
+     * is valid and in order, so that frame_dates can be searched as it
+     * is. */
+    uint32_t *order;
+};
+
+typedef struct {
+    uint64_t date;
+    uint32_t frame;
+} SERDatePair;
+
+static int compareDatePairs(const void *a, const void *b) {
+    const SERDatePair *pa = a, *pb = b;
+    if (pa->date != pb->date) return (pa->date < pb->date ? -1 : 1);
+    if (pa->frame != pb->frame) return (pa->frame < pb->frame ? -1 : 1);
+    return 0;
+}
+
+/* Build movie->date_index from the cached frame dates. Frames without a
+ * date are not indexed. If dates are not in order (ie. WARN_BAD_FRAME_DATES
+ * or clock jumps in the middle of the movie), frames get sorted by date
+ * (and by index if they have the same date). */
+static int buildDateIndex(SERMovie *movie) {
+    const uint64_t *dates = movie->frame_dates;
+    uint32_t count = movie->frame_dates_count, ordered = 0, valid = 0, i;
+    SERDatePair *pairs = NULL;
+    if (movie->date_index != NULL || count == 0) return 1;
+    SERDateIndex *index = calloc(1, sizeof(*index));
+    if (index == NULL) goto oom;
+    while (ordered < count && dates[ordered] != 0 &&
+           (ordered == 0 || dates[ordered] >= dates[ordered - 1])) ordered++;
+    index->ordered = ordered;
+    if (ordered == count) {
+        index->count = count;
+        movie->date_index = index;
+        return 1;
+    }
+    for (i = 0; i < count; i++) {
+        if (dates[i] != 0) valid++;
+    }
+    if (valid > 0) {
+        pairs = malloc(valid * sizeof(*pairs));
+        index->order = malloc(valid * sizeof(uint32_t));
+        if (pairs == NULL || index->order == NULL) goto oom;
+        uint32_t n = 0;
+        for (i = 0; i < count; i++) {
+            if (dates[i] == 0) continue;
+            pairs[n].date = dates[i];
+            pairs[n].frame = i;
+            n++;
+        }
+        qsort(pairs, valid, sizeof(*pairs), compareDatePairs);
+        for (i = 0; i < valid; i++) index->order[i] = pairs[i].frame;
+        free(pairs);
+    }
+    index->count = valid;
+    movie->date_index = index;
+    return 1;
+oom:
+    SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+    if (pairs != NULL) free(pairs);
+    if (index != NULL) {
+        if (index->order != NULL) free(index->order);
+        free(index);
+    }
+    return 0;
+}
+
+static inline uint32_t getIndexedFrame(SERDateIndex *index, uint32_t i) {
+    return (index->order != NULL ? index->order[i] : i);
+}
+
+/* Get the number of indexed frames whose date is lower than `datetime`
+ * (or equal to it, if `inclusive` is not zero). Interpolation steps,
+ * that quickly find dates of frames recorded at a steady rate, alternate
+ * with bisection steps, so that search is O(log n) even when frame rate
+ * is not constant. */
+static uint32_t searchDateIndex(SERMovie *movie, uint64_t datetime,
+    int inclusive)
+{
+    SERDateIndex *index = movie->date_index;
+    const uint64_t *dates = movie->frame_dates;
+    uint32_t lo = 0, hi = index->count;
+    int interpolate = 1;
+    while (lo < hi) {
+        uint32_t mid = lo + ((hi - lo) / 2);
+        if (interpolate && hi - lo > 2) {
+            uint64_t first = dates[getIndexedFrame(index, lo)],
+                     last = dates[getIndexedFrame(index, hi - 1)];
+            if (datetime > first && datetime < last) {
+                double pos = (double) (datetime - first) /
+                             (double) (last - first);
+                mid = lo + (uint32_t) (pos * (hi - 1 - lo));
+            }
+        }
+        interpolate = !interpolate;
+        uint64_t date = dates[getIndexedFrame(index, mid)];
+        if (date < datetime || (inclusive && date == datetime)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Find the frame having the earliest date greater than or equal to
+ * `datetime` (SER datetime, see SERGetFrameDate). If more frames have the
+ * same date, the first of them is returned.
+ * Return the frame index or -1 if there's no such frame (or if the movie
+ * has no frame dates). */
+long SERFindFrameByTime(SERMovie *movie, uint64_t datetime) {
+    SERDateIndex *index = movie->date_index;
+    if (index == NULL) return -1;
+    uint32_t pos = searchDateIndex(movie, datetime, 0);
+    if (pos >= index->count) return -1;
+    return getIndexedFrame(index, pos);
+}
+
+/* Find the frame having the latest date lower than or equal to
+ * `datetime`. If more frames have the same date, the last of them is
+ * returned. Return the frame index or -1 if there's no such frame. */
+long SERFindLastFrameByTime(SERMovie *movie, uint64_t datetime) {
+    SERDateIndex *index = movie->date_index;
+    if (index == NULL) return -1;
+    uint32_t pos = searchDateIndex(movie, datetime, 1);
+    if (pos == 0) return -1;
+    return getIndexedFrame(index, pos - 1);
+}
+
+/* Get the number of leading frames having valid dates in chronological
+ * order: dates of these frames can be searched directly (ie. by using
+ * binary search on SERGetFrameDates). */
+uint32_t SERCountOrderedFrameDates(SERMovie *movie) {
+    if (movie->date_index == NULL) return 0;
+    return movie->date_index->ordered;
+}
+
+uint64_t SERGetFirstFrameDate(SERMovie *movie) {
+    return SERGetFrameDate(movie, 0);
+}
+
+uint64_t SERGetLastFrameDate(SERMovie *movie) {
+    if (movie->header == NULL && !parseHeader(movie)) return 0;
+    long idx = SERGetFrameCount(movie) - 1;
+    return SERGetFrameDate(movie, idx);
+}
+
+SERHeader *SERDuplicateHeader(SERHeader *srcheader) {
+    SERHeader *dup = malloc(sizeof(*srcheader));
+    if (dup == NULL) return NULL;
+    memcpy(dup, srcheader, sizeof(*srcheader));
+    return dup;
+}
+
+int SERCountMovieWarnings(int warnings) {
+    size_t len = sizeof(warnings), i;
     int count = 0;
     for (i = 0; i < len; i++) {
         if (warnings & (1 << i)) count++;
@@ -526,16 +1518,442 @@ int SERCountMovieWarnings(int warnings) {
     return count;
 }
 
+/* Get the current size of movie's file, or -1 on errors. */
+static off_t getMovieFileSize(SERMovie *movie) {
+    off_t filesize = -1;
+    if (fseeko(movie->file, 0, SEEK_END) == 0)
+        filesize = ftello(movie->file);
+    fseeko(movie->file, 0, SEEK_SET);
+    SERRecordMovieStats(movie, SER_STATS_SEEK, 2, 0, 0);
+    return filesize;
+}
+
+/* Check movie's frames and trailer against the size of its file, adding
+ * the related warnings to movie->warnings, and compute first and last
+ * frame dates and movie duration. Frame dates must be already loaded. */
+static void checkMovieFrames(SERMovie *movie) {
+    uint32_t frame_c = SERGetFrameCount(movie);
+    uint64_t trailer_offset = SERGetTrailerOffset(movie->header),
+             expected_trailer_size = (frame_c * sizeof(uint64_t)),
+             trailer_size = 0;
+    if (movie->filesize < trailer_offset) {
+        movie->warnings |= WARN_INCOMPLETE_FRAMES;
+        return;
+    } else if (!SERMovieHasTrailer(movie)) {
+            movie->warnings |= WARN_MISSING_TRAILER;
+    } else {
+        trailer_size = movie->filesize - trailer_offset;
+        if (trailer_size < expected_trailer_size)
+            movie->warnings |= WARN_INCOMPLETE_TRAILER;
+    }
+    movie->firstFrameDate = SERGetFirstFrameDate(movie);
+    movie->lastFrameDate = SERGetLastFrameDate(movie);
+    if (movie->lastFrameDate > movie->firstFrameDate) {
+        uint64_t duration = movie->lastFrameDate - movie->firstFrameDate;
+        duration /= TIMEUNITS_PER_SEC;
+        movie->duration = duration;
+    } else if (!(movie->warnings & WARN_INCOMPLETE_TRAILER))
+        movie->warnings |= WARN_BAD_FRAME_DATES;
+}
+
+/* Movie indexes */
+
+int SERUseMovieIndexes = 1;
+
+struct SERMovieIndex {
+    /* Mapping of the loaded index file, NULL if none */
+    void *mapped_data;
+    size_t mapped_size;
+    /* Frame dates and their order are read from the mapping */
+    int dates_mapped;
+    /* Sections set by SERSetMovieIndexSection, that replace the loaded
+     * ones */
+    void *sections[SER_INDEX_SECTIONS];
+    size_t sizes[SER_INDEX_SECTIONS];
+    int set[SER_INDEX_SECTIONS];
+};
+
+#if defined(__APPLE__)
+#define getFileMTime(st) \
+    ((int64_t) (st)->st_mtimespec.tv_sec * NANOSEC_PER_SEC + \
+     (st)->st_mtimespec.tv_nsec)
+#elif IS_UNIX
+#define getFileMTime(st) \
+    ((int64_t) (st)->st_mtim.tv_sec * NANOSEC_PER_SEC + \
+     (st)->st_mtim.tv_nsec)
+#else
+#define getFileMTime(st) ((int64_t) (st)->st_mtime * NANOSEC_PER_SEC)
+#endif
+
+#define alignIndexOffset(offset) (((offset) + 7) & ~((uint64_t) 7))
+
+/* Release frame dates and their index, unless they belong to the mapping
+ * of the movie index. */
+static void freeFrameDates(SERMovie *movie) {
+    int mapped = (movie->index != NULL && movie->index->dates_mapped);
+    if (movie->frame_dates != NULL && !mapped) free(movie->frame_dates);
+    if (movie->date_index != NULL) {
+        if (movie->date_index->order != NULL && !mapped)
+            free(movie->date_index->order);
+        free(movie->date_index);
+    }
+    if (movie->index != NULL) movie->index->dates_mapped = 0;
+}
+
+static void releaseMovieIndex(SERMovieIndex *index) {
+    int i;
+#if IS_UNIX
+    if (index->mapped_data != NULL)
+        munmap(index->mapped_data, index->mapped_size);
+#endif
+    for (i = 0; i < SER_INDEX_SECTIONS; i++) {
+        if (index->sections[i] != NULL) free(index->sections[i]);
+    }
+    free(index);
+}
+
+/* Get the path of movie's index file, followed by `suffix`. The returned
+ * path must be freed. */
+static char *getMovieIndexPath(SERMovie *movie, const char *suffix) {
+    char *path = malloc(strlen(movie->filepath) + strlen(SER_INDEX_EXT) +
+                        strlen(suffix) + 1);
+    if (path == NULL) return NULL;
+    sprintf(path, "%s%s%s", movie->filepath, SER_INDEX_EXT, suffix);
+    return path;
+}
+
+/* Check that the index file mapped at `data` (`size` bytes) belongs to
+ * the movie file described by `st` and that its sections are valid. */
+static int isValidMovieIndex(SERMovie *movie, const void *data, size_t size,
+    struct stat *st)
+{
+    const SERIndexHeader *header = data;
+    const SERIndexSection *sections = header->sections;
+    int i;
+    if (memcmp(header->sFileID, SER_INDEX_FILE_ID,
+               sizeof(header->sFileID)) != 0 ||
+        header->uiVersion != SER_INDEX_VERSION ||
+        header->uiByteOrder != SER_INDEX_BYTE_ORDER ||
+        header->ulMovieSize != (uint64_t) st->st_size ||
+        header->lMovieMTime != getFileMTime(st) ||
+        memcmp(&header->movieHeader, movie->header, sizeof(SERHeader)) != 0)
+        return 0;
+    for (i = 0; i < SER_INDEX_SECTIONS; i++) {
+        const SERIndexSection *section = sections + i;
+        if (section->ulSize == 0) continue;
+        if (section->ulOffset < sizeof(SERIndexHeader) ||
+            (section->ulOffset & 7) != 0 || section->ulOffset > size ||
+            section->ulSize > size - section->ulOffset) return 0;
+    }
+    const SERIndexSection *dates = sections + SER_INDEX_DATES,
+                          *order = sections + SER_INDEX_DATE_ORDER;
+    uint64_t count = dates->ulSize / sizeof(uint64_t);
+    if ((dates->ulSize % sizeof(uint64_t)) != 0 ||
+        count > movie->header->uiFrameCount) return 0;
+    if (count == 0) return (order->ulSize == 0);
+    if (order->ulSize < 2 * sizeof(uint32_t)) return 0;
+    const uint32_t *info = (const uint32_t *)
+        ((const char *) data + order->ulOffset);
+    uint32_t ordered = info[0], indexed = info[1], j;
+    if (ordered > indexed || indexed > count) return 0;
+    if (order->ulSize == 2 * sizeof(uint32_t)) return (ordered == count);
+    if (order->ulSize != (2 + (uint64_t) indexed) * sizeof(uint32_t))
+        return 0;
+    for (j = 0; j < indexed; j++) {
+        if (info[2 + j] >= count) return 0;
+    }
+    return 1;
+}
+
+/* Load the index file of the movie (see SERSaveMovieIndex) if it has a
+ * valid one: the index file gets mapped into memory and frame dates and
+ * their order are read from the mapping, so they don't have to be loaded
+ * and sorted again. Cached warnings are added to movie->warnings.
+ * Return 1 if the index has been loaded, 0 otherwise. */
+static int loadMovieIndex(SERMovie *movie) {
+#if IS_UNIX
+    struct stat st, movie_st;
+    SERMovieIndex *index = NULL;
+    SERDateIndex *date_index = NULL;
+    void *addr = MAP_FAILED;
+    size_t size = 0;
+    if (movie->following) return 0;
+    char *path = getMovieIndexPath(movie, "");
+    if (path == NULL) return 0;
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0) return 0;
+    if (fstat(fd, &st) != 0 || fstat(fileno(movie->file), &movie_st) != 0 ||
+        (uint64_t) st.st_size < sizeof(SERIndexHeader) ||
+        (uint64_t) st.st_size > SIZE_MAX) goto invalid;
+    size = (size_t) st.st_size;
+    addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED || !isValidMovieIndex(movie, addr, size,
+                                                 &movie_st)) goto invalid;
+    const SERIndexHeader *header = addr;
+    const SERIndexSection *dates = header->sections + SER_INDEX_DATES,
+                          *order = header->sections + SER_INDEX_DATE_ORDER;
+    index = calloc(1, sizeof(*index));
+    if (index == NULL) goto invalid;
+    if (dates->ulSize > 0) {
+        const uint32_t *info = (const uint32_t *)
+            ((char *) addr + order->ulOffset);
+        date_index = calloc(1, sizeof(*date_index));
+        if (date_index == NULL) goto invalid;
+        date_index->ordered = info[0];
+        date_index->count = info[1];
+        if (order->ulSize > 2 * sizeof(uint32_t))
+            date_index->order = (uint32_t *) (info + 2);
+        movie->frame_dates = (uint64_t *) ((char *) addr + dates->ulOffset);
+    }
+    index->mapped_data = addr;
+    index->mapped_size = size;
+    index->dates_mapped = 1;
+    movie->index = index;
+    movie->frame_dates_count = (uint32_t) (dates->ulSize / sizeof(uint64_t));
+    movie->frame_dates_loaded = 1;
+    movie->date_index = date_index;
+    movie->warnings |= (int) header->uiWarnings;
+    close(fd);
+    return 1;
+invalid:
+    if (index != NULL) free(index);
+    if (addr != MAP_FAILED) munmap(addr, size);
+    close(fd);
+    return 0;
+#else
+    (void) movie;
+    return 0;
+#endif
+}
+
+/* Get the section `section` (SER_INDEX_*) of the movie index, that is the
+ * section set by SERSetMovieIndexSection or the one loaded from movie's
+ * index file, and store its size into `size`.
+ * The returned data is owned by the movie and it must not be modified.
+ * Return NULL if the movie index has no such section. */
+const void *SERGetMovieIndexSection(SERMovie *movie, int section,
+    size_t *size)
+{
+    SERMovieIndex *index = movie->index;
+    assert(size != NULL);
+    *size = 0;
+    if (index == NULL || section < 0 || section >= SER_INDEX_SECTIONS)
+        return NULL;
+    if (index->set[section]) {
+        *size = index->sizes[section];
+        return index->sections[section];
+    }
+    if (index->mapped_data == NULL) return NULL;
+    const SERIndexHeader *header = index->mapped_data;
+    const SERIndexSection *s = header->sections + section;
+    if (s->ulSize == 0) return NULL;
+    *size = (size_t) s->ulSize;
+    return (const char *) index->mapped_data + s->ulOffset;
+}
+
+/* Set the section `section` (SER_INDEX_*) of the movie index to a copy of
+ * the `size` bytes of `data`, so that it gets written by the next
+ * SERSaveMovieIndex (a zero size removes the section). Frame dates
+ * sections cannot be set, since they're always taken from the movie.
+ * Return 1 on success, 0 otherwise. */
+int SERSetMovieIndexSection(SERMovie *movie, int section, const void *data,
+    size_t size)
+{
+    void *copy = NULL;
+    if (section < SER_INDEX_HASHES || section >= SER_INDEX_SECTIONS) {
+        SERLogErr(LOG_TAG_ERR "Invalid movie index section: %d\n", section);
+        return 0;
+    }
+    if (movie->index == NULL) {
+        movie->index = calloc(1, sizeof(SERMovieIndex));
+        if (movie->index == NULL) goto oom;
+    }
+    if (size > 0) {
+        copy = malloc(size);
+        if (copy == NULL) goto oom;
+        memcpy(copy, data, size);
+    }
+    SERMovieIndex *index = movie->index;
+    if (index->sections[section] != NULL) free(index->sections[section]);
+    index->sections[section] = copy;
+    index->sizes[section] = size;
+    index->set[section] = 1;
+    return 1;
+oom:
+    SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+    return 0;
+}
+
+/* Write `size` bytes of `data` to `out` at `offset`, after filling the
+ * file with zeros from `*pos` (the current position) up to `offset`. */
+static int writeIndexData(FILE *out, uint64_t *pos, uint64_t offset,
+    const void *data, size_t size)
+{
+    static const char zeros[8] = {0};
+    while (*pos < offset) {
+        size_t n = (size_t) (offset - *pos);
+        if (n > sizeof(zeros)) n = sizeof(zeros);
+        if (fwrite(zeros, 1, n, out) != n) return 0;
+        *pos += n;
+    }
+    if (size > 0 && fwrite(data, 1, size, out) != size) return 0;
+    *pos += size;
+    return 1;
+}
+
+/* Write the index file of the movie (its path followed by SER_INDEX_EXT)
+ * containing movie warnings, frame dates and their order, and the other
+ * sections of the movie index (see SERSetMovieIndexSection), so that
+ * SEROpenMovie can load them instead of reading the movie again, until
+ * the movie file gets modified.
+ * The index is written to a temporary file which then replaces the
+ * previous index file, so that processes still using the previous one
+ * are not affected. Followed movies cannot be indexed.
+ * Return 1 on success, 0 otherwise. */
+int SERSaveMovieIndex(SERMovie *movie) {
+    SERIndexHeader header;
+    const void *data[SER_INDEX_SECTIONS];
+    uint32_t order_info[2] = {0, 0};
+    struct stat st;
+    char *path = NULL, *tmppath = NULL, *err = NULL;
+    FILE *out = NULL;
+    uint64_t offset, pos = 0;
+    int i;
+    if (movie->following) {
+        err = "followed movies cannot be indexed";
+        goto fail;
+    }
+    if (!loadFrameDates(movie)) goto fail;
+    if (fstat(fileno(movie->file), &st) != 0) {
+        err = strerror(errno);
+        goto fail;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.sFileID, SER_INDEX_FILE_ID, sizeof(header.sFileID));
+    header.uiVersion = SER_INDEX_VERSION;
+    header.uiByteOrder = SER_INDEX_BYTE_ORDER;
+    header.uiWarnings = (uint32_t) movie->warnings;
+    header.ulMovieSize = (uint64_t) st.st_size;
+    header.lMovieMTime = getFileMTime(&st);
+    memcpy(&header.movieHeader, movie->header, sizeof(SERHeader));
+    offset = alignIndexOffset(sizeof(header));
+    for (i = 0; i < SER_INDEX_SECTIONS; i++) {
+        size_t size = 0;
+        if (i == SER_INDEX_DATES) {
+            data[i] = movie->frame_dates;
+            size = movie->frame_dates_count * sizeof(uint64_t);
+        } else if (i == SER_INDEX_DATE_ORDER) {
+            SERDateIndex *date_index = movie->date_index;
+            data[i] = NULL;
+            if (date_index != NULL) {
+                order_info[0] = date_index->ordered;
+                order_info[1] = date_index->count;
+                data[i] = date_index->order;
+                size = sizeof(order_info);
+                if (date_index->order != NULL)
+                    size += date_index->count * sizeof(uint32_t);
+            }
+        } else data[i] = SERGetMovieIndexSection(movie, i, &size);
+        if (size == 0) continue;
+        header.sections[i].ulOffset = offset;
+        header.sections[i].ulSize = size;
+        offset = alignIndexOffset(offset + size);
+    }
+    path = getMovieIndexPath(movie, "");
+    tmppath = getMovieIndexPath(movie, ".tmp");
+    if (path == NULL || tmppath == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    out = fopen(tmppath, "wb");
+    if (out == NULL) {
+        err = strerror(errno);
+        goto fail;
+    }
+    if (!writeIndexData(out, &pos, 0, &header, sizeof(header)))
+        goto write_err;
+    for (i = 0; i < SER_INDEX_SECTIONS; i++) {
+        SERIndexSection *section = header.sections + i;
+        size_t size = (size_t) section->ulSize;
+        uint64_t section_offset = section->ulOffset;
+        if (size == 0) continue;
+        if (i == SER_INDEX_DATE_ORDER) {
+            if (!writeIndexData(out, &pos, section_offset, order_info,
+                                sizeof(order_info))) goto write_err;
+            section_offset += sizeof(order_info);
+            size -= sizeof(order_info);
+        }
+        if (!writeIndexData(out, &pos, section_offset, data[i], size))
+            goto write_err;
+    }
+    int closed = fclose(out);
+    out = NULL;
+    if (closed != 0) goto write_err;
+    if (rename(tmppath, path) != 0) {
+        err = strerror(errno);
+        goto fail;
+    }
+    free(path);
+    free(tmppath);
+    return 1;
+write_err:
+    err = strerror(errno);
+fail:
+    if (out != NULL) fclose(out);
+    if (tmppath != NULL) {
+        remove(tmppath);
+        free(tmppath);
+    }
+    if (path != NULL) free(path);
+    SERLogErr(LOG_TAG_ERR "Failed to save movie index");
+    if (err != NULL) SERLogErr(": %s", err);
+    SERLogErr("\n");
+    return 0;
+}
+
+/* Drop cached frame dates and their index, so that they get loaded again
+ * by loadFrameDates. */
+static void resetFrameDates(SERMovie *movie) {
+    freeFrameDates(movie);
+    movie->frame_dates = NULL;
+    movie->date_index = NULL;
+    movie->frame_dates_count = 0;
+    movie->frame_dates_loaded = 0;
+    movie->firstFrameDate = 0;
+    movie->lastFrameDate = 0;
+    movie->duration = 0;
+}
+
 /* Close movie->file and release everything. */
 void SERCloseMovie(SERMovie *movie) {
     if (movie == NULL) return;
+#if IS_UNIX
+    if (movie->mapped_data != NULL)
+        munmap(movie->mapped_data, movie->mapped_size);
+#endif
+    if (movie->frame_pool != NULL) {
+        SERFramePool *pool = movie->frame_pool;
+        int i;
+        pthread_mutex_lock(&pool->lock);
+        for (i = 0; i < pool->count; i++) freeFrame(pool->frames[i]);
+        pool->count = 0;
+        pool->closed = 1;
+        unrefFramePool(pool);
+    }
     if (movie->header != NULL) free(movie->header);
+    freeFrameDates(movie);
+    if (movie->index != NULL) releaseMovieIndex(movie->index);
+    if (movie->archive != NULL) releaseArchive(movie->archive);
+    if (movie->stats != NULL) free(movie->stats);
     if (movie->file != NULL) fclose(movie->file);
     free(movie);
 }
 
 /* Create a new SERMovie object and return a pointer to it.
  * The function will also open movie->file and parse movie's header.
+ * Compressed movies (see SERArchiveWriterBegin) are detected and opened
+ * transparently.
  * It returns NULL if anything goes wrong.
  * It's up to you to release the returned movie object by using
  * `SERCloseMovie` function. */
@@ -548,6 +1966,18 @@ SERMovie *SEROpenMovie(char *filepath) {
     }
     memset(movie, 0, sizeof(SERMovie));
     movie->filepath = filepath;
+    movie->frame_pool = createFramePool();
+    if (movie->frame_pool == NULL) {
+        fprintf(stderr, "Out-of-memory\n");
+        free(movie);
+        return NULL;
+    }
+    movie->stats_phase = SER_STATS_PHASE_OPEN;
+    if (SERCollectMovieStats && !SEREnableMovieStats(movie)) {
+        fprintf(stderr, "Out-of-memory\n");
+        SERCloseMovie(movie);
+        return NULL;
+    }
     char *err = NULL;
     movie->file = openMovieFileForReading(movie, &err);
     if (movie->file == NULL) {
@@ -556,6 +1986,11 @@ SERMovie *SEROpenMovie(char *filepath) {
         SERCloseMovie(movie);
         return NULL;
     }
+    if (!openArchive(movie)) {
+        SERLogErr(LOG_TAG_ERR "Failed to open compressed movie\n");
+        SERCloseMovie(movie);
+        return NULL;
+    }
     if (!parseHeader(movie)) {
         SERLogErr(LOG_TAG_ERR "Failed to parse movie header\n");
         SERCloseMovie(movie);
@@ -569,31 +2004,683 @@ SERMovie *SEROpenMovie(char *filepath) {
     movie->warnings = 0;
     movie->invert_endianness = 0;
     movie->duration = 0;
-    fseek(movie->file, 0, SEEK_END);
-    movie->filesize = ftell(movie->file);
-    fseek(movie->file, 0, SEEK_SET);
-    uint32_t frame_c = SERGetFrameCount(movie);
-    size_t trailer_offset = SERGetTrailerOffset(movie->header),
-           expected_trailer_size = (frame_c * sizeof(uint64_t)),
-         trailer_size = 0;
-    if (movie->filesize < trailer_offset) {
-        movie->warnings |= WARN_INCOMPLETE_FRAMES;
-        goto has_warns;
-    } else if (!SERMovieHasTrailer(movie)) {
-            movie->warnings |= WARN_MISSING_TRAILER;
-    } else {
-        trailer_size = movie->filesize - trailer_offset;
-        if (trailer_size < expected_trailer_size)
-            movie->warnings |= WARN_INCOMPLETE_TRAILER;
+    if (movie->archive != NULL)
+        movie->filesize = movie->archive->header.ulMovieSize;
+    else {
+        off_t filesize = getMovieFileSize(movie);
+        if (filesize < 0) {
+            SERLogErr(LOG_TAG_ERR "Failed to get movie file size: %s\n",
+                strerror(errno));
+            SERCloseMovie(movie);
+            return NULL;
+        }
+        movie->filesize = (uint64_t) filesize;
     }
-    movie->firstFrameDate = SERGetFirstFrameDate(movie);
-    movie->lastFrameDate = SERGetLastFrameDate(movie);
-    if (movie->lastFrameDate > movie->firstFrameDate) {
-        uint64_t duration = movie->lastFrameDate - movie->firstFrameDate;
-        duration /= TIMEUNITS_PER_SEC;
-        movie->duration = duration;
-    } else if (!(movie->warnings & WARN_INCOMPLETE_TRAILER))
-        movie->warnings |= WARN_BAD_FRAME_DATES;
-has_warns:
+    /* Load and index frame dates now, so that they can be accessed
+     * concurrently later. They're taken from the movie index if the movie
+     * has a valid one. */
+    if (!SERUseMovieIndexes || !loadMovieIndex(movie)) {
+        if (loadFrameDates(movie)) buildDateIndex(movie);
+    }
+    checkMovieFrames(movie);
+    movie->stats_phase = SER_STATS_PHASE_COPY;
     return movie;
 }
+
+/* Same as `SEROpenMovie`, but the whole movie file also gets mapped into
+ * memory (read-only), so that frames can be accessed without any copy
+ * by using `SERGetFrameView`. Other functions (ie. `SERGetFrame`) keep
+ * working as usual and they will read from the mapping.
+ * Return NULL if the movie cannot be opened or mapped (compressed movies
+ * cannot be mapped). */
+SERMovie *SEROpenMovieMapped(char *filepath) {
+    SERMovie *movie = SEROpenMovie(filepath);
+    if (movie == NULL) return NULL;
+    if (movie->archive != NULL) {
+        SERLogErr(LOG_TAG_ERR "Compressed movies cannot be mapped\n");
+        SERCloseMovie(movie);
+        return NULL;
+    }
+#if IS_UNIX
+    if (movie->filesize > SIZE_MAX) {
+        SERLogErr(LOG_TAG_ERR "Movie file too big to be mapped\n");
+        SERCloseMovie(movie);
+        return NULL;
+    }
+    void *addr = mmap(NULL, (size_t) movie->filesize, PROT_READ, MAP_SHARED,
+        fileno(movie->file), 0);
+    if (addr == MAP_FAILED) {
+        SERLogErr(LOG_TAG_ERR "Failed to map movie file: %s\n",
+            strerror(errno));
+        SERCloseMovie(movie);
+        return NULL;
+    }
+    movie->mapped_data = addr;
+    movie->mapped_size = (size_t) movie->filesize;
+    return movie;
+#else
+    SERLogErr(LOG_TAG_ERR "Memory-mapped movies not supported\n");
+    SERCloseMovie(movie);
+    return NULL;
+#endif
+}
+
+/* Tell the system how movie's frames are going to be accessed (see
+ * SER_ACCESS_* values), so that it can tune read-ahead accordingly.
+ * For mapped movies this calls madvise on the mapping, otherwise
+ * posix_fadvise on the movie file, where available.
+ * Return 1 on success, 0 otherwise. */
+int SERAdviseMovieAccess(SERMovie *movie, int access) {
+#if IS_UNIX
+    int ret = 0, sequential = (access == SER_ACCESS_SEQUENTIAL ||
+                               access == SER_ACCESS_NOREUSE);
+    movie->noreuse = (access == SER_ACCESS_NOREUSE);
+    if (movie->mapped_data != NULL) {
+        int advice = MADV_NORMAL;
+        if (sequential) advice = MADV_SEQUENTIAL;
+        else if (access == SER_ACCESS_RANDOM) advice = MADV_RANDOM;
+        ret = madvise(movie->mapped_data, movie->mapped_size, advice);
+    }
+#ifdef POSIX_FADV_NORMAL
+    else {
+        int advice = POSIX_FADV_NORMAL, fd = fileno(movie->file);
+        if (sequential) advice = POSIX_FADV_SEQUENTIAL;
+        else if (access == SER_ACCESS_RANDOM) advice = POSIX_FADV_RANDOM;
+        ret = posix_fadvise(fd, 0, 0, advice);
+#ifdef POSIX_FADV_NOREUSE
+        if (ret == 0 && movie->noreuse)
+            ret = posix_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE);
+#endif
+    }
+#endif
+    return (ret == 0);
+#else
+    return 0;
+#endif
+}
+
+/* Follow mode */
+
+/* Start following a movie whose file is still being written (ie. by a
+ * capture software), so that frames written after the movie has been
+ * opened can be picked up by calling SERRefreshMovie, without reopening
+ * the movie.
+ * While the movie is followed, its frame count is the number of complete
+ * frames found in the file (capture softwares usually write the actual
+ * frame count only at the end of the capture), it has no frame dates and
+ * it has the WARN_MISSING_TRAILER warning (and WARN_INCOMPLETE_FRAMES
+ * while a frame is being written). Follow mode ends by itself when the
+ * movie gets finalized (see SERRefreshMovie).
+ * Compressed and mapped movies cannot be followed, and the movie index
+ * (see SERSaveMovieIndex) of followed movies is dropped.
+ * Return 1 on success, 0 otherwise. */
+int SERFollowMovie(SERMovie *movie) {
+    if (movie->archive != NULL || movie->mapped_data != NULL) {
+        SERLogErr(LOG_TAG_ERR "Compressed or mapped movies cannot be "
+            "followed\n");
+        return 0;
+    }
+    if (SERGetFrameSize(movie->header) == 0) {
+        SERLogErr(LOG_TAG_ERR "Invalid frame size (0)\n");
+        return 0;
+    }
+    /* Dates loaded when the movie has been opened may just be frame data
+     * written beyond the frame count found in the header. */
+    resetFrameDates(movie);
+    if (movie->index != NULL) {
+        releaseMovieIndex(movie->index);
+        movie->index = NULL;
+    }
+    movie->frame_dates_loaded = 1;
+    movie->warnings &= ~(WARN_INCOMPLETE_TRAILER | WARN_BAD_FRAME_DATES);
+    movie->header->uiFrameCount = 0;
+    movie->following = 1;
+    return (SERRefreshMovie(movie) >= 0);
+}
+
+/* Update a followed movie (see SERFollowMovie) from the current size of
+ * its file: the frame count grows to the number of complete frames, so
+ * that only the new frames have to be read.
+ * The movie is considered finalized when the header written by the
+ * capture software contains the frame count and the whole trailer has
+ * been written: then the header is reloaded, frame dates get loaded,
+ * WARN_INCOMPLETE_FRAMES and WARN_MISSING_TRAILER are cleared (unless the
+ * finalized movie still has them) and follow mode ends (movie->following
+ * becomes 0).
+ * Return the number of new complete frames (0 if nothing changed), or -1
+ * on errors (ie. if the movie file has been truncated). */
+long SERRefreshMovie(SERMovie *movie) {
+    SERHeader header;
+    SERHeader *current = movie->header;
+    uint32_t prev = SERGetFrameCount(movie), count;
+    if (!movie->following) return 0;
+    off_t filesize = getMovieFileSize(movie);
+    if (filesize < 0) {
+        SERLogErr(LOG_TAG_ERR "Failed to get movie file size: %s\n",
+            strerror(errno));
+        return -1;
+    }
+    if ((uint64_t) filesize < sizeof(SERHeader) ||
+        !readFileData(movie, &header, sizeof(header), 0))
+    {
+        SERLogErr(LOG_TAG_ERR "Failed to read SER movie header\n");
+        return -1;
+    }
+    if (IS_BIG_ENDIAN) swapMovieHeader(&header);
+    if (SERGetFrameSize(&header) != SERGetFrameSize(current)) {
+        SERLogErr(LOG_TAG_ERR "Movie frame format has changed\n");
+        return -1;
+    }
+    movie->filesize = (uint64_t) filesize;
+    uint64_t frames = SERGetRealFrameCount(movie);
+    if (header.uiFrameCount > 0 && frames >= header.uiFrameCount &&
+        movie->filesize >= SERGetTrailerOffset(&header) +
+                           (uint64_t) header.uiFrameCount * sizeof(uint64_t))
+    {
+        count = header.uiFrameCount;
+        if (count < prev) goto truncated;
+        memcpy(current, &header, sizeof(header));
+        movie->following = 0;
+        resetFrameDates(movie);
+        movie->warnings &= ~(WARN_INCOMPLETE_FRAMES | WARN_MISSING_TRAILER);
+        if (loadFrameDates(movie)) buildDateIndex(movie);
+        checkMovieFrames(movie);
+        return (long) (count - prev);
+    }
+    int partial = (movie->filesize > sizeof(SERHeader) +
+                                     frames * SERGetFrameSize(current));
+    /* Frames beyond the frame count written in the header are trailer
+     * data being written. */
+    if (header.uiFrameCount > 0 && frames >= header.uiFrameCount) {
+        frames = header.uiFrameCount;
+        partial = 0;
+    }
+    if (frames > UINT32_MAX) frames = UINT32_MAX;
+    count = (uint32_t) frames;
+    if (count < prev) goto truncated;
+    current->uiFrameCount = count;
+    movie->warnings |= WARN_MISSING_TRAILER;
+    if (partial) movie->warnings |= WARN_INCOMPLETE_FRAMES;
+    else
+        movie->warnings &= ~WARN_INCOMPLETE_FRAMES;
+    return (long) (count - prev);
+truncated:
+    SERLogErr(LOG_TAG_ERR "Movie file has been truncated\n");
+    return -1;
+}
+
+/* Frame iterator */
+
+typedef struct {
+    SERFrame frame;
+    int ready;  /* Slot contains a frame that has not been released yet */
+    int ok;     /* Frame has been successfully read */
+} SERIteratorSlot;
+
+struct SERFrameIterator {
+    SERMovie *movie;
+    uint32_t from;
+    uint32_t stride;
+    uint32_t total;     /* Number of frames returned by the iterator */
+    uint32_t next;      /* Sequence number of the next frame to return */
+    int depth;
+    int nslots;         /* Number of allocated slots */
+    int current;        /* Slot returned by the last call, -1 if none. */
+    int failed;
+    int stop;
+    int threaded;
+    SERIteratorSlot *slots;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+/* Hint the system that `size` bytes starting from `offset` are going to be
+ * read soon. */
+static void prefetchMovieData(SERMovie *movie, uint64_t offset,
+    uint64_t size)
+{
+#if IS_UNIX
+    if (movie->mapped_data != NULL) {
+        long pagesize = sysconf(_SC_PAGESIZE);
+        if (pagesize <= 0 || offset >= movie->mapped_size) return;
+        size_t start = offset - (offset % pagesize);
+        if (offset + size > movie->mapped_size)
+            size = movie->mapped_size - offset;
+        madvise((char *) movie->mapped_data + start, size + (offset - start),
+            MADV_WILLNEED);
+    }
+#ifdef POSIX_FADV_WILLNEED
+    else {
+        if (movie->archive != NULL)
+            getArchiveFileRange(movie, &offset, &size);
+        posix_fadvise(fileno(movie->file), (off_t) offset, (off_t) size,
+            POSIX_FADV_WILLNEED);
+    }
+#endif
+#else
+    (void) movie;
+    (void) offset;
+    (void) size;
+#endif
+}
+
+static uint32_t getIteratorFrameIndex(SERFrameIterator *it, uint32_t seq) {
+    return it->from + (seq * it->stride);
+}
+
+/* Read the frame with sequence number `seq` into its slot and hint the
+ * system about the frame that will be read `depth` frames later. */
+static int readIteratorFrame(SERFrameIterator *it, uint32_t seq) {
+    SERIteratorSlot *slot = it->slots + (seq % it->depth);
+    uint32_t frame_idx = getIteratorFrameIndex(it, seq);
+    uint64_t offset = 0;
+    if (seq + it->depth < it->total && it->stride > 1) {
+        uint32_t ahead_idx = getIteratorFrameIndex(it, seq + it->depth);
+        prefetchMovieData(it->movie,
+            SERGetFrameOffset(it->movie->header, ahead_idx),
+            slot->frame.size);
+    }
+    initFrame(it->movie, &slot->frame, frame_idx);
+    if (!getFrameDataOffset(it->movie, frame_idx, &offset)) return 0;
+    if (!readMovieData(it->movie, slot->frame.data, slot->frame.size,
+        offset))
+    {
+        SERLogErr(LOG_TAG_ERR "Failed to read frame %d\n", frame_idx);
+        return 0;
+    }
+    return 1;
+}
+
+/* Background reader: fill free slots in order, until every frame has been
+ * read, a read fails or the iterator gets stopped. */
+static void *iteratorReaderThread(void *arg) {
+    SERFrameIterator *it = arg;
+    uint32_t seq;
+    for (seq = 0; seq < it->total; seq++) {
+        SERIteratorSlot *slot = it->slots + (seq % it->depth);
+        pthread_mutex_lock(&it->lock);
+        while (slot->ready && !it->stop)
+            pthread_cond_wait(&it->cond, &it->lock);
+        int stop = it->stop;
+        pthread_mutex_unlock(&it->lock);
+        if (stop) break;
+        int ok = readIteratorFrame(it, seq);
+        pthread_mutex_lock(&it->lock);
+        slot->ok = ok;
+        slot->ready = 1;
+        pthread_cond_broadcast(&it->cond);
+        pthread_mutex_unlock(&it->lock);
+        if (!ok) break;
+    }
+    return NULL;
+}
+
+/* Start iterating over movie's frames: frames are returned by the
+ * `SERFrameIteratorNext` function, starting from frame `from` and
+ * stepping by `stride` frames (1 means every frame), as long as the frame
+ * index is lower than `from + count` (use 0 as `count` to iterate until
+ * the last frame).
+ * While the caller processes a frame, a background thread reads the next
+ * `depth` frames (use 0 for SER_ITERATOR_DEFAULT_DEPTH). For memory-mapped
+ * movies, frames are returned as zero-copy views and the system is just
+ * hinted to read them ahead.
+ * It's up to you to release the iterator by calling `SERFrameIteratorEnd`.
+ * Return NULL if the range is not valid or if out-of-memory. */
+SERFrameIterator *SERFrameIteratorBegin(SERMovie *movie, uint32_t from,
+    uint32_t count, uint32_t stride, int depth)
+{
+    SERFrameIterator *it = NULL;
+    uint32_t frame_count = SERGetFrameCount(movie);
+    int i;
+    assert(movie->header != NULL);
+    if (stride == 0) stride = 1;
+    if (depth <= 0) depth = SER_ITERATOR_DEFAULT_DEPTH;
+    if (depth > SER_ITERATOR_MAX_DEPTH) depth = SER_ITERATOR_MAX_DEPTH;
+    if (from >= frame_count) {
+        SERLogErr(LOG_TAG_ERR "Frame index %d beyond movie frames (%d)\n",
+            from, frame_count);
+        return NULL;
+    }
+    if (count == 0 || count > frame_count - from) count = frame_count - from;
+    it = malloc(sizeof(*it));
+    if (it == NULL) goto oom;
+    memset(it, 0, sizeof(*it));
+    it->movie = movie;
+    it->from = from;
+    it->stride = stride;
+    it->total = (count + stride - 1) / stride;
+    it->depth = depth;
+    it->current = -1;
+    size_t frame_size = SERGetFrameSize(movie->header);
+    uint64_t offset = SERGetFrameOffset(movie->header, from);
+    if (stride == 1)
+        prefetchMovieData(movie, offset, (uint64_t) depth * frame_size);
+    if (movie->mapped_data != NULL) {
+        it->depth = 1;
+        it->slots = calloc(1, sizeof(*it->slots));
+        if (it->slots == NULL) goto oom;
+        return it;
+    }
+    it->slots = calloc(depth, sizeof(*it->slots));
+    if (it->slots == NULL) goto oom;
+    it->nslots = depth;
+    for (i = 0; i < depth; i++) {
+        it->slots[i].frame.data = malloc(frame_size);
+        if (it->slots[i].frame.data == NULL) goto oom;
+        it->slots[i].frame.size = frame_size;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (stride == 1) {
+        uint64_t advise_offset = offset,
+                 advise_size = (uint64_t) count * frame_size;
+        if (movie->archive != NULL)
+            getArchiveFileRange(movie, &advise_offset, &advise_size);
+        posix_fadvise(fileno(movie->file), (off_t) advise_offset,
+            (off_t) advise_size, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+    if (pthread_mutex_init(&it->lock, NULL) != 0) goto nothread;
+    if (pthread_cond_init(&it->cond, NULL) != 0) {
+        pthread_mutex_destroy(&it->lock);
+        goto nothread;
+    }
+    if (pthread_create(&it->thread, NULL, iteratorReaderThread, it) != 0) {
+        pthread_cond_destroy(&it->cond);
+        pthread_mutex_destroy(&it->lock);
+        goto nothread;
+    }
+    it->threaded = 1;
+    return it;
+nothread:
+    /* Frames will be read synchronously by SERFrameIteratorNext */
+    it->depth = 1;
+    return it;
+oom:
+    SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+    SERFrameIteratorEnd(it);
+    return NULL;
+}
+
+/* Return the next frame of the iterator, or NULL if there are no more
+ * frames or if the frame could not be read (`SERFrameIteratorEnd` will
+ * then tell whether the iteration completed successfully).
+ * The returned frame (and its data) is owned by the iterator and it only
+ * remains valid until the next call to `SERFrameIteratorNext` or
+ * `SERFrameIteratorEnd`: do not call `SERReleaseFrame` on it. */
+const SERFrame *SERFrameIteratorNext(SERFrameIterator *it) {
+    if (it == NULL || it->failed) return NULL;
+    if (it->threaded && it->current >= 0) {
+        pthread_mutex_lock(&it->lock);
+        it->slots[it->current].ready = 0;
+        pthread_cond_broadcast(&it->cond);
+        pthread_mutex_unlock(&it->lock);
+    }
+    it->current = -1;
+    if (it->next >= it->total) return NULL;
+    uint32_t seq = it->next++;
+    int slot_idx = seq % it->depth;
+    SERIteratorSlot *slot = it->slots + slot_idx;
+    if (it->movie->mapped_data != NULL) {
+        uint32_t frame_idx = getIteratorFrameIndex(it, seq);
+        if (!SERGetFrameView(it->movie, frame_idx, &slot->frame)) {
+            it->failed = 1;
+            return NULL;
+        }
+        if (seq + it->depth < it->total) {
+            uint32_t ahead_idx = getIteratorFrameIndex(it, seq + it->depth);
+            prefetchMovieData(it->movie,
+                SERGetFrameOffset(it->movie->header, ahead_idx),
+                slot->frame.size);
+        }
+        it->current = slot_idx;
+        return &slot->frame;
+    }
+    if (!it->threaded) {
+        if (!readIteratorFrame(it, seq)) {
+            it->failed = 1;
+            return NULL;
+        }
+        it->current = slot_idx;
+        return &slot->frame;
+    }
+    pthread_mutex_lock(&it->lock);
+    while (!slot->ready) pthread_cond_wait(&it->cond, &it->lock);
+    int ok = slot->ok;
+    pthread_mutex_unlock(&it->lock);
+    if (!ok) {
+        it->failed = 1;
+        return NULL;
+    }
+    it->current = slot_idx;
+    return &slot->frame;
+}
+
+/* Stop the iterator and release it. Return 1 if every frame returned by
+ * the iterator has been successfully read, 0 otherwise. */
+int SERFrameIteratorEnd(SERFrameIterator *it) {
+    if (it == NULL) return 0;
+    int ok = !it->failed;
+    int i;
+    if (it->threaded) {
+        pthread_mutex_lock(&it->lock);
+        it->stop = 1;
+        pthread_cond_broadcast(&it->cond);
+        pthread_mutex_unlock(&it->lock);
+        pthread_join(it->thread, NULL);
+        pthread_cond_destroy(&it->cond);
+        pthread_mutex_destroy(&it->lock);
+    }
+    if (it->slots != NULL) {
+        /* Slots of mapped movies don't own their data (nslots is 0) */
+        for (i = 0; i < it->nslots; i++) {
+            if (it->slots[i].frame.data != NULL)
+                free(it->slots[i].frame.data);
+        }
+        free(it->slots);
+    }
+    free(it);
+    return ok;
+}
+
+/* Read `size` bytes of the movie file, starting from `offset`, into
+ * `buf`. Compressed movies are read as if they were the original movie,
+ * so this can be used to copy any part of a movie (ie. its trailer) as it
+ * is. Return 1 on success, 0 otherwise. */
+int SERReadMovieData(SERMovie *movie, void *buf, size_t size,
+    uint64_t offset)
+{
+    if (offset + size > movie->filesize) return 0;
+    return readMovieData(movie, buf, size, offset);
+}
+
+/* Get the size of the file of a compressed movie, or 0 if the movie is
+ * not compressed. */
+uint64_t SERGetCompressedSize(SERMovie *movie) {
+    if (movie->archive == NULL) return 0;
+    return movie->archive->filesize;
+}
+
+/* Compressed movie writer */
+
+struct SERArchiveWriter {
+    SERMovie *movie;
+    FILE *out;
+    SERArchiveHeader header;    /* In host byte order (but movieHeader) */
+    CodecFrameFormat format;
+    uint64_t *index;
+    uint64_t offset;            /* Current offset of the compressed movie */
+    uint32_t added;
+    void *buf;                  /* Encoded frame */
+    int failed;
+};
+
+static void releaseArchiveWriter(SERArchiveWriter *writer) {
+    if (writer->index != NULL) free(writer->index);
+    if (writer->buf != NULL) free(writer->buf);
+    free(writer);
+}
+
+/* Start writing a compressed copy of `movie` into `out`, that must be
+ * opened for writing (and empty). Every complete frame of the movie must
+ * then be added, in order, by calling `SERArchiveWriterAddFrame` with
+ * frame's raw data (ie. as returned by SERGetFrameInto), then the
+ * compressed movie gets completed by `SERArchiveWriterEnd`.
+ * Compressed movies are opened by SEROpenMovie as if they were the
+ * original movie, and its original file can be restored byte by byte
+ * from them (ie. by copying SERReadMovieData).
+ * Return NULL on errors. */
+SERArchiveWriter *SERArchiveWriterBegin(SERMovie *movie, FILE *out) {
+    SERArchiveWriter *writer = NULL;
+    SERArchiveHeader empty;
+    char *err = NULL;
+    assert(movie->header != NULL);
+    size_t frame_size = SERGetFrameSize(movie->header);
+    if (frame_size == 0) {
+        err = "invalid frame size (0)";
+        goto fail;
+    }
+    uint32_t count = SERGetFrameCount(movie);
+    if (movie->filesize < sizeof(SERHeader)) count = 0;
+    else if (SERGetRealFrameCount(movie) < count)
+        count = SERGetRealFrameCount(movie);
+    writer = calloc(1, sizeof(*writer));
+    if (writer == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    writer->movie = movie;
+    writer->out = out;
+    memcpy(writer->header.sFileID, SER_ARCHIVE_FILE_ID,
+        sizeof(writer->header.sFileID));
+    writer->header.uiVersion = SER_ARCHIVE_VERSION;
+    if (SERIsBigEndian(movie))
+        writer->header.uiFlags |= SER_ARCHIVE_BIG_ENDIAN_SAMPLES;
+    writer->header.uiFrameCount = count;
+    writer->header.ulMovieSize = movie->filesize;
+    /* Keep the original header as it is */
+    if (!readMovieData(movie, &(writer->header.movieHeader),
+        sizeof(SERHeader), 0))
+    {
+        err = "failed to read movie header";
+        goto fail;
+    }
+    writer->format = getArchiveFormat(movie->header, writer->header.uiFlags);
+    writer->index = malloc(((size_t) count + 1) * sizeof(uint64_t));
+    writer->buf = malloc(CodecGetMaxEncodedSize(&(writer->format)));
+    if (writer->index == NULL || writer->buf == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    /* The header gets written at the end, so that incomplete compressed
+     * movies are never recognized as such. */
+    memset(&empty, 0, sizeof(empty));
+    if (fwrite(&empty, sizeof(empty), 1, out) != 1) {
+        err = "failed to write compressed movie header";
+        goto fail;
+    }
+    writer->offset = sizeof(empty);
+    return writer;
+fail:
+    SERLogErr(LOG_TAG_ERR "%s\n", err);
+    if (writer != NULL) releaseArchiveWriter(writer);
+    return NULL;
+}
+
+/* Number of frames that must be added to the writer: incomplete frames
+ * are not encoded (they're kept in the tail). */
+uint32_t SERArchiveWriterGetFrameCount(SERArchiveWriter *writer) {
+    return writer->header.uiFrameCount;
+}
+
+/* Encode and write the next frame of the movie. `frame` must contain
+ * frame's raw data. Return 1 on success, 0 otherwise. */
+int SERArchiveWriterAddFrame(SERArchiveWriter *writer, const void *frame) {
+    if (writer->failed) return 0;
+    if (writer->added >= writer->header.uiFrameCount) {
+        SERLogErr(LOG_TAG_ERR "Too many frames for compressed movie\n");
+        writer->failed = 1;
+        return 0;
+    }
+    SERMovie *movie = writer->movie;
+    uint64_t start = SERMovieStatsClock(movie);
+    size_t size = CodecEncodeFrame(&(writer->format), frame, writer->buf);
+    SERRecordMovieStats(movie, SER_STATS_CONVERT, 1, size, start);
+    start = SERMovieStatsClock(movie);
+    size_t written = fwrite(writer->buf, 1, size, writer->out);
+    SERRecordMovieStats(movie, SER_STATS_WRITE, 1, written, start);
+    if (written != size) {
+        SERLogErr(LOG_TAG_ERR "Failed to write compressed frame %d\n",
+            writer->added);
+        writer->failed = 1;
+        return 0;
+    }
+    writer->index[writer->added++] = writer->offset;
+    writer->offset += size;
+    return 1;
+}
+
+/* Write the tail and the index of the compressed movie, then its header,
+ * and release the writer. Return 1 if the compressed movie has been
+ * successfully completed, 0 otherwise. */
+int SERArchiveWriterEnd(SERArchiveWriter *writer) {
+    if (writer == NULL) return 0;
+    SERMovie *movie = writer->movie;
+    SERArchiveHeader *header = &(writer->header);
+    uint32_t count = header->uiFrameCount, i;
+    char *err = NULL, *buf = NULL;
+    if (writer->failed) goto fail;
+    if (writer->added != count) {
+        err = "missing frames in compressed movie";
+        goto fail;
+    }
+    writer->index[count] = writer->offset;
+    uint64_t tail_start = SERGetFrameOffset(movie->header, count);
+    header->ulTailOffset = writer->offset;
+    header->ulTailSize = movie->filesize - tail_start;
+    buf = malloc(ARCHIVE_COPY_SIZE);
+    if (buf == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    uint64_t copied = 0;
+    while (copied < header->ulTailSize) {
+        size_t chunk = header->ulTailSize - copied;
+        if (chunk > ARCHIVE_COPY_SIZE) chunk = ARCHIVE_COPY_SIZE;
+        if (!readMovieData(movie, buf, chunk, tail_start + copied)) {
+            err = "failed to read movie trailer";
+            goto fail;
+        }
+        uint64_t start = SERMovieStatsClock(movie);
+        size_t written = fwrite(buf, 1, chunk, writer->out);
+        SERRecordMovieStats(movie, SER_STATS_WRITE, 1, written, start);
+        if (written != chunk) {
+            err = "failed to write compressed movie";
+            goto fail;
+        }
+        copied += chunk;
+    }
+    header->ulIndexOffset = writer->offset + header->ulTailSize;
+    if (IS_BIG_ENDIAN) {
+        for (i = 0; i <= count; i++) swapint64(writer->index + i);
+        swapArchiveHeader(header);
+    }
+    if (fwrite(writer->index, sizeof(uint64_t), (size_t) count + 1,
+        writer->out) != (size_t) count + 1 ||
+        fflush(writer->out) != 0 ||
+        fseeko(writer->out, 0, SEEK_SET) != 0 ||
+        fwrite(header, sizeof(*header), 1, writer->out) != 1 ||
+        fflush(writer->out) != 0)
+    {
+        err = "failed to write compressed movie";
+        goto fail;
+    }
+    free(buf);
+    releaseArchiveWriter(writer);
+    return 1;
+fail:
+    if (err != NULL) SERLogErr(LOG_TAG_ERR "%s\n", err);
+    if (buf != NULL) free(buf);
+    releaseArchiveWriter(writer);
+    return 0;
+}
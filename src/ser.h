@@ -63,14 +63,88 @@
 
 #define SER_FILE_ID "LUCAM-RECORDER"
 
+/* If not zero, movies opened by SEROpenMovie collect I/O statistics
+ * since they get opened (see SERGetMovieStats) */
+extern int SERCollectMovieStats;
+
+/* If not zero, SEROpenMovie loads the index file of movies that have a
+ * valid one (see SERSaveMovieIndex) */
+extern int SERUseMovieIndexes;
+
+/* Access pattern hints for SERAdviseMovieAccess */
+#define SER_ACCESS_NORMAL       0
+#define SER_ACCESS_SEQUENTIAL   1
+#define SER_ACCESS_RANDOM       2
+/* Sequential, every frame read only once: read data gets dropped from the
+ * page cache. */
+#define SER_ACCESS_NOREUSE      3
+
+/* Max. number of released frames kept by every movie for reuse */
+#define SER_FRAME_POOL_SIZE     4
+
+/* Number of frames read ahead by SERFrameIterator (see
+ * SERFrameIteratorBegin) */
+#define SER_ITERATOR_DEFAULT_DEPTH  3
+#define SER_ITERATOR_MAX_DEPTH      64
+
+/* Layouts of frames read by SERReadFrames */
+#define SER_LAYOUT_INTERLEAVED  0   /* RGBRGB... (as SERGetFramePixels) */
+#define SER_LAYOUT_PLANAR       1   /* RR... GG... BB... */
+
+/* Demosaicing methods for SERGetFrameRGB & co. */
+#define SER_DEBAYER_BILINEAR    1
+#define SER_DEBAYER_EDGE_AWARE  2
+
+/* Compressed movies (see SERArchiveWriterBegin) */
+#define SER_ARCHIVE_FILE_ID     "SERUTILS-SERZ"
+#define SER_ARCHIVE_VERSION     1
+#define SER_ARCHIVE_EXT         ".serz"
+/* SERArchiveHeader flags */
+#define SER_ARCHIVE_BIG_ENDIAN_SAMPLES  (1 << 0)
+
+/* Movie index files (see SERSaveMovieIndex) */
+#define SER_INDEX_FILE_ID       "SERUTILS-SIDX"
+#define SER_INDEX_VERSION       1
+#define SER_INDEX_EXT           ".idx"
+#define SER_INDEX_BYTE_ORDER    0x01020304
+/* Sections of movie indexes. Frame dates and their order are taken from
+ * the movie, other sections are set by SERSetMovieIndexSection. */
+#define SER_INDEX_DATES         0   /* uint64_t for every frame date */
+#define SER_INDEX_DATE_ORDER    1   /* uint32_t ordered and count, followed
+                                       by `count` uint32_t frames sorted by
+                                       date if not every date is ordered */
+#define SER_INDEX_HASHES        2   /* uint64_t for every frame */
+#define SER_INDEX_SCORES        3   /* double for every frame */
+#define SER_INDEX_FRAME_STATS   4   /* SERFrameStats for every frame */
+#define SER_INDEX_HISTOGRAM     5   /* uint64_t for every value of every
+                                       plane */
+#define SER_INDEX_SECTIONS      6
+
+/* Phases of movie processing used by I/O statistics (see
+ * SERGetMovieStats) */
+#define SER_STATS_PHASE_OPEN        0
+#define SER_STATS_PHASE_CHECK       1
+#define SER_STATS_PHASE_COPY        2
+#define SER_STATS_PHASE_TRAILER     3
+#define SER_STATS_PHASES            4
+
+/* Operations recorded by SERRecordMovieStats */
+#define SER_STATS_READ              0
+#define SER_STATS_SEEK              1
+#define SER_STATS_WRITE             2
+#define SER_STATS_CONVERT           3
+
 #define SERMovieHasTrailer(movie) \
-    (movie->filesize > (size_t) SERGetTrailerOffset(movie->header))
+    (!movie->following && \
+     movie->filesize > SERGetTrailerOffset(movie->header))
 #define SERGetFrameCount(movie) \
     (movie->header->uiFrameCount)
 #define SERGetLastFrameIndex(movie) \
     (SERGetFrameCount(movie) - 1)
 #define SERGetRealFrameCount(movie) \
     ((movie->filesize - sizeof(SERHeader)) / SERGetFrameSize(movie->header))
+#define SERIsCompressedMovie(movie) \
+    (movie->archive != NULL)
 
 /* See WARN above SERHeader->uiLittleEndian definition. */
 #define SERIsBigEndian(movie) \
@@ -110,20 +184,139 @@ typedef struct PACKED_STRUCT {
     uint64_t ulDateTime_UTC;
 } SERHeader;
 
+/* Header of compressed movies. Compressed movies contain the original
+ * header (as it is), every complete frame encoded by codec.c, the original
+ * bytes following the last complete frame (trailer, incomplete frames,
+ * etc.) and an index containing the offset of every encoded frame, so
+ * that the original movie can be restored byte by byte.
+ * Layout:
+ *
+ *   SERArchiveHeader
+ *   encoded frames             (uiFrameCount frames)
+ *   tail                       (ulTailSize bytes, at ulTailOffset)
+ *   index                      (uiFrameCount + 1 uint64_t, at
+ *                               ulIndexOffset, the last one being the end
+ *                               of the last frame)
+ *
+ * Every integer is stored in little-endian byte order. */
+typedef struct PACKED_STRUCT {
+    char sFileID[14];
+    uint32_t uiVersion;
+    uint32_t uiFlags;
+    uint32_t uiFrameCount;  /* Number of encoded frames */
+    uint64_t ulMovieSize;   /* Size of the original movie file */
+    uint64_t ulTailOffset;
+    uint64_t ulTailSize;
+    uint64_t ulIndexOffset;
+    SERHeader movieHeader;  /* Original movie header */
+} SERArchiveHeader;
+
+typedef struct PACKED_STRUCT {
+    uint64_t ulOffset;
+    uint64_t ulSize;        /* 0 if the section is missing */
+} SERIndexSection;
+
+/* Header of movie index files, that cache data derived from the frames
+ * of a movie (ie. movie.ser.idx for movie.ser), so that it doesn't have
+ * to be computed again.
+ * An index is only used while the size and the modification time of the
+ * movie file and the movie header are the ones stored in its header.
+ * Layout:
+ *
+ *   SERIndexHeader
+ *   sections                   (at ulOffset, aligned to 8 bytes)
+ *
+ * Every integer is stored in host byte order: indexes written on hosts
+ * using a different byte order are ignored. */
+typedef struct PACKED_STRUCT {
+    char sFileID[14];
+    uint32_t uiVersion;
+    uint32_t uiByteOrder;   /* SER_INDEX_BYTE_ORDER */
+    uint32_t uiWarnings;    /* Movie warnings */
+    uint64_t ulMovieSize;   /* Size of the movie file */
+    int64_t lMovieMTime;    /* Modification time of the movie file (ns) */
+    SERHeader movieHeader;  /* Movie header (in host byte order) */
+    SERIndexSection sections[SER_INDEX_SECTIONS];
+} SERIndexHeader;
+
 #ifndef __GNUC__
 #pragma pack(pop)
 #endif
 
+/* I/O counters, times are in nanoseconds */
+typedef struct {
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t reads;
+    uint64_t seeks;
+    uint64_t writes;
+    uint64_t read_time;
+    uint64_t convert_time;
+    uint64_t write_time;
+} SERIOStats;
+
+typedef struct {
+    SERIOStats phases[SER_STATS_PHASES];
+    SERIOStats total;
+} SERMovieStats;
+
+/* Statistics of a frame, stored in SER_INDEX_FRAME_STATS sections */
+typedef struct {
+    uint32_t min;
+    uint32_t max;
+    double mean;
+    double stddev;
+    uint64_t saturated;
+} SERFrameStats;
+
+typedef struct SERFramePool SERFramePool;
+typedef struct SERFrameIterator SERFrameIterator;
+typedef struct SERArchive SERArchive;
+typedef struct SERDateIndex SERDateIndex;
+typedef struct SERArchiveWriter SERArchiveWriter;
+typedef struct SERMovieIndex SERMovieIndex;
+
 typedef struct {
     char *filepath;
     FILE *file;
-    size_t filesize;
+    uint64_t filesize;
     SERHeader *header;
     uint32_t duration;
     uint64_t firstFrameDate;
     uint64_t lastFrameDate;
     int warnings;
     int invert_endianness;
+    /* Read-only mapping of the whole movie file (see SEROpenMovieMapped),
+     * NULL if the movie has been opened without mapping. */
+    void *mapped_data;
+    size_t mapped_size;
+    /* Frame timestamps read from movie's trailer (in host byte order).
+     * They're loaded once, the first time they're needed. */
+    uint64_t *frame_dates;
+    uint32_t frame_dates_count;
+    int frame_dates_loaded;
+    /* Frames sorted by date, used by SERFindFrameByTime. It's built when
+     * the movie gets opened. */
+    SERDateIndex *date_index;
+    /* Released frames kept for reuse by SERGetFrame */
+    SERFramePool *frame_pool;
+    /* Index of compressed movies, NULL for plain SER movies. Compressed
+     * movies are read as if they were the original movie: `filesize` is
+     * the size of the original movie and frames get decoded on read. */
+    SERArchive *archive;
+    /* I/O statistics, NULL unless enabled (see SERGetMovieStats) */
+    SERMovieStats *stats;
+    int stats_phase;
+    /* Drop file data from the page cache after reading it (see
+     * SER_ACCESS_NOREUSE) */
+    int noreuse;
+    /* Set while the movie file is still being written (see
+     * SERFollowMovie) */
+    int following;
+    /* Index loaded from the index file of the movie (frame dates can be
+     * read from its mapping) and sections to be saved by
+     * SERSaveMovieIndex, NULL if none */
+    SERMovieIndex *index;
 } SERMovie;
 
 typedef union {
@@ -153,28 +346,97 @@ typedef struct {
     uint32_t height;
     size_t size;
     void *data;
+    SERFramePool *pool; /* Pool the frame will be returned to on release */
 } SERFrame;
 
+/* Thread safety: once a movie has been opened (and until it gets closed),
+ * frames and dates can be read concurrently from different threads by
+ * using the same SERMovie, since SERGetFrame*, SERGetFramePixels* and
+ * SERGetFrameDate* functions use positional reads and don't store any
+ * per-call state into the movie. Frames taken from the same movie can be
+ * released from any thread.
+ * Opening, closing, SERAdviseMovieAccess, SERFollowMovie,
+ * SERRefreshMovie and changes to SERMovie fields
+ * (ie. invert_endianness) must not happen while other threads are using
+ * the movie. */
 SERMovie   *SEROpenMovie(char *filepath);
+SERMovie   *SEROpenMovieMapped(char *filepath);
+int         SERAdviseMovieAccess(SERMovie *movie, int access);
+int         SERFollowMovie(SERMovie *movie);
+long        SERRefreshMovie(SERMovie *movie);
 void        SERCloseMovie(SERMovie *movie);
 uint64_t    SERGetFrameDate(SERMovie *movie, long idx);
+const uint64_t *SERGetFrameDates(SERMovie *movie, uint32_t *count);
 uint64_t    SERGetFirstFrameDate(SERMovie *movie);
 uint64_t    SERGetLastFrameDate(SERMovie *movie);
+long        SERFindFrameByTime(SERMovie *movie, uint64_t datetime);
+long        SERFindLastFrameByTime(SERMovie *movie, uint64_t datetime);
+uint32_t    SERCountOrderedFrameDates(SERMovie *movie);
 int         SERGetNumberOfPlanes(SERHeader *header);
 int         SERGetBytesPerPixel(SERHeader *header);
 size_t      SERGetFrameSize(SERHeader *header);
-long        SERGetFrameOffset(SERHeader *header, int frame_idx);
-long        SERGetTrailerOffset(SERHeader *header);
+uint64_t    SERGetFrameOffset(SERHeader *header, uint32_t frame_idx);
+uint64_t    SERGetTrailerOffset(SERHeader *header);
 SERFrame   *SERGetFrame(SERMovie *movie, uint32_t frame_idx);
+int         SERGetFramePartInto(SERMovie *movie, uint32_t frame_idx,
+                                size_t offset, size_t size, void *buf);
+int         SERGetFrameROI(SERMovie *movie, uint32_t frame_idx,
+                           uint32_t x, uint32_t y, uint32_t width,
+                           uint32_t height, void *dst);
+int         SERGetFrameView(SERMovie *movie, uint32_t frame_idx,
+                            SERFrame *frame);
+int         SERGetFrameInto(SERMovie *movie, uint32_t frame_idx, void *buf,
+                            size_t bufsize);
 int         SERGetFramePixel(SERMovie * movie, SERFrame *frame,
                              uint32_t x, uint32_t y, int big_endian,
                              SERPixelValue *value);
 void       *SERGetFramePixels(SERMovie *movie, uint32_t frame_idx,
                               int big_endian, size_t *sz);
+int         SERGetFramePixelsInto(SERMovie *movie, uint32_t frame_idx,
+                                  int big_endian, void *dst, size_t dstsize);
+int         SERReadFrames(SERMovie *movie, uint32_t from, uint32_t count,
+                          int layout, int big_endian, void *dst,
+                          size_t dst_stride);
+void        SERConvertFramePixels(SERMovie *movie, const void *src, void *dst,
+                                  size_t size, int big_endian);
+int         SERCanDebayer(SERMovie *movie);
+size_t      SERGetFrameRGBSize(SERHeader *header);
+void       *SERGetFrameRGB(SERMovie *movie, uint32_t frame_idx, int method,
+                           int big_endian, size_t *sz);
+int         SERGetFrameRGBInto(SERMovie *movie, uint32_t frame_idx,
+                               int method, int big_endian, void *dst,
+                               size_t dstsize);
+int         SERDebayerFramePixels(SERMovie *movie, const void *pixels,
+                                  void *dst, int method, int big_endian);
 void        SERReleaseFrame(SERFrame *frame);
+SERFrameIterator *SERFrameIteratorBegin(SERMovie *movie, uint32_t from,
+                                        uint32_t count, uint32_t stride,
+                                        int depth);
+const SERFrame   *SERFrameIteratorNext(SERFrameIterator *iterator);
+int               SERFrameIteratorEnd(SERFrameIterator *iterator);
+int         SERReadMovieData(SERMovie *movie, void *buf, size_t size,
+                             uint64_t offset);
+uint64_t    SERGetCompressedSize(SERMovie *movie);
+SERArchiveWriter *SERArchiveWriterBegin(SERMovie *movie, FILE *out);
+uint32_t          SERArchiveWriterGetFrameCount(SERArchiveWriter *writer);
+int               SERArchiveWriterAddFrame(SERArchiveWriter *writer,
+                                           const void *frame);
+int               SERArchiveWriterEnd(SERArchiveWriter *writer);
+const void *SERGetMovieIndexSection(SERMovie *movie, int section,
+                                    size_t *size);
+int         SERSetMovieIndexSection(SERMovie *movie, int section,
+                                    const void *data, size_t size);
+int         SERSaveMovieIndex(SERMovie *movie);
+int         SEREnableMovieStats(SERMovie *movie);
+void        SERSetMovieStatsPhase(SERMovie *movie, int phase);
+uint64_t    SERMovieStatsClock(SERMovie *movie);
+void        SERRecordMovieStats(SERMovie *movie, int op, uint64_t calls,
+                                size_t bytes, uint64_t start);
+int         SERGetMovieStats(SERMovie *movie, SERMovieStats *stats);
 SERHeader  *SERDuplicateHeader(SERHeader *srcheader);
 int         SERCountMovieWarnings(int warnings);
 char       *SERGetColorString(uint32_t colorID);
 time_t      SERVideoTimeToUnixtime(uint64_t video_t, uint32_t *usec);
+uint64_t    SERUnixtimeToVideoTime(time_t unixtime, uint32_t usec);
 
 #endif /* __SER_H__ */
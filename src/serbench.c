@@ -0,0 +1,648 @@
+/*
+ *  SERUtils - A command line utility for processing SER movie files
+ *  Copyright (C) 2020  Giuseppe Fabio Nicotra <artix2 at gmail dot com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Benchmark of the library and of the serutils command line utility
+ * (used by `make bench`).
+ * Synthetic movies are generated into a scratch directory, then every
+ * benchmark is run --repeat times and the fastest run is reported as a
+ * JSON object per line, so that results of different versions can be
+ * easily compared (ie. with diff or jq).
+ * Movies are read right after being written, so results are measured
+ * with a warm page cache. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "serutils.h"
+#include "simd.h"
+
+#define BENCH_DEFAULT_WIDTH     640
+#define BENCH_DEFAULT_HEIGHT    480
+#define BENCH_DEFAULT_DEPTH     16
+#define BENCH_DEFAULT_FRAMES    300
+#define BENCH_DEFAULT_REPEAT    3
+#define BENCH_DEFAULT_DIR       "/tmp/serbench"
+
+/* Max. frames of the movies used by the per-format pixel benchmarks */
+#define BENCH_PIXEL_FRAMES      100
+/* Lookups performed by date benchmarks */
+#define BENCH_DATE_LOOKUPS      1000000
+#define BENCH_TIME_LOOKUPS      100000
+#define BENCH_OPEN_COUNT        20
+#define BENCH_SPLIT_CHUNKS      4
+#define BENCH_SPLIT_MIN_FRAMES  100
+
+/* Frame interval of generated trailers (SER time units, 100ns) */
+#define BENCH_FRAME_INTERVAL    100000
+#define BENCH_FIRST_DATE        637000000000000000ULL
+
+#define BENCH_MOVIE_NAME        "bench.ser"
+#define BENCH_OUTPUT_DIR        "out"
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+    uint32_t color;
+    uint32_t frames;
+    int trailer;
+    int repeat;
+    int keep;
+    char *dir;
+    char *serutils;
+    char *label;
+} BenchConfig;
+
+typedef struct {
+    const char *name;
+    const char *format;     /* Pixel format, or NULL */
+    int big_endian;
+    uint64_t bytes;         /* Bytes processed by a single run */
+    uint64_t frames;        /* Frames processed by a single run */
+    uint64_t ops;           /* Operations (reads, lookups, ...) per run */
+    double seconds;         /* Duration of the fastest run */
+    int runs;
+} BenchResult;
+
+typedef struct {
+    char *path;
+    SERMovie *movie;
+    uint32_t *order;        /* Frame order used by random access */
+    void *buffer;
+    size_t bufsize;
+    int big_endian;
+    char **argv;            /* serutils arguments */
+    uint64_t cmd_bytes;
+    uint64_t cmd_frames;
+} BenchContext;
+
+typedef int (*BenchFunc)(BenchContext *ctx, BenchResult *res);
+
+typedef struct {
+    const char *name;
+    uint32_t color;
+    uint32_t depth;
+} PixelFormat;
+
+static PixelFormat pixel_formats[] = {
+    {"mono8", COLOR_MONO, 8},
+    {"mono16", COLOR_MONO, 16},
+    {"rggb8", COLOR_BAYER_RGGB, 8},
+    {"rggb16", COLOR_BAYER_RGGB, 16},
+    {"rgb8", COLOR_RGB, 8},
+    {"rgb16", COLOR_RGB, 16},
+    {"bgr8", COLOR_BGR, 8},
+    {"bgr16", COLOR_BGR, 16},
+};
+
+BenchConfig conf;
+
+static void initConfig() {
+    conf.width = BENCH_DEFAULT_WIDTH;
+    conf.height = BENCH_DEFAULT_HEIGHT;
+    conf.depth = BENCH_DEFAULT_DEPTH;
+    conf.color = COLOR_MONO;
+    conf.frames = BENCH_DEFAULT_FRAMES;
+    conf.trailer = 1;
+    conf.repeat = BENCH_DEFAULT_REPEAT;
+    conf.keep = 0;
+    conf.dir = BENCH_DEFAULT_DIR;
+    conf.serutils = NULL;
+    conf.label = NULL;
+}
+
+static double getTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static uint32_t nextRandom(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return (*state = x);
+}
+
+/* Movie generator */
+
+/* Write a synthetic SER movie at `path`. Frames contain a gradient with
+ * some noise, so that they look a bit like real images (ie. to the
+ * compressor). Frame dates are BENCH_FRAME_INTERVAL apart. */
+static int generateMovie(char *path, uint32_t width, uint32_t height,
+    uint32_t depth, uint32_t color, uint32_t frames, int trailer)
+{
+    SERHeader header;
+    FILE *f = NULL;
+    uint8_t *frame = NULL;
+    uint32_t seed = 0x5E12u, i, x, y, c;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.sFileID, SER_FILE_ID, sizeof(header.sFileID));
+    header.uiColorID = color;
+    header.uiImageWidth = width;
+    header.uiImageHeight = height;
+    header.uiPixelDepth = depth;
+    header.uiFrameCount = frames;
+    strcpy(header.sObserver, "serbench");
+    header.ulDateTime = BENCH_FIRST_DATE;
+    header.ulDateTime_UTC = BENCH_FIRST_DATE;
+    int planes = SERGetNumberOfPlanes(&header),
+        bps = SERGetBytesPerPixel(&header) / planes;
+    size_t size = SERGetFrameSize(&header);
+    uint32_t maxval = (1u << depth) - 1;
+    frame = malloc(size);
+    if (frame == NULL) goto oom;
+    f = fopen(path, "w");
+    if (f == NULL) {
+        SERLogErr(LOG_TAG_ERR "Could not create '%s': %s\n", path,
+            strerror(errno));
+        goto fail;
+    }
+    if (fwrite(&header, sizeof(header), 1, f) != 1) goto write_err;
+    for (i = 0; i < frames; i++) {
+        uint8_t *p = frame;
+        for (y = 0; y < height; y++) {
+            for (x = 0; x < width; x++) {
+                for (c = 0; c < (uint32_t) planes; c++) {
+                    uint32_t v = ((x + y + i + c * 64) * maxval) /
+                                 (width + height + 192);
+                    v += nextRandom(&seed) % ((maxval >> 6) + 1);
+                    if (v > maxval) v = maxval;
+                    if (bps == 1) *(p++) = (uint8_t) v;
+                    else {
+                        *(p++) = (uint8_t) v;
+                        *(p++) = (uint8_t) (v >> 8);
+                    }
+                }
+            }
+        }
+        if (fwrite(frame, size, 1, f) != 1) goto write_err;
+    }
+    if (trailer) {
+        for (i = 0; i < frames; i++) {
+            uint64_t date = BENCH_FIRST_DATE +
+                ((uint64_t) i * BENCH_FRAME_INTERVAL);
+            if (IS_BIG_ENDIAN) date = __builtin_bswap64(date);
+            if (fwrite(&date, sizeof(date), 1, f) != 1) goto write_err;
+        }
+    }
+    if (fclose(f) != 0) {
+        f = NULL;
+        goto write_err;
+    }
+    free(frame);
+    return 1;
+write_err:
+    SERLogErr(LOG_TAG_ERR "Failed to write '%s': %s\n", path,
+        strerror(errno));
+    goto fail;
+oom:
+    SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+fail:
+    if (f != NULL) fclose(f);
+    if (frame != NULL) free(frame);
+    return 0;
+}
+
+/* Library benchmarks */
+
+static int benchOpen(BenchContext *ctx, BenchResult *res) {
+    int i;
+    for (i = 0; i < BENCH_OPEN_COUNT; i++) {
+        SERMovie *movie = SEROpenMovie(ctx->path);
+        if (movie == NULL) return 0;
+        res->frames += SERGetFrameCount(movie);
+        SERCloseMovie(movie);
+    }
+    res->ops = BENCH_OPEN_COUNT;
+    return 1;
+}
+
+static int readFrames(BenchContext *ctx, BenchResult *res, int random) {
+    SERMovie *movie = ctx->movie;
+    uint32_t count = SERGetFrameCount(movie), i;
+    for (i = 0; i < count; i++) {
+        uint32_t idx = (random ? ctx->order[i] : i);
+        SERFrame *frame = SERGetFrame(movie, idx);
+        if (frame == NULL) return 0;
+        res->bytes += frame->size;
+        SERReleaseFrame(frame);
+    }
+    res->frames = res->ops = count;
+    return 1;
+}
+
+static int benchFramesSequential(BenchContext *ctx, BenchResult *res) {
+    return readFrames(ctx, res, 0);
+}
+
+static int benchFramesRandom(BenchContext *ctx, BenchResult *res) {
+    return readFrames(ctx, res, 1);
+}
+
+static int benchFramePixels(BenchContext *ctx, BenchResult *res) {
+    SERMovie *movie = ctx->movie;
+    uint32_t count = SERGetFrameCount(movie), i;
+    for (i = 0; i < count; i++) {
+        if (!SERGetFramePixelsInto(movie, i, ctx->big_endian, ctx->buffer,
+            ctx->bufsize)) return 0;
+        res->bytes += ctx->bufsize;
+    }
+    res->frames = res->ops = count;
+    return 1;
+}
+
+static int benchFrameDates(BenchContext *ctx, BenchResult *res) {
+    SERMovie *movie = ctx->movie;
+    uint32_t count = SERGetFrameCount(movie), i, passes;
+    volatile uint64_t last = 0;
+    if (count == 0) return 0;
+    passes = BENCH_DATE_LOOKUPS / count;
+    if (passes == 0) passes = 1;
+    while (passes-- > 0) {
+        for (i = 0; i < count; i++) last = SERGetFrameDate(movie, i);
+        res->ops += count;
+    }
+    (void) last;
+    res->bytes = res->ops * sizeof(uint64_t);
+    res->frames = res->ops;
+    return 1;
+}
+
+static int benchFindFrameByTime(BenchContext *ctx, BenchResult *res) {
+    SERMovie *movie = ctx->movie;
+    uint32_t count = SERGetFrameCount(movie), seed = 0xDA7Eu, i;
+    uint64_t span = ((uint64_t) (count - 1) * BENCH_FRAME_INTERVAL) + 1;
+    for (i = 0; i < BENCH_TIME_LOOKUPS; i++) {
+        uint64_t t = BENCH_FIRST_DATE + (nextRandom(&seed) % span);
+        if (SERFindFrameByTime(movie, t) < 0) return 0;
+    }
+    res->frames = res->ops = BENCH_TIME_LOOKUPS;
+    return 1;
+}
+
+/* Command line benchmarks */
+
+static void cleanOutputDir() {
+    char path[PATH_MAX + 1];
+    snprintf(path, PATH_MAX, "%s/%s", conf.dir, BENCH_OUTPUT_DIR);
+    DIR *dir = opendir(path);
+    if (dir == NULL) return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        char filepath[(PATH_MAX * 2) + 2];
+        snprintf(filepath, sizeof(filepath), "%s/%s", path, entry->d_name);
+        unlink(filepath);
+    }
+    closedir(dir);
+}
+
+static int benchCommand(BenchContext *ctx, BenchResult *res) {
+    int status = 0;
+    cleanOutputDir();
+    pid_t pid = fork();
+    if (pid < 0) {
+        SERLogErr(LOG_TAG_ERR "fork failed: %s\n", strerror(errno));
+        return 0;
+    }
+    if (pid == 0) {
+        int fd = open("/dev/null", O_RDWR);
+        if (fd >= 0) {
+            dup2(fd, STDIN_FILENO);
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+        }
+        execv(ctx->argv[0], ctx->argv);
+        _exit(127);
+    }
+    if (waitpid(pid, &status, 0) < 0) return 0;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        SERLogErr(LOG_TAG_ERR "'%s %s' failed (status: %d)\n", ctx->argv[0],
+            ctx->argv[1], status);
+        return 0;
+    }
+    res->bytes = ctx->cmd_bytes;
+    res->frames = ctx->cmd_frames;
+    res->ops = 1;
+    return 1;
+}
+
+/* Runner */
+
+static void printResult(BenchResult *res) {
+    double secs = res->seconds;
+    printf("{\"bench\":\"%s\"", res->name);
+    if (conf.label != NULL) printf(",\"label\":\"%s\"", conf.label);
+    printf(",\"version\":\"%s\",\"simd\":\"%s\"", SERUTILS_VERSION,
+        SIMDGetLevelName(SIMDGetLevel()));
+    if (res->format != NULL) {
+        printf(",\"format\":\"%s\",\"big_endian\":%d", res->format,
+            res->big_endian);
+    } else {
+        printf(",\"color\":\"%s\",\"depth\":%u",
+            SERGetColorString(conf.color), conf.depth);
+    }
+    printf(",\"width\":%u,\"height\":%u,\"trailer\":%d,\"runs\":%d",
+        conf.width, conf.height, conf.trailer, res->runs);
+    printf(",\"frames\":%llu,\"bytes\":%llu,\"ops\":%llu,\"seconds\":%.6f",
+        (unsigned long long) res->frames, (unsigned long long) res->bytes,
+        (unsigned long long) res->ops, secs);
+    if (secs <= 0) secs = 1e-9;
+    printf(",\"mb_s\":%.2f,\"frames_s\":%.1f,\"ops_s\":%.1f}\n",
+        (res->bytes / (1024.0 * 1024.0)) / secs, res->frames / secs,
+        res->ops / secs);
+    fflush(stdout);
+}
+
+/* Run `func` conf.repeat times and print the fastest run */
+static int runBench(const char *name, BenchFunc func, BenchContext *ctx,
+    const char *format)
+{
+    BenchResult best;
+    int i;
+    memset(&best, 0, sizeof(best));
+    for (i = 0; i < conf.repeat; i++) {
+        BenchResult res;
+        memset(&res, 0, sizeof(res));
+        double start = getTime();
+        if (!func(ctx, &res)) {
+            SERLogErr(LOG_TAG_ERR "Benchmark '%s' failed\n", name);
+            return 0;
+        }
+        res.seconds = getTime() - start;
+        if (i == 0 || res.seconds < best.seconds) best = res;
+    }
+    best.name = name;
+    best.format = format;
+    best.big_endian = ctx->big_endian;
+    best.runs = conf.repeat;
+    printResult(&best);
+    return 1;
+}
+
+static int runLibraryBenchmarks(char *path) {
+    BenchContext ctx;
+    uint32_t seed = 0xF4A3Eu, i;
+    int ok = 0;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.path = path;
+    if (!runBench("open", benchOpen, &ctx, NULL)) return 0;
+    ctx.movie = SEROpenMovie(path);
+    if (ctx.movie == NULL) return 0;
+    uint32_t count = SERGetFrameCount(ctx.movie);
+    ctx.order = malloc(count * sizeof(uint32_t));
+    if (ctx.order == NULL) goto oom;
+    for (i = 0; i < count; i++) ctx.order[i] = i;
+    for (i = count; i > 1; i--) {
+        uint32_t j = nextRandom(&seed) % i, tmp = ctx.order[i - 1];
+        ctx.order[i - 1] = ctx.order[j];
+        ctx.order[j] = tmp;
+    }
+    if (!runBench("get_frame_seq", benchFramesSequential, &ctx, NULL) ||
+        !runBench("get_frame_random", benchFramesRandom, &ctx, NULL))
+        goto cleanup;
+    if (conf.trailer) {
+        if (!runBench("get_frame_date", benchFrameDates, &ctx, NULL) ||
+            !runBench("find_frame_by_time", benchFindFrameByTime, &ctx,
+                NULL)) goto cleanup;
+    }
+    ok = 1;
+    goto cleanup;
+oom:
+    SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+cleanup:
+    if (ctx.order != NULL) free(ctx.order);
+    SERCloseMovie(ctx.movie);
+    return ok;
+}
+
+static int runPixelBenchmarks() {
+    char path[PATH_MAX + 1];
+    size_t nformats = sizeof(pixel_formats) / sizeof(PixelFormat), i;
+    uint32_t frames = conf.frames;
+    if (frames > BENCH_PIXEL_FRAMES) frames = BENCH_PIXEL_FRAMES;
+    for (i = 0; i < nformats; i++) {
+        PixelFormat *fmt = pixel_formats + i;
+        BenchContext ctx;
+        int ok = 1, big_endian;
+        memset(&ctx, 0, sizeof(ctx));
+        snprintf(path, PATH_MAX, "%s/bench-%s.ser", conf.dir, fmt->name);
+        if (!generateMovie(path, conf.width, conf.height, fmt->depth,
+            fmt->color, frames, 0)) return 0;
+        ctx.movie = SEROpenMovie(path);
+        if (ctx.movie == NULL) return 0;
+        ctx.bufsize = SERGetFrameSize(ctx.movie->header);
+        ctx.buffer = malloc(ctx.bufsize);
+        if (ctx.buffer == NULL) {
+            SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+            ok = 0;
+        }
+        /* Both output byte orders, since one of them needs swapping */
+        for (big_endian = 0; ok && big_endian <= 1; big_endian++) {
+            if (fmt->depth <= 8 && big_endian) break;
+            ctx.big_endian = big_endian;
+            ok = runBench("get_frame_pixels", benchFramePixels, &ctx,
+                fmt->name);
+        }
+        if (ctx.buffer != NULL) free(ctx.buffer);
+        SERCloseMovie(ctx.movie);
+        if (!conf.keep) unlink(path);
+        if (!ok) return 0;
+    }
+    return 1;
+}
+
+static int runCommandBenchmark(const char *name, char *path, char *action,
+    char *value, uint32_t frames)
+{
+    char outdir[PATH_MAX + 1];
+    BenchContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    snprintf(outdir, PATH_MAX, "%s/%s/", conf.dir, BENCH_OUTPUT_DIR);
+    char *argv[] = {conf.serutils, action, value, "--overwrite",
+        "--no-colors", "-o", outdir, path, NULL};
+    if (value == NULL) {
+        /* Actions without value */
+        memmove(argv + 2, argv + 3, sizeof(argv) - 3 * sizeof(char *));
+    }
+    ctx.argv = argv;
+    ctx.cmd_frames = frames;
+    ctx.cmd_bytes = (uint64_t) frames * conf.width * conf.height *
+        (conf.color >= COLOR_RGB ? 3 : 1) * (conf.depth > 8 ? 2 : 1);
+    return runBench(name, benchCommand, &ctx, NULL);
+}
+
+static int runCommandBenchmarks(char *path) {
+    char outdir[PATH_MAX + 1], half[32];
+    uint32_t frames = conf.frames, half_count = frames / 2;
+    if (half_count == 0) half_count = 1;
+    snprintf(outdir, PATH_MAX, "%s/%s", conf.dir, BENCH_OUTPUT_DIR);
+    if (mkdir(outdir, 0755) != 0 && errno != EEXIST) {
+        SERLogErr(LOG_TAG_ERR "Could not create '%s': %s\n", outdir,
+            strerror(errno));
+        return 0;
+    }
+    snprintf(half, sizeof(half), "1,%u", half_count);
+    int ok = runCommandBenchmark("extract", path, "--extract", half,
+                                 half_count) &&
+             runCommandBenchmark("save_frame", path, "--save-frame", "1", 1) &&
+             runCommandBenchmark("compress", path, "--compress", NULL,
+                                 frames);
+    /* Cut and split need frame dates in order to update movie dates */
+    if (ok && !conf.trailer) {
+        fprintf(stderr, "Skipping cut and split: movie has no trailer\n");
+        goto done;
+    }
+    if (ok) {
+        ok = runCommandBenchmark("cut", path, "--cut", half,
+                                 frames - half_count);
+    }
+    /* serutils needs at least BENCH_SPLIT_MIN_FRAMES frames per chunk */
+    uint32_t chunks = frames / BENCH_SPLIT_MIN_FRAMES;
+    if (chunks > BENCH_SPLIT_CHUNKS) chunks = BENCH_SPLIT_CHUNKS;
+    if (ok && chunks >= 2) {
+        char split[32];
+        snprintf(split, sizeof(split), "%u", chunks);
+        ok = runCommandBenchmark("split", path, "--split", split, frames);
+    } else if (ok) {
+        fprintf(stderr, "Skipping split: at least %d frames needed\n",
+            BENCH_SPLIT_MIN_FRAMES * 2);
+    }
+done:
+    cleanOutputDir();
+    if (!conf.keep) rmdir(outdir);
+    return ok;
+}
+
+static void printHelp(char **argv) {
+    fprintf(stderr, "serbench v%s\n\n", SERUTILS_VERSION);
+    fprintf(stderr, "Usage: %s [OPTIONS]\n\n", argv[0]);
+    fprintf(stderr, "OPTIONS:\n\n");
+    fprintf(stderr, "   --width WIDTH         Frame width (default: %d)\n",
+        BENCH_DEFAULT_WIDTH);
+    fprintf(stderr, "   --height HEIGHT       Frame height (default: %d)\n",
+        BENCH_DEFAULT_HEIGHT);
+    fprintf(stderr, "   --depth DEPTH         Pixel depth, 1-16 (default: "
+                                              "%d)\n", BENCH_DEFAULT_DEPTH);
+    fprintf(stderr, "   --color COLOR_ID      SER color ID (default: %d, "
+                                              "mono)\n", COLOR_MONO);
+    fprintf(stderr, "   --frames FRAMES       Frame count (default: %d)\n",
+        BENCH_DEFAULT_FRAMES);
+    fprintf(stderr, "   --no-trailer          Don't write frame dates\n");
+    fprintf(stderr, "   --repeat N            Runs per benchmark, the "
+                                              "fastest is reported\n"
+                    "                         (default: %d)\n",
+                    BENCH_DEFAULT_REPEAT);
+    fprintf(stderr, "   --dir DIR             Scratch directory (default: "
+                                              BENCH_DEFAULT_DIR ")\n");
+    fprintf(stderr, "   --serutils PATH       serutils binary used by "
+                                              "command line benchmarks\n"
+                    "                         (skipped if omitted)\n");
+    fprintf(stderr, "   --label LABEL         Label added to every result\n");
+    fprintf(stderr, "   --keep                Keep generated files\n");
+    fprintf(stderr, "   --generate PATH       Just write a synthetic movie "
+                                              "to PATH\n");
+    fprintf(stderr, "   -h, --help            Print this help\n\n");
+    fprintf(stderr, "Results are printed to stdout as JSON lines.\n\n");
+}
+
+static int parseUInt(char *val, uint32_t *dst) {
+    char *end = NULL;
+    unsigned long n = strtoul(val, &end, 10);
+    if (end == val || *end != '\0' || n > UINT32_MAX) return 0;
+    *dst = (uint32_t) n;
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    char *generate_path = NULL, path[PATH_MAX + 1];
+    int i;
+    initConfig();
+    for (i = 1; i < argc; i++) {
+        char *arg = argv[i], *val = (i < argc - 1 ? argv[i + 1] : NULL);
+        uint32_t n = 0;
+        int has_val = 1;
+        if (strcmp("-h", arg) == 0 || strcmp("--help", arg) == 0) {
+            printHelp(argv);
+            return 0;
+        } else if (strcmp("--no-trailer", arg) == 0) {
+            conf.trailer = 0;
+            has_val = 0;
+        } else if (strcmp("--keep", arg) == 0) {
+            conf.keep = 1;
+            has_val = 0;
+        } else if (val == NULL) {
+            fprintf(stderr, "Invalid or incomplete option `%s`\n", arg);
+            return 1;
+        } else if (strcmp("--dir", arg) == 0) conf.dir = val;
+        else if (strcmp("--serutils", arg) == 0) conf.serutils = val;
+        else if (strcmp("--label", arg) == 0) conf.label = val;
+        else if (strcmp("--generate", arg) == 0) generate_path = val;
+        else if (!parseUInt(val, &n)) {
+            fprintf(stderr, "Invalid value for `%s`: %s\n", arg, val);
+            return 1;
+        } else if (strcmp("--width", arg) == 0) conf.width = n;
+        else if (strcmp("--height", arg) == 0) conf.height = n;
+        else if (strcmp("--depth", arg) == 0) conf.depth = n;
+        else if (strcmp("--color", arg) == 0) conf.color = n;
+        else if (strcmp("--frames", arg) == 0) conf.frames = n;
+        else if (strcmp("--repeat", arg) == 0) conf.repeat = (int) n;
+        else {
+            fprintf(stderr, "Unknown option `%s`\n", arg);
+            return 1;
+        }
+        if (has_val) i++;
+    }
+    if (conf.width == 0 || conf.height == 0 || conf.frames == 0 ||
+        conf.depth == 0 || conf.depth > 16 || conf.repeat <= 0)
+    {
+        fprintf(stderr, "Invalid movie geometry or repeat count\n");
+        return 1;
+    }
+    if (generate_path != NULL) {
+        return !generateMovie(generate_path, conf.width, conf.height,
+            conf.depth, conf.color, conf.frames, conf.trailer);
+    }
+    if (mkdir(conf.dir, 0755) != 0 && errno != EEXIST) {
+        SERLogErr(LOG_TAG_ERR "Could not create '%s': %s\n", conf.dir,
+            strerror(errno));
+        return 1;
+    }
+    snprintf(path, PATH_MAX, "%s/%s", conf.dir, BENCH_MOVIE_NAME);
+    double start = getTime();
+    if (!generateMovie(path, conf.width, conf.height, conf.depth,
+        conf.color, conf.frames, conf.trailer)) return 1;
+    /* Progress goes to stderr, stdout only gets results */
+    fprintf(stderr, "Generated %s in %.2f sec.\n", path, getTime() - start);
+    int ok = runLibraryBenchmarks(path) && runPixelBenchmarks();
+    if (ok && conf.serutils != NULL) ok = runCommandBenchmarks(path);
+    if (!conf.keep) unlink(path);
+    return (ok ? 0 : 1);
+}
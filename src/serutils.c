@@ -22,12 +22,32 @@
 #include <string.h>
 #include <time.h>
 #include <assert.h>
+#include <math.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/errno.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <sys/sendfile.h>
+#include <sys/inotify.h>
+#endif
 #include "log.h"
 #include "ser.h"
 #include "fits.h"
+#include "simd.h"
+#include "directio.h"
+#include "hash.h"
+
+#if IS_UNIX
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#endif
 
 #define ACTION_NONE         0
 #define ACTION_EXTRACT      1
@@ -35,18 +55,81 @@
 #define ACTION_SPLIT        3
 #define ACTION_SAVE_FRAME   4
 #define ACTION_FIX          5
+#define ACTION_UNDO_FIX     6
+#define ACTION_SCORE        7
+#define ACTION_STATS        8
+#define ACTION_SAVE_FRAMES  9
+#define ACTION_SAVE_CUBE    10
+#define ACTION_STACK        11
+#define ACTION_COMPRESS     12
+#define ACTION_DECOMPRESS   13
+#define ACTION_JOIN         14
+#define ACTION_BIN          15
+
+#define STATS_HISTOGRAM_BUCKETS 16
+#define STATS_HISTOGRAM_BAR_LEN 40
 
 #define SPLIT_MODE_COUNT    1
 #define SPLIT_MODE_FRAMES   2
 #define SPLIT_MODE_SECS     3
 
-#define MAX_SPLIT_COUNT             50
 #define MIN_SPLIT_FRAMES_PER_CHUNCK 100
+#define MAX_SPLIT_JOBS              4
+
+#define MAX_SCORE_JOBS              64
+#define SCORE_PROGRESS_STEP         32
+/* --follow: max. wait between movie refreshes (milliseconds), and time
+ * without new frames after which movies stop being followed (seconds) */
+#define FOLLOW_POLL_INTERVAL        500
+#define FOLLOW_IDLE_TIMEOUT         60
+/* --crop-track: margin searched around the crop region, in percent of
+ * the region size */
+#define CROP_TRACK_MARGIN           50
+/* --deep-check: intervals between frame dates greater than the median
+ * interval times DEEP_CHECK_GAP_FACTOR are reported as gaps (dropped
+ * frames). At most DEEP_CHECK_MAX_LISTED frames of every kind are
+ * listed in the console output (every frame is listed in JSON). */
+#define DEEP_CHECK_GAP_FACTOR       1.5
+#define DEEP_CHECK_MAX_LISTED       10
+#define DEEP_CHECK_NO_DUPLICATE     UINT32_MAX
+
+#define BIN_MAX_FACTOR              8
+#define BIN_DEFAULT_GAMMA           1.0
+
+#define STACK_METHOD_MEAN           1
+#define STACK_METHOD_MEDIAN         2
+#define STACK_METHOD_SIGMA_CLIP     3
+
+#define MAX_STACK_JOBS              16
+/* Max. memory used by every stacking thread for the tile it's processing */
+#define STACK_TILE_MAX_BYTES        (16 * SIZE_MB)
+/* 32-bit accumulators can't overflow before 65537 16-bit samples */
+#define STACK_FLUSH_FRAMES          65536
+#define STACK_CLIP_ITERATIONS       5
+#define STACK_DEFAULT_CLIP_SIGMA    3.0
+
+#define CUBE_TABLE_ROW_SIZE         (4 + 8 + FITS_DATE_LEN)
+#define CUBE_TABLE_ROWS_PER_WRITE   256
+#define CUBE_PROGRESS_STEP          64
+
+#define BATCH_SUMMARY_FILENAME      "serutils-batch-summary.json"
+
+#define FIX_JOURNAL_SUFFIX          ".fix-journal"
+#define FIX_JOURNAL_MAGIC           "SERFIXJ1"
+
+/* Frame dates are expressed in 100 nanoseconds units */
+#define FRAME_DATE_UNITS_PER_SEC    10000000
 
 #define SIZE_KB 1024
 #define SIZE_MB (SIZE_KB * 1024)
 #define SIZE_GB (SIZE_MB * 1024)
 
+/* Size of the buffer used to copy frames when the system cannot copy them
+ * directly between files, and max. size of every single copy step
+ * (progress is reported after every step). */
+#define COPY_BUFFER_SIZE    (8 * SIZE_MB)
+#define COPY_STEP_SIZE      (64 * SIZE_MB)
+
 #define BREAK_FRAMES        1
 #define BREAK_DATES         2
 #define BREAK_DATE_ORDER    3
@@ -73,6 +156,71 @@ typedef struct {
     uint32_t count;
 } SERFrameRange;
 
+typedef struct {
+    uint32_t done;
+    uint32_t tot;
+    pthread_mutex_t *lock; /* Used if shared between multiple threads */
+    uint64_t bytes;        /* Bytes written so far */
+} CopyProgress;
+
+/* Frame statistics are cached by movie indexes (see --index) as they are */
+typedef SERFrameStats FrameStats;
+
+/* Statistics of the whole movie, computed by --stats */
+typedef struct {
+    int planes;
+    int depth;              /* Native depth used for the histogram */
+    uint32_t bins;          /* Histogram bins per channel (2^depth) */
+    uint32_t saturation;    /* Min. value considered as saturated */
+    uint32_t frame_count;   /* Number of complete frames */
+    FrameStats *frames;
+    uint64_t *histogram;    /* `planes` histograms of `bins` counters */
+} MovieStats;
+
+/* Gap between frame dates found by --deep-check */
+typedef struct {
+    uint32_t frame;         /* First frame after the gap */
+    uint64_t interval;      /* Distance from the previous frame */
+    uint32_t dropped;       /* Estimated number of dropped frames */
+} FrameGap;
+
+/* Results of --deep-check. Frames are indexed from 0, but they're
+ * numbered from 1 in the output (as in FRAME_RANGE). */
+typedef struct {
+    uint32_t frames;            /* Number of complete frames */
+    uint32_t declared_frames;   /* Frame count of the header */
+    uint64_t *hashes;           /* XXH64 hash of every frame */
+    uint32_t *duplicate_of;     /* Earlier frame with the same hash, or
+                                   DEEP_CHECK_NO_DUPLICATE */
+    uint8_t *zero;              /* Frames whose bytes are all zero */
+    uint32_t duplicates;
+    uint32_t zeros;
+    uint64_t median_interval;   /* Median interval between frame dates */
+    uint32_t gap_count;
+    FrameGap *gaps;
+} DeepCheck;
+
+/* Result of a movie processed in batch mode, sent by worker processes
+ * to the main process. */
+typedef struct {
+    int opened;
+    int warnings;
+    uint32_t frames;
+} BatchResult;
+
+typedef struct {
+    char *path;
+    char log_path[PATH_MAX + 1];
+    pid_t pid;
+    int result_fd;
+    int exit_code;
+    int done;
+    double elapsed;
+    struct timespec start;
+    BatchResult result;
+    char name_tag[16];  /* Appended to output and log names, if needed */
+} BatchItem;
+
 typedef struct {
     int year;
     int month;
@@ -85,10 +233,20 @@ typedef struct {
     char *image_info;
 } WinJUPOSInfo;
 
+/* Bound of a FRAME_RANGE given as UTC times */
+typedef struct {
+    int has_date;
+    time_t seconds;     /* Unix time, or seconds since midnight */
+    uint32_t usec;
+} TimeArgument;
+
 typedef struct {
     int frames_from;
     int frames_to;
     int frames_count;
+    int use_time_range;
+    TimeArgument time_from;
+    TimeArgument time_to;
     int split_amount;
     int split_mode;
     int action;
@@ -97,19 +255,55 @@ typedef struct {
     int log_to_json;
     int use_winjupos_filename;
     int do_check;
+    int deep_check;
     int overwrite;
     int break_movie; /* Used for tests */
     int save_frame_id;
     int image_format;
+    int debayer_method;
+    int stack_method;
+    double clip_sigma;
     int invert_endianness;
+    int jobs;
+    int fix_in_place;
+    int profile;
+    int direct_io;
+    int follow;
+    uint32_t keep_best;
+    int keep_best_percent;
+    uint32_t roi_x;
+    uint32_t roi_y;
+    uint32_t roi_width;
+    uint32_t roi_height;
+    uint32_t crop_x;
+    uint32_t crop_y;
+    uint32_t crop_width;
+    uint32_t crop_height;
+    int crop_track;
+    int bin_factor;
+    int bin_sum;
+    int bin_8bit;
+    double bin_gamma;
+    int save_index;
 } MainConfig;
 
 /* Globals */
 
 MainConfig conf;
-SERFrameRange splitRanges[MAX_SPLIT_COUNT] = {0};
+SERFrameRange *splitRanges = NULL;
 uint32_t split_count = 0;
 char output_movie_path[PATH_MAX + 1] = {0};
+char *copy_buffer = NULL;
+double *frame_scores = NULL;
+MovieStats *movie_stats = NULL;
+DeepCheck *deep_check = NULL;
+/* Movie whose I/O statistics also account writes of the current action
+ * (--profile) */
+SERMovie *stats_movie = NULL;
+/* Appended to the name of every file written for the current movie, so
+ * that movies having the same name don't overwrite each other's files in
+ * batch mode */
+char *output_name_tag = NULL;
 char *warn_messages[] = {
     WARN_FILESIZE_MISMATCH_MSG,
     WARN_INCOMPLETE_FRAMES_MSG,
@@ -123,10 +317,31 @@ char *image_formats[] = {
     "fits"
 };
 
+/* Indexed by SER_STATS_PHASE_* */
+char *profile_phases[] = {"open", "check", "copy", "trailer"};
+
+/* Indexed by STACK_METHOD_* */
+char *stack_methods[] = {
+    NULL,
+    "mean",
+    "median",
+    "sigma-clip"
+};
+
+/* Indexed by SER_DEBAYER_* */
+char *debayer_methods[] = {
+    NULL,
+    "bilinear",
+    "edge-aware"
+};
+
 
 /* Forward declarations */
 
 static void printMovieWarnings(SERMovie *movie);
+static int deepCheckMovie(SERMovie *movie, uint32_t *issues);
+static void logDeepCheckToJSON(FILE *json_file, DeepCheck *check);
+static int getWorkerJobs(void);
 
 /* Utils */
 
@@ -223,7 +438,7 @@ static size_t getElapsedTimeStr(char *dest, size_t max_size, time_t sec) {
     return len;
 }
 
-static size_t getFilesizeStr(char *dest, size_t max_size, long bytes) {
+static size_t getFilesizeStr(char *dest, size_t max_size, uint64_t bytes) {
     size_t len = 0;
     *dest = '\0';
     float fsize = 0;
@@ -276,6 +491,7 @@ static int makeFilepath(char *dstfilepath, char *original_path, char *dir,
     strcpy(dstfilepath, dir);
     if (!has_sep) strcat(dstfilepath, "/");
     strncat(dstfilepath, fname, fstem_len);
+    if (output_name_tag != NULL) strcat(dstfilepath, output_name_tag);
     if (suffix != NULL) strcat(dstfilepath, suffix);
     if (ext != NULL) {
         if (!ext_has_dot) strcat(dstfilepath, ".");
@@ -473,11 +689,24 @@ static int makeMovieOutputPath(char *output_path, SERMovie *movie,
         }
     }
     if (!using_wjupos && range != NULL && conf.break_movie == 0 && !do_fix) {
-        char *fmt = (conf.action == ACTION_CUT ? "-%d-%d-cut" : "-%d-%d");
+        char *fmt = (conf.action == ACTION_CUT ? "-%d-%d-cut" :
+                     (conf.crop_width > 0 ? "-%d-%d-crop" : "-%d-%d"));
         sprintf(suffix_buffer, fmt, range->from + 1, range->to + 1);
         suffix = suffix_buffer;
     } else if (do_fix) {
         suffix = "-fixed";
+    } else if (!using_wjupos && conf.action == ACTION_JOIN) {
+        suffix = "-joined";
+    } else if (!using_wjupos && conf.action == ACTION_BIN) {
+        if (conf.bin_factor > 1) {
+            sprintf(suffix_buffer, "-bin%d%s", conf.bin_factor,
+                (conf.bin_8bit ? "-8bit" : ""));
+        } else strcpy(suffix_buffer, "-8bit");
+        suffix = suffix_buffer;
+    } else if (!using_wjupos && conf.action == ACTION_SCORE) {
+        sprintf(suffix_buffer, "-best%u%s", conf.keep_best,
+            (conf.keep_best_percent ? "pct" : ""));
+        suffix = suffix_buffer;
     } else if (conf.break_movie > 0) {
         switch (conf.break_movie) {
         case BREAK_FRAMES:
@@ -505,6 +734,47 @@ static int makeMovieOutputPath(char *output_path, SERMovie *movie,
     return 1;
 }
 
+/* Seconds of a frame date, with the same precision used by split
+ * ranges. */
+static time_t getFrameSeconds(uint64_t datetime) {
+    return SERVideoTimeToUnixtime(datetime, NULL);
+}
+
+/* Get the number of leading frames whose dates can be used to split the
+ * movie by seconds: dates must be valid and their seconds must never go
+ * backwards. */
+static uint32_t getSplitDatesCount(SERMovie *movie) {
+    uint32_t dates_count = 0, frame_count = SERGetFrameCount(movie),
+             count = SERCountOrderedFrameDates(movie);
+    const uint64_t *dates = SERGetFrameDates(movie, &dates_count);
+    if (dates == NULL) return 0;
+    if (dates_count > frame_count) dates_count = frame_count;
+    if (count > dates_count) count = dates_count;
+    if (count > 0 && getFrameSeconds(dates[0]) <= 0) return 0;
+    /* Dates going backwards by less than a second are still fine */
+    while (count < dates_count && dates[count] != 0 &&
+           (count == 0 ||
+            getFrameSeconds(dates[count]) >= getFrameSeconds(dates[count - 1])))
+        count++;
+    return count;
+}
+
+/* Index of the first frame in `from` - `to - 1`, whose date is at least
+ * `seconds` (Unixtime), or `to` if there's no such frame. Dates must be
+ * in order. */
+static uint32_t findFrameBySeconds(const uint64_t *dates, uint32_t from,
+    uint32_t to, time_t seconds)
+{
+    uint32_t lo = from, hi = to;
+    if (lo > hi) return to;
+    while (lo < hi) {
+        uint32_t mid = lo + ((hi - lo) / 2);
+        if (getFrameSeconds(dates[mid]) < seconds) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
 static int determineSplitRanges(SERMovie *movie) {
     assert(movie->header != NULL);
     char *err = NULL;
@@ -512,7 +782,7 @@ static int determineSplitRanges(SERMovie *movie) {
     uint32_t frames_to_add = SERGetFrameCount(movie),
              frames_added = 0, ranges_added = 0, last_frame_added = 0,
              last_movie_frame = SERGetLastFrameIndex(movie), i;
-    time_t chuncks_duration[MAX_SPLIT_COUNT] = {0};
+    time_t *chuncks_duration = NULL;
     if (conf.split_amount <= 0) {
         err = "invalid value";
         goto fail;
@@ -530,9 +800,19 @@ static int determineSplitRanges(SERMovie *movie) {
         err = errmsg;
         goto fail;
     }
+    /* Every chunck needs at least MIN_SPLIT_FRAMES_PER_CHUNCK frames, so
+     * this is the max. number of chuncks (plus room for the last one). */
+    uint32_t max_ranges =
+        (SERGetFrameCount(movie) / MIN_SPLIT_FRAMES_PER_CHUNCK) + 2;
+    if (splitRanges != NULL) free(splitRanges);
+    splitRanges = calloc(max_ranges, sizeof(*splitRanges));
+    chuncks_duration = calloc(max_ranges, sizeof(*chuncks_duration));
+    if (splitRanges == NULL || chuncks_duration == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
     if (conf.split_mode == SPLIT_MODE_COUNT) {
         split_count = conf.split_amount;
-        if (split_count > MAX_SPLIT_COUNT) goto max_split_count_exceeded;
         uint32_t frames_per_movie = SERGetFrameCount(movie) / split_count,
                  frames_added = 0, ranges_added = 0;
         if (frames_per_movie < MIN_SPLIT_FRAMES_PER_CHUNCK) {
@@ -594,65 +874,67 @@ static int determineSplitRanges(SERMovie *movie) {
             updateRangeCount(range);
             frames_added += range->count;
             last_frame_added = range->to;
-            if (++ranges_added > MAX_SPLIT_COUNT) {
-                split_count = ranges_added;
-                goto max_split_count_exceeded;
-            }
+            ranges_added++;
+            assert(ranges_added < max_ranges);
         }
         split_count = ranges_added;
     } else if (conf.split_mode == SPLIT_MODE_SECS) {
         err = NULL;
-        time_t previous_t = 0, elapsed_t = 0,
+        time_t elapsed_t = 0,
                max_t = (time_t) conf.split_amount,
                min_t = ((time_t) conf.split_amount) / 10;
+        uint32_t dates_count = 0, frame_count = SERGetFrameCount(movie),
+                 valid_count = getSplitDatesCount(movie);
+        const uint64_t *dates = SERGetFrameDates(movie, &dates_count);
         SERFrameRange *range = splitRanges;
         range->from = 0;
         range->to = 0;
         range->count = 0;
-        for (i = 0; i < SERGetFrameCount(movie); i++) {
-            uint64_t datetime = SERGetFrameDate(movie, i);
-            if (datetime == 0) goto invalid_datetime;
-            time_t frame_t = SERVideoTimeToUnixtime(datetime, NULL);
-            if (frame_t <= 0 || frame_t < previous_t) goto invalid_datetime;
-            if (i == 0) range->from = i;
-            else if (i == range->from) {
-                previous_t = frame_t;
-                continue;
-            } else if (previous_t > 0) {
-                time_t last_frame_elapsed_t = (frame_t - previous_t);
-                if (last_frame_elapsed_t > max_t) {
-                    sprintf(errmsg, "too big time lapse between frame %d and "
-                        "frame %d: %zu seconds",
-                        i, i - 1, last_frame_elapsed_t
-                    );
-                    err = errmsg;
-                    goto fail;
-                }
-                elapsed_t += last_frame_elapsed_t;
+        /* Every chunck ends at the first frame being at least `max_t`
+         * seconds after the first frame of the chunck (or at the frame
+         * before it, if it's more than `max_t` seconds after), so chuncks
+         * are found by binary search on (valid) frame dates. */
+        while (range->from < frame_count) {
+            if (range->from >= valid_count) {
+                i = range->from;
+                goto invalid_datetime;
             }
-            if (elapsed_t >= max_t) {
-                uint32_t frame_idx = i;
-                if (elapsed_t > max_t) frame_idx--;
-                range->to = frame_idx;
-                updateRangeCount(range);
-                chuncks_duration[ranges_added] = elapsed_t;
-                if (++ranges_added > MAX_SPLIT_COUNT) {
-                    split_count = ranges_added;
-                    goto max_split_count_exceeded;
-                }
-                if (range->count < MIN_SPLIT_FRAMES_PER_CHUNCK) {
-                    sprintf(errmsg, "every chunck needs at least %d frames",
-                        MIN_SPLIT_FRAMES_PER_CHUNCK);
-                    err = errmsg;
-                    goto fail;
-                }
-                range = splitRanges + ranges_added;
-                range->from = frame_idx + 1;
-                range->to = 0;
-                range->count = 0;
-                elapsed_t = 0;
+            time_t start_t = getFrameSeconds(dates[range->from]);
+            i = findFrameBySeconds(dates, range->from + 1, valid_count,
+                start_t + max_t);
+            if (i >= valid_count) {
+                if (i < frame_count) goto invalid_datetime;
+                break;
+            }
+            time_t frame_t = getFrameSeconds(dates[i]),
+                   last_frame_elapsed_t =
+                       frame_t - getFrameSeconds(dates[i - 1]);
+            if (last_frame_elapsed_t > max_t) {
+                sprintf(errmsg, "too big time lapse between frame %d and "
+                    "frame %d: %zu seconds",
+                    i, i - 1, last_frame_elapsed_t
+                );
+                err = errmsg;
+                goto fail;
             }
-            previous_t = frame_t;
+            elapsed_t = frame_t - start_t;
+            uint32_t frame_idx = i;
+            if (elapsed_t > max_t) frame_idx--;
+            range->to = frame_idx;
+            updateRangeCount(range);
+            chuncks_duration[ranges_added] = elapsed_t;
+            ranges_added++;
+            assert(ranges_added < max_ranges);
+            if (range->count < MIN_SPLIT_FRAMES_PER_CHUNCK) {
+                sprintf(errmsg, "every chunck needs at least %d frames",
+                    MIN_SPLIT_FRAMES_PER_CHUNCK);
+                err = errmsg;
+                goto fail;
+            }
+            range = splitRanges + ranges_added;
+            range->from = frame_idx + 1;
+            range->to = 0;
+            range->count = 0;
             continue;
 invalid_datetime:
             sprintf(errmsg, "invalid datetime for frame %d", i);
@@ -681,7 +963,6 @@ invalid_datetime:
             chuncks_duration[ranges_added] = duration;
         }
         split_count = ranges_added;
-        if (split_count > MAX_SPLIT_COUNT) goto max_split_count_exceeded;
     }
     uint32_t tot_frames_added = 0;
     time_t tot_time = 0;
@@ -716,12 +997,10 @@ invalid_datetime:
     printf("Average frames per chunck: %d\n", (tot_frames_added / split_count));
     printf("Average seconds per chunck: %ld\n\n",
         ((time_t)tot_time / split_count));
+    free(chuncks_duration);
     return 1;
-max_split_count_exceeded:
-    sprintf(errmsg, "too much splits (%d), maximum splits allowed: %d",
-        split_count, MAX_SPLIT_COUNT);
-    err = errmsg;
 fail:
+    if (chuncks_duration != NULL) free(chuncks_duration);
     SERLogErr(LOG_TAG_ERR "Unable to split movie");
     if (err != NULL) SERLogErr(": %s", err);
     fprintf(stderr, "\n");
@@ -732,19 +1011,45 @@ static void initConfig() {
     conf.frames_from = 0;
     conf.frames_to = 0;
     conf.frames_count = 0;
+    conf.use_time_range = 0;
+    memset(&conf.time_from, 0, sizeof(conf.time_from));
+    memset(&conf.time_to, 0, sizeof(conf.time_to));
     conf.split_amount = 0;
     conf.split_mode = 0;
     conf.action = ACTION_NONE;
     conf.output_path = NULL;
     conf.output_dir = NULL;
     conf.log_to_json = 0;
+    conf.profile = 0;
+    conf.direct_io = 0;
     conf.use_winjupos_filename = 0;
     conf.do_check = 0;
+    conf.deep_check = 0;
     conf.overwrite = 0;
     conf.break_movie = 0;
     conf.image_format = 0;
+    conf.debayer_method = 0;
+    conf.stack_method = STACK_METHOD_MEAN;
+    conf.clip_sigma = STACK_DEFAULT_CLIP_SIGMA;
     conf.save_frame_id = 0;
     conf.invert_endianness = 0;
+    conf.jobs = 0;
+    conf.fix_in_place = 0;
+    conf.keep_best = 0;
+    conf.keep_best_percent = 0;
+    conf.roi_x = 0;
+    conf.roi_y = 0;
+    conf.roi_width = 0;
+    conf.roi_height = 0;
+    conf.crop_x = 0;
+    conf.crop_y = 0;
+    conf.crop_width = 0;
+    conf.crop_height = 0;
+    conf.crop_track = 0;
+    conf.bin_factor = 1;
+    conf.bin_sum = 0;
+    conf.bin_8bit = 0;
+    conf.bin_gamma = BIN_DEFAULT_GAMMA;
     SERLogUseColors = 1;
     SERLogLevel = LOG_LEVEL_INFO;
 }
@@ -752,24 +1057,134 @@ static void initConfig() {
 
 static void printHelp(char **argv) {
     fprintf(stderr, "serutils v%s\n\n", SERUTILS_VERSION);
-    fprintf(stderr, "Usage: %s [OPTIONS] SER_MOVIE_PATH\n\n", argv[0]);
+    fprintf(stderr, "Usage: %s [OPTIONS] SER_MOVIE_PATH [SER_MOVIE_PATH ...]"
+                    "\n\n", argv[0]);
     fprintf(stderr, "OPTIONS:\n\n");
     fprintf(stderr, "   --extract FRAME_RANGE    Extract frames\n");
+    fprintf(stderr, "   --crop X,Y,W,H           Only extract this region "
+                                                 "of frames (with --extract)"
+                                                 "\n");
+    fprintf(stderr, "   --crop-track             Move the --crop region "
+                                                 "along with the planet\n"
+                    "                            (centroid of the brightest "
+                    "pixels)\n");
     fprintf(stderr, "   --cut FRAME_RANGE        Cut frames\n");
     fprintf(stderr, "   --split SPLIT            Split movie\n");
+    fprintf(stderr, "   --join                   Join all the given movies, "
+                                                 "in order, into a single\n"
+                    "                            movie\n");
     fprintf(stderr, "   --save-frame FRAME_ID    Save frame\n");
+    fprintf(stderr, "   --save-frames FRAME_RANGE\n"
+                    "                            Save every frame in range "
+                    "to its own image\n");
+    fprintf(stderr, "   --save-cube FRAME_RANGE  Save frames in range to a "
+                                                 "single FITS cube\n");
+    fprintf(stderr, "   --stack FRAME_RANGE      Stack frames in range into "
+                                                 "a single float image\n");
+    fprintf(stderr, "   --stack-method METHOD    Stacking method: 'mean' "
+                                                 "(default), 'median' or\n"
+                    "                            'sigma-clip'\n");
+    fprintf(stderr, "   --clip-sigma SIGMA       Rejection threshold for "
+                                                 "'sigma-clip' (default: "
+                                                 "%.1f)\n",
+                                                 STACK_DEFAULT_CLIP_SIGMA);
+    fprintf(stderr, "   --compress               Write a losslessly "
+                                                 "compressed copy of the "
+                                                 "movie\n"
+                    "                            (" SER_ARCHIVE_EXT "). "
+                    "Compressed movies can be used as\n"
+                    "                            input by any other action."
+                    "\n");
+    fprintf(stderr, "   --decompress             Restore the original movie "
+                                                 "from a compressed one\n");
+    fprintf(stderr, "   --bin N                  Write a copy of the movie "
+                                                 "with NxN pixels binned\n"
+                    "                            into one (1 - %d). Bayer "
+                    "frames are binned\n"
+                    "                            by color.\n", BIN_MAX_FACTOR);
+    fprintf(stderr, "   --bin-sum                Sum binned pixels instead "
+                                                 "of averaging them\n");
+    fprintf(stderr, "   --to-8bit                Reduce binned frames (or "
+                                                 "frames) to 8-bit\n");
+    fprintf(stderr, "   --gamma GAMMA            Gamma used by --to-8bit "
+                                                 "(default: %.1f)\n",
+                                                 BIN_DEFAULT_GAMMA);
+    fprintf(stderr, "   --score                  Compute sharpness score of "
+                                                 "every frame\n");
+    fprintf(stderr, "   --roi X,Y,W,H            Only use this region for "
+                                                 "--score\n");
+    fprintf(stderr, "   --stats                  Compute per-frame and "
+                                                 "whole movie statistics\n");
+    fprintf(stderr, "   --follow                 Keep scoring frames (or "
+                                                 "computing statistics)\n"
+                    "                            while the movie is being "
+                    "captured, until it\n"
+                    "                            gets finalized or no frame "
+                    "is written for %ds\n", FOLLOW_IDLE_TIMEOUT);
+    fprintf(stderr, "   --keep-best N[%%]         Score frames and extract "
+                                                 "the best N frames\n"
+                    "                            (or N%% of frames)\n");
     fprintf(stderr, "   --check                  Perform movie check before "
                                                  "any other action\n");
+    fprintf(stderr, "   --deep-check             Also hash every frame to "
+                                                 "find duplicated, all-zero\n"
+                    "                            and truncated frames, and "
+                    "look for dropped\n"
+                    "                            frames (gaps in frame dates)"
+                    "\n");
     fprintf(stderr, "   --fix                    Try to fix movie if needed."
-                                                 "\n");
+                                                 " With --deep-check,\n"
+                    "                            duplicated and all-zero "
+                    "frames are dropped.\n");
+    fprintf(stderr, "   --in-place               Fix movie by patching it "
+                                                 "instead of writing a new "
+                                                 "one.\n"
+                    "                            Original data is saved to "
+                    "a journal file\n"
+                    "                            (MOVIE" FIX_JOURNAL_SUFFIX
+                    ").\n");
+    fprintf(stderr, "   --undo-fix               Undo a fix performed with "
+                                                 "--in-place\n");
     fprintf(stderr, "   --image-format [FORMAT]  Image format for --save-frame"
-                                                 " action.\n"
+                                                 " and --save-frames\n"
+                    "                            actions.\n"
                     "                            Leave it empty to get a list "
                     "of supported formats.\n");
+    fprintf(stderr, "   --debayer METHOD         Convert Bayer frames to RGB "
+                                                 "when writing movies\n"
+                    "                            or images. METHOD can be "
+                    "'bilinear' or\n"
+                    "                            'edge-aware'.\n");
     fprintf(stderr, "   --invert-endianness      Invert movie endianness "
                                                  "specified in movie header\n");
     fprintf(stderr, "   -o, --output FILE        Output movie path.\n");
+    fprintf(stderr, "   -j, --jobs JOBS          Number of parallel jobs: "
+                                                 "movies processed at the "
+                                                 "same\n"
+                    "                            time in batch mode, threads "
+                    "used by --split\n"
+                    "                            and --stack otherwise.\n");
     fprintf(stderr, "   --json                   Log movie info to JSON\n");
+    fprintf(stderr, "   --profile                Print I/O statistics "
+                                                 "(also logged to JSON)\n");
+    fprintf(stderr, "   --direct-io              Don't fill the page cache "
+                                                 "while reading movies and\n"
+                    "                            writing new movies "
+                    "(O_DIRECT)\n");
+    fprintf(stderr, "   --index                  Save frame dates, hashes, "
+                                                 "scores and statistics\n"
+                    "                            to the movie index "
+                    "(MOVIE" SER_INDEX_EXT "), so that they\n"
+                    "                            don't have to be computed "
+                    "again\n");
+    fprintf(stderr, "   --no-index               Ignore movie indexes\n");
+    fprintf(stderr, "   --progress-fd FD         Write progress as JSON "
+                                                 "lines to file descriptor "
+                                                 "FD\n");
+    fprintf(stderr, "   --progress-rate N        Redraw progress at most N "
+                                                 "times per second\n"
+                    "                            (default: %d, 0 redraws "
+                    "every step)\n", LOG_DEFAULT_PROGRESS_RATE);
     fprintf(stderr, "   --winjupos-format        Use WinJUPOS spec. for "
                                                  "output filename\n");
     fprintf(stderr, "   --overwrite              Force overwriting existing "
@@ -783,8 +1198,12 @@ static void printHelp(char **argv) {
     fprintf(stderr, "       <from>..<to>\n");
     fprintf(stderr, "       <from>,<count>\n");
     fprintf(stderr, "       <count>\n");
+    fprintf(stderr, "       <from_time>..<to_time>\n");
     fprintf(stderr, "     You can use negative value for <from> and <to>.\n"
-        "     Example: -1 means the last frame\n\n"
+        "     Example: -1 means the last frame\n"
+        "     Times are UTC frame dates, as HH:MM[:SS[.fff]] (on the day "
+        "of the first\n     frame) or YYYY-MM-DDTHH:MM:SS[.fff].\n"
+        "     Example: 21:30:00..21:32:30\n\n"
     );
     fprintf(stderr, "   * Examples of value for SPLIT:\n");
     fprintf(stderr, "       --split  5      Split movie in 5 movies\n");
@@ -798,6 +1217,14 @@ static void printHelp(char **argv) {
         "but if --output argument is a\n     "
         "directory, the automatically determined filename will be "
         "added to it.\n");
+    fprintf(stderr,
+        "   * Batch mode: if more than one movie or a directory (containing "
+        ".ser or\n     " SER_ARCHIVE_EXT " files) is passed, movies are "
+        "processed by a pool of --jobs worker\n     processes. Output of "
+        "every movie is written to its own log file and a\n     summary is "
+        "printed at the end (with --json, also saved to\n     "
+        BATCH_SUMMARY_FILENAME ").\n"
+        "     In batch mode --output must be a directory.\n");
     fprintf(stderr, "\n");
 }
 
@@ -828,11 +1255,76 @@ ask:
     }
 }
 
+/* Days since 1970-01-01 of a date of the proleptic Gregorian calendar */
+static long getDaysFromCivil(int year, int month, int day) {
+    year -= (month <= 2);
+    long era = (year >= 0 ? year : year - 399) / 400;
+    long yoe = year - era * 400;
+    long doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/* Parse an UTC time like YYYY-MM-DDTHH:MM:SS[.ffffff] or HH:MM[:SS[.f]],
+ * optionally followed by 'Z'. */
+static int parseTimeArgument(char *arg, TimeArgument *t) {
+    int year = 0, month = 0, day = 0, hour = 0, min = 0, sec = 0, n = 0;
+    uint32_t usec = 0, mul = 100000;
+    char *p = arg;
+    memset(t, 0, sizeof(*t));
+    if (strchr(p, 'T') != NULL) {
+        if (sscanf(p, "%4d-%2d-%2dT%n", &year, &month, &day, &n) != 3 ||
+            n == 0) return 0;
+        if (month < 1 || month > 12 || day < 1 || day > 31) return 0;
+        t->has_date = 1;
+        p += n;
+    }
+    n = 0;
+    if (sscanf(p, "%2d:%2d%n", &hour, &min, &n) != 2 || n == 0) return 0;
+    p += n;
+    if (*p == ':') {
+        n = 0;
+        if (sscanf(p, ":%2d%n", &sec, &n) != 1 || n == 0) return 0;
+        p += n;
+        if (*p == '.') {
+            p++;
+            if (*p < '0' || *p > '9') return 0;
+            while (*p >= '0' && *p <= '9') {
+                usec += (*(p++) - '0') * mul;
+                mul /= 10;
+            }
+        }
+    }
+    if (*p == 'Z') p++;
+    if (*p != '\0') return 0;
+    if (hour > 23 || min > 59 || sec > 59) return 0;
+    t->seconds = (hour * 3600) + (min * 60) + sec;
+    if (t->has_date)
+        t->seconds += (time_t) getDaysFromCivil(year, month, day) * 86400;
+    t->usec = usec;
+    return 1;
+}
+
+/* Parse a FRAME_RANGE given as <from>..<to> UTC times */
+static int parseTimeRangeArgument(char *arg) {
+    char *sep = strstr(arg, "..");
+    if (sep == NULL || sep == arg || sep[2] == '\0') return 0;
+    *sep = '\0';
+    int ok = parseTimeArgument(arg, &conf.time_from) &&
+             parseTimeArgument(sep + 2, &conf.time_to);
+    *sep = '.';
+    if (!ok) return 0;
+    conf.use_time_range = 1;
+    return 1;
+}
+
 static int parseFrameRangeArgument (char *arg) {
     uint32_t from = 0, to = 0, count = 0, last_n = 0;
     int is_comma = 0;
     size_t arglen = strlen(arg);
     if (arglen == 0) return 0;
+    if (strchr(arg, ':') != NULL) return parseTimeRangeArgument(arg);
+    conf.use_time_range = 0;
     /* Search for separators: '-', ".." and ',' */
     char *sep = strstr(arg, "..");
     if (sep == NULL) sep = strchr(arg, ',');
@@ -920,6 +1412,74 @@ static int parseOptions(int argc, char **argv) {
             conf.action = ACTION_SAVE_FRAME;
             if (conf.image_format == 0)
                 conf.image_format = IMAGE_FORMAT_FITS;
+        } else if (strcmp("--save-frames", arg) == 0) {
+            if (is_last_arg) {
+                fprintf(stderr, "Missing value for `%s`\n", arg);
+                exit(1);
+            }
+            if (!parseFrameRangeArgument(argv[++i])) goto invalid_range_arg;
+            conf.action = ACTION_SAVE_FRAMES;
+            if (conf.image_format == 0)
+                conf.image_format = IMAGE_FORMAT_FITS;
+        } else if (strcmp("--save-cube", arg) == 0) {
+            if (is_last_arg) {
+                fprintf(stderr, "Missing value for `%s`\n", arg);
+                exit(1);
+            }
+            if (!parseFrameRangeArgument(argv[++i])) goto invalid_range_arg;
+            conf.action = ACTION_SAVE_CUBE;
+        } else if (strcmp("--stack", arg) == 0) {
+            if (is_last_arg) {
+                fprintf(stderr, "Missing value for `%s`\n", arg);
+                exit(1);
+            }
+            if (!parseFrameRangeArgument(argv[++i])) goto invalid_range_arg;
+            conf.action = ACTION_STACK;
+            if (conf.image_format == 0)
+                conf.image_format = IMAGE_FORMAT_FITS;
+        } else if (strcmp("--stack-method", arg) == 0) {
+            if (is_last_arg) goto print_stack_methods;
+            char *method = argv[++i];
+            int j, nmethods = (int)(sizeof(stack_methods) / sizeof(char *));
+            conf.stack_method = 0;
+            for (j = 0; j < nmethods; j++) {
+                if (stack_methods[j] == NULL) continue;
+                if (strcasecmp(method, stack_methods[j]) == 0) {
+                    conf.stack_method = j;
+                    break;
+                }
+            }
+            if (conf.stack_method == 0) {
+                fprintf(stderr, "Invalid stacking method\n");
+                goto print_stack_methods;
+            }
+        } else if (strcmp("--clip-sigma", arg) == 0) {
+            if (is_last_arg) {
+                fprintf(stderr, "Missing value for `%s`\n", arg);
+                exit(1);
+            }
+            conf.clip_sigma = atof(argv[++i]);
+            if (conf.clip_sigma <= 0) {
+                fprintf(stderr, "Invalid --clip-sigma value\n");
+                exit(1);
+            }
+        } else if (strcmp("--debayer", arg) == 0) {
+            if (is_last_arg) goto print_debayer_methods;
+            char *method = argv[++i];
+            int j, nmethods =
+                (int)(sizeof(debayer_methods) / sizeof(char *));
+            conf.debayer_method = 0;
+            for (j = 0; j < nmethods; j++) {
+                if (debayer_methods[j] == NULL) continue;
+                if (strcasecmp(method, debayer_methods[j]) == 0) {
+                    conf.debayer_method = j;
+                    break;
+                }
+            }
+            if (conf.debayer_method == 0) {
+                fprintf(stderr, "Invalid debayer method\n");
+                goto print_debayer_methods;
+            }
         } else if (strcmp("--image-format", arg) == 0) {
             if (is_last_arg) goto print_image_formats;
             char *format = argv[++i];
@@ -937,15 +1497,145 @@ static int parseOptions(int argc, char **argv) {
                 fprintf(stderr, "Invalid image format\n");
                 goto print_image_formats;
             }
+        } else if (strcmp("--direct-io", arg) == 0) {
+            conf.direct_io = 1;
+        } else if (strcmp("--index", arg) == 0) {
+            conf.save_index = 1;
+        } else if (strcmp("--no-index", arg) == 0) {
+            SERUseMovieIndexes = 0;
+        } else if (strcmp("--profile", arg) == 0) {
+            conf.profile = 1;
+            SERCollectMovieStats = 1;
+        } else if (strcmp("--progress-fd", arg) == 0) {
+            if (is_last_arg) {
+                fprintf(stderr, "Missing value for progress-fd\n");
+                exit(1);
+            }
+            char *endp = NULL, *val = argv[++i];
+            long fd = strtol(val, &endp, 10);
+            int valid = (*val != '\0' && *endp == '\0' && fd >= 0 &&
+                         fd <= INT_MAX);
+#if IS_UNIX
+            if (valid) valid = (fcntl((int) fd, F_GETFD) >= 0);
+#endif
+            if (!valid) {
+                fprintf(stderr, "Invalid --progress-fd value\n");
+                exit(1);
+            }
+            SERLogProgressFD = (int) fd;
+#if IS_UNIX
+            /* A reader closing the pipe must only stop progress lines
+             * (see writeProgressJSON), not kill the action. */
+            signal(SIGPIPE, SIG_IGN);
+#endif
+        } else if (strcmp("--progress-rate", arg) == 0) {
+            if (is_last_arg) {
+                fprintf(stderr, "Missing value for progress-rate\n");
+                exit(1);
+            }
+            char *endp = NULL, *val = argv[++i];
+            long rate = strtol(val, &endp, 10);
+            if (*val == '\0' || *endp != '\0' || rate < 0 || rate > 1000) {
+                fprintf(stderr, "Invalid --progress-rate value\n");
+                exit(1);
+            }
+            SERLogProgressRate = (int) rate;
         } else if (strcmp("--json", arg) == 0) {
             conf.log_to_json = 1;
         } else if (strcmp("--winjupos-format", arg) == 0) {
             conf.use_winjupos_filename = 1;
         } else if (strcmp("--check", arg) == 0) {
             conf.do_check = 1;
+        } else if (strcmp("--deep-check", arg) == 0) {
+            conf.do_check = 1;
+            conf.deep_check = 1;
         } else if (strcmp("--fix", arg) == 0) {
             conf.do_check = 1;
             conf.action = ACTION_FIX;
+        } else if (strcmp("--compress", arg) == 0) {
+            conf.action = ACTION_COMPRESS;
+        } else if (strcmp("--decompress", arg) == 0) {
+            conf.action = ACTION_DECOMPRESS;
+        } else if (strcmp("--join", arg) == 0) {
+            conf.action = ACTION_JOIN;
+        } else if (strcmp("--score", arg) == 0) {
+            conf.action = ACTION_SCORE;
+        } else if (strcmp("--stats", arg) == 0) {
+            conf.action = ACTION_STATS;
+        } else if (strcmp("--follow", arg) == 0) {
+            conf.follow = 1;
+        } else if (strcmp("--keep-best", arg) == 0) {
+            if (is_last_arg) {
+                fprintf(stderr, "Missing value for `--keep-best`\n");
+                exit(1);
+            }
+            char *val = argv[++i];
+            int best = atoi(val);
+            if (best <= 0) {
+                fprintf(stderr, "Invalid --keep-best value\n");
+                exit(1);
+            }
+            conf.keep_best_percent = (val[strlen(val) - 1] == '%');
+            if (conf.keep_best_percent && best > 100) best = 100;
+            conf.keep_best = best;
+            conf.action = ACTION_SCORE;
+        } else if (strcmp("--roi", arg) == 0) {
+            if (is_last_arg) {
+                fprintf(stderr, "Missing value for `--roi`\n");
+                exit(1);
+            }
+            if (sscanf(argv[++i], "%u,%u,%u,%u", &conf.roi_x, &conf.roi_y,
+                &conf.roi_width, &conf.roi_height) != 4 ||
+                conf.roi_width == 0 || conf.roi_height == 0)
+            {
+                fprintf(stderr, "Invalid --roi value\n");
+                exit(1);
+            }
+        } else if (strcmp("--crop", arg) == 0) {
+            if (is_last_arg) {
+                fprintf(stderr, "Missing value for `--crop`\n");
+                exit(1);
+            }
+            if (sscanf(argv[++i], "%u,%u,%u,%u", &conf.crop_x, &conf.crop_y,
+                &conf.crop_width, &conf.crop_height) != 4 ||
+                conf.crop_width == 0 || conf.crop_height == 0)
+            {
+                fprintf(stderr, "Invalid --crop value\n");
+                exit(1);
+            }
+        } else if (strcmp("--crop-track", arg) == 0) {
+            conf.crop_track = 1;
+        } else if (strcmp("--bin", arg) == 0) {
+            if (is_last_arg) {
+                fprintf(stderr, "Missing value for `%s`\n", arg);
+                exit(1);
+            }
+            conf.bin_factor = atoi(argv[++i]);
+            if (conf.bin_factor < 1 || conf.bin_factor > BIN_MAX_FACTOR) {
+                fprintf(stderr, "Invalid --bin value (1 - %d)\n",
+                    BIN_MAX_FACTOR);
+                exit(1);
+            }
+            conf.action = ACTION_BIN;
+        } else if (strcmp("--bin-sum", arg) == 0) {
+            conf.bin_sum = 1;
+        } else if (strcmp("--to-8bit", arg) == 0) {
+            conf.bin_8bit = 1;
+            conf.action = ACTION_BIN;
+        } else if (strcmp("--gamma", arg) == 0) {
+            if (is_last_arg) {
+                fprintf(stderr, "Missing value for `%s`\n", arg);
+                exit(1);
+            }
+            conf.bin_gamma = atof(argv[++i]);
+            if (conf.bin_gamma <= 0) {
+                fprintf(stderr, "Invalid --gamma value\n");
+                exit(1);
+            }
+        } else if (strcmp("--in-place", arg) == 0) {
+            conf.fix_in_place = 1;
+        } else if (strcmp("--undo-fix", arg) == 0) {
+            conf.action = ACTION_UNDO_FIX;
         } else if (strcmp("--overwrite", arg) == 0) {
             conf.overwrite = 1;
         } else if (strcmp("--invert-endianness", arg) == 0) {
@@ -958,6 +1648,16 @@ static int parseOptions(int argc, char **argv) {
                 exit(1);
             }
             conf.output_path = argv[++i];
+        } else if (strcmp("-j", arg) == 0 || strcmp("--jobs", arg) == 0) {
+            if (is_last_arg) {
+                fprintf(stderr, "Missing value for jobs\n");
+                exit(1);
+            }
+            conf.jobs = atoi(argv[++i]);
+            if (conf.jobs <= 0) {
+                fprintf(stderr, "Invalid --jobs value\n");
+                exit(1);
+            }
         /* Used for tests */
         } else if (strcmp("--break-frames", arg) == 0) {
             conf.break_movie = BREAK_FRAMES;
@@ -985,8 +1685,28 @@ static int parseOptions(int argc, char **argv) {
         if (conf.break_movie == BREAK_FRAMES) conf.frames_to = -2;
         else conf.frames_to = -1;
         conf.use_winjupos_filename = 0;
-    } else if (conf.action == ACTION_SAVE_FRAME)
+    } else if (conf.action == ACTION_SAVE_FRAME ||
+               conf.action == ACTION_SAVE_FRAMES ||
+               conf.action == ACTION_SAVE_CUBE ||
+               conf.action == ACTION_STACK ||
+               conf.action == ACTION_COMPRESS ||
+               conf.action == ACTION_DECOMPRESS)
         conf.use_winjupos_filename = 0;
+    if (conf.action == ACTION_STACK && conf.debayer_method > 0) {
+        /* Bayer frames are stacked as they are (ie. for dark/flat
+         * masters), the result keeps the BAYERPAT keyword. */
+        fprintf(stderr, "WARN: --debayer is not supported by --stack, "
+            "ignoring it\n");
+        conf.debayer_method = 0;
+    }
+    if ((conf.action == ACTION_COMPRESS || conf.action == ACTION_DECOMPRESS)
+        && conf.debayer_method > 0)
+    {
+        /* Compressed movies are always a lossless copy of the original */
+        fprintf(stderr, "WARN: --debayer is not supported by --compress and "
+            "--decompress, ignoring it\n");
+        conf.debayer_method = 0;
+    }
     return i;
 invalid_range_arg:
     fprintf(stderr, "Invalid frame range\n");
@@ -996,6 +1716,22 @@ invalid_split_arg:
     fprintf(stderr, "Invalid --split value\n");
     exit(1);
     return -1;
+print_stack_methods:
+    fprintf(stderr, "Supported stacking methods:\n");
+    for (i = 0; i < (int)(sizeof(stack_methods) / sizeof(char *)); i++) {
+        if (stack_methods[i] == NULL) continue;
+        fprintf(stderr, "    %s\n", stack_methods[i]);
+    }
+    exit(1);
+    return -1;
+print_debayer_methods:
+    fprintf(stderr, "Supported debayer methods:\n");
+    for (i = 0; i < (int)(sizeof(debayer_methods) / sizeof(char *)); i++) {
+        if (debayer_methods[i] == NULL) continue;
+        fprintf(stderr, "    %s\n", debayer_methods[i]);
+    }
+    exit(1);
+    return -1;
 print_image_formats:
     fprintf(stderr, "Supported image formats:\n");
     for (i = 0; i < (int)(sizeof(image_formats) / sizeof(char *)); i++) {
@@ -1049,17 +1785,17 @@ static int performMovieCheck(SERMovie *movie, int *issues) {
         SERLogErr(LOG_TAG_FATAL "missing header\n");
         return 0;
     }
-    size_t trailer_offs = SERGetTrailerOffset(movie->header);
+    uint64_t trailer_offs = SERGetTrailerOffset(movie->header);
     uint32_t frame_c = SERGetFrameCount(movie);
-    size_t expected_filesize = sizeof(SERHeader) +
-        (frame_c * SERGetFrameSize(movie->header));
+    uint64_t expected_filesize = trailer_offs;
     if (movie->filesize > trailer_offs) {
         int has_valid_dates = 1;
-        uint32_t i;
+        uint32_t i, dates_count = 0;
         uint64_t last_date = 0;
+        const uint64_t *dates = SERGetFrameDates(movie, &dates_count);
         expected_filesize += (frame_c * sizeof(uint64_t));
         for (i = 0; i < SERGetFrameCount(movie); i++) {
-            uint64_t date = SERGetFrameDate(movie, i);
+            uint64_t date = (i < dates_count ? dates[i] : 0);
             has_valid_dates = (last_date <= date);
             if (!has_valid_dates) break;
             last_date = date;
@@ -1078,6 +1814,11 @@ static int performMovieCheck(SERMovie *movie, int *issues) {
         printMovieWarnings(movie);
         count += wcount;
     }
+    if (conf.deep_check) {
+        uint32_t deep_issues = 0;
+        if (!deepCheckMovie(movie, &deep_issues)) return 0;
+        count += (int) deep_issues;
+    }
     ok = (count == 0);
     if (issues != NULL) *issues = count;
     if (ok) SERLogSuccess("Good, no issues found!\n\n");
@@ -1110,6 +1851,59 @@ static int determineFrameRange(SERHeader * header, SERFrameRange *range,
     return 1;
 }
 
+/* Get the SER datetime of a time-based FRAME_RANGE bound. Times without
+ * a date refer to the UTC day of the earliest frame (`first_date`), or to
+ * the following day if they're more than 12 hours earlier than it (ie.
+ * movies recorded across midnight). */
+static uint64_t resolveTimeArgument(TimeArgument *t, uint64_t first_date) {
+    time_t seconds = t->seconds;
+    if (!t->has_date) {
+        time_t first_t = SERVideoTimeToUnixtime(first_date, NULL);
+        seconds += first_t - (first_t % 86400);
+        if (seconds + 43200 < first_t) seconds += 86400;
+    }
+    return SERUnixtimeToVideoTime(seconds, t->usec);
+}
+
+/* Determine the frame range requested by FRAME_RANGE options, either as
+ * frame numbers or as UTC times (see parseTimeRangeArgument). */
+static int determineConfFrameRange(SERMovie *movie, SERFrameRange *range,
+    char **err)
+{
+    if (!conf.use_time_range) {
+        return determineFrameRange(movie->header, range, conf.frames_from,
+            conf.frames_to, conf.frames_count, err);
+    }
+    long first = SERFindFrameByTime(movie, 0);
+    if (first < 0) {
+        if (err != NULL) *err = "movie has no frame dates";
+        return 0;
+    }
+    uint64_t first_date = SERGetFrameDate(movie, first),
+             from_date = resolveTimeArgument(&conf.time_from, first_date),
+             to_date = resolveTimeArgument(&conf.time_to, first_date);
+    if (to_date < from_date) {
+        if (err != NULL) *err = "last time < first time";
+        return 0;
+    }
+    long from = SERFindFrameByTime(movie, from_date),
+         to = SERFindLastFrameByTime(movie, to_date);
+    if (from < 0 || to < 0 || to < from) {
+        if (err != NULL) *err = "no frames in time range";
+        return 0;
+    }
+    if (SERCountOrderedFrameDates(movie) < SERGetFrameCount(movie)) {
+        SERLogWarn(LOG_TAG_WARN "Frame dates are not in chronological "
+            "order, frames between %ld and %ld could be out of time range\n",
+            from + 1, to + 1);
+    }
+    if (!determineFrameRange(movie->header, range, from, to, 0, err))
+        return 0;
+    SERLogInfo("Time range: frames %d..%d\n", range->from + 1,
+        range->to + 1);
+    return 1;
+}
+
 static void printMovieWarnings(SERMovie *movie) {
     int warnings = movie->warnings;
     size_t wlen = sizeof(warnings),
@@ -1130,13 +1924,113 @@ static void printMovieWarnings(SERMovie *movie) {
     }
 }
 
+/* Get the start time of an I/O operation for --profile (0 if disabled) */
+static uint64_t getStatsClock() {
+    return (stats_movie != NULL ? SERMovieStatsClock(stats_movie) : 0);
+}
+
+static void recordStats(int op, uint64_t calls, size_t bytes,
+    uint64_t start)
+{
+    if (stats_movie != NULL)
+        SERRecordMovieStats(stats_movie, op, calls, bytes, start);
+}
+
+/* Movies written by --extract, --cut, --split, --join, --keep-best and
+ * --decompress are written through a DirectIOWriter if --direct-io has
+ * been used, so that they don't fill the page cache. */
+typedef struct DirectOutput {
+    FILE *file;
+    DirectIOWriter *writer;
+    struct DirectOutput *next;
+} DirectOutput;
+
+static DirectOutput *direct_outputs = NULL;
+static pthread_mutex_t direct_outputs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static DirectIOWriter *getDirectWriter(FILE *file) {
+    DirectOutput *output;
+    if (!conf.direct_io) return NULL;
+    pthread_mutex_lock(&direct_outputs_lock);
+    for (output = direct_outputs; output != NULL; output = output->next) {
+        if (output->file == file) break;
+    }
+    pthread_mutex_unlock(&direct_outputs_lock);
+    return (output != NULL ? output->writer : NULL);
+}
+
+/* Open a movie file for writing. Files opened by this function must be
+ * closed by using closeOutputVideo. */
+static FILE *openOutputVideo(char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL || !conf.direct_io) return file;
+    DirectOutput *output = calloc(1, sizeof(*output));
+    if (output == NULL ||
+        (output->writer = DirectIOWriterOpen(fileno(file))) == NULL)
+    {
+        SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+        if (output != NULL) free(output);
+        fclose(file);
+        return NULL;
+    }
+    output->file = file;
+    pthread_mutex_lock(&direct_outputs_lock);
+    output->next = direct_outputs;
+    direct_outputs = output;
+    pthread_mutex_unlock(&direct_outputs_lock);
+    return file;
+}
+
+/* Same as fclose, for files opened by openOutputVideo */
+static int closeOutputVideo(FILE *file) {
+    DirectOutput *output = NULL, **prev;
+    int ok = 1;
+    if (conf.direct_io) {
+        pthread_mutex_lock(&direct_outputs_lock);
+        for (prev = &direct_outputs; *prev != NULL; prev = &((*prev)->next)) {
+            if ((*prev)->file == file) {
+                output = *prev;
+                *prev = output->next;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&direct_outputs_lock);
+    }
+    if (output != NULL) {
+        uint64_t start = getStatsClock();
+        ok = DirectIOWriterClose(output->writer);
+        recordStats(SER_STATS_WRITE, 0, 0, start);
+        free(output);
+    }
+    if (fclose(file) != 0) ok = 0;
+    return (ok ? 0 : EOF);
+}
+
+/* Same as fwrite(buf, 1, size, file), accounted by --profile */
+static size_t writeFileData(FILE *file, const void *buf, size_t size) {
+    DirectIOWriter *writer = getDirectWriter(file);
+    uint64_t start = getStatsClock();
+    size_t nwritten;
+    if (writer != NULL) nwritten = DirectIOWriterWrite(writer, buf, size);
+    else nwritten = fwrite(buf, 1, size, file);
+    recordStats(SER_STATS_WRITE, 1, nwritten, start);
+    return nwritten;
+}
+
 static int writeHeaderToVideo(FILE *video, SERHeader *header) {
-    fseek(video, 0, SEEK_SET);
+    DirectIOWriter *writer = getDirectWriter(video);
+    if (writer != NULL && DirectIOWriterTell(writer) != 0) {
+        SERLogErr(LOG_TAG_ERR "Header must be written first with "
+            "--direct-io\n");
+        return 0;
+    }
+    fseeko(video, 0, SEEK_SET);
+    recordStats(SER_STATS_SEEK, 1, 0, 0);
     size_t nwritten = 0, totwritten = 0, maxbytes = sizeof(*header);
     size_t remain = maxbytes;
     char *p = (char *) header;
     while (totwritten < maxbytes) {
-        nwritten = fwrite(p, 1, remain, video);
+        nwritten = writeFileData(video, p, remain);
         if (nwritten <= 0) break;
         totwritten += nwritten;
         p += totwritten;
@@ -1149,13 +2043,17 @@ static int writeHeaderToVideo(FILE *video, SERHeader *header) {
 static int writeTrailerToVideo(FILE *video, uint64_t *datetimes, size_t size) {
     size_t nwritten = 0, totwritten = 0, remain = size;
     char *ptr = (char *) datetimes;
+    if (stats_movie != NULL)
+        SERSetMovieStatsPhase(stats_movie, SER_STATS_PHASE_TRAILER);
     while (totwritten < size) {
-        nwritten = fwrite(ptr, 1, remain, video);
+        nwritten = writeFileData(video, ptr, remain);
         if (nwritten <= 0) break;
         totwritten += nwritten;
         ptr += nwritten;
         remain -= nwritten;
     }
+    if (stats_movie != NULL)
+        SERSetMovieStatsPhase(stats_movie, SER_STATS_PHASE_COPY);
     int ok = (totwritten == size);
     if (!ok) {
         fprintf(stderr, "Written %zu trailer byte(s) of %zu\n",
@@ -1164,60 +2062,564 @@ static int writeTrailerToVideo(FILE *video, uint64_t *datetimes, size_t size) {
     return ok;
 }
 
-static int appendFrameToVideo(FILE *video, SERMovie *srcmovie,
-    int frame_idx, char **err)
+/* Copy `size` bytes starting at `offset` from `srcvideo` to the current
+ * position of `video`. Data is copied by the kernel (copy_file_range or
+ * sendfile) when possible, otherwise through the reusable buffer pointed
+ * by `buffer` (that will be allocated if NULL, it's up to the caller to
+ * free it).
+ * Source data is read by using explicit offsets, so different threads
+ * can copy data from the same source at the same time.
+ * Return 1 on success, 0 otherwise. */
+static int copyVideoData(FILE *video, FILE *srcvideo, uint64_t offset,
+    size_t size, char **buffer, char **err)
 {
-    SERHeader *srcheader = srcmovie->header;
-    FILE *srcvideo = srcmovie->file;
-    size_t frame_sz = SERGetFrameSize(srcheader), nread = 0, nwritten = 0,
-           totread = 0, totwritten = 0;
-    char *buffer = NULL;
-    if (frame_sz == 0) {
-        if (err != NULL) *err = "invalid frame size (0)";
-        goto fail;
+    size_t totwritten = 0, remain = size;
+    uint64_t start = getStatsClock(), calls = 0;
+#if defined(__linux__)
+    /* Data copied by the kernel goes through the page cache */
+    if (conf.direct_io) goto buffered_copy;
+    off_t dst_offset;
+    if (fflush(video) != 0 || (dst_offset = ftello(video)) < 0) {
+        if (err != NULL) *err = "failed to write frame";
+        return 0;
     }
-    buffer = malloc(frame_sz);
-    if (buffer == NULL) {
-        if (err != NULL)
-            *err = "out-of-memory (could not allocate frame bufer)";
-        goto fail;
+    int src_fd = fileno(srcvideo), dst_fd = fileno(video), use_sendfile = 0;
+    off_t src_offset = (off_t) offset;
+#if defined(SYS_copy_file_range)
+    while (remain > 0) {
+        ssize_t n = syscall(SYS_copy_file_range, src_fd, &src_offset, dst_fd,
+            NULL, remain, 0);
+        calls++;
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && totwritten == 0) {
+            /* Not supported for these files, try with sendfile */
+            use_sendfile = 1;
+            break;
+        }
+        if (n <= 0) break;
+        totwritten += n;
+        remain -= n;
     }
-    long offset = SERGetFrameOffset(srcheader, frame_idx);
-    if (fseek(srcvideo, offset, SEEK_SET) < 0) {
-        if (err != NULL) *err = "frame beyond movie size, cannot read frame";
-        goto fail;
+#else
+    use_sendfile = 1;
+#endif
+    while (use_sendfile && remain > 0) {
+        ssize_t n = sendfile(dst_fd, src_fd, &src_offset, remain);
+        calls++;
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && totwritten == 0) {
+            /* Fallback to buffered copy */
+            use_sendfile = 0;
+            break;
+        }
+        if (n <= 0) break;
+        totwritten += n;
+        remain -= n;
     }
-    char *p = buffer;
-    size_t remain = frame_sz;
-    while (totread < frame_sz) {
-        nread = fread(p, 1, remain, srcvideo);
-        if (nread <= 0) break;
-        totread += nread;
-        p += nread;
-        remain -= nread;
+    if (totwritten > 0) {
+        /* Data copied by the kernel is both read and written by every
+         * call, time is accounted to writes. */
+        recordStats(SER_STATS_READ, calls, totwritten, 0);
+        recordStats(SER_STATS_WRITE, calls, totwritten, start);
+        recordStats(SER_STATS_SEEK, 1, 0, 0);
+        if (fseeko(video, dst_offset + (off_t) totwritten, SEEK_SET) < 0) {
+            if (err != NULL) *err = "failed to write frame";
+            return 0;
+        }
+        if (remain > 0) {
+            if (err != NULL) *err = "failed to copy frames";
+            return 0;
+        }
+        return 1;
     }
-    if (totread != frame_sz) {
-        if (err != NULL) *err = "failed to read frame";
-        goto fail;
+buffered_copy:
+#endif
+    if (*buffer == NULL) {
+        *buffer = malloc(COPY_BUFFER_SIZE);
+        if (*buffer == NULL) {
+            if (err != NULL)
+                *err = "out-of-memory (could not allocate frame bufer)";
+            return 0;
+        }
     }
-    p = buffer;
-    remain = frame_sz;
-    while (totwritten < frame_sz) {
-        nwritten = fwrite(p, 1, remain, video);
-        if (nwritten <= 0) break;
-        totwritten += nwritten;
-        p += nwritten;
-        remain -= nwritten;
+    char *buf = *buffer;
+#if !IS_UNIX
+    if (fseeko(srcvideo, (off_t) offset, SEEK_SET) < 0) {
+        if (err != NULL) *err = "frame beyond movie size, cannot read frame";
+        return 0;
     }
-    if (totwritten != frame_sz) {
-        if (err != NULL) *err = "failed to write frame";
-        goto fail;
+#endif
+    while (remain > 0) {
+        size_t chunk = (remain < COPY_BUFFER_SIZE ? remain : COPY_BUFFER_SIZE);
+        size_t nwritten = 0, totread = 0;
+        start = getStatsClock();
+        calls = 0;
+        while (totread < chunk) {
+            calls++;
+#if IS_UNIX
+            ssize_t nread = pread(fileno(srcvideo), buf + totread,
+                chunk - totread, (off_t) (offset + totread));
+            if (nread < 0 && errno == EINTR) continue;
+#else
+            size_t nread = fread(buf + totread, 1, chunk - totread, srcvideo);
+#endif
+            if (nread <= 0) break;
+            totread += nread;
+        }
+        recordStats(SER_STATS_READ, calls, totread, start);
+        if (totread != chunk) {
+            if (err != NULL) *err = "failed to read frame";
+            return 0;
+        }
+#if IS_UNIX && defined(POSIX_FADV_DONTNEED)
+        if (conf.direct_io) {
+            posix_fadvise(fileno(srcvideo), (off_t) offset, (off_t) chunk,
+                POSIX_FADV_DONTNEED);
+        }
+#endif
+        nwritten = writeFileData(video, buf, chunk);
+        if (nwritten != chunk) {
+            if (err != NULL) *err = "failed to write frame";
+            return 0;
+        }
+        offset += chunk;
+        remain -= chunk;
     }
-    if (buffer != NULL) free(buffer);
     return 1;
-fail:
-    if (buffer != NULL) free(buffer);
-    return 0;
+}
+
+/* Update copy progress after `frames` frames (`bytes` bytes) have been
+ * written and log it. */
+static void updateCopyProgress(CopyProgress *progress, uint32_t frames,
+    uint64_t bytes)
+{
+    if (progress == NULL) return;
+    if (progress->lock != NULL) pthread_mutex_lock(progress->lock);
+    progress->done += frames;
+    progress->bytes += bytes;
+    SERLogProgressBytes("Writing frames", progress->done, progress->tot,
+        progress->bytes);
+    if (progress->lock != NULL) pthread_mutex_unlock(progress->lock);
+}
+
+/* Frames written by the current action are converted to RGB if
+ * --debayer has been used and the movie is a Bayer movie. */
+static int isDebayering(SERMovie *movie) {
+    return (conf.debayer_method > 0 && SERCanDebayer(movie));
+}
+
+/* Update a header copied from a Bayer movie for a movie containing its
+ * debayered frames: pixels of 9-16 bits frames get scaled to 16 bits. */
+static void setDebayeredHeader(SERHeader *header) {
+    header->uiColorID = COLOR_RGB;
+    if (header->uiPixelDepth > 8) header->uiPixelDepth = 16;
+}
+
+static int appendDebayeredFramesToVideo(FILE *video, SERMovie *movie,
+    uint32_t from, uint32_t count, CopyProgress *progress, char **err)
+{
+    size_t frame_size = SERGetFrameSize(movie->header),
+           rgb_size = SERGetFrameRGBSize(movie->header);
+    void *mosaic = NULL, *rgb = NULL;
+    SERFrameIterator *it = NULL;
+    uint32_t written = 0;
+    mosaic = malloc(frame_size);
+    rgb = malloc(rgb_size);
+    if (mosaic == NULL || rgb == NULL) {
+        if (err != NULL) *err = "out-of-memory";
+        goto fail;
+    }
+    it = SERFrameIteratorBegin(movie, from, count, 1, 0);
+    if (it == NULL) {
+        if (err != NULL) *err = "could not read frames";
+        goto fail;
+    }
+    const SERFrame *frame;
+    while ((frame = SERFrameIteratorNext(it)) != NULL) {
+        SERConvertFramePixels(movie, frame->data, mosaic, frame_size,
+            IS_BIG_ENDIAN);
+        /* Pixels are written with the byte order of the original movie,
+         * since the header is a copy of the original one. */
+        if (!SERDebayerFramePixels(movie, mosaic, rgb, conf.debayer_method,
+            SERIsBigEndian(movie)))
+        {
+            if (err != NULL) *err = "failed to debayer frame";
+            goto fail;
+        }
+        if (writeFileData(video, rgb, rgb_size) != rgb_size) {
+            if (err != NULL) *err = "failed to write frame";
+            goto fail;
+        }
+        written++;
+        updateCopyProgress(progress, 1, rgb_size);
+    }
+    int iterator_ok = SERFrameIteratorEnd(it);
+    it = NULL;
+    if (!iterator_ok || written != count) {
+        if (err != NULL) *err = "could not read frames";
+        goto fail;
+    }
+    free(mosaic);
+    free(rgb);
+    return 1;
+fail:
+    if (it != NULL) SERFrameIteratorEnd(it);
+    if (mosaic != NULL) free(mosaic);
+    if (rgb != NULL) free(rgb);
+    return 0;
+}
+
+/* Frames of compressed movies cannot be copied by the kernel, so they're
+ * decoded into the iterator buffers and written from there. */
+static int appendDecodedFramesToVideo(FILE *video, SERMovie *movie,
+    uint32_t from, uint32_t count, CopyProgress *progress, char **err)
+{
+    size_t frame_size = SERGetFrameSize(movie->header);
+    uint32_t written = 0;
+    SERFrameIterator *it = SERFrameIteratorBegin(movie, from, count, 1, 0);
+    if (it == NULL) {
+        if (err != NULL) *err = "could not read frames";
+        return 0;
+    }
+    const SERFrame *frame;
+    while (written < count && (frame = SERFrameIteratorNext(it)) != NULL) {
+        if (writeFileData(video, frame->data, frame_size) != frame_size) {
+            if (err != NULL) *err = "failed to write frame";
+            SERFrameIteratorEnd(it);
+            return 0;
+        }
+        written++;
+        updateCopyProgress(progress, 1, frame_size);
+    }
+    if (!SERFrameIteratorEnd(it) || written != count) {
+        if (err != NULL) *err = "could not read frames";
+        return 0;
+    }
+    return 1;
+}
+
+/* --crop: only a region of every frame gets written. */
+
+static inline int isBayerMovie(SERMovie *movie) {
+    uint32_t color = movie->header->uiColorID;
+    return (color >= COLOR_BAYER_RGGB && color < COLOR_RGB);
+}
+
+/* Check that the --crop region lies inside movie's frames. The region of
+ * Bayer movies is moved to even coordinates, so that cropped frames keep
+ * the color pattern of the movie. Return 0 if the region is not valid. */
+static int checkCropRegion(SERMovie *movie, char **err) {
+    SERHeader *header = movie->header;
+    if (isBayerMovie(movie)) {
+        conf.crop_x &= ~1u;
+        conf.crop_y &= ~1u;
+    }
+    if (conf.crop_x >= header->uiImageWidth ||
+        conf.crop_y >= header->uiImageHeight ||
+        conf.crop_width > header->uiImageWidth - conf.crop_x ||
+        conf.crop_height > header->uiImageHeight - conf.crop_y)
+    {
+        if (err != NULL) *err = "crop region outside of frame";
+        return 0;
+    }
+    return 1;
+}
+
+/* Brightness of pixel `idx` of raw frame data (sum of its channels) */
+static inline uint32_t getRawPixelLuma(const uint8_t *pixels, size_t idx,
+    int planes, int bps, int big_endian)
+{
+    uint32_t value = 0;
+    int c;
+    const uint8_t *p = pixels + idx * planes * bps;
+    for (c = 0; c < planes; c++, p += bps) {
+        if (bps == 1) value += p[0];
+        else if (big_endian) value += ((uint32_t) p[0] << 8) | p[1];
+        else value += p[0] | ((uint32_t) p[1] << 8);
+    }
+    return value;
+}
+
+/* Find the centroid of the pixels brighter than the midpoint between the
+ * darkest and the brightest pixel of `pixels` (raw frame data of
+ * `width` x `height` pixels), that is the centroid of the planet in
+ * planetary frames. Return 0 if every pixel has the same brightness. */
+static int findFrameCentroid(const void *pixels, uint32_t width,
+    uint32_t height, int planes, int bps, int big_endian, double *cx,
+    double *cy)
+{
+    size_t npix = (size_t) width * height, i;
+    uint32_t min = UINT32_MAX, max = 0, x, y;
+    for (i = 0; i < npix; i++) {
+        uint32_t v = getRawPixelLuma(pixels, i, planes, bps, big_endian);
+        if (v < min) min = v;
+        if (v > max) max = v;
+    }
+    if (max <= min) return 0;
+    uint32_t threshold = min + (max - min) / 2;
+    double sum = 0, sum_x = 0, sum_y = 0;
+    for (y = 0, i = 0; y < height; y++) {
+        for (x = 0; x < width; x++, i++) {
+            uint32_t v = getRawPixelLuma(pixels, i, planes, bps, big_endian);
+            if (v <= threshold) continue;
+            double weight = v - threshold;
+            sum += weight;
+            sum_x += weight * x;
+            sum_y += weight * y;
+        }
+    }
+    if (sum == 0) return 0;
+    *cx = sum_x / sum;
+    *cy = sum_y / sum;
+    return 1;
+}
+
+/* Clamp the `size` long segment centered on `center` to [lo, hi). If
+ * `even` is not zero, the segment starts on an even position, so that
+ * Bayer frames keep their CFA pattern (the current region, which starts
+ * on an even position, always fits after rounding `lo` up). */
+static uint32_t centerCropSegment(double center, uint32_t size, uint32_t lo,
+    uint32_t hi, int even)
+{
+    double start = center - (size / 2.0);
+    if (even) lo = (lo + 1) & ~1u;
+    uint32_t pos = lo;
+    if (start > lo) pos = (uint32_t) (start + 0.5);
+    if (pos + size > hi) pos = hi - size;
+    if (even) pos &= ~1u;
+    if (pos < lo) pos = lo;
+    return pos;
+}
+
+/* Write the --crop region of `count` frames starting from `from`. Only
+ * the rows of the region are read (see SERGetFrameROI).
+ * With --crop-track, the region is searched for the planet in a window
+ * extending CROP_TRACK_MARGIN percent of the region size around it (that
+ * is the only part of the frame being read), and it gets centered on the
+ * centroid of the planet before being written, so it follows the planet
+ * as it drifts. */
+static int appendCroppedFramesToVideo(FILE *video, SERMovie *movie,
+    uint32_t from, uint32_t count, CopyProgress *progress, char **err)
+{
+    SERHeader *header = movie->header;
+    uint32_t width = header->uiImageWidth, height = header->uiImageHeight,
+             crop_w = conf.crop_width, crop_h = conf.crop_height,
+             crop_x = conf.crop_x, crop_y = conf.crop_y, i, row;
+    int bpp = SERGetBytesPerPixel(header), even = isBayerMovie(movie),
+        planes = SERGetNumberOfPlanes(header),
+        big_endian = SERIsBigEndian(movie);
+    size_t crop_row_size = (size_t) crop_w * bpp,
+           crop_size = crop_row_size * crop_h;
+    char *crop = NULL, *window = NULL;
+    uint32_t margin_w = 0, margin_h = 0;
+    if (conf.crop_track) {
+        margin_w = (uint32_t) ((uint64_t) crop_w * CROP_TRACK_MARGIN / 100);
+        margin_h = (uint32_t) ((uint64_t) crop_h * CROP_TRACK_MARGIN / 100);
+        window = malloc((size_t) (crop_w + 2 * margin_w) *
+                        (crop_h + 2 * margin_h) * bpp);
+    }
+    crop = malloc(crop_size);
+    if (crop == NULL || (conf.crop_track && window == NULL)) {
+        if (err != NULL) *err = "out-of-memory";
+        goto fail;
+    }
+    for (i = 0; i < count; i++) {
+        uint32_t idx = from + i;
+        if (!conf.crop_track) {
+            if (!SERGetFrameROI(movie, idx, crop_x, crop_y, crop_w, crop_h,
+                crop)) goto read_failed;
+        } else {
+            uint32_t win_x = (crop_x > margin_w ? crop_x - margin_w : 0),
+                     win_y = (crop_y > margin_h ? crop_y - margin_h : 0),
+                     win_w = crop_x + crop_w + margin_w,
+                     win_h = crop_y + crop_h + margin_h;
+            if (win_w > width) win_w = width;
+            if (win_h > height) win_h = height;
+            win_w -= win_x;
+            win_h -= win_y;
+            if (!SERGetFrameROI(movie, idx, win_x, win_y, win_w, win_h,
+                window)) goto read_failed;
+            double cx, cy;
+            if (findFrameCentroid(window, win_w, win_h, planes, bpp / planes,
+                big_endian, &cx, &cy))
+            {
+                crop_x = centerCropSegment(win_x + cx, crop_w, win_x,
+                                           win_x + win_w, even);
+                crop_y = centerCropSegment(win_y + cy, crop_h, win_y,
+                                           win_y + win_h, even);
+            }
+            size_t win_row_size = (size_t) win_w * bpp;
+            const char *src = window + (size_t) (crop_y - win_y) *
+                              win_row_size + (size_t) (crop_x - win_x) * bpp;
+            for (row = 0; row < crop_h; row++) {
+                memcpy(crop + row * crop_row_size, src + row * win_row_size,
+                    crop_row_size);
+            }
+        }
+        if (writeFileData(video, crop, crop_size) != crop_size) {
+            if (err != NULL) *err = "failed to write frame";
+            goto fail;
+        }
+        updateCopyProgress(progress, 1, crop_size);
+    }
+    if (conf.crop_track) {
+        printf("\nCrop region moved from %u,%u to %u,%u", conf.crop_x,
+            conf.crop_y, crop_x, crop_y);
+    }
+    free(crop);
+    if (window != NULL) free(window);
+    return 1;
+read_failed:
+    if (err != NULL) *err = "could not read frames";
+fail:
+    if (crop != NULL) free(crop);
+    if (window != NULL) free(window);
+    return 0;
+}
+
+/* Append `count` contiguous frames of `srcmovie`, starting from frame
+ * `from`, to `video`. Frames are copied in big steps, and `progress`
+ * (if not NULL) is updated after every step. See `copyVideoData` for
+ * the `buffer` argument. */
+static int appendFramesToVideo(FILE *video, SERMovie *srcmovie, uint32_t from,
+    uint32_t count, CopyProgress *progress, char **buffer, char **err)
+{
+    if (conf.crop_width > 0) {
+        return appendCroppedFramesToVideo(video, srcmovie, from, count,
+            progress, err);
+    }
+    if (isDebayering(srcmovie)) {
+        return appendDebayeredFramesToVideo(video, srcmovie, from, count,
+            progress, err);
+    }
+    if (SERIsCompressedMovie(srcmovie)) {
+        return appendDecodedFramesToVideo(video, srcmovie, from, count,
+            progress, err);
+    }
+    SERHeader *srcheader = srcmovie->header;
+    size_t frame_sz = SERGetFrameSize(srcheader);
+    if (frame_sz == 0) {
+        if (err != NULL) *err = "invalid frame size (0)";
+        return 0;
+    }
+    uint32_t frames_per_step = COPY_STEP_SIZE / frame_sz, copied = 0;
+    if (frames_per_step == 0) frames_per_step = 1;
+    while (copied < count) {
+        uint32_t step_count = count - copied;
+        if (step_count > frames_per_step) step_count = frames_per_step;
+        uint64_t offset = SERGetFrameOffset(srcheader, from + copied);
+        if (!copyVideoData(video, srcmovie->file, offset,
+            step_count * frame_sz, buffer, err)) return 0;
+        copied += step_count;
+        updateCopyProgress(progress, step_count,
+            (uint64_t) step_count * frame_sz);
+    }
+    return 1;
+}
+
+/* Copy dates of frames `from` - `from + count - 1` into `datetimes`.
+ * Return 0 if any of the frames has no date. */
+static int getFrameRangeDates(SERMovie *movie, uint32_t from, uint32_t count,
+    uint64_t *datetimes)
+{
+    uint32_t dates_count = 0, i;
+    const uint64_t *dates = SERGetFrameDates(movie, &dates_count);
+    if (dates == NULL || from + count > dates_count) return 0;
+    for (i = 0; i < count; i++) {
+        uint64_t datetime = dates[from + i];
+        if (datetime == 0) return 0;
+        datetimes[i] = datetime;
+    }
+    return 1;
+}
+
+/* Create a copy of the header of `movie` suitable for a new movie
+ * containing only the frames in `range`: frame count is updated and, if
+ * the movie has a trailer, the movie date is set to the date of first
+ * frame in the range. Dates of the first and last frame in the range are
+ * stored into `first_date` and `last_date` (0 if the movie has no
+ * trailer). Return NULL if out-of-memory. */
+static SERHeader *createRangeHeader(SERMovie *movie, SERFrameRange *range,
+    uint64_t *first_date, uint64_t *last_date)
+{
+    SERHeader *header = movie->header;
+    SERHeader *new_header = SERDuplicateHeader(header);
+    if (new_header == NULL) return NULL;
+    new_header->uiFrameCount = range->count;
+    if (isDebayering(movie)) setDebayeredHeader(new_header);
+    *first_date = 0;
+    *last_date = 0;
+    if (SERMovieHasTrailer(movie)) {
+        int64_t utc_diff = header->ulDateTime_UTC - header->ulDateTime;
+        uint64_t first_frame_utc;
+        *first_date = SERGetFrameDate(movie, range->from);
+        *last_date = SERGetFrameDate(movie, range->to);
+        first_frame_utc = *first_date;
+        if (utc_diff > 0 && (uint64_t) utc_diff < first_frame_utc)
+            first_frame_utc -= utc_diff;
+        new_header->ulDateTime = *first_date;
+        new_header->ulDateTime_UTC = first_frame_utc;
+    }
+    return new_header;
+}
+
+/* Write a new movie containing the frames of `movie` in `range` to
+ * `video`, by using `header` as the movie header. Frames are copied as
+ * they are and the datetimes trailer (if any) is rebuilt from the dates
+ * of the copied frames. See `appendFramesToVideo` for the `progress` and
+ * `buffer` arguments.
+ * Return 1 on success, 0 otherwise. */
+static int writeRangeToVideo(FILE *video, SERMovie *movie, SERHeader *header,
+    SERFrameRange *range, CopyProgress *progress, char **buffer, char **err)
+{
+    uint64_t *datetimes_buffer = NULL;
+    uint32_t from = range->from, count = range->count;
+    int has_trailer = SERMovieHasTrailer(movie);
+    if (progress == NULL || progress->lock == NULL)
+        printf("Writing movie header\n");
+    if (!writeHeaderToVideo(video, header)) {
+        *err = "failed to write header";
+        goto fail;
+    }
+    size_t trailer_size = (count * sizeof(uint64_t));
+    uint32_t broken_dates_count = 0;
+    if (conf.break_movie == BREAK_DATES) {
+        broken_dates_count = (count > 1 ? 2 : count);
+        trailer_size = (broken_dates_count * sizeof(uint64_t));
+    }
+    if (has_trailer) {
+        datetimes_buffer = malloc(count * sizeof(uint64_t));
+        if (datetimes_buffer == NULL) {
+            *err = "out-of-memory";
+            goto fail;
+        }
+        if (!getFrameRangeDates(movie, from, count, datetimes_buffer)) {
+            *err = "invalid frame date";
+            goto fail;
+        }
+    }
+    if (!appendFramesToVideo(video, movie, from, count, progress, buffer, err))
+        goto fail;
+    if (has_trailer && datetimes_buffer != NULL) {
+        if (conf.break_movie == BREAK_DATE_ORDER && count > 1) {
+            uint64_t first_date = datetimes_buffer[0],
+                     last_date = datetimes_buffer[count - 1];
+            datetimes_buffer[0] = last_date;
+            datetimes_buffer[1] = first_date;
+        } else if (conf.break_movie == BREAK_NO_DATES) goto final;
+        if (progress == NULL || progress->lock == NULL)
+            printf("\nWriting frame datetimes trailer");
+        if (!writeTrailerToVideo(video, datetimes_buffer, trailer_size)) {
+            *err = "failed to write frame datetimes trailer";
+            goto fail;
+        }
+    }
+final:
+    if (datetimes_buffer != NULL) free(datetimes_buffer);
+    return 1;
+fail:
+    if (datetimes_buffer != NULL) free(datetimes_buffer);
+    return 0;
 }
 
 static int extractFramesFromVideo(SERMovie *movie, char *outputpath,
@@ -1225,9 +2627,9 @@ static int extractFramesFromVideo(SERMovie *movie, char *outputpath,
 {
     char *err = NULL;
     SERHeader *new_header = NULL;
-    uint64_t *datetimes_buffer = NULL;
     FILE *ofile = NULL;
-    uint32_t from, to, count, i = 0;
+    char opath[PATH_MAX + 1];
+    uint32_t from, to, count;
     int do_fix = (conf.action == ACTION_FIX),
         has_trailer = SERMovieHasTrailer(movie);
     from = range->from;
@@ -1238,27 +2640,25 @@ static int extractFramesFromVideo(SERMovie *movie, char *outputpath,
         err = "missing source movie header";
         goto fail;
     }
-    new_header = SERDuplicateHeader(header);
-    if (new_header == NULL) goto fail;
-    if (conf.break_movie != BREAK_FRAMES)
-        new_header->uiFrameCount = count;
-    int64_t utc_diff = header->ulDateTime_UTC - header->ulDateTime;
-    uint64_t first_frame_date, last_frame_date, first_frame_utc;
-    if (has_trailer) {
-        first_frame_date = SERGetFrameDate(movie, from);
-        first_frame_utc = first_frame_date;
-        last_frame_date = SERGetFrameDate(movie, to);
-        if (first_frame_date == 0 && !do_fix) {
-            err = "unable to read first frame date";
-            goto fail;
-        }
-        if (utc_diff > 0 && (uint64_t) utc_diff < first_frame_utc)
-            first_frame_utc -= utc_diff;
-        new_header->ulDateTime = first_frame_date;
-        new_header->ulDateTime_UTC = first_frame_utc;
+    if (conf.crop_width > 0 && !checkCropRegion(movie, &err)) goto fail;
+    uint64_t first_frame_date = 0, last_frame_date = 0;
+    new_header = createRangeHeader(movie, range, &first_frame_date,
+                                   &last_frame_date);
+    if (new_header == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    if (conf.crop_width > 0) {
+        new_header->uiImageWidth = conf.crop_width;
+        new_header->uiImageHeight = conf.crop_height;
+    }
+    if (conf.break_movie == BREAK_FRAMES)
+        new_header->uiFrameCount = header->uiFrameCount;
+    if (has_trailer && first_frame_date == 0 && !do_fix) {
+        err = "unable to read first frame date";
+        goto fail;
     }
     if (outputpath == NULL) {
-        char opath[PATH_MAX + 1];
         SERMovie dummy_movie = {0};
         dummy_movie.filepath = movie->filepath;
         dummy_movie.header = new_header;
@@ -1272,7 +2672,7 @@ static int extractFramesFromVideo(SERMovie *movie, char *outputpath,
         int overwrite = askForFileOverwrite(outputpath);
         if (!overwrite) goto fail;
     }
-    ofile = fopen(outputpath, "w");
+    ofile = openOutputVideo(outputpath);
     if (ofile == NULL) {
         SERLogErr(LOG_TAG_ERR "Failed to open %s for writing\n", outputpath);
         err = "could not open output video for writing";
@@ -1280,76 +2680,34 @@ static int extractFramesFromVideo(SERMovie *movie, char *outputpath,
     }
     SERPrintHeader("EXTRACT FRAMES");
     printf("Extracting %d frame(s): %d - %d\n", count, from + 1, to + 1);
-    printf("Writing movie header\n");
-    if (!writeHeaderToVideo(ofile, new_header)) {
-        err = "failed to write header";
-        goto fail;
-    }
-    long offset = SERGetFrameOffset(header, from);
-    if (fseek(movie->file, offset, SEEK_SET) < 0) {
-        err = "frame offset beyond movie length";
-        goto fail;
-    }
-    size_t trailer_size = (count * sizeof(uint64_t));
-    uint32_t broken_dates_count = 0;
-    if (conf.break_movie == BREAK_DATES) {
-        broken_dates_count = (count > 1 ? 2 : count);
-        trailer_size = (broken_dates_count * sizeof(uint64_t));
-    }
-    if (has_trailer) {
-        datetimes_buffer = malloc(trailer_size);
-        if (datetimes_buffer == NULL) {
-            err = "out-of-memory";
-            goto fail;
-        }
-    }
-    for (i = 0; i < count; i++) {
-        int frame_id = i + 1;
-        SERLogProgress("Writing frames", frame_id, count);
-        int frame_idx = from + i;
-        if (!appendFrameToVideo(ofile, movie, frame_idx, &err)) {
-            printf("\n");
-            fflush(stdout);
-            goto fail;
-        }
-        if (datetimes_buffer == NULL) continue;
-        uint64_t datetime = SERGetFrameDate(movie, frame_idx);
-        if (datetime == 0) {
-            printf("\n");
-            fflush(stdout);
-            err = "invalid frame date";
-            goto fail;
-        }
-        if (broken_dates_count > 0 && i >= broken_dates_count) continue;
-        datetimes_buffer[i] = datetime;
+    if (conf.crop_width > 0) {
+        printf("Crop region: %u,%u %ux%u%s\n", conf.crop_x, conf.crop_y,
+            conf.crop_width, conf.crop_height,
+            (conf.crop_track ? " (tracking)" : ""));
+        /* Rows outside of the region are skipped: don't let read-ahead
+         * read them anyway. */
+        if (!conf.direct_io) SERAdviseMovieAccess(movie, SER_ACCESS_RANDOM);
     }
+    CopyProgress progress = {0, count, NULL};
+    int ok = writeRangeToVideo(ofile, movie, new_header, range, &progress,
+                               &copy_buffer, &err);
     printf("\n");
     fflush(stdout);
-    if (has_trailer && datetimes_buffer != NULL) {
-        if (conf.break_movie == BREAK_DATE_ORDER && count > 1) {
-            uint64_t first_date = datetimes_buffer[0],
-                     last_date = datetimes_buffer[count - 1];
-            datetimes_buffer[0] = last_date;
-            datetimes_buffer[1] = first_date;
-        } else if (conf.break_movie == BREAK_NO_DATES) goto final;
-        printf("Writing frame datetimes trailer\n");
-        if (!writeTrailerToVideo(ofile, datetimes_buffer, trailer_size)) {
-            err = "failed to write frame datetimes trailer";
-            goto fail;
-        }
+    if (!ok) goto fail;
+    if (closeOutputVideo(ofile) != 0) {
+        ofile = NULL;
+        err = "failed to write movie";
+        goto fail;
     }
-final:
+    ofile = NULL;
     printf("New video written to:\n%s\n\n", outputpath);
     fflush(stdout);
     if (new_header != NULL) free(new_header);
-    if (datetimes_buffer != NULL) free(datetimes_buffer);
-    fclose(ofile);
     strcpy(output_movie_path, outputpath);
     return 1;
 fail:
-    if (ofile != NULL) fclose(ofile);
+    if (ofile != NULL) closeOutputVideo(ofile);
     if (new_header != NULL) free(new_header);
-    if (datetimes_buffer != NULL) free(datetimes_buffer);
     SERLogErr(LOG_TAG_ERR "Could not extract frames");
     if (err != NULL)
         SERLogErr(": %s (frame count: %d)", err, header->uiFrameCount);
@@ -1364,8 +2722,9 @@ static int cutFramesFromVideo(SERMovie *movie, char *outputpath,
     SERHeader *new_header = NULL;
     uint64_t *datetimes_buffer = NULL;
     FILE *ofile = NULL;
+    char opath[PATH_MAX + 1];
     uint32_t from, to, count, tot_frames, first_frame_idx, last_frame_idx,
-            src_last_frame, i = 0;
+            src_last_frame;
     from = range->from;
     to = range->to;
     count = range->count;
@@ -1380,6 +2739,7 @@ static int cutFramesFromVideo(SERMovie *movie, char *outputpath,
     }
     new_header = SERDuplicateHeader(header);
     if (new_header == NULL) goto fail;
+    if (isDebayering(movie)) setDebayeredHeader(new_header);
     tot_frames = SERGetFrameCount(movie) - count;
     new_header->uiFrameCount = tot_frames;
     src_last_frame = SERGetLastFrameIndex(movie);
@@ -1400,7 +2760,6 @@ static int cutFramesFromVideo(SERMovie *movie, char *outputpath,
     new_header->ulDateTime = first_frame_date;
     new_header->ulDateTime_UTC = first_frame_utc;
     if (outputpath == NULL) {
-        char opath[PATH_MAX + 1];
         SERMovie dummy_movie = {0};
         dummy_movie.filepath = movie->filepath;
         dummy_movie.header = new_header;
@@ -1414,7 +2773,7 @@ static int cutFramesFromVideo(SERMovie *movie, char *outputpath,
         int overwrite = askForFileOverwrite(outputpath);
         if (!overwrite) goto fail;
     }
-    ofile = fopen(outputpath, "w");
+    ofile = openOutputVideo(outputpath);
     if (ofile == NULL) {
         SERLogErr(LOG_TAG_ERR "Failed to open %s for writing\n", outputpath);
         err = "could not open output video for writing";
@@ -1428,53 +2787,31 @@ static int cutFramesFromVideo(SERMovie *movie, char *outputpath,
         err = "failed to write header";
         goto fail;
     }
-    long offset = SERGetFrameOffset(header, from);
-    if (fseek(movie->file, offset, SEEK_SET) < 0) {
-        err = "frame offset beyond movie length";
-        goto fail;
-    }
     size_t trailer_size = (tot_frames * sizeof(uint64_t));
     datetimes_buffer = malloc(trailer_size);
     if (datetimes_buffer == NULL) {
         err = "out-of-memory";
         goto fail;
     }
-    int frame_idx, frame_id = 0;
-    for (i = 0; i < from; i++) {
-        frame_id = i + 1;
-        frame_idx = i;
-        SERLogProgress("Writing frames", frame_id, tot_frames);
-        if (!appendFrameToVideo(ofile, movie, frame_idx, &err)) {
-            printf("\n");
-            fflush(stdout);
-            goto fail;
-        }
-        uint64_t datetime = SERGetFrameDate(movie, frame_idx);
-        if (datetime == 0) {
-            printf("\n");
-            fflush(stdout);
-            err = "invalid frame date";
-            goto fail;
-        }
-        datetimes_buffer[frame_idx] = datetime;
+    uint32_t tail_count = src_last_frame - to;
+    if (!getFrameRangeDates(movie, 0, from, datetimes_buffer) ||
+        !getFrameRangeDates(movie, to + 1, tail_count,
+                            datetimes_buffer + from))
+    {
+        err = "invalid frame date";
+        goto fail;
     }
-    for (i = to + 1; i <= src_last_frame; i++) {
-        frame_idx++;
-        frame_id = frame_idx + 1;
-        SERLogProgress("Writing frames", frame_id, tot_frames);
-        if (!appendFrameToVideo(ofile, movie, i, &err)) {
-            printf("\n");
-            fflush(stdout);
-            goto fail;
-        }
-        uint64_t datetime = SERGetFrameDate(movie, i);
-        if (datetime == 0) {
-            printf("\n");
-            fflush(stdout);
-            err = "invalid frame date";
-            goto fail;
-        }
-        datetimes_buffer[frame_idx] = datetime;
+    /* Frames before and after the cut range are written with two range
+     * copies. */
+    CopyProgress progress = {0, tot_frames, NULL};
+    if (!appendFramesToVideo(ofile, movie, 0, from, &progress, &copy_buffer,
+                             &err) ||
+        !appendFramesToVideo(ofile, movie, to + 1, tail_count, &progress,
+                             &copy_buffer, &err))
+    {
+        printf("\n");
+        fflush(stdout);
+        goto fail;
     }
     printf("\n");
     fflush(stdout);
@@ -1483,16 +2820,21 @@ static int cutFramesFromVideo(SERMovie *movie, char *outputpath,
         err = "failed to write frame datetimes trailer";
         goto fail;
     }
+    if (closeOutputVideo(ofile) != 0) {
+        ofile = NULL;
+        err = "failed to write movie";
+        goto fail;
+    }
+    ofile = NULL;
     printf("New video written to:\n%s\n", outputpath);
     fflush(stdout);
 
     if (new_header != NULL) free(new_header);
     if (datetimes_buffer != NULL) free(datetimes_buffer);
-    fclose(ofile);
     strcpy(output_movie_path, outputpath);
     return 1;
 fail:
-    if (ofile != NULL) fclose(ofile);
+    if (ofile != NULL) closeOutputVideo(ofile);
     if (new_header != NULL) free(new_header);
     if (datetimes_buffer != NULL) free(datetimes_buffer);
     if (err != NULL) {
@@ -1502,47 +2844,200 @@ fail:
     return 0;
 }
 
+typedef struct {
+    SERFrameRange *range;
+    SERHeader *header;
+    char *path;
+    int ok;
+    char *err;
+} SplitJob;
+
+typedef struct {
+    SERMovie *movie;
+    SplitJob *jobs;
+    uint32_t count;
+    uint32_t next;
+    int failed;
+    pthread_mutex_t lock;
+    CopyProgress progress;
+} SplitContext;
+
+/* Split worker thread: fetch the next pending chunk from the context and
+ * write it to its own output file, until no more chunks are left or
+ * some other worker failed. */
+static void *splitWorker(void *arg) {
+    SplitContext *ctx = arg;
+    char *buffer = NULL;
+    while (1) {
+        SplitJob *job = NULL;
+        pthread_mutex_lock(&ctx->lock);
+        if (!ctx->failed && ctx->next < ctx->count)
+            job = ctx->jobs + ctx->next++;
+        pthread_mutex_unlock(&ctx->lock);
+        if (job == NULL) break;
+        FILE *ofile = openOutputVideo(job->path);
+        if (ofile == NULL) {
+            job->err = "could not open output video for writing";
+        } else {
+            job->ok = writeRangeToVideo(ofile, ctx->movie, job->header,
+                job->range, &ctx->progress, &buffer, &job->err);
+            if (closeOutputVideo(ofile) != 0 && job->ok) {
+                job->ok = 0;
+                job->err = "failed to write frame";
+            }
+        }
+        if (!job->ok) {
+            pthread_mutex_lock(&ctx->lock);
+            ctx->failed = 1;
+            pthread_mutex_unlock(&ctx->lock);
+        }
+    }
+    if (buffer != NULL) free(buffer);
+    return NULL;
+}
+
+/* Return the number of split jobs to use: the one specified with
+ * --jobs or the number of online CPUs, capped to MAX_SPLIT_JOBS (chunks
+ * are mostly I/O bound, so using too many threads doesn't help). */
+static int getSplitJobs(uint32_t chunks) {
+    int jobs = conf.jobs;
+    if (jobs <= 0) {
+        jobs = 1;
+#if IS_UNIX
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        if (ncpu > 0) jobs = (int) ncpu;
+#endif
+        if (jobs > MAX_SPLIT_JOBS) jobs = MAX_SPLIT_JOBS;
+    }
+    if ((uint32_t) jobs > chunks) jobs = (int) chunks;
+    return jobs;
+}
+
 static int splitMovie(SERMovie *movie) {
     char *err = NULL;
     char errmsg[1024] = {0};
+    SplitContext ctx = {0};
+    pthread_t *threads = NULL;
+    int i, nthreads = 0, written_movies = 0, lock_initialized = 0;
     if (split_count == 0) goto fail;
-    assert(split_count <= MAX_SPLIT_COUNT);
-    char **movie_files = malloc(split_count * sizeof(*movie_files));
-    if (movie_files == NULL) {
+    ctx.movie = movie;
+    ctx.count = split_count;
+    ctx.jobs = calloc(split_count, sizeof(*ctx.jobs));
+    if (ctx.jobs == NULL) {
         err = "Out-of-memory";
         goto fail;
     }
-    memset(movie_files, 0, split_count * sizeof(*movie_files));
-    int i, ok, extracted_movies = 0;
+    /* Output paths are determined (and overwrites are confirmed) before
+     * starting to write anything. */
+    uint32_t tot_frames = 0;
     for (i = 0; i < (int)split_count; i++) {
+        SplitJob *job = ctx.jobs + i;
         SERFrameRange *range = splitRanges + i;
+        uint64_t first_date, last_date;
+        char opath[PATH_MAX + 1];
         assert(range->from < range->to);
         assert(range->count > 0);
-        ok = extractFramesFromVideo(movie, NULL, range);
-        if (!ok) break;
-        movie_files[extracted_movies++] = strdup(output_movie_path);
-    }
-    if (!ok) {
-        if (extracted_movies <= 0) err = "no movies extracted";
-        else {
-            sprintf(errmsg, "only %d frame(s) extracted out of %d",
-                extracted_movies, split_count
-            );
-            err = errmsg;
-        }
-    }
-    if (movie_files != NULL) {
-        if (extracted_movies > 0) printf("Files:\n\n");
-        for (i = 0; i < extracted_movies; i++) {
-            char *filepath = movie_files[i];
-            if (filepath != NULL) printf("%s\n", filepath);
-            free(filepath);
+        job->range = range;
+        job->header = createRangeHeader(movie, range, &first_date, &last_date);
+        if (job->header == NULL) {
+            err = "Out-of-memory";
+            goto fail;
+        }
+        if (conf.break_movie == BREAK_FRAMES)
+            job->header->uiFrameCount = movie->header->uiFrameCount;
+        if (SERMovieHasTrailer(movie) && first_date == 0) {
+            err = "unable to read first frame date";
+            goto fail;
+        }
+        SERMovie dummy_movie = {0};
+        dummy_movie.filepath = movie->filepath;
+        dummy_movie.header = job->header;
+        dummy_movie.firstFrameDate = first_date;
+        dummy_movie.lastFrameDate = last_date;
+        if (makeMovieOutputPath(opath, &dummy_movie, range, NULL) <= 0)
+            goto fail;
+        if (fileExists(opath) && !conf.overwrite) {
+            int overwrite = askForFileOverwrite(opath);
+            if (!overwrite) goto fail;
+        }
+        job->path = strdup(opath);
+        if (job->path == NULL) {
+            err = "Out-of-memory";
+            goto fail;
+        }
+        tot_frames += range->count;
+    }
+    if (pthread_mutex_init(&ctx.lock, NULL) != 0) {
+        err = "could not initialize lock";
+        goto fail;
+    }
+    lock_initialized = 1;
+    ctx.progress.tot = tot_frames;
+    ctx.progress.lock = &ctx.lock;
+    nthreads = getSplitJobs(split_count);
+    threads = calloc(nthreads, sizeof(*threads));
+    if (threads == NULL) {
+        err = "Out-of-memory";
+        goto fail;
+    }
+    SERPrintHeader("SPLIT MOVIE");
+    printf("Writing %d movie(s) using %d job(s)\n", split_count, nthreads);
+    fflush(stdout);
+    int started = 0;
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(threads + i, NULL, splitWorker, &ctx) != 0) break;
+        started++;
+    }
+    /* If no thread could be started, just run the worker here. */
+    if (started == 0) splitWorker(&ctx);
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    printf("\n");
+    fflush(stdout);
+    for (i = 0; i < (int)split_count; i++) {
+        SplitJob *job = ctx.jobs + i;
+        if (job->ok) {
+            written_movies++;
+            continue;
+        }
+        if (job->err != NULL) {
+            SERLogErr(LOG_TAG_ERR "Could not write %s: %s\n", job->path,
+                job->err);
+            if (err == NULL) err = job->err;
         }
-        free(movie_files);
+    }
+    if (written_movies < (int)split_count) {
+        if (written_movies <= 0) err = "no movies extracted";
+        else {
+            sprintf(errmsg, "only %d movie(s) extracted out of %d",
+                written_movies, split_count
+            );
+            err = errmsg;
+        }
+    }
+    if (written_movies > 0) printf("Files:\n\n");
+    for (i = 0; i < (int)split_count; i++) {
+        SplitJob *job = ctx.jobs + i;
+        if (job->ok) printf("%s\n", job->path);
     }
     if (err != NULL) goto fail;
+    free(threads);
+    for (i = 0; i < (int)split_count; i++) {
+        free(ctx.jobs[i].header);
+        free(ctx.jobs[i].path);
+    }
+    free(ctx.jobs);
+    pthread_mutex_destroy(&ctx.lock);
     return 1;
 fail:
+    if (threads != NULL) free(threads);
+    if (ctx.jobs != NULL) {
+        for (i = 0; i < (int)split_count; i++) {
+            if (ctx.jobs[i].header != NULL) free(ctx.jobs[i].header);
+            if (ctx.jobs[i].path != NULL) free(ctx.jobs[i].path);
+        }
+        free(ctx.jobs);
+    }
+    if (lock_initialized) pthread_mutex_destroy(&ctx.lock);
     SERLogErr("Failed to split movie");
     if (err != NULL) SERLogErr(": %s", err);
     fprintf(stderr, "\n");
@@ -1614,9 +3109,17 @@ static void printMovieInfo(SERMovie *movie) {
         printFieldValuePair("FPS", "%.2f", fps);
     }
 print_filesize:
-    fmt = "%ld%s";
-    if (getFilesizeStr(fsize, BUFLEN, movie->filesize) > 0) fmt = "%ld (%s)";
+    fmt = "%" PRIu64 "%s";
+    if (getFilesizeStr(fsize, BUFLEN, movie->filesize) > 0)
+        fmt = "%" PRIu64 " (%s)";
     printFieldValuePair("Filesize", fmt, movie->filesize, fsize);
+    if (SERIsCompressedMovie(movie)) {
+        uint64_t compressed_size = SERGetCompressedSize(movie);
+        fmt = "%" PRIu64 "%s";
+        if (getFilesizeStr(fsize, BUFLEN, compressed_size) > 0)
+            fmt = "%" PRIu64 " (%s)";
+        printFieldValuePair("Compressed size", fmt, compressed_size, fsize);
+    }
     if (movie->warnings != 0) {
         SERLogWarn("Found %d warning(s)\n",
             SERCountMovieWarnings(movie->warnings));
@@ -1624,6 +3127,152 @@ print_filesize:
     printf("\n");
 }
 
+/* Get summary statistics of channel `plane` from the movie histogram. */
+static void getChannelStats(MovieStats *stats, int plane, FrameStats *out,
+    uint64_t *count)
+{
+    uint64_t *hist = stats->histogram + ((size_t) plane * stats->bins);
+    uint64_t n = 0;
+    double sum = 0, sumsq = 0;
+    uint32_t i;
+    memset(out, 0, sizeof(*out));
+    out->min = stats->bins;
+    for (i = 0; i < stats->bins; i++) {
+        uint64_t c = hist[i];
+        if (c == 0) continue;
+        if (i < out->min) out->min = i;
+        out->max = i;
+        n += c;
+        sum += (double) c * i;
+        sumsq += (double) c * i * i;
+        if (i >= stats->saturation) out->saturated += c;
+    }
+    if (n == 0) out->min = 0;
+    else {
+        out->mean = sum / n;
+        double var = (sumsq / n) - (out->mean * out->mean);
+        out->stddev = (var > 0 ? sqrt(var) : 0);
+    }
+    if (count != NULL) *count = n;
+}
+
+static const char *getChannelName(SERHeader *header, int plane) {
+    if (header->uiColorID == COLOR_RGB) return (char *[]){"R", "G", "B"}[plane];
+    if (header->uiColorID == COLOR_BGR) return (char *[]){"B", "G", "R"}[plane];
+    return SERGetColorString(header->uiColorID);
+}
+
+static void logStatsToJSON(FILE *json_file, SERMovie *movie,
+    MovieStats *stats)
+{
+    uint32_t frame_count = stats->frame_count, i;
+    int p;
+    fprintf(json_file, "    \"stats\": {\n");
+    fprintf(json_file, "        \"depth\": %d,\n", stats->depth);
+    fprintf(json_file, "        \"saturation\": %u,\n", stats->saturation);
+    fprintf(json_file, "        \"channels\": [");
+    for (p = 0; p < stats->planes; p++) {
+        FrameStats ch;
+        getChannelStats(stats, p, &ch, NULL);
+        uint64_t *hist = stats->histogram + ((size_t) p * stats->bins);
+        fprintf(json_file, "%s\n            {\n", (p > 0 ? "," : ""));
+        fprintf(json_file, "                \"name\": \"%s\",\n",
+            getChannelName(movie->header, p));
+        fprintf(json_file, "                \"min\": %u,\n", ch.min);
+        fprintf(json_file, "                \"max\": %u,\n", ch.max);
+        fprintf(json_file, "                \"mean\": %.6f,\n", ch.mean);
+        fprintf(json_file, "                \"stddev\": %.6f,\n", ch.stddev);
+        fprintf(json_file, "                \"saturated\": %llu,\n",
+            (unsigned long long) ch.saturated);
+        fprintf(json_file, "                \"histogram\": [");
+        for (i = 0; i < stats->bins; i++) {
+            fprintf(json_file, "%s%llu", (i > 0 ? "," : ""),
+                (unsigned long long) hist[i]);
+        }
+        fprintf(json_file, "]\n            }");
+    }
+    fprintf(json_file, "\n        ],\n");
+    fprintf(json_file, "        \"frames\": [");
+    for (i = 0; i < frame_count; i++) {
+        FrameStats *fs = stats->frames + i;
+        fprintf(json_file, "%s\n            {\"min\": %u, \"max\": %u, "
+            "\"mean\": %.6f, \"stddev\": %.6f, \"saturated\": %llu}",
+            (i > 0 ? "," : ""), fs->min, fs->max, fs->mean, fs->stddev,
+            (unsigned long long) fs->saturated);
+    }
+    fprintf(json_file, "\n        ]\n");
+    fprintf(json_file, "    },\n");
+}
+
+static void printIOStats(SERIOStats *io) {
+    double read_mb = io->bytes_read / (double) SIZE_MB,
+           written_mb = io->bytes_written / (double) SIZE_MB,
+           read_t = io->read_time / 1e9, write_t = io->write_time / 1e9;
+    printFieldValuePair("Read", "%.2f MB, %llu call(s), %.3f sec. "
+        "(%.1f MB/s)", read_mb, (unsigned long long) io->reads, read_t,
+        (read_t > 0 ? read_mb / read_t : 0));
+    printFieldValuePair("Seeks", "%llu", (unsigned long long) io->seeks);
+    printFieldValuePair("Convert", "%.3f sec.", io->convert_time / 1e9);
+    printFieldValuePair("Written", "%.2f MB, %llu call(s), %.3f sec. "
+        "(%.1f MB/s)", written_mb, (unsigned long long) io->writes, write_t,
+        (write_t > 0 ? written_mb / write_t : 0));
+}
+
+/* Print I/O statistics collected by --profile, for every phase having
+ * some I/O */
+static void printMovieProfile(SERMovie *movie) {
+    SERMovieStats stats;
+    int i;
+    if (!SERGetMovieStats(movie, &stats)) return;
+    SERPrintHeader("PROFILE");
+    for (i = 0; i < SER_STATS_PHASES; i++) {
+        SERIOStats *io = stats.phases + i;
+        if (io->reads == 0 && io->seeks == 0 && io->writes == 0 &&
+            io->convert_time == 0) continue;
+        printf("Phase '%s':\n", profile_phases[i]);
+        printIOStats(io);
+        printf("\n");
+    }
+    printf("Total:\n");
+    printIOStats(&(stats.total));
+    printf("\n");
+}
+
+static void logIOStatsToJSON(FILE *json_file, const char *name,
+    SERIOStats *io, int last)
+{
+    fprintf(json_file, "        \"%s\": {\n", name);
+    fprintf(json_file, "            \"bytesRead\": %llu,\n",
+        (unsigned long long) io->bytes_read);
+    fprintf(json_file, "            \"bytesWritten\": %llu,\n",
+        (unsigned long long) io->bytes_written);
+    fprintf(json_file, "            \"reads\": %llu,\n",
+        (unsigned long long) io->reads);
+    fprintf(json_file, "            \"seeks\": %llu,\n",
+        (unsigned long long) io->seeks);
+    fprintf(json_file, "            \"writes\": %llu,\n",
+        (unsigned long long) io->writes);
+    fprintf(json_file, "            \"readTime\": %.6f,\n",
+        io->read_time / 1e9);
+    fprintf(json_file, "            \"convertTime\": %.6f,\n",
+        io->convert_time / 1e9);
+    fprintf(json_file, "            \"writeTime\": %.6f\n",
+        io->write_time / 1e9);
+    fprintf(json_file, "        }%s\n", (last ? "" : ","));
+}
+
+static void logProfileToJSON(FILE *json_file, SERMovie *movie) {
+    SERMovieStats stats;
+    int i;
+    if (!SERGetMovieStats(movie, &stats)) return;
+    fprintf(json_file, "    \"profile\": {\n");
+    for (i = 0; i < SER_STATS_PHASES; i++) {
+        logIOStatsToJSON(json_file, profile_phases[i], stats.phases + i, 0);
+    }
+    logIOStatsToJSON(json_file, "total", &(stats.total), 1);
+    fprintf(json_file, "    },\n");
+}
+
 static int logToJSON(FILE *json_file, SERMovie *movie)
 {
     char fileID[15];
@@ -1633,9 +3282,9 @@ static int logToJSON(FILE *json_file, SERMovie *movie)
     char *abspath = NULL;
     SERHeader *header = movie->header;
     strncpy(fileID, (const char*) header->sFileID, 14);
-    strncpy(observer, (const char*) header->sObserver, 40);
-    strncpy(camera, (const char*) header->sInstrument, 40);
-    strncpy(scope, (const char*) header->sTelescope, 40);
+    memcpy(observer, header->sObserver, 39);
+    memcpy(camera, header->sInstrument, 39);
+    memcpy(scope, header->sTelescope, 39);
     fileID[14] = '\0';
     observer[39] = '\0';
     scope[39] = '\0';
@@ -1672,6 +3321,18 @@ static int logToJSON(FILE *json_file, SERMovie *movie)
     fprintf(json_file, "    \"lastFrameUnixtime\": %zu,\n",
         SERVideoTimeToUnixtime(movie->lastFrameDate, NULL));
     fprintf(json_file, "    \"duration\": %d,\n", movie->duration);
+    if (frame_scores != NULL) {
+        uint32_t frame_count = SERGetFrameCount(movie), j;
+        fprintf(json_file, "    \"scores\": [");
+        for (j = 0; j < frame_count; j++) {
+            fprintf(json_file, "%s\n        %.6e", (j > 0 ? "," : ""),
+                frame_scores[j]);
+        }
+        fprintf(json_file, "\n    ],\n");
+    }
+    if (movie_stats != NULL) logStatsToJSON(json_file, movie, movie_stats);
+    if (deep_check != NULL) logDeepCheckToJSON(json_file, deep_check);
+    if (movie->stats != NULL) logProfileToJSON(json_file, movie);
 
     fprintf(json_file, "    \"warnings\": [");
     size_t wlen = sizeof(movie->warnings),
@@ -1695,20 +3356,25 @@ static int logToJSON(FILE *json_file, SERMovie *movie)
     return 1;
 }
 
-static int saveFITSImage(SERMovie *movie, FILE *imagefile, uint32_t frame_idx,
-    void *pixels, size_t size)
+/* Add the keywords describing images of `movie` to `hdr`. If the movie
+ * has a trailer, a DATE-OBS keyword is added too: its value is set for
+ * every frame by `updateFITSHeaderDate`.
+ * If `cube_frames` is > 0, the header describes a cube of `cube_frames`
+ * images (the last axis being the frame axis) followed by extensions.
+ * If `bitpix` is not zero, it overrides the BITPIX value deduced by the
+ * movie pixel depth (ie. -32 for float images). */
+static int addFITSImageKeywords(FITSHeaderUnit *hdr, SERMovie *movie,
+    uint32_t cube_frames, int bitpix)
 {
-    FITSHeaderUnit *hdr = NULL;
-    void *data_unit =  NULL;
-    size_t data_size = 0;
-    hdr = FITSCreateHeaderUnit();
     int keyword_added =
         FITSHeaderAdd(hdr, "SIMPLE", "file does conform to FITS standard", "T");
     if (!keyword_added) goto keyword_fail;
     uint32_t color_id = movie->header->uiColorID;
-    int bitpix = (movie->header->uiPixelDepth <= 8 ? 8 : 16),
-        is_mono = (color_id < COLOR_RGB),
+    if (isDebayering(movie)) color_id = COLOR_RGB;
+    int is_mono = (color_id < COLOR_RGB),
         naxis = (is_mono ? 2 : 3);
+    if (cube_frames > 0) naxis++;
+    if (bitpix == 0) bitpix = (movie->header->uiPixelDepth <= 8 ? 8 : 16);
     keyword_added = FITSHeaderAdd(hdr, "BITPIX",
         "number of bits per data pixel", "%d", bitpix);
     if (!keyword_added) goto keyword_fail;
@@ -1726,6 +3392,16 @@ static int saveFITSImage(SERMovie *movie, FILE *imagefile, uint32_t frame_idx,
             "channels", "%d", 3);
         if (!keyword_added) goto keyword_fail;
     }
+    if (cube_frames > 0) {
+        char frames_kw[BUFLEN];
+        snprintf(frames_kw, sizeof(frames_kw), "NAXIS%d", naxis);
+        keyword_added = FITSHeaderAdd(hdr, frames_kw,
+            "frames", "%u", cube_frames);
+        if (!keyword_added) goto keyword_fail;
+        keyword_added = FITSHeaderAdd(hdr, "EXTEND",
+            "file may contain extensions", "T");
+        if (!keyword_added) goto keyword_fail;
+    }
     if (is_mono && color_id > COLOR_MONO) {
         /* Bayer pattern */
         char bayer_pat[BUFLEN];
@@ -1736,110 +3412,109 @@ static int saveFITSImage(SERMovie *movie, FILE *imagefile, uint32_t frame_idx,
         if (!keyword_added) goto keyword_fail;
     }
     if (SERMovieHasTrailer(movie)) {
-        uint32_t usec = 0;
-        time_t frame_time = 0;
-        char timestamp[24];
-        size_t datelen = 0;
-        uint64_t frame_datetime = SERGetFrameDate(movie, frame_idx);
-        if (frame_datetime > 0)
-            frame_time = SERVideoTimeToUnixtime(frame_datetime, &usec);
-        if (frame_time > 0) {
-            struct tm *frame_tm = gmtime(&frame_time);
-            datelen = strftime(timestamp, 24, "%Y-%m-%dT%H:%M:%S", frame_tm);
-        }
-        if (datelen == 19) {
-            char *ptr = timestamp + datelen;
-            usec /= 1000;
-            if (usec < 1000) datelen += snprintf(ptr, 5, ".%03d", usec);
-            else SERLogWarn(LOG_TAG_WARN "Invalid microsec. for frame date\n");
-        }
-        if (datelen == 23) {
-            timestamp[23] = '\0';
-            keyword_added = FITSHeaderAdd(hdr, "DATE-OBS",
-                "UTC date of observation", "'%s'", timestamp);
-            if (!keyword_added) goto keyword_fail;
-        }
+        keyword_added = FITSHeaderAdd(hdr, "DATE-OBS",
+            "UTC date of observation", "''");
+        if (!keyword_added) goto keyword_fail;
     }
+    return 1;
+keyword_fail:
+    SERLogErr(LOG_TAG_ERR "Failed to add FITS keyword\n");
+    return 0;
+}
+
+/* Build the FITS header shared by every frame of the movie (see
+ * `addFITSImageKeywords`), so that the header can be built once and used
+ * as a template for a whole range of frames. */
+static FITSHeaderUnit *createFITSHeaderTemplate(SERMovie *movie,
+    uint32_t cube_frames)
+{
+    FITSHeaderUnit *hdr = FITSCreateHeaderUnit();
+    if (hdr == NULL) return NULL;
+    if (!addFITSImageKeywords(hdr, movie, cube_frames, 0)) goto fail;
     /* End header */
-    if (!FITSHeaderEnd(hdr)) goto keyword_fail;
-    data_unit = FITSCreateDataUnit(pixels, size, &data_size);
-    if (data_unit == NULL) {
-        SERLogErr(LOG_TAG_ERR "Failed to create FITS data unit\n");
+    if (!FITSHeaderEnd(hdr)) {
+        SERLogErr(LOG_TAG_ERR "Failed to add FITS keyword\n");
         goto fail;
     }
-    size_t nwritten = 0, totwritten = 0, remain = hdr->size;
-    char *ptr = (char *) hdr->header;
-    assert(hdr->header != NULL);
     SERLogInfo("FITS Header: added %d keyword(s)\n", hdr->count);
-    printf("Writing %zu bytes of FITS header\n", hdr->size);
-    while (totwritten < hdr->size) {
-        nwritten = fwrite(ptr, 1, remain, imagefile);
-        if (nwritten <= 0) break;
-        totwritten += nwritten;
-        ptr += nwritten;
-        remain -= nwritten;
-    }
-    if (totwritten != hdr->size) {
-        SERLogErr(LOG_TAG_ERR "Failed to write header unit to FITS file\n");
-        goto fail;
-    }
-    nwritten = 0, totwritten = 0, remain = data_size;
-    ptr = (char *) data_unit;
-    printf("Writing %zu bytes of FITS data\n", data_size);
-    while (totwritten < data_size) {
-        nwritten = fwrite(ptr, 1, remain, imagefile);
-        if (nwritten <= 0) break;
-        totwritten += nwritten;
-        ptr += nwritten;
-        remain -= nwritten;
+    return hdr;
+fail:
+    FITSReleaseHeaderUnit(hdr);
+    return NULL;
+}
+
+/* Format a SER frame date as a FITS date (ie. 2020-01-01T00:00:00.000)
+ * into `timestamp`, that must be at least FITS_DATE_LEN + 1 bytes long.
+ * Return 1 if the date is valid, 0 otherwise. */
+static int formatFITSDate(uint64_t frame_datetime, char *timestamp) {
+    uint32_t usec = 0;
+    time_t frame_time = 0;
+    size_t datelen = 0;
+    if (frame_datetime > 0)
+        frame_time = SERVideoTimeToUnixtime(frame_datetime, &usec);
+    if (frame_time > 0) {
+        struct tm frame_tm;
+        if (gmtime_r(&frame_time, &frame_tm) != NULL) {
+            datelen = strftime(timestamp, FITS_DATE_LEN + 1,
+                "%Y-%m-%dT%H:%M:%S", &frame_tm);
+        }
     }
-    if (totwritten != data_size) {
-        SERLogErr(LOG_TAG_ERR "Failed to write data unit to FITS file\n");
-        goto fail;
+    if (datelen == 19) {
+        char *ptr = timestamp + datelen;
+        usec /= 1000;
+        if (usec < 1000) datelen += snprintf(ptr, 5, ".%03d", usec);
+        else SERLogWarn(LOG_TAG_WARN "Invalid microsec. for frame date\n");
     }
-    FITSReleaseHeaderUnit(hdr);
-    free(data_unit);
+    if (datelen != FITS_DATE_LEN) return 0;
+    timestamp[FITS_DATE_LEN] = '\0';
     return 1;
-keyword_fail:
-    SERLogErr(LOG_TAG_ERR "Failed to add FITS keyword\n");
-fail:
-    if (hdr != NULL) FITSReleaseHeaderUnit(hdr);
-    if (data_unit != NULL) free(data_unit);
-    return 0;
 }
 
-static int saveFrame(SERMovie *movie, int frame_id) {
-    uint32_t frame_idx = 0;
-    char *err = NULL;
-    char errmsg[BUFLEN];
-    void *pixels = NULL;
-    FILE *imagefile = NULL;
-    int format = conf.image_format;
-    if (format == 0) format = IMAGE_FORMAT_RAW;
-    if (frame_id == 0) {
-        err = "invalid frame id: 0";
-        goto fail;
+/* Set the DATE-OBS value of the header template to the date of the frame
+ * at `frame_idx`. If the frame has no valid date, the value is left
+ * empty. */
+static int updateFITSHeaderDate(FITSHeaderUnit *hdr, SERMovie *movie,
+    uint32_t frame_idx)
+{
+    if (!SERMovieHasTrailer(movie)) return 1;
+    char timestamp[FITS_DATE_LEN + 1];
+    if (!formatFITSDate(SERGetFrameDate(movie, frame_idx), timestamp)) {
+        SERLogWarn(LOG_TAG_WARN "Missing date for frame %d\n", frame_idx + 1);
+        return FITSHeaderUpdate(hdr, "DATE-OBS", "UTC date of observation",
+            "''");
     }
-    if (frame_id < 0) frame_idx = SERGetFrameCount(movie) + frame_id;
-    else frame_idx = frame_id - 1;
-    if (frame_idx >= SERGetFrameCount(movie)) {
-        sprintf(errmsg, "frame id %d beyond movie frames %d", frame_idx + 1,
-            SERGetFrameCount(movie));
-        err = errmsg;
-        goto fail;
+    return FITSHeaderUpdate(hdr, "DATE-OBS", "UTC date of observation",
+        "'%s'", timestamp);
+}
+
+/* Same as FITSWriteFile, accounted by --profile */
+static int writeFITSFile(FILE *file, FITSHeaderUnit *hdr, void *data,
+    size_t size)
+{
+    uint64_t start = getStatsClock();
+    int ok = FITSWriteFile(file, hdr, data, size);
+    recordStats(SER_STATS_WRITE, 1, (ok ? hdr->size + size : 0), start);
+    return ok;
+}
+
+static int saveFITSImage(SERMovie *movie, FILE *imagefile,
+    FITSHeaderUnit *hdr, uint32_t frame_idx, void *pixels, size_t size)
+{
+    if (!updateFITSHeaderDate(hdr, movie, frame_idx)) {
+        SERLogErr(LOG_TAG_ERR "Failed to update FITS header\n");
+        return 0;
     }
-    size_t size = 0;
-    int big_endian = IS_BIG_ENDIAN;
-    if (format == IMAGE_FORMAT_FITS) big_endian = 1;
-    pixels = SERGetFramePixels(movie, frame_idx, big_endian, &size);
-    if (pixels == NULL || size == 0) {
-        sprintf(errmsg, "could not get frame %d pixels", frame_id);
-        err = errmsg;
-        goto fail;
+    if (!writeFITSFile(imagefile, hdr, pixels, size)) {
+        SERLogErr(LOG_TAG_ERR "Failed to write FITS file\n");
+        return 0;
     }
-    SERLogInfo("Read %zu pixel byte(s)\n", size);
+    return 1;
+}
+
+static int makeFrameImagePath(char *outpath, SERMovie *movie,
+    uint32_t frame_idx, int format)
+{
     char *dir = conf.output_dir;
-    char outpath[PATH_MAX];
     char suffix[BUFLEN];
     char *ext = NULL;
     outpath[0] = '\0';
@@ -1849,118 +3524,3274 @@ static int saveFrame(SERMovie *movie, int frame_id) {
     if (format == IMAGE_FORMAT_FITS) ext = ".fit";
     else if (format == IMAGE_FORMAT_RAW) ext = ".raw";
     else {
-        SERLogErr(LOG_TAG_ERR, "Invalid image format\n");
-        goto fail;
+        SERLogErr(LOG_TAG_ERR "Invalid image format\n");
+        return 0;
     }
     if (!makeFilepath(outpath, movie->filepath, dir, suffix, ext)) {
         SERLogErr("Failed to create temporary filepath\n");
-        goto fail;
-    }
-    if (fileExists(outpath) && !conf.overwrite) {
-        int overwrite = askForFileOverwrite(outpath);
-        if (!overwrite) goto fail;
+        return 0;
     }
-    imagefile = fopen(outpath, "w");
+    return 1;
+}
+
+static int writeFrameImage(char *outpath, SERMovie *movie,
+    FITSHeaderUnit *fits_hdr, uint32_t frame_idx, void *pixels, size_t size)
+{
+    FILE *imagefile = fopen(outpath, "w");
     if (imagefile == NULL) {
         SERLogErr(LOG_TAG_ERR "Could not open '%s' for writing\n", outpath);
+        return 0;
+    }
+    int ok = 0;
+    if (fits_hdr != NULL) {
+        ok = saveFITSImage(movie, imagefile, fits_hdr, frame_idx, pixels,
+            size);
+        if (!ok) SERLogErr("Could not create FITS file\n");
+    } else {
+        ok = (writeFileData(imagefile, pixels, size) == size);
+        if (!ok) SERLogErr(LOG_TAG_ERR "Failed to write image\n");
+    }
+    if (fclose(imagefile) != 0) ok = 0;
+    return ok;
+}
+
+/* Save every frame in `range` to its own image file. The pixel buffer and
+ * the FITS header are allocated once and reused for every frame. */
+static int saveFrames(SERMovie *movie, SERFrameRange *range) {
+    char *err = NULL;
+    char errmsg[BUFLEN];
+    char outpath[PATH_MAX];
+    void *pixels = NULL;
+    FITSHeaderUnit *fits_hdr = NULL;
+    uint32_t i, saved = 0;
+    int format = conf.image_format;
+    if (format == 0) format = IMAGE_FORMAT_RAW;
+    int big_endian = IS_BIG_ENDIAN;
+    if (format == IMAGE_FORMAT_FITS) big_endian = 1;
+    int debayer = isDebayering(movie);
+    size_t size = SERGetFrameSize(movie->header);
+    if (debayer) size = SERGetFrameRGBSize(movie->header);
+    if (size == 0) {
+        err = "invalid frame size";
+        goto fail;
+    }
+    /* Output paths are checked (and overwrites are confirmed) before
+     * starting to write anything. */
+    for (i = range->from; i <= range->to; i++) {
+        if (!makeFrameImagePath(outpath, movie, i, format)) goto fail;
+        if (fileExists(outpath) && !conf.overwrite) {
+            int overwrite = askForFileOverwrite(outpath);
+            if (!overwrite) goto fail;
+        }
+    }
+    pixels = malloc(size);
+    if (pixels == NULL) {
+        err = "Out-of-memory";
         goto fail;
     }
     if (format == IMAGE_FORMAT_FITS) {
-        if (!saveFITSImage(movie, imagefile, frame_idx, pixels, size)) {
-            SERLogErr("Could not create FITS file\n");
+        fits_hdr = createFITSHeaderTemplate(movie, 0);
+        if (fits_hdr == NULL) goto fail;
+    }
+    int single = (range->count == 1);
+    for (i = range->from; i <= range->to; i++) {
+        int got_pixels = 0;
+        if (debayer) {
+            got_pixels = SERGetFrameRGBInto(movie, i, conf.debayer_method,
+                big_endian, pixels, size);
+        } else got_pixels =
+            SERGetFramePixelsInto(movie, i, big_endian, pixels, size);
+        if (!got_pixels) {
+            sprintf(errmsg, "could not get frame %d pixels", i + 1);
+            err = errmsg;
             goto fail;
         }
-    } else if (format == IMAGE_FORMAT_RAW) {
-        SERLogInfo("Writing %zu bytes to raw image\n", size);
-        size_t nwritten = 0, totwritten = 0, remain = size;
-        char *ptr = pixels;
-        while (totwritten < size) {
-            nwritten = fwrite(pixels, 1, remain, imagefile);
-            if (nwritten <= 0) break;
-            totwritten += nwritten;
-            ptr += totwritten;
-            remain -= totwritten;
-        }
-        if (totwritten != size) {
-            SERLogErr(LOG_TAG_ERR "Failed to write image\n");
+        if (!makeFrameImagePath(outpath, movie, i, format)) goto fail;
+        if (single) {
+            SERLogInfo("Read %zu pixel byte(s)\n", size);
+            if (fits_hdr != NULL) {
+                printf("Writing %zu bytes of FITS header\n", fits_hdr->size);
+                printf("Writing %zu bytes of FITS data\n",
+                    size + FITSGetDataUnitPadding(size));
+            } else SERLogInfo("Writing %zu bytes to raw image\n", size);
+        }
+        if (!writeFrameImage(outpath, movie, fits_hdr, i, pixels, size))
             goto fail;
+        saved++;
+        if (!single) {
+            printf("\rSaved %d/%d frame(s)", saved, range->count);
+            fflush(stdout);
         }
     }
+    if (single) SERLogSuccess("Frame image saved to:\n'%s'\n", outpath);
+    else {
+        printf("\n");
+        SERLogSuccess("%d frame image(s) saved to:\n'%s'\n", saved,
+            (conf.output_dir != NULL ? conf.output_dir : "/tmp"));
+    }
     free(pixels);
-    fclose(imagefile);
-    SERLogSuccess("Frame image saved to:\n'%s'\n", outpath);
+    FITSReleaseHeaderUnit(fits_hdr);
     return 1;
 fail:
+    if (saved > 0) printf("\n");
     if (err != NULL) SERLogErr(LOG_TAG_ERR "%s\n", err);
     if (pixels != NULL) free(pixels);
-    if (imagefile != NULL) fclose(imagefile);
+    if (fits_hdr != NULL) FITSReleaseHeaderUnit(fits_hdr);
     return 0;
 }
 
-static int fixMovie(SERMovie *movie) {
-    if (movie->warnings == 0) {
-        SERLogSuccess("This movie has no issues, no fix needed ;)\n");
-        return 1;
+/* Timestamps table (binary table extension of FITS cubes): one row per
+ * frame, holding frame number, SER date (100ns ticks since 0001-01-01)
+ * and UTC date of observation. */
+static FITSHeaderUnit *createFITSTimestampsHeader(uint32_t rows) {
+    FITSHeaderUnit *hdr = FITSCreateHeaderUnit();
+    if (hdr == NULL) return NULL;
+    int ok =
+        FITSHeaderAdd(hdr, "XTENSION", "binary table extension",
+            "'BINTABLE'") &&
+        FITSHeaderAdd(hdr, "BITPIX", "8-bit bytes", "%d", 8) &&
+        FITSHeaderAdd(hdr, "NAXIS", "2-dimensional binary table", "%d", 2) &&
+        FITSHeaderAdd(hdr, "NAXIS1", "width of table in bytes", "%d",
+            CUBE_TABLE_ROW_SIZE) &&
+        FITSHeaderAdd(hdr, "NAXIS2", "number of rows in table", "%u",
+            rows) &&
+        FITSHeaderAdd(hdr, "PCOUNT", "size of special data area", "%d", 0) &&
+        FITSHeaderAdd(hdr, "GCOUNT", "one data group", "%d", 1) &&
+        FITSHeaderAdd(hdr, "TFIELDS", "number of fields in each row", "%d",
+            3) &&
+        FITSHeaderAdd(hdr, "TTYPE1", "frame number", "'FRAME'") &&
+        FITSHeaderAdd(hdr, "TFORM1", "32-bit integer", "'1J'") &&
+        FITSHeaderAdd(hdr, "TTYPE2", "SER date (100ns ticks)", "'SERDATE'") &&
+        FITSHeaderAdd(hdr, "TFORM2", "64-bit integer", "'1K'") &&
+        FITSHeaderAdd(hdr, "TTYPE3", "UTC date of observation",
+            "'DATE-OBS'") &&
+        FITSHeaderAdd(hdr, "TFORM3", "character string", "'%dA'",
+            FITS_DATE_LEN) &&
+        FITSHeaderAdd(hdr, "EXTNAME", "name of this extension",
+            "'TIMESTAMPS'") &&
+        FITSHeaderEnd(hdr);
+    if (!ok) {
+        SERLogErr(LOG_TAG_ERR "Failed to add FITS keyword\n");
+        FITSReleaseHeaderUnit(hdr);
+        return NULL;
     }
-    if (movie->warnings & WARN_INCOMPLETE_FRAMES) {
-        SERLogInfo("Trying to fix incomplete frames...\n");
-        size_t frame_count = SERGetRealFrameCount(movie);
-        if (frame_count == 0) {
-            SERLogErr("Movie has no frames!\n");
+    return hdr;
+}
+
+static int writeFITSTimestampsTable(FILE *file, SERMovie *movie,
+    SERFrameRange *range)
+{
+    unsigned char rows[CUBE_TABLE_ROWS_PER_WRITE * CUBE_TABLE_ROW_SIZE];
+    FITSHeaderUnit *hdr = createFITSTimestampsHeader(range->count);
+    if (hdr == NULL) return 0;
+    int ok = (writeFileData(file, hdr->header, hdr->size) == hdr->size);
+    FITSReleaseHeaderUnit(hdr);
+    if (!ok) return 0;
+    uint32_t i, nrows = 0;
+    for (i = range->from; i <= range->to; i++) {
+        unsigned char *row = rows + (nrows * CUBE_TABLE_ROW_SIZE);
+        uint32_t frame_id = i + 1;
+        uint64_t date = SERGetFrameDate(movie, i);
+        int j;
+        /* FITS binary tables are big endian */
+        for (j = 0; j < 4; j++) row[j] = (frame_id >> (24 - (j * 8))) & 0xFF;
+        for (j = 0; j < 8; j++)
+            row[4 + j] = (date >> (56 - (j * 8))) & 0xFF;
+        char timestamp[FITS_DATE_LEN + 1];
+        /* Missing dates are left empty (filled with NULs) */
+        memset(row + 12, 0, FITS_DATE_LEN);
+        if (formatFITSDate(date, timestamp))
+            memcpy(row + 12, timestamp, FITS_DATE_LEN);
+        if (++nrows == CUBE_TABLE_ROWS_PER_WRITE || i == range->to) {
+            size_t size = nrows * CUBE_TABLE_ROW_SIZE;
+            if (writeFileData(file, rows, size) != size) return 0;
+            nrows = 0;
+        }
+    }
+    return FITSWriteDataPadding(file,
+        (size_t) range->count * CUBE_TABLE_ROW_SIZE);
+}
+
+/* Save all the frames in `range` to a single FITS cube, whose last axis
+ * is the frame axis. Frames are streamed one by one into the data unit,
+ * so that memory usage doesn't depend on the size of the range. If the
+ * movie has a trailer, frame dates are saved in a binary table extension
+ * (TIMESTAMPS) following the cube. */
+static int saveFramesCube(SERMovie *movie, SERFrameRange *range) {
+    char *err = NULL;
+    char outpath[PATH_MAX];
+    char suffix[BUFLEN];
+    void *pixels = NULL;
+    FILE *cube = NULL;
+    FITSHeaderUnit *hdr = NULL;
+    void *rgb = NULL;
+    SERFrameIterator *it = NULL;
+    uint32_t written = 0;
+    int debayer = isDebayering(movie);
+    size_t frame_size = SERGetFrameSize(movie->header),
+           image_size = frame_size;
+    if (frame_size == 0) {
+        err = "invalid frame size";
+        goto fail;
+    }
+    if (debayer) image_size = SERGetFrameRGBSize(movie->header);
+    if (conf.output_path != NULL) {
+        if (strlen(conf.output_path) >= PATH_MAX) {
+            err = "output path too long";
             goto fail;
         }
-        SERFrameRange range;
-        range.from = 0;
-        range.to = frame_count - 1;
-        range.count = frame_count;
-        char *output_path = conf.output_path;
-        if (conf.use_winjupos_filename) output_path = NULL;
-        if (!extractFramesFromVideo(movie, output_path, &range)) {
-            SERLogErr("Failed to fix movie\n");
+        strcpy(outpath, conf.output_path);
+    } else {
+        snprintf(suffix, BUFLEN, "-cube-%d-%d", range->from + 1,
+            range->to + 1);
+        char *dir = conf.output_dir;
+        if (dir == NULL) dir = "/tmp";
+        if (!makeFilepath(outpath, movie->filepath, dir, suffix, ".fit")) {
+            err = "failed to create output filepath";
+            goto fail;
+        }
+    }
+    if (fileExists(outpath) && !conf.overwrite) {
+        int overwrite = askForFileOverwrite(outpath);
+        if (!overwrite) goto fail;
+    }
+    hdr = createFITSHeaderTemplate(movie, range->count);
+    if (hdr == NULL) goto fail;
+    /* DATE-OBS of the primary header is the date of the first frame */
+    if (!updateFITSHeaderDate(hdr, movie, range->from)) {
+        err = "failed to update FITS header";
+        goto fail;
+    }
+    pixels = malloc(frame_size);
+    if (debayer) rgb = malloc(image_size);
+    if (pixels == NULL || (debayer && rgb == NULL)) {
+        err = "Out-of-memory";
+        goto fail;
+    }
+    cube = fopen(outpath, "w");
+    if (cube == NULL) {
+        SERLogErr(LOG_TAG_ERR "Could not open '%s' for writing\n", outpath);
+        goto fail;
+    }
+    printf("Writing %zu bytes of FITS header\n", hdr->size);
+    if (writeFileData(cube, hdr->header, hdr->size) != hdr->size) {
+        err = "failed to write FITS header";
+        goto fail;
+    }
+    it = SERFrameIteratorBegin(movie, range->from, range->count, 1, 0);
+    if (it == NULL) {
+        err = "could not read frames";
+        goto fail;
+    }
+    const SERFrame *frame;
+    while ((frame = SERFrameIteratorNext(it)) != NULL) {
+        const void *image = pixels;
+        if (debayer) {
+            SERConvertFramePixels(movie, frame->data, pixels, frame_size,
+                IS_BIG_ENDIAN);
+            if (!SERDebayerFramePixels(movie, pixels, rgb,
+                conf.debayer_method, 1))
+            {
+                err = "failed to debayer frame";
+                goto fail;
+            }
+            image = rgb;
+        } else SERConvertFramePixels(movie, frame->data, pixels, frame_size, 1);
+        if (writeFileData(cube, image, image_size) != image_size) {
+            err = "failed to write frame";
             goto fail;
         }
+        if ((++written % CUBE_PROGRESS_STEP) == 0) {
+            SERLogProgressBytes("Writing frames", written, range->count,
+                (uint64_t) written * image_size);
+        }
+    }
+    int iterator_ok = SERFrameIteratorEnd(it);
+    it = NULL;
+    if (!iterator_ok || written != range->count) {
+        err = "could not read frames";
+        goto fail;
     }
+    SERLogProgressBytes("Writing frames", written, range->count,
+        (uint64_t) written * image_size);
+    printf("\n");
+    if (!FITSWriteDataPadding(cube, (size_t) written * image_size)) {
+        err = "failed to write FITS data";
+        goto fail;
+    }
+    if (SERMovieHasTrailer(movie) &&
+        !writeFITSTimestampsTable(cube, movie, range))
+    {
+        err = "failed to write timestamps table";
+        goto fail;
+    }
+    if (fclose(cube) != 0) {
+        cube = NULL;
+        err = "failed to write FITS file";
+        goto fail;
+    }
+    free(pixels);
+    if (rgb != NULL) free(rgb);
+    FITSReleaseHeaderUnit(hdr);
+    SERLogSuccess("FITS cube (%d frame(s)) saved to:\n'%s'\n", written,
+        outpath);
     return 1;
 fail:
+    if (err != NULL) SERLogErr(LOG_TAG_ERR "%s\n", err);
+    if (it != NULL) SERFrameIteratorEnd(it);
+    if (cube != NULL) fclose(cube);
+    if (pixels != NULL) free(pixels);
+    if (rgb != NULL) free(rgb);
+    if (hdr != NULL) FITSReleaseHeaderUnit(hdr);
     return 0;
 }
 
-int main(int argc, char **argv) {
-    initConfig();
-    int filepath_idx = parseOptions(argc, argv);
-    if (filepath_idx >= argc) {
-        printHelp(argv);
+/* Frames are stacked by tiles: every tile is a contiguous range of
+ * samples (and a whole number of pixels) of the frame, processed by a
+ * single thread that reads only that part of every frame in the range.
+ * Mean stacking accumulates samples into 32-bit accumulators; median and
+ * sigma-clip stacking need all the values of every sample, so tiles are
+ * kept small enough that they never need more than STACK_TILE_MAX_BYTES,
+ * whatever the number of frames. */
+typedef struct {
+    SERMovie *movie;
+    SERFrameRange *range;
+    int method;
+    double sigma;
+    int bytes_per_sample;
+    size_t samples;         /* Samples (pixels * channels) per frame */
+    size_t tile_samples;    /* Samples per tile */
+    uint32_t tiles;
+    uint32_t next_tile;
+    uint32_t done;
+    int failed;
+    float *result;
+    pthread_mutex_t lock;
+} StackContext;
+
+static int readStackTile(StackContext *ctx, uint32_t frame_idx, size_t from,
+    size_t count, void *buf)
+{
+    size_t bps = ctx->bytes_per_sample;
+    if (!SERGetFramePartInto(ctx->movie, frame_idx, from * bps, count * bps,
+        buf)) return 0;
+    SERConvertFramePixels(ctx->movie, buf, buf, count * bps, IS_BIG_ENDIAN);
+    return 1;
+}
+
+static int stackTileMean(StackContext *ctx, size_t from, size_t count,
+    void *buf, uint32_t *acc, double *totals)
+{
+    SERFrameRange *range = ctx->range;
+    uint32_t i, accumulated = 0;
+    size_t j;
+    memset(acc, 0, count * sizeof(*acc));
+    memset(totals, 0, count * sizeof(*totals));
+    for (i = range->from; i <= range->to; i++) {
+        if (!readStackTile(ctx, i, from, count, buf)) return 0;
+        SIMDAccumulateSamples(buf, acc, count, ctx->bytes_per_sample);
+        if (++accumulated == STACK_FLUSH_FRAMES || i == range->to) {
+            for (j = 0; j < count; j++) {
+                totals[j] += acc[j];
+                acc[j] = 0;
+            }
+            accumulated = 0;
+        }
+    }
+    float *result = ctx->result + from;
+    for (j = 0; j < count; j++)
+        result[j] = (float) (totals[j] / range->count);
+    return 1;
+}
+
+static inline void swapSamples(uint16_t *a, uint16_t *b) {
+    uint16_t tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+/* Quickselect: reorder `values` so that the k-th smallest value is at
+ * index `k`, smaller values before it and greater values after it. */
+static uint16_t selectSample(uint16_t *values, uint32_t count, uint32_t k) {
+    uint32_t lo = 0, hi = count - 1;
+    while (lo < hi) {
+        uint16_t pivot = values[lo + ((hi - lo) / 2)];
+        uint32_t i = lo, j = hi;
+        while (i <= j) {
+            while (values[i] < pivot) i++;
+            while (values[j] > pivot) j--;
+            if (i <= j) {
+                swapSamples(values + i, values + j);
+                i++;
+                if (j == 0) break;
+                j--;
+            }
+        }
+        if (k <= j) hi = j;
+        else if (k >= i) lo = i;
+        else break;
+    }
+    return values[k];
+}
+
+static float getMedianSample(uint16_t *values, uint32_t count) {
+    uint32_t k = count / 2, i;
+    uint16_t hi = selectSample(values, count, k);
+    if (count % 2) return hi;
+    /* Even count: average with the greatest of the lower half */
+    uint16_t lo = values[0];
+    for (i = 1; i < k; i++) {
+        if (values[i] > lo) lo = values[i];
+    }
+    return ((float) lo + (float) hi) / 2;
+}
+
+/* Iterative sigma-clipped mean: values farther than `sigma` standard
+ * deviations from the mean of the remaining values are rejected, until
+ * nothing gets rejected or after STACK_CLIP_ITERATIONS iterations. */
+static float getSigmaClippedSample(uint16_t *values, uint32_t count,
+    double sigma)
+{
+    uint32_t kept = count, iter, i;
+    double mean = 0;
+    for (iter = 0; iter <= STACK_CLIP_ITERATIONS; iter++) {
+        double sum = 0, sumsq = 0;
+        for (i = 0; i < kept; i++) {
+            double v = values[i];
+            sum += v;
+            sumsq += v * v;
+        }
+        mean = sum / kept;
+        if (iter == STACK_CLIP_ITERATIONS) break;
+        double var = (sumsq / kept) - (mean * mean);
+        if (var <= 0) break;
+        double max_dist = sigma * sqrt(var);
+        uint32_t n = 0;
+        for (i = 0; i < kept; i++) {
+            if (fabs(values[i] - mean) <= max_dist)
+                values[n++] = values[i];
+        }
+        if (n == kept || n == 0) break;
+        kept = n;
+    }
+    return (float) mean;
+}
+
+static int stackTileValues(StackContext *ctx, size_t from, size_t count,
+    void *buf, uint16_t *values)
+{
+    SERFrameRange *range = ctx->range;
+    uint32_t frames = range->count, i, f = 0;
+    size_t j;
+    for (i = range->from; i <= range->to; i++, f++) {
+        if (!readStackTile(ctx, i, from, count, buf)) return 0;
+        /* Values of every sample are stored contiguously */
+        if (ctx->bytes_per_sample == 1) {
+            const uint8_t *p = buf;
+            for (j = 0; j < count; j++) values[(j * frames) + f] = p[j];
+        } else {
+            const uint16_t *p = buf;
+            for (j = 0; j < count; j++) values[(j * frames) + f] = p[j];
+        }
+    }
+    float *result = ctx->result + from;
+    for (j = 0; j < count; j++) {
+        uint16_t *v = values + (j * frames);
+        if (ctx->method == STACK_METHOD_MEDIAN)
+            result[j] = getMedianSample(v, frames);
+        else result[j] = getSigmaClippedSample(v, frames, ctx->sigma);
+    }
+    return 1;
+}
+
+static void *stackWorker(void *arg) {
+    StackContext *ctx = arg;
+    size_t tile_samples = ctx->tile_samples;
+    void *buf = malloc(tile_samples * ctx->bytes_per_sample);
+    uint32_t *acc = NULL;
+    double *totals = NULL;
+    uint16_t *values = NULL;
+    if (ctx->method == STACK_METHOD_MEAN) {
+        acc = malloc(tile_samples * sizeof(*acc));
+        totals = malloc(tile_samples * sizeof(*totals));
+        if (acc == NULL || totals == NULL) goto fail;
+    } else {
+        values = malloc(tile_samples * ctx->range->count * sizeof(*values));
+        if (values == NULL) goto fail;
+    }
+    if (buf == NULL) goto fail;
+    while (1) {
+        pthread_mutex_lock(&ctx->lock);
+        uint32_t tile = ctx->next_tile++;
+        int stop = (ctx->failed || tile >= ctx->tiles);
+        pthread_mutex_unlock(&ctx->lock);
+        if (stop) break;
+        size_t from = (size_t) tile * tile_samples,
+               count = ctx->samples - from;
+        if (count > tile_samples) count = tile_samples;
+        int ok;
+        if (acc != NULL) ok = stackTileMean(ctx, from, count, buf, acc, totals);
+        else ok = stackTileValues(ctx, from, count, buf, values);
+        if (!ok) goto fail;
+        pthread_mutex_lock(&ctx->lock);
+        ctx->done++;
+        SERLogProgress("Stacking tiles", ctx->done, ctx->tiles);
+        pthread_mutex_unlock(&ctx->lock);
+    }
+    free(buf);
+    if (acc != NULL) free(acc);
+    if (totals != NULL) free(totals);
+    if (values != NULL) free(values);
+    return NULL;
+fail:
+    pthread_mutex_lock(&ctx->lock);
+    ctx->failed = 1;
+    pthread_mutex_unlock(&ctx->lock);
+    if (buf != NULL) free(buf);
+    if (acc != NULL) free(acc);
+    if (totals != NULL) free(totals);
+    if (values != NULL) free(values);
+    return NULL;
+}
+
+static int writeStackedImage(SERMovie *movie, SERFrameRange *range,
+    StackContext *ctx, char *outpath)
+{
+    size_t size = ctx->samples * sizeof(float), i;
+    FITSHeaderUnit *hdr = NULL;
+    FILE *image = fopen(outpath, "w");
+    if (image == NULL) {
+        SERLogErr(LOG_TAG_ERR "Could not open '%s' for writing\n", outpath);
+        return 0;
+    }
+    int ok = 1;
+    if (conf.image_format != IMAGE_FORMAT_RAW) {
+        hdr = FITSCreateHeaderUnit();
+        ok = (hdr != NULL && addFITSImageKeywords(hdr, movie, 0, -32) &&
+              updateFITSHeaderDate(hdr, movie, range->from));
+        if (ok) {
+            ok = FITSHeaderAdd(hdr, "NCOMBINE", "number of stacked frames",
+                    "%u", range->count) &&
+                 FITSHeaderAdd(hdr, "STACKMET", "stacking method", "'%s'",
+                    stack_methods[ctx->method]) &&
+                 FITSHeaderEnd(hdr);
+            if (!ok) SERLogErr(LOG_TAG_ERR "Failed to add FITS keyword\n");
+        }
+        if (ok && !IS_BIG_ENDIAN) {
+            /* FITS floats are big endian */
+            uint32_t *p = (uint32_t *) ctx->result;
+            for (i = 0; i < ctx->samples; i++) {
+                uint32_t v = p[i];
+                p[i] = (v >> 24) | ((v >> 8) & 0xFF00) |
+                       ((v << 8) & 0xFF0000) | (v << 24);
+            }
+        }
+        if (ok) ok = writeFITSFile(image, hdr, ctx->result, size);
+    } else ok = (writeFileData(image, ctx->result, size) == size);
+    if (hdr != NULL) FITSReleaseHeaderUnit(hdr);
+    if (fclose(image) != 0) ok = 0;
+    if (!ok) SERLogErr(LOG_TAG_ERR "Failed to write '%s'\n", outpath);
+    return ok;
+}
+
+/* Stack the frames in `range` into a single 32-bit float image (FITS or
+ * raw, in host byte order), by using the mean, the median or the
+ * sigma-clipped mean of every sample. Pixel values keep the scale of
+ * frame pixels (ie. 0-65535 for 9-16 bits movies). */
+static int stackFrames(SERMovie *movie, SERFrameRange *range) {
+    char *err = NULL;
+    char outpath[PATH_MAX];
+    char suffix[BUFLEN];
+    StackContext ctx = {0};
+    pthread_t *threads = NULL;
+    int i, jobs = conf.jobs, started = 0, lock_initialized = 0;
+    int format = conf.image_format;
+    if (format == 0) format = IMAGE_FORMAT_FITS;
+    size_t frame_size = SERGetFrameSize(movie->header);
+    if (frame_size == 0) {
+        err = "invalid frame size";
+        goto fail;
+    }
+    if (range->from + range->count > SERGetRealFrameCount(movie)) {
+        err = "frame range beyond available frames";
+        goto fail;
+    }
+    ctx.movie = movie;
+    ctx.range = range;
+    ctx.method = conf.stack_method;
+    ctx.sigma = conf.clip_sigma;
+    ctx.bytes_per_sample = (movie->header->uiPixelDepth <= 8 ? 1 : 2);
+    ctx.samples = frame_size / ctx.bytes_per_sample;
+    if (jobs <= 0) {
+        jobs = 1;
+#if IS_UNIX
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        if (ncpu > 0) jobs = (int) ncpu;
+#endif
+    }
+    if (jobs > MAX_STACK_JOBS) jobs = MAX_STACK_JOBS;
+    /* Tile size: bounded by memory, but small enough to give some work
+     * to every thread. Tiles always contain whole pixels. */
+    size_t planes = SERGetNumberOfPlanes(movie->header),
+           sample_mem = ctx.bytes_per_sample;
+    if (ctx.method == STACK_METHOD_MEAN)
+        sample_mem += sizeof(uint32_t) + sizeof(double);
+    else sample_mem += (size_t) range->count * sizeof(uint16_t);
+    size_t tile_samples = STACK_TILE_MAX_BYTES / sample_mem,
+           per_job = (ctx.samples + jobs - 1) / jobs;
+    if (tile_samples > per_job) tile_samples = per_job;
+    tile_samples -= (tile_samples % planes);
+    if (tile_samples == 0) tile_samples = planes;
+    ctx.tile_samples = tile_samples;
+    ctx.tiles = (ctx.samples + tile_samples - 1) / tile_samples;
+    if ((uint32_t) jobs > ctx.tiles) jobs = (int) ctx.tiles;
+    if (conf.output_path != NULL) {
+        if (strlen(conf.output_path) >= PATH_MAX) {
+            err = "output path too long";
+            goto fail;
+        }
+        strcpy(outpath, conf.output_path);
+    } else {
+        char *dir = conf.output_dir;
+        if (dir == NULL) dir = "/tmp";
+        snprintf(suffix, BUFLEN, "-stack-%s-%d-%d", stack_methods[ctx.method],
+            range->from + 1, range->to + 1);
+        if (!makeFilepath(outpath, movie->filepath, dir, suffix,
+            (format == IMAGE_FORMAT_FITS ? ".fit" : ".raw")))
+        {
+            err = "failed to create output filepath";
+            goto fail;
+        }
+    }
+    if (fileExists(outpath) && !conf.overwrite) {
+        int overwrite = askForFileOverwrite(outpath);
+        if (!overwrite) goto fail;
+    }
+    ctx.result = malloc(ctx.samples * sizeof(float));
+    threads = calloc(jobs, sizeof(*threads));
+    if (ctx.result == NULL || threads == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    if (pthread_mutex_init(&ctx.lock, NULL) != 0) {
+        err = "could not initialize lock";
+        goto fail;
+    }
+    lock_initialized = 1;
+    SERPrintHeader("STACK FRAMES");
+    printf("Stacking %u frame(s): %d - %d (%s, %u tile(s), %d job(s))\n",
+        range->count, range->from + 1, range->to + 1,
+        stack_methods[ctx.method], ctx.tiles, jobs);
+    fflush(stdout);
+    SIMDGetLevel();
+    for (i = 0; i < jobs; i++) {
+        if (pthread_create(threads + i, NULL, stackWorker, &ctx) != 0) break;
+        started++;
+    }
+    /* Tiles are taken from a shared queue: if no thread could be started,
+     * all the tiles are processed here. */
+    if (started == 0) stackWorker(&ctx);
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    printf("\n");
+    if (ctx.failed) {
+        err = "failed to stack frames";
+        goto fail;
+    }
+    if (!writeStackedImage(movie, range, &ctx, outpath)) goto fail;
+    SERLogSuccess("Stacked image saved to:\n'%s'\n", outpath);
+    free(ctx.result);
+    free(threads);
+    pthread_mutex_destroy(&ctx.lock);
+    return 1;
+fail:
+    if (err != NULL) SERLogErr(LOG_TAG_ERR "%s\n", err);
+    if (ctx.result != NULL) free(ctx.result);
+    if (threads != NULL) free(threads);
+    if (lock_initialized) pthread_mutex_destroy(&ctx.lock);
+    return 0;
+}
+
+static int saveFrame(SERMovie *movie, int frame_id) {
+    uint32_t frame_idx = 0;
+    char errmsg[BUFLEN];
+    SERFrameRange range;
+    if (frame_id == 0) {
+        SERLogErr(LOG_TAG_ERR "invalid frame id: 0\n");
+        return 0;
+    }
+    if (frame_id < 0) frame_idx = SERGetFrameCount(movie) + frame_id;
+    else frame_idx = frame_id - 1;
+    if (frame_idx >= SERGetFrameCount(movie)) {
+        sprintf(errmsg, "frame id %d beyond movie frames %d", frame_idx + 1,
+            SERGetFrameCount(movie));
+        SERLogErr(LOG_TAG_ERR "%s\n", errmsg);
+        return 0;
+    }
+    range.from = frame_idx;
+    range.to = frame_idx;
+    range.count = 1;
+    return saveFrames(movie, &range);
+}
+
+/* Fix journal layout (native endianness):
+ *
+ *   FIX_JOURNAL_MAGIC     8 bytes
+ *   original filesize     uint64_t
+ *   fixed filesize        uint64_t
+ *   original header       sizeof(SERHeader) bytes
+ *   tail bytes            (original filesize - fixed filesize) bytes
+ *
+ * Tail bytes are the bytes that get truncated by the fix, so that the
+ * original movie can be fully restored by `undoMovieFix`. */
+static void getFixJournalPath(char *journal_path, const char *movie_path) {
+    snprintf(journal_path, PATH_MAX, "%s%s", movie_path, FIX_JOURNAL_SUFFIX);
+}
+
+static int writeFixJournal(SERMovie *movie, uint64_t new_size, char **err) {
+    char journal_path[PATH_MAX + 1];
+    FILE *journal = NULL;
+    uint64_t orig_size = movie->filesize;
+    getFixJournalPath(journal_path, movie->filepath);
+    if (fileExists(journal_path)) {
+        *err = "a fix journal already exists for this movie, use --undo-fix "
+               "or remove it";
+        return 0;
+    }
+    journal = fopen(journal_path, "w");
+    if (journal == NULL) {
+        *err = "could not open fix journal for writing";
+        return 0;
+    }
+    if (fwrite(FIX_JOURNAL_MAGIC, 1, 8, journal) != 8 ||
+        fwrite(&orig_size, sizeof(orig_size), 1, journal) != 1 ||
+        fwrite(&new_size, sizeof(new_size), 1, journal) != 1 ||
+        fwrite(movie->header, sizeof(SERHeader), 1, journal) != 1)
+    {
+        *err = "failed to write fix journal";
+        goto fail;
+    }
+    if (orig_size > new_size &&
+        !copyVideoData(journal, movie->file, new_size,
+                       orig_size - new_size, &copy_buffer, err))
+        goto fail;
+    if (fflush(journal) != 0) {
+        *err = "failed to write fix journal";
+        goto fail;
+    }
+#if IS_UNIX
+    fsync(fileno(journal));
+#endif
+    fclose(journal);
+    printf("Fix journal written to: %s\n", journal_path);
+    return 1;
+fail:
+    if (journal != NULL) fclose(journal);
+    remove(journal_path);
+    return 0;
+}
+
+/* Fix a movie in place: the incomplete last frame (if any) and any byte
+ * beyond the expected trailer are truncated, and only the header is
+ * rewritten. Original header and truncated bytes are saved to a journal
+ * before touching the movie. */
+static int fixMovieInPlace(SERMovie *movie) {
+    char *err = NULL;
+    FILE *video = NULL;
+    SERHeader *new_header = NULL;
+    SERHeader *header = movie->header;
+    size_t frame_sz = SERGetFrameSize(header);
+    uint64_t new_size = movie->filesize;
+    uint32_t frame_count = SERGetFrameCount(movie);
+#if !IS_UNIX
+    err = "in-place fix not supported on this platform";
+    goto fail;
+#endif
+    if (SERIsCompressedMovie(movie)) {
+        err = "compressed movies cannot be fixed in place";
+        goto fail;
+    }
+    if (frame_sz == 0) {
+        err = "invalid frame size (0)";
+        goto fail;
+    }
+    if (movie->warnings & WARN_INCOMPLETE_FRAMES) {
+        frame_count = SERGetRealFrameCount(movie);
+        if (frame_count == 0) {
+            err = "movie has no frames";
+            goto fail;
+        }
+        new_size = sizeof(SERHeader) + ((uint64_t) frame_count * frame_sz);
+    } else if (SERMovieHasTrailer(movie)) {
+        uint64_t expected_size = (uint64_t) SERGetTrailerOffset(header) +
+            ((uint64_t) frame_count * sizeof(uint64_t));
+        if (new_size > expected_size) new_size = expected_size;
+    }
+    if (new_size == movie->filesize && frame_count == header->uiFrameCount) {
+        SERLogSuccess("Nothing to fix in place\n");
+        return 1;
+    }
+    new_header = SERDuplicateHeader(header);
+    if (new_header == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    new_header->uiFrameCount = frame_count;
+    SERPrintHeader("FIX MOVIE IN PLACE");
+    if (!writeFixJournal(movie, new_size, &err)) goto fail;
+    video = fopen(movie->filepath, "r+");
+    if (video == NULL) {
+        err = "could not open movie for writing";
+        goto fail;
+    }
+    if (new_size < movie->filesize) {
+        printf("Truncating %llu byte(s)\n",
+            (unsigned long long) (movie->filesize - new_size));
+#if IS_UNIX
+        if (ftruncate(fileno(video), (off_t) new_size) != 0) {
+            err = "failed to truncate movie";
+            goto fail;
+        }
+#endif
+    }
+    if (!writeHeaderToVideo(video, new_header)) {
+        err = "failed to write header";
+        goto fail;
+    }
+    if (fclose(video) != 0) {
+        video = NULL;
+        err = "failed to write header";
+        goto fail;
+    }
+    SERLogSuccess("Movie fixed in place: %s (%d frame(s))\n", movie->filepath,
+        frame_count);
+    free(new_header);
+    return 1;
+fail:
+    if (video != NULL) fclose(video);
+    if (new_header != NULL) free(new_header);
+    SERLogErr(LOG_TAG_ERR "Could not fix movie in place");
+    if (err != NULL) SERLogErr(": %s", err);
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+/* Restore a movie fixed with `fixMovieInPlace` by using its journal. */
+static int undoMovieFix(char *filepath) {
+    char journal_path[PATH_MAX + 1];
+    char magic[8];
+    char *err = NULL;
+    FILE *journal = NULL, *video = NULL;
+    uint64_t orig_size, new_size;
+    SERHeader header;
+    struct stat info;
+    getFixJournalPath(journal_path, filepath);
+    journal = fopen(journal_path, "r");
+    if (journal == NULL) {
+        err = "could not open fix journal";
+        goto fail;
+    }
+    if (fread(magic, 1, 8, journal) != 8 ||
+        memcmp(magic, FIX_JOURNAL_MAGIC, 8) != 0 ||
+        fread(&orig_size, sizeof(orig_size), 1, journal) != 1 ||
+        fread(&new_size, sizeof(new_size), 1, journal) != 1 ||
+        fread(&header, sizeof(header), 1, journal) != 1 ||
+        orig_size < new_size)
+    {
+        err = "invalid fix journal";
+        goto fail;
+    }
+    if (stat(filepath, &info) != 0 || (uint64_t) info.st_size != new_size) {
+        err = "movie size doesn't match the one stored in the journal";
+        goto fail;
+    }
+    video = fopen(filepath, "r+");
+    if (video == NULL) {
+        err = "could not open movie for writing";
+        goto fail;
+    }
+    SERPrintHeader("UNDO FIX");
+    if (orig_size > new_size) {
+        off_t tail_offset = ftello(journal);
+        if (tail_offset < 0 || fseeko(video, (off_t) new_size, SEEK_SET) < 0 ||
+            !copyVideoData(video, journal, tail_offset, orig_size - new_size,
+                           &copy_buffer, &err))
+        {
+            if (err == NULL) err = "failed to restore truncated data";
+            goto fail;
+        }
+    }
+    if (!writeHeaderToVideo(video, &header)) {
+        err = "failed to write header";
+        goto fail;
+    }
+    if (fclose(video) != 0) {
+        video = NULL;
+        err = "failed to write movie";
+        goto fail;
+    }
+    fclose(journal);
+    remove(journal_path);
+    SERLogSuccess("Movie restored: %s\n", filepath);
+    return 1;
+fail:
+    if (video != NULL) fclose(video);
+    if (journal != NULL) fclose(journal);
+    SERLogErr(LOG_TAG_ERR "Could not undo fix");
+    if (err != NULL) SERLogErr(": %s", err);
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+/* Movie index (--index) */
+
+/* Get the section `section` of the movie index if it has `size` bytes.
+ * Scores and statistics depend on the byte order of the samples, so they
+ * are only cached for the byte order specified in movie header. */
+static const void *getIndexedFrameData(SERMovie *movie, int section,
+    size_t size)
+{
+    size_t section_size = 0;
+    if (conf.invert_endianness && section != SER_INDEX_HASHES) return NULL;
+    const void *data = SERGetMovieIndexSection(movie, section,
+                                               &section_size);
+    if (data == NULL || size == 0 || section_size != size) return NULL;
+    return data;
+}
+
+/* Save the movie index with the frame data computed by the current action
+ * (sections computed by previous runs are kept). Return 1 on success, 0
+ * otherwise. */
+static int saveMovieIndex(SERMovie *movie) {
+    uint32_t frame_count = SERGetFrameCount(movie);
+    int ok = 1;
+    if (movie->following) {
+        SERLogWarn(LOG_TAG_WARN "Movie is still being written, movie index "
+            "not saved\n");
+        return 1;
+    }
+    if (!conf.follow && !conf.invert_endianness) {
+        if (frame_scores != NULL && conf.roi_width == 0) {
+            ok = SERSetMovieIndexSection(movie, SER_INDEX_SCORES,
+                frame_scores, (size_t) frame_count * sizeof(double));
+        }
+        if (ok && movie_stats != NULL) {
+            MovieStats *stats = movie_stats;
+            ok = SERSetMovieIndexSection(movie, SER_INDEX_FRAME_STATS,
+                     stats->frames, (size_t) frame_count * sizeof(FrameStats))
+                 && SERSetMovieIndexSection(movie, SER_INDEX_HISTOGRAM,
+                     stats->histogram, (size_t) stats->planes * stats->bins *
+                     sizeof(uint64_t));
+        }
+    }
+    if (ok && deep_check != NULL && deep_check->frames > 0) {
+        ok = SERSetMovieIndexSection(movie, SER_INDEX_HASHES,
+            deep_check->hashes, (size_t) deep_check->frames *
+            sizeof(uint64_t));
+    }
+    if (!ok || !SERSaveMovieIndex(movie)) return 0;
+    printf("Movie index saved to: '%s%s'\n", movie->filepath,
+        SER_INDEX_EXT);
+    return 1;
+}
+
+/* Deep check (--deep-check) */
+
+typedef struct {
+    SERMovie *movie;
+    DeepCheck *check;
+    int jobs;
+    uint32_t done;
+    int failed;
+    pthread_mutex_t lock;
+} DeepCheckContext;
+
+typedef struct {
+    DeepCheckContext *ctx;
+    int index;
+} DeepCheckWorker;
+
+typedef struct {
+    uint64_t hash;
+    uint32_t index;
+} FrameHash;
+
+static void freeDeepCheck(DeepCheck *check) {
+    if (check == NULL) return;
+    if (check->hashes != NULL) free(check->hashes);
+    if (check->duplicate_of != NULL) free(check->duplicate_of);
+    if (check->zero != NULL) free(check->zero);
+    if (check->gaps != NULL) free(check->gaps);
+    free(check);
+}
+
+static inline int isBadFrame(DeepCheck *check, uint32_t idx) {
+    return (check->zero[idx] ||
+            check->duplicate_of[idx] != DEEP_CHECK_NO_DUPLICATE);
+}
+
+/* Deep check worker thread: every worker hashes one frame out of `jobs`
+ * (see scoreWorker), so that the movie is read once. */
+static void *deepCheckWorker(void *arg) {
+    DeepCheckWorker *worker = arg;
+    DeepCheckContext *ctx = worker->ctx;
+    DeepCheck *check = ctx->check;
+    size_t frame_size = SERGetFrameSize(ctx->movie->header);
+    uint32_t processed = 0;
+    SERFrameIterator *it = SERFrameIteratorBegin(ctx->movie, worker->index,
+        check->frames - worker->index, ctx->jobs, 0);
+    if (it == NULL) goto fail;
+    const SERFrame *frame;
+    while ((frame = SERFrameIteratorNext(it)) != NULL) {
+        const uint8_t *data = frame->data;
+        check->hashes[frame->index] = HashXXH64(data, frame_size, 0);
+        check->zero[frame->index] = (data[0] == 0 &&
+            memcmp(data, data + 1, frame_size - 1) == 0);
+        if (++processed == SCORE_PROGRESS_STEP) {
+            pthread_mutex_lock(&ctx->lock);
+            ctx->done += processed;
+            SERLogProgress("Hashing frames", ctx->done, check->frames);
+            pthread_mutex_unlock(&ctx->lock);
+            processed = 0;
+        }
+    }
+    if (!SERFrameIteratorEnd(it)) goto fail;
+    pthread_mutex_lock(&ctx->lock);
+    ctx->done += processed;
+    SERLogProgress("Hashing frames", ctx->done, check->frames);
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+fail:
+    pthread_mutex_lock(&ctx->lock);
+    ctx->failed = 1;
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+/* Hash every frame of ctx->check, by using one thread per job. Return 1
+ * on success, 0 otherwise. */
+static int hashMovieFrames(DeepCheckContext *ctx) {
+    DeepCheckWorker workers[MAX_SCORE_JOBS];
+    pthread_t threads[MAX_SCORE_JOBS];
+    uint32_t count = ctx->check->frames;
+    int i, jobs = getWorkerJobs(), started = 0;
+    if ((uint32_t) jobs > count) jobs = (int) count;
+    ctx->jobs = jobs;
+    ctx->done = 0;
+    ctx->failed = 0;
+    for (i = 0; i < jobs; i++) {
+        workers[i].ctx = ctx;
+        workers[i].index = i;
+        if (pthread_create(threads + i, NULL, deepCheckWorker,
+            workers + i) != 0) break;
+        started++;
+    }
+    if (started < jobs) {
+        /* Not every thread could be started: hash all the frames here */
+        for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+        started = 0;
+        ctx->jobs = 1;
+        ctx->done = 0;
+        ctx->failed = 0;
+        workers[0].index = 0;
+        deepCheckWorker(workers);
+    }
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    return !ctx->failed;
+}
+
+static int compareFrameHashes(const void *a, const void *b) {
+    const FrameHash *ha = a, *hb = b;
+    if (ha->hash != hb->hash) return (ha->hash < hb->hash ? -1 : 1);
+    return (ha->index < hb->index ? -1 : (ha->index > hb->index));
+}
+
+static int compareIntervals(const void *a, const void *b) {
+    uint64_t ia = *((const uint64_t *) a), ib = *((const uint64_t *) b);
+    return (ia < ib ? -1 : (ia > ib));
+}
+
+/* Mark frames having the same hash of an earlier frame as duplicates of
+ * it. All-zero frames are reported on their own. */
+static int findDuplicatedFrames(DeepCheck *check) {
+    uint32_t count = 0, i, first = 0;
+    FrameHash *hashes = malloc(((size_t) check->frames + 1) *
+                               sizeof(FrameHash));
+    if (hashes == NULL) return 0;
+    for (i = 0; i < check->frames; i++) {
+        check->duplicate_of[i] = DEEP_CHECK_NO_DUPLICATE;
+        if (check->zero[i]) {
+            check->zeros++;
+            continue;
+        }
+        hashes[count].hash = check->hashes[i];
+        hashes[count].index = i;
+        count++;
+    }
+    qsort(hashes, count, sizeof(FrameHash), compareFrameHashes);
+    for (i = 0; i < count; i++) {
+        if (i == 0 || hashes[i].hash != hashes[i - 1].hash) {
+            first = hashes[i].index;
+            continue;
+        }
+        check->duplicate_of[hashes[i].index] = first;
+        check->duplicates++;
+    }
+    free(hashes);
+    return 1;
+}
+
+/* Find gaps between frame dates, that is intervals greater than
+ * DEEP_CHECK_GAP_FACTOR times the median interval, and estimate the
+ * number of frames dropped at every gap. Dates that are not in order
+ * are skipped (they're already reported by the movie warnings). */
+static int findFrameDateGaps(SERMovie *movie, DeepCheck *check) {
+    uint32_t dates_count = 0, count = check->frames, n = 0, i;
+    const uint64_t *dates = SERGetFrameDates(movie, &dates_count);
+    if (!SERMovieHasTrailer(movie) || dates == NULL) return 1;
+    if (dates_count < count) count = dates_count;
+    if (count < 3) return 1;
+    uint64_t *intervals = malloc((count - 1) * sizeof(uint64_t));
+    if (intervals == NULL) return 0;
+    for (i = 1; i < count; i++) {
+        if (dates[i] > dates[i - 1]) intervals[n++] = dates[i] - dates[i - 1];
+    }
+    if (n == 0) {
+        free(intervals);
         return 1;
     }
-    char *filepath = argv[filepath_idx];
-    if (conf.output_path != NULL && isDirectory(conf.output_path)) {
-        conf.output_dir = conf.output_path;
-        conf.output_path = NULL;
+    qsort(intervals, n, sizeof(uint64_t), compareIntervals);
+    uint64_t median = intervals[n / 2];
+    double threshold = median * DEEP_CHECK_GAP_FACTOR;
+    free(intervals);
+    check->median_interval = median;
+    for (i = 1; i < count; i++) {
+        if (dates[i] > dates[i - 1] &&
+            (double) (dates[i] - dates[i - 1]) > threshold) check->gap_count++;
+    }
+    if (check->gap_count == 0) return 1;
+    check->gaps = malloc(check->gap_count * sizeof(FrameGap));
+    if (check->gaps == NULL) return 0;
+    for (i = 1, n = 0; i < count; i++) {
+        if (dates[i] <= dates[i - 1]) continue;
+        uint64_t interval = dates[i] - dates[i - 1];
+        if ((double) interval <= threshold) continue;
+        FrameGap *gap = check->gaps + (n++);
+        gap->frame = i;
+        gap->interval = interval;
+        gap->dropped = (uint32_t) ((double) interval / median + 0.5) - 1;
+        if (gap->dropped == 0) gap->dropped = 1;
+    }
+    return 1;
+}
+
+static void printDeepCheckResults(DeepCheck *check) {
+    uint32_t i, listed = 0;
+    if (check->duplicates > 0) {
+        SERLogWarn(LOG_TAG_WARN "%u duplicated frame(s):", check->duplicates);
+        for (i = 0; i < check->frames && listed < DEEP_CHECK_MAX_LISTED;
+             i++)
+        {
+            if (check->duplicate_of[i] == DEEP_CHECK_NO_DUPLICATE) continue;
+            SERLogWarn(" %u (of %u)", i + 1, check->duplicate_of[i] + 1);
+            listed++;
+        }
+        SERLogWarn("%s\n", (check->duplicates > listed ? " ..." : ""));
+    }
+    if (check->zeros > 0) {
+        SERLogWarn(LOG_TAG_WARN "%u all-zero frame(s):", check->zeros);
+        for (i = 0, listed = 0;
+             i < check->frames && listed < DEEP_CHECK_MAX_LISTED; i++)
+        {
+            if (!check->zero[i]) continue;
+            SERLogWarn(" %u", i + 1);
+            listed++;
+        }
+        SERLogWarn("%s\n", (check->zeros > listed ? " ..." : ""));
+    }
+    if (check->declared_frames > check->frames) {
+        SERLogWarn(LOG_TAG_WARN "%u truncated or missing frame(s): %u - %u\n",
+            check->declared_frames - check->frames, check->frames + 1,
+            check->declared_frames);
+    }
+    if (check->gap_count > 0) {
+        SERLogWarn(LOG_TAG_WARN "%u gap(s) in frame dates (median frame "
+            "interval: %.3f ms):", check->gap_count,
+            (double) check->median_interval * 1000 /
+            FRAME_DATE_UNITS_PER_SEC);
+        for (i = 0; i < check->gap_count && i < DEEP_CHECK_MAX_LISTED; i++) {
+            FrameGap *gap = check->gaps + i;
+            SERLogWarn(" %u (%u dropped)", gap->frame + 1, gap->dropped);
+        }
+        SERLogWarn("%s\n", (check->gap_count > i ? " ..." : ""));
+    }
+}
+
+/* Look for duplicated, all-zero and truncated frames, and for gaps in
+ * frame dates that reveal dropped frames. Every frame is read once and
+ * hashed by using `conf.jobs` threads (or one per CPU).
+ * Results are stored into `deep_check` and the number of issues into
+ * `issues`. Return 1 on success, 0 otherwise. */
+static int deepCheckMovie(SERMovie *movie, uint32_t *issues) {
+    char *err = NULL;
+    SERHeader *header = movie->header;
+    DeepCheck *check = NULL;
+    DeepCheckContext ctx;
+    int lock_initialized = 0;
+    memset(&ctx, 0, sizeof(ctx));
+    *issues = 0;
+    size_t frame_size = SERGetFrameSize(header);
+    if (frame_size == 0) {
+        err = "invalid frame size (0)";
+        goto fail;
+    }
+    check = calloc(1, sizeof(*check));
+    if (check == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    check->declared_frames = SERGetFrameCount(movie);
+    check->frames = check->declared_frames;
+    if (SERGetRealFrameCount(movie) < check->frames)
+        check->frames = SERGetRealFrameCount(movie);
+    size_t frames = (size_t) check->frames + 1;
+    check->hashes = malloc(frames * sizeof(uint64_t));
+    check->duplicate_of = malloc(frames * sizeof(uint32_t));
+    check->zero = calloc(frames, sizeof(uint8_t));
+    if (check->hashes == NULL || check->duplicate_of == NULL ||
+        check->zero == NULL)
+    {
+        err = "out-of-memory";
+        goto fail;
+    }
+    if (pthread_mutex_init(&ctx.lock, NULL) != 0) {
+        err = "failed to initialize lock";
+        goto fail;
+    }
+    lock_initialized = 1;
+    ctx.movie = movie;
+    ctx.check = check;
+    printf("Deep check of %u frame(s)\n", check->frames);
+    fflush(stdout);
+    const uint64_t *hashes = getIndexedFrameData(movie, SER_INDEX_HASHES,
+        (size_t) check->frames * sizeof(uint64_t));
+    if (hashes != NULL) {
+        /* All-zero frames have the hash of an all-zero frame */
+        void *zeros = calloc(1, frame_size);
+        if (zeros == NULL) {
+            err = "out-of-memory";
+            goto fail;
+        }
+        uint64_t zero_hash = HashXXH64(zeros, frame_size, 0);
+        uint32_t i;
+        free(zeros);
+        memcpy(check->hashes, hashes, check->frames * sizeof(uint64_t));
+        for (i = 0; i < check->frames; i++)
+            check->zero[i] = (hashes[i] == zero_hash);
+        printf("Frame hashes loaded from movie index\n");
+    } else if (check->frames > 0) {
+        if (!hashMovieFrames(&ctx)) {
+            err = "failed to read frames";
+            goto fail;
+        }
+        printf("\n");
+    }
+    if (!findDuplicatedFrames(check) || !findFrameDateGaps(movie, check)) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    pthread_mutex_destroy(&ctx.lock);
+    printDeepCheckResults(check);
+    *issues = check->duplicates + check->zeros + check->gap_count +
+              (check->declared_frames - check->frames);
+    freeDeepCheck(deep_check);
+    deep_check = check;
+    return 1;
+fail:
+    if (lock_initialized) pthread_mutex_destroy(&ctx.lock);
+    freeDeepCheck(check);
+    printf("\n");
+    SERLogErr(LOG_TAG_ERR "Could not perform deep check");
+    if (err != NULL) SERLogErr(": %s", err);
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+static void logDeepCheckToJSON(FILE *json_file, DeepCheck *check) {
+    uint32_t i, n;
+    fprintf(json_file, "    \"deepCheck\": {\n");
+    fprintf(json_file, "        \"frames\": %u,\n", check->frames);
+    fprintf(json_file, "        \"duplicatedFrames\": [");
+    for (i = 0, n = 0; i < check->frames; i++) {
+        if (check->duplicate_of[i] == DEEP_CHECK_NO_DUPLICATE) continue;
+        fprintf(json_file, "%s\n            {\"frame\": %u, "
+            "\"duplicateOf\": %u}", (n++ > 0 ? "," : ""), i + 1,
+            check->duplicate_of[i] + 1);
+    }
+    fprintf(json_file, "%s],\n", (n > 0 ? "\n        " : ""));
+    fprintf(json_file, "        \"zeroFrames\": [");
+    for (i = 0, n = 0; i < check->frames; i++) {
+        if (!check->zero[i]) continue;
+        fprintf(json_file, "%s%u", (n++ > 0 ? ", " : ""), i + 1);
+    }
+    fprintf(json_file, "],\n");
+    fprintf(json_file, "        \"truncatedFrames\": [");
+    for (i = check->frames; i < check->declared_frames; i++) {
+        fprintf(json_file, "%s%u", (i > check->frames ? ", " : ""), i + 1);
+    }
+    fprintf(json_file, "],\n");
+    fprintf(json_file, "        \"medianFrameInterval\": %llu,\n",
+        (unsigned long long) check->median_interval);
+    fprintf(json_file, "        \"gaps\": [");
+    for (i = 0; i < check->gap_count; i++) {
+        FrameGap *gap = check->gaps + i;
+        fprintf(json_file, "%s\n            {\"frame\": %u, \"interval\": "
+            "%llu, \"droppedFrames\": %u}", (i > 0 ? "," : ""),
+            gap->frame + 1, (unsigned long long) gap->interval,
+            gap->dropped);
+    }
+    fprintf(json_file, "%s]\n", (check->gap_count > 0 ? "\n        " : ""));
+    fprintf(json_file, "    },\n");
+}
+
+/* Write a fixed copy of the movie without the frames found by
+ * --deep-check: ranges of good frames are copied as they are, together
+ * with their dates, so that duplicated, all-zero and truncated frames
+ * are dropped in a single pass. */
+static int fixBadFrames(SERMovie *movie) {
+    DeepCheck *check = deep_check;
+    char *err = NULL;
+    char opath[PATH_MAX + 1];
+    char *outputpath = conf.output_path;
+    SERHeader *new_header = NULL;
+    FILE *ofile = NULL;
+    uint64_t *new_dates = NULL;
+    uint32_t good = 0, n = 0, from = 0, i;
+    for (i = 0; i < check->frames; i++) {
+        if (!isBadFrame(check, i)) good++;
+    }
+    if (good == 0) {
+        err = "movie has no good frames";
+        goto fail;
+    }
+    new_header = SERDuplicateHeader(movie->header);
+    if (new_header == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    new_header->uiFrameCount = good;
+    uint32_t dates_count = 0;
+    const uint64_t *dates = SERGetFrameDates(movie, &dates_count);
+    if (SERMovieHasTrailer(movie) && dates != NULL &&
+        dates_count >= check->frames)
+    {
+        new_dates = malloc((size_t) good * sizeof(uint64_t));
+        if (new_dates == NULL) {
+            err = "out-of-memory";
+            goto fail;
+        }
+    }
+    if (conf.use_winjupos_filename) outputpath = NULL;
+    if (outputpath == NULL) {
+        if (makeMovieOutputPath(opath, movie, NULL, NULL) <= 0) goto fail;
+        outputpath = opath;
+    }
+    if (fileExists(outputpath) && !conf.overwrite) {
+        int overwrite = askForFileOverwrite(outputpath);
+        if (!overwrite) goto fail;
+    }
+    ofile = openOutputVideo(outputpath);
+    if (ofile == NULL) {
+        SERLogErr(LOG_TAG_ERR "Failed to open %s for writing\n", outputpath);
+        err = "could not open output video for writing";
+        goto fail;
+    }
+    SERPrintHeader("FIX MOVIE");
+    printf("Dropping %u bad frame(s), %u frame(s) left\n",
+        check->declared_frames - good, good);
+    if (check->gap_count > 0) {
+        SERLogWarn(LOG_TAG_WARN "dropped frames (gaps in frame dates) "
+            "cannot be recovered\n");
+    }
+    if (!writeHeaderToVideo(ofile, new_header)) {
+        err = "failed to write header";
+        goto fail;
+    }
+    CopyProgress progress = {0, good, NULL};
+    for (i = 0; i <= check->frames; i++) {
+        if (i < check->frames && !isBadFrame(check, i)) {
+            if (new_dates != NULL) new_dates[n++] = dates[i];
+            continue;
+        }
+        if (i > from && !appendFramesToVideo(ofile, movie, from, i - from,
+            &progress, &copy_buffer, &err)) goto fail;
+        from = i + 1;
+    }
+    if (new_dates != NULL) {
+        printf("\nWriting frame datetimes trailer");
+        if (!writeTrailerToVideo(ofile, new_dates, good * sizeof(uint64_t))) {
+            err = "failed to write frame datetimes trailer";
+            goto fail;
+        }
+    }
+    printf("\n");
+    if (closeOutputVideo(ofile) != 0) {
+        ofile = NULL;
+        err = "failed to write movie";
+        goto fail;
+    }
+    ofile = NULL;
+    printf("New video written to:\n%s\n\n", outputpath);
+    fflush(stdout);
+    strcpy(output_movie_path, outputpath);
+    free(new_header);
+    if (new_dates != NULL) free(new_dates);
+    return 1;
+fail:
+    if (ofile != NULL) {
+        closeOutputVideo(ofile);
+        remove(outputpath);
+    }
+    if (new_header != NULL) free(new_header);
+    if (new_dates != NULL) free(new_dates);
+    printf("\n");
+    SERLogErr(LOG_TAG_ERR "Could not fix movie");
+    if (err != NULL) SERLogErr(": %s", err);
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+static int fixMovie(SERMovie *movie) {
+    uint32_t bad_frames = 0;
+    if (deep_check != NULL)
+        bad_frames = deep_check->duplicates + deep_check->zeros;
+    if (movie->warnings == 0 && bad_frames == 0) {
+        SERLogSuccess("This movie has no issues, no fix needed ;)\n");
+        return 1;
+    }
+    if (bad_frames > 0) {
+        if (conf.fix_in_place) {
+            SERLogErr(LOG_TAG_ERR "frames found by --deep-check cannot be "
+                "dropped by --in-place\n");
+            return 0;
+        }
+        return fixBadFrames(movie);
+    }
+    if (conf.fix_in_place) return fixMovieInPlace(movie);
+    if (movie->warnings & WARN_INCOMPLETE_FRAMES) {
+        SERLogInfo("Trying to fix incomplete frames...\n");
+        size_t frame_count = SERGetRealFrameCount(movie);
+        if (frame_count == 0) {
+            SERLogErr("Movie has no frames!\n");
+            goto fail;
+        }
+        SERFrameRange range;
+        range.from = 0;
+        range.to = frame_count - 1;
+        range.count = frame_count;
+        char *output_path = conf.output_path;
+        if (conf.use_winjupos_filename) output_path = NULL;
+        if (!extractFramesFromVideo(movie, output_path, &range)) {
+            SERLogErr("Failed to fix movie\n");
+            goto fail;
+        }
+    }
+    return 1;
+fail:
+    return 0;
+}
+
+/* Compressed movies */
+
+/* Determine the output path of --compress and --decompress, that must not
+ * be the movie itself. */
+static int makeArchiveOutputPath(char *outpath, SERMovie *movie, char *ext,
+    char **err)
+{
+    struct stat src_st, dst_st;
+    if (conf.output_path != NULL) {
+        if (strlen(conf.output_path) >= PATH_MAX) {
+            *err = "output path too long";
+            return 0;
+        }
+        strcpy(outpath, conf.output_path);
+    } else {
+        char *dir = conf.output_dir;
+        if (dir == NULL) dir = "/tmp/";
+        if (!makeFilepath(outpath, movie->filepath, dir, NULL, ext)) {
+            *err = "failed to create output filepath";
+            return 0;
+        }
+    }
+    if (stat(movie->filepath, &src_st) == 0 && stat(outpath, &dst_st) == 0 &&
+        src_st.st_dev == dst_st.st_dev && src_st.st_ino == dst_st.st_ino)
+    {
+        *err = "output path is the movie itself";
+        return 0;
+    }
+    return 1;
+}
+
+static void printCompressionSizes(uint64_t original_size,
+    uint64_t compressed_size)
+{
+    char fsize[BUFLEN];
+    char *fmt = "%" PRIu64 "%s";
+    fsize[0] = '\0';
+    if (getFilesizeStr(fsize, BUFLEN, original_size) > 0)
+        fmt = "%" PRIu64 " (%s)";
+    printFieldValuePair("Original size", fmt, original_size, fsize);
+    fmt = "%" PRIu64 "%s";
+    fsize[0] = '\0';
+    if (getFilesizeStr(fsize, BUFLEN, compressed_size) > 0)
+        fmt = "%" PRIu64 " (%s)";
+    printFieldValuePair("Compressed size", fmt, compressed_size, fsize);
+    if (compressed_size > 0) {
+        printFieldValuePair("Ratio", "%.2f:1",
+            (double) original_size / (double) compressed_size);
+    }
+}
+
+/* Write a compressed copy of the movie (see SERArchiveWriterBegin): its
+ * frames are encoded while the next ones get read in background. */
+static int compressMovie(SERMovie *movie) {
+    char *err = NULL;
+    char outpath[PATH_MAX];
+    FILE *out = NULL;
+    SERArchiveWriter *writer = NULL;
+    SERFrameIterator *it = NULL;
+    uint32_t count = 0, done = 0;
+    size_t frame_size = SERGetFrameSize(movie->header);
+    if (SERIsCompressedMovie(movie)) {
+        err = "movie is already compressed";
+        goto fail;
+    }
+    if (!makeArchiveOutputPath(outpath, movie, SER_ARCHIVE_EXT, &err))
+        goto fail;
+    if (fileExists(outpath) && !conf.overwrite) {
+        int overwrite = askForFileOverwrite(outpath);
+        if (!overwrite) return 0;
+    }
+    out = fopen(outpath, "w");
+    if (out == NULL) {
+        SERLogErr(LOG_TAG_ERR "Failed to open %s for writing\n", outpath);
+        err = "could not open compressed movie for writing";
+        goto fail;
+    }
+    writer = SERArchiveWriterBegin(movie, out);
+    if (writer == NULL) goto fail;
+    count = SERArchiveWriterGetFrameCount(writer);
+    SERPrintHeader("COMPRESS MOVIE");
+    printf("Compressing %u frame(s)\n", count);
+    fflush(stdout);
+    if (count > 0) {
+        it = SERFrameIteratorBegin(movie, 0, count, 1, 0);
+        if (it == NULL) {
+            err = "could not read frames";
+            goto fail;
+        }
+        const SERFrame *frame;
+        while ((frame = SERFrameIteratorNext(it)) != NULL) {
+            if (!SERArchiveWriterAddFrame(writer, frame->data)) goto fail;
+            done++;
+            SERLogProgressBytes("Compressing frames", done, count,
+                (uint64_t) done * frame_size);
+        }
+        int iterator_ok = SERFrameIteratorEnd(it);
+        it = NULL;
+        if (!iterator_ok) {
+            err = "could not read frames";
+            goto fail;
+        }
+    }
+    int ok = SERArchiveWriterEnd(writer);
+    writer = NULL;
+    if (!ok) goto fail;
+    off_t compressed_size = -1;
+    if (fseeko(out, 0, SEEK_END) == 0) compressed_size = ftello(out);
+    if (fclose(out) != 0 || compressed_size < 0) {
+        out = NULL;
+        err = "failed to write compressed movie";
+        remove(outpath);
+        goto fail;
+    }
+    out = NULL;
+    printf("\n");
+    printCompressionSizes(movie->filesize, (uint64_t) compressed_size);
+    SERLogSuccess("Compressed movie saved to:\n'%s'\n", outpath);
+    return 1;
+fail:
+    if (it != NULL) SERFrameIteratorEnd(it);
+    if (writer != NULL) SERArchiveWriterEnd(writer);
+    if (out != NULL) {
+        fclose(out);
+        remove(outpath);
+    }
+    printf("\n");
+    SERLogErr(LOG_TAG_ERR "Could not compress movie");
+    if (err != NULL) SERLogErr(": %s", err);
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+/* Restore the original file of a compressed movie, byte by byte. Frames
+ * are decoded in chunks of whole frames. */
+static int decompressMovie(SERMovie *movie) {
+    char *err = NULL;
+    char outpath[PATH_MAX];
+    FILE *out = NULL;
+    if (!SERIsCompressedMovie(movie)) {
+        err = "movie is not compressed";
+        goto fail;
+    }
+    size_t frame_size = SERGetFrameSize(movie->header);
+    if (frame_size == 0) {
+        err = "invalid frame size (0)";
+        goto fail;
+    }
+    if (!makeArchiveOutputPath(outpath, movie, ".ser", &err)) goto fail;
+    if (fileExists(outpath) && !conf.overwrite) {
+        int overwrite = askForFileOverwrite(outpath);
+        if (!overwrite) return 0;
+    }
+    if (copy_buffer == NULL) {
+        copy_buffer = malloc(COPY_BUFFER_SIZE);
+        if (copy_buffer == NULL) {
+            err = "out-of-memory";
+            goto fail;
+        }
+    }
+    out = openOutputVideo(outpath);
+    if (out == NULL) {
+        SERLogErr(LOG_TAG_ERR "Failed to open %s for writing\n", outpath);
+        err = "could not open movie for writing";
+        goto fail;
+    }
+    uint32_t count = SERGetFrameCount(movie), done = 0;
+    if (SERGetRealFrameCount(movie) < count)
+        count = SERGetRealFrameCount(movie);
+    uint64_t frames_end = SERGetFrameOffset(movie->header, count),
+             offset = 0;
+    size_t frames_per_chunk = COPY_BUFFER_SIZE / frame_size;
+    if (frames_per_chunk == 0) frames_per_chunk = 1;
+    SERPrintHeader("DECOMPRESS MOVIE");
+    printf("Decompressing %u frame(s)\n", count);
+    fflush(stdout);
+    char *buf = copy_buffer;
+    while (offset < movie->filesize) {
+        uint64_t remain = movie->filesize - offset;
+        size_t chunk = (remain < COPY_BUFFER_SIZE ? remain : COPY_BUFFER_SIZE);
+        if (offset < sizeof(SERHeader)) chunk = sizeof(SERHeader) - offset;
+        else if (offset < frames_end) {
+            uint32_t frames = count - done;
+            if (frames > frames_per_chunk) frames = frames_per_chunk;
+            chunk = (size_t) frames * frame_size;
+            if (chunk > COPY_BUFFER_SIZE) {
+                /* Frames bigger than the copy buffer */
+                char *bigbuf = realloc(copy_buffer, chunk);
+                if (bigbuf == NULL) {
+                    err = "out-of-memory";
+                    goto fail;
+                }
+                copy_buffer = buf = bigbuf;
+            }
+            done += frames;
+        }
+        if (!SERReadMovieData(movie, buf, chunk, offset)) {
+            err = "failed to read movie data";
+            goto fail;
+        }
+        if (writeFileData(out, buf, chunk) != chunk) {
+            err = "failed to write movie";
+            goto fail;
+        }
+        offset += chunk;
+        if (offset <= frames_end && offset > sizeof(SERHeader))
+            SERLogProgressBytes("Decompressing frames", done, count,
+                offset - sizeof(SERHeader));
+    }
+    int ok = (closeOutputVideo(out) == 0);
+    out = NULL;
+    if (!ok) {
+        err = "failed to write movie";
+        remove(outpath);
+        goto fail;
+    }
+    printf("\n");
+    printCompressionSizes(movie->filesize, SERGetCompressedSize(movie));
+    SERLogSuccess("Original movie saved to:\n'%s'\n", outpath);
+    return 1;
+fail:
+    if (out != NULL) {
+        closeOutputVideo(out);
+        remove(outpath);
+    }
+    printf("\n");
+    SERLogErr(LOG_TAG_ERR "Could not decompress movie");
+    if (err != NULL) SERLogErr(": %s", err);
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+/* Follow mode (--follow) */
+
+/* Called with every range of new frames found while following a movie */
+typedef int (*FollowCallback)(SERMovie *movie, uint32_t from, uint32_t count,
+                              void *privdata);
+
+#if IS_UNIX
+
+/* Wait until the movie file gets modified (if `watch_fd` is an inotify
+ * descriptor watching it) or `timeout` milliseconds have elapsed. */
+static void waitForMovieChanges(int watch_fd, int timeout) {
+#if defined(__linux__)
+    if (watch_fd >= 0) {
+        char events[4096];
+        struct pollfd pfd = {watch_fd, POLLIN, 0};
+        if (poll(&pfd, 1, timeout) > 0 && (pfd.revents & POLLIN)) {
+            ssize_t nread = read(watch_fd, events, sizeof(events));
+            (void) nread;
+        }
+        return;
+    }
+#else
+    (void) watch_fd;
+#endif
+    poll(NULL, 0, timeout);
+}
+
+/* Follow a movie that is still being written (see SERFollowMovie): every
+ * time new complete frames are found, `process` is called with them.
+ * Stop when the movie gets finalized or when no new frame has been
+ * written for FOLLOW_IDLE_TIMEOUT seconds.
+ * Return 1 on success, 0 otherwise. */
+static int followMovie(SERMovie *movie, FollowCallback process,
+    void *privdata)
+{
+    int watch_fd = -1, ok = 1;
+#if defined(__linux__)
+    watch_fd = inotify_init();
+    if (watch_fd >= 0 &&
+        inotify_add_watch(watch_fd, movie->filepath,
+                          IN_MODIFY | IN_CLOSE_WRITE) < 0)
+    {
+        close(watch_fd);
+        watch_fd = -1;
+    }
+#endif
+    time_t last_frame_time = time(NULL);
+    if (movie->following) {
+        printf("Following movie, waiting for new frames...\n");
+        fflush(stdout);
+    }
+    while (movie->following) {
+        waitForMovieChanges(watch_fd, FOLLOW_POLL_INTERVAL);
+        uint32_t from = SERGetFrameCount(movie);
+        long added = SERRefreshMovie(movie);
+        if (added < 0) {
+            ok = 0;
+            break;
+        }
+        if (added > 0) {
+            last_frame_time = time(NULL);
+            if (!process(movie, from, (uint32_t) added, privdata)) {
+                ok = 0;
+                break;
+            }
+        } else if (time(NULL) - last_frame_time >= FOLLOW_IDLE_TIMEOUT) {
+            printf("No new frames in %d seconds, stopped following movie\n",
+                FOLLOW_IDLE_TIMEOUT);
+            break;
+        }
+    }
+    if (ok && !movie->following)
+        printf("Movie has been finalized (%u frames)\n",
+            SERGetFrameCount(movie));
+    printf("\n");
+    fflush(stdout);
+    if (watch_fd >= 0) close(watch_fd);
+    return ok;
+}
+
+#else
+
+static int followMovie(SERMovie *movie, FollowCallback process,
+    void *privdata)
+{
+    (void) movie;
+    (void) process;
+    (void) privdata;
+    SERLogErr(LOG_TAG_ERR "--follow not supported on this platform\n");
+    return 0;
+}
+
+#endif
+
+/* Frame scoring */
+
+typedef struct {
+    SERMovie *movie;
+    double *scores;
+    uint32_t step;      /* Distance between pixels of the same color */
+    int jobs;
+    uint32_t from;      /* First frame of the range being scored */
+    uint32_t count;     /* Frames in the range being scored */
+    uint32_t scored;
+    int failed;
+    pthread_mutex_t lock;
+} ScoreContext;
+
+typedef struct {
+    ScoreContext *ctx;
+    int index;
+} ScoreWorker;
+
+typedef struct {
+    uint32_t index;
+    double score;
+} ScoredFrame;
+
+static inline uint32_t getLumaSample(const void *pixels, size_t idx,
+    int planes, int is16)
+{
+    uint32_t value = 0;
+    int c;
+    idx *= planes;
+    for (c = 0; c < planes; c++) {
+        if (is16) value += ((const uint16_t *) pixels)[idx + c];
+        else value += ((const uint8_t *) pixels)[idx + c];
+    }
+    return value;
+}
+
+/* Compute frame sharpness as the gradient energy (mean squared difference
+ * between adjacent pixels) over the ROI specified in conf (or over the
+ * whole frame), normalized to the maximum pixel value. `pixels` must be
+ * in host byte order (see SERConvertFramePixels). For Bayer movies, the
+ * gradient is computed between pixels of the same color (`step` = 2). */
+static double computeFrameScore(const void *pixels, SERHeader *header,
+    uint32_t step)
+{
+    uint32_t width = header->uiImageWidth, height = header->uiImageHeight,
+             x0 = 0, y0 = 0, x1 = width, y1 = height, x, y;
+    int planes = SERGetNumberOfPlanes(header),
+        is16 = (header->uiPixelDepth > 8);
+    if (conf.roi_width > 0) {
+        x0 = conf.roi_x;
+        y0 = conf.roi_y;
+        x1 = x0 + conf.roi_width;
+        y1 = y0 + conf.roi_height;
+        if (x1 > width) x1 = width;
+        if (y1 > height) y1 = height;
+    }
+    double energy = 0;
+    uint64_t count = 0;
+    for (y = y0; y + step < y1; y++) {
+        uint64_t row_energy = 0;
+        size_t row = (size_t) y * width, next_row = row + (step * width);
+        for (x = x0; x + step < x1; x++) {
+            int64_t v = getLumaSample(pixels, row + x, planes, is16),
+                    dx = getLumaSample(pixels, row + x + step, planes,
+                                       is16) - v,
+                    dy = getLumaSample(pixels, next_row + x, planes,
+                                       is16) - v;
+            row_energy += (uint64_t) (dx * dx + dy * dy);
+        }
+        count += (x > x0 ? x - x0 : 0);
+        energy += (double) row_energy;
+    }
+    if (count == 0) return 0;
+    double maxval = (is16 ? 65535.0 : 255.0) * planes;
+    return energy / count / (maxval * maxval);
+}
+
+/* Score worker thread: every worker scores one frame out of `jobs`, by
+ * using its own read-ahead iterator, so that every frame is read once. */
+static void *scoreWorker(void *arg) {
+    ScoreWorker *worker = arg;
+    ScoreContext *ctx = worker->ctx;
+    SERMovie *movie = ctx->movie;
+    size_t frame_size = SERGetFrameSize(movie->header);
+    void *pixels = malloc(frame_size);
+    uint32_t scored = 0;
+    if (pixels == NULL) goto fail;
+    SERFrameIterator *it = SERFrameIteratorBegin(movie,
+        ctx->from + worker->index, ctx->count - worker->index, ctx->jobs, 0);
+    if (it == NULL) goto fail;
+    const SERFrame *frame;
+    while ((frame = SERFrameIteratorNext(it)) != NULL) {
+        SERConvertFramePixels(movie, frame->data, pixels, frame_size,
+            IS_BIG_ENDIAN);
+        ctx->scores[frame->index] =
+            computeFrameScore(pixels, movie->header, ctx->step);
+        if (++scored == SCORE_PROGRESS_STEP) {
+            pthread_mutex_lock(&ctx->lock);
+            ctx->scored += scored;
+            SERLogProgress("Scoring frames", ctx->scored, ctx->count);
+            pthread_mutex_unlock(&ctx->lock);
+            scored = 0;
+        }
+    }
+    if (!SERFrameIteratorEnd(it)) goto fail;
+    free(pixels);
+    pthread_mutex_lock(&ctx->lock);
+    ctx->scored += scored;
+    SERLogProgress("Scoring frames", ctx->scored, ctx->count);
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+fail:
+    if (pixels != NULL) free(pixels);
+    pthread_mutex_lock(&ctx->lock);
+    ctx->failed = 1;
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+static int compareScoredFramesByScore(const void *a, const void *b) {
+    const ScoredFrame *fa = a, *fb = b;
+    if (fa->score > fb->score) return -1;
+    if (fa->score < fb->score) return 1;
+    return (fa->index < fb->index ? -1 : (fa->index > fb->index));
+}
+
+static int compareScoredFramesByIndex(const void *a, const void *b) {
+    const ScoredFrame *fa = a, *fb = b;
+    return (fa->index < fb->index ? -1 : (fa->index > fb->index));
+}
+
+/* Number of threads used by --score and --stats: `conf.jobs`, or one per
+ * CPU. */
+static int getWorkerJobs(void) {
+    int jobs = conf.jobs;
+    if (jobs <= 0) {
+        jobs = 1;
+#if IS_UNIX
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        if (ncpu > 0) jobs = (int) ncpu;
+#endif
+    }
+    if (jobs > MAX_SCORE_JOBS) jobs = MAX_SCORE_JOBS;
+    return jobs;
+}
+
+/* Score `count` frames starting from `from` into ctx->scores, by using
+ * one thread per job. Return 1 on success, 0 otherwise. */
+static int scoreFrameRange(ScoreContext *ctx, uint32_t from, uint32_t count) {
+    ScoreWorker workers[MAX_SCORE_JOBS];
+    pthread_t threads[MAX_SCORE_JOBS];
+    int i, jobs = getWorkerJobs(), started = 0;
+    if ((uint32_t) jobs > count) jobs = (int) count;
+    ctx->from = from;
+    ctx->count = count;
+    ctx->jobs = jobs;
+    ctx->scored = 0;
+    ctx->failed = 0;
+    for (i = 0; i < jobs; i++) {
+        workers[i].ctx = ctx;
+        workers[i].index = i;
+        if (pthread_create(threads + i, NULL, scoreWorker, workers + i) != 0)
+            break;
+        started++;
+    }
+    if (started < jobs) {
+        /* Not every thread could be started: score all the frames here. */
+        for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+        started = 0;
+        ctx->jobs = 1;
+        ctx->scored = 0;
+        ctx->failed = 0;
+        workers[0].index = 0;
+        scoreWorker(workers);
+    }
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    return !ctx->failed;
+}
+
+/* Follow callback of scoreMovieFrames: score the new frames and print
+ * the best one. */
+static int scoreNewFrames(SERMovie *movie, uint32_t from, uint32_t count,
+    void *privdata)
+{
+    ScoreContext *ctx = privdata;
+    double *scores = realloc(frame_scores,
+                             ((size_t) from + count) * sizeof(double));
+    (void) movie;
+    if (scores == NULL) {
+        SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+        return 0;
+    }
+    frame_scores = scores;
+    ctx->scores = scores;
+    if (!scoreFrameRange(ctx, from, count)) {
+        printf("\n");
+        SERLogErr(LOG_TAG_ERR "Failed to score new frames\n");
+        return 0;
+    }
+    uint32_t best = from, i;
+    for (i = from + 1; i < from + count; i++) {
+        if (scores[i] > scores[best]) best = i;
+    }
+    printf("\nFrames %u..%u: best score %.6e (frame %u)\n", from + 1,
+        from + count, scores[best], best + 1);
+    fflush(stdout);
+    return 1;
+}
+
+/* Compute the score of every frame into the `frame_scores` global, by
+ * using `conf.jobs` threads (or one per CPU). With --follow, frames
+ * written after the movie has been opened are scored as they come. */
+static int scoreMovieFrames(SERMovie *movie) {
+    char *err = NULL;
+    ScoreContext ctx = {0};
+    SERHeader *header = movie->header;
+    uint32_t frame_count = SERGetFrameCount(movie);
+    int jobs = getWorkerJobs(), lock_initialized = 0;
+    if ((frame_count == 0 && !conf.follow) || SERGetFrameSize(header) == 0) {
+        err = "movie has no frames";
+        goto fail;
+    }
+    if (conf.roi_width > 0 && (conf.roi_x >= header->uiImageWidth ||
+        conf.roi_y >= header->uiImageHeight))
+    {
+        err = "ROI outside of frame";
+        goto fail;
+    }
+    if ((uint32_t) jobs > frame_count && frame_count > 0)
+        jobs = (int) frame_count;
+    if (frame_count > 0) {
+        frame_scores = calloc(frame_count, sizeof(double));
+        if (frame_scores == NULL) {
+            err = "out-of-memory";
+            goto fail;
+        }
+    }
+    if (pthread_mutex_init(&ctx.lock, NULL) != 0) {
+        err = "could not initialize lock";
+        goto fail;
+    }
+    lock_initialized = 1;
+    ctx.movie = movie;
+    ctx.scores = frame_scores;
+    ctx.step = 1;
+    if (header->uiColorID >= COLOR_BAYER_RGGB && header->uiColorID < COLOR_RGB)
+        ctx.step = 2;
+    SERPrintHeader("SCORE FRAMES");
+    const double *scores = NULL;
+    if (conf.roi_width == 0) {
+        scores = getIndexedFrameData(movie, SER_INDEX_SCORES,
+                                     (size_t) frame_count * sizeof(double));
+    }
+    if (scores != NULL) {
+        memcpy(frame_scores, scores, frame_count * sizeof(double));
+        printf("Scores of %u frame(s) loaded from movie index\n\n",
+            frame_count);
+    } else printf("Scoring %u frame(s) using %d job(s)\n", frame_count, jobs);
+    if (conf.roi_width > 0) {
+        printf("ROI: %u,%u %ux%u\n", conf.roi_x, conf.roi_y,
+            conf.roi_width, conf.roi_height);
+    }
+    fflush(stdout);
+    if (frame_count > 0 && scores == NULL) {
+        int ok = scoreFrameRange(&ctx, 0, frame_count);
+        printf("\n\n");
+        if (!ok) {
+            err = "failed to read frames";
+            goto fail;
+        }
+    }
+    if (conf.follow) {
+        if (!followMovie(movie, scoreNewFrames, &ctx)) {
+            err = "failed to follow movie";
+            goto fail;
+        }
+        if (SERGetFrameCount(movie) == 0) {
+            err = "movie has no frames";
+            goto fail;
+        }
+    }
+    pthread_mutex_destroy(&ctx.lock);
+    return 1;
+fail:
+    if (lock_initialized) pthread_mutex_destroy(&ctx.lock);
+    if (frame_scores != NULL) {
+        free(frame_scores);
+        frame_scores = NULL;
+    }
+    SERLogErr(LOG_TAG_ERR "Could not score frames");
+    if (err != NULL) SERLogErr(": %s", err);
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+/* Write the `count` frames in `frames` (sorted by index) to a new movie.
+ * Runs of contiguous frames are copied with a single range copy. */
+static int writeSelectedFrames(SERMovie *movie, ScoredFrame *frames,
+    uint32_t count, char *outputpath)
+{
+    char *err = NULL;
+    char opath[PATH_MAX + 1];
+    SERHeader *new_header = NULL;
+    uint64_t *datetimes = NULL;
+    FILE *ofile = NULL;
+    uint32_t i, runs = 0;
+    SERFrameRange range;
+    range.from = frames[0].index;
+    range.to = frames[count - 1].index;
+    range.count = count;
+    uint64_t first_date, last_date;
+    new_header = createRangeHeader(movie, &range, &first_date, &last_date);
+    if (new_header == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    if (outputpath == NULL) {
+        SERMovie dummy_movie = {0};
+        dummy_movie.filepath = movie->filepath;
+        dummy_movie.header = new_header;
+        dummy_movie.firstFrameDate = first_date;
+        dummy_movie.lastFrameDate = last_date;
+        if (makeMovieOutputPath(opath, &dummy_movie, NULL, NULL) <= 0)
+            goto fail;
+        outputpath = opath;
+    }
+    if (fileExists(outputpath) && !conf.overwrite) {
+        int overwrite = askForFileOverwrite(outputpath);
+        if (!overwrite) goto fail;
+    }
+    ofile = openOutputVideo(outputpath);
+    if (ofile == NULL) {
+        SERLogErr(LOG_TAG_ERR "Failed to open %s for writing\n", outputpath);
+        err = "could not open output video for writing";
+        goto fail;
+    }
+    SERPrintHeader("KEEP BEST FRAMES");
+    printf("Writing %u frame(s)\n", count);
+    if (!writeHeaderToVideo(ofile, new_header)) {
+        err = "failed to write header";
+        goto fail;
+    }
+    CopyProgress progress = {0, count, NULL};
+    uint32_t run_start = 0;
+    for (i = 1; i <= count; i++) {
+        if (i < count && frames[i].index == frames[i - 1].index + 1) continue;
+        uint32_t run_count = i - run_start;
+        if (!appendFramesToVideo(ofile, movie, frames[run_start].index,
+            run_count, &progress, &copy_buffer, &err))
+        {
+            printf("\n");
+            goto fail;
+        }
+        run_start = i;
+        runs++;
+    }
+    printf("\n");
+    if (SERMovieHasTrailer(movie)) {
+        datetimes = malloc(count * sizeof(uint64_t));
+        if (datetimes == NULL) {
+            err = "out-of-memory";
+            goto fail;
+        }
+        for (i = 0; i < count; i++)
+            datetimes[i] = SERGetFrameDate(movie, frames[i].index);
+        printf("Writing frame datetimes trailer\n");
+        if (!writeTrailerToVideo(ofile, datetimes,
+            count * sizeof(uint64_t)))
+        {
+            err = "failed to write frame datetimes trailer";
+            goto fail;
+        }
+    }
+    printf("Copied %u run(s) of contiguous frames\n", runs);
+    if (closeOutputVideo(ofile) != 0) {
+        ofile = NULL;
+        err = "failed to write movie";
+        goto fail;
+    }
+    ofile = NULL;
+    printf("New video written to:\n%s\n\n", outputpath);
+    fflush(stdout);
+    free(new_header);
+    if (datetimes != NULL) free(datetimes);
+    strcpy(output_movie_path, outputpath);
+    return 1;
+fail:
+    if (ofile != NULL) closeOutputVideo(ofile);
+    if (new_header != NULL) free(new_header);
+    if (datetimes != NULL) free(datetimes);
+    SERLogErr(LOG_TAG_ERR "Could not write best frames");
+    if (err != NULL) SERLogErr(": %s", err);
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+/* Score movie's frames, print a summary and, if --keep-best has been
+ * used, write the best frames to a new movie. */
+static int scoreMovie(SERMovie *movie) {
+    if (!scoreMovieFrames(movie)) return 0;
+    uint32_t frame_count = SERGetFrameCount(movie), i;
+    ScoredFrame *frames = malloc(frame_count * sizeof(*frames));
+    if (frames == NULL) {
+        SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+        return 0;
+    }
+    double sum = 0;
+    for (i = 0; i < frame_count; i++) {
+        frames[i].index = i;
+        frames[i].score = frame_scores[i];
+        sum += frame_scores[i];
+    }
+    qsort(frames, frame_count, sizeof(*frames), compareScoredFramesByScore);
+    printFieldValuePair("Best score", "%.6e (frame %u)", frames[0].score,
+        frames[0].index + 1);
+    printFieldValuePair("Worst score", "%.6e (frame %u)",
+        frames[frame_count - 1].score, frames[frame_count - 1].index + 1);
+    printFieldValuePair("Mean score", "%.6e", sum / frame_count);
+    printf("\n");
+    int ok = 1;
+    if (conf.keep_best > 0) {
+        uint32_t keep = conf.keep_best;
+        if (conf.keep_best_percent) {
+            keep = (uint32_t) (((uint64_t) frame_count * keep + 50) / 100);
+            if (keep == 0) keep = 1;
+        }
+        if (keep > frame_count) keep = frame_count;
+        qsort(frames, keep, sizeof(*frames), compareScoredFramesByIndex);
+        char *output_path = conf.output_path;
+        if (conf.use_winjupos_filename) output_path = NULL;
+        ok = writeSelectedFrames(movie, frames, keep, output_path);
+    } else {
+        uint32_t top = (frame_count < 10 ? frame_count : 10);
+        printf("Best %u frame(s):\n\n", top);
+        for (i = 0; i < top; i++)
+            printf("%6u  %.6e\n", frames[i].index + 1, frames[i].score);
+        printf("\n");
+    }
+    free(frames);
+    return ok;
+}
+
+/* Movie statistics */
+
+typedef struct {
+    SERMovie *movie;
+    MovieStats *stats;
+    int jobs;
+    uint32_t from;      /* First frame of the range being read */
+    uint32_t frames;    /* Frames in the range being read */
+    int bytes_per_sample;
+    int swap;
+    uint32_t done;
+    int failed;
+    pthread_mutex_t lock;
+} StatsContext;
+
+typedef struct {
+    StatsContext *ctx;
+    int index;
+    uint64_t *histogram;
+} StatsWorker;
+
+static void freeMovieStats(MovieStats *stats) {
+    if (stats == NULL) return;
+    if (stats->frames != NULL) free(stats->frames);
+    if (stats->histogram != NULL) free(stats->histogram);
+    free(stats);
+}
+
+/* Stats worker thread: every worker processes one frame out of `jobs`
+ * (see scoreWorker) and fills its own histogram, that will be merged
+ * into the movie histogram at the end. */
+static void *statsWorker(void *arg) {
+    StatsWorker *worker = arg;
+    StatsContext *ctx = worker->ctx;
+    MovieStats *stats = ctx->stats;
+    SERMovie *movie = ctx->movie;
+    size_t frame_size = SERGetFrameSize(movie->header);
+    size_t count = frame_size / ctx->bytes_per_sample, i;
+    uint32_t processed = 0, last_bin = stats->bins - 1;
+    int planes = stats->planes;
+    void *samples = NULL;
+    SERFrameIterator *it = NULL;
+    if (ctx->swap) {
+        samples = malloc(frame_size);
+        if (samples == NULL) goto fail;
+    }
+    it = SERFrameIteratorBegin(movie, ctx->from + worker->index,
+        ctx->frames - worker->index, ctx->jobs, 0);
+    if (it == NULL) goto fail;
+    const SERFrame *frame;
+    while ((frame = SERFrameIteratorNext(it)) != NULL) {
+        const void *data = frame->data;
+        if (ctx->swap) {
+            /* Only swap bytes (depth 16 means no rescaling) */
+            SIMDConvertPixels(data, samples, frame_size, 16, 1, 0, 1);
+            data = samples;
+        }
+        SIMDSampleStats sstats;
+        SIMDComputeSampleStats(data, count, ctx->bytes_per_sample,
+            stats->saturation, &sstats);
+        FrameStats *fs = stats->frames + frame->index;
+        fs->min = sstats.min;
+        fs->max = sstats.max;
+        fs->saturated = sstats.saturated;
+        if (sstats.count > 0) {
+            fs->mean = (double) sstats.sum / sstats.count;
+            double var = ((double) sstats.sumsq / sstats.count) -
+                         (fs->mean * fs->mean);
+            fs->stddev = (var > 0 ? sqrt(var) : 0);
+        }
+        uint64_t *hist = worker->histogram;
+        uint32_t bins = stats->bins;
+        if (ctx->bytes_per_sample == 1) {
+            const uint8_t *p = data;
+            if (planes == 1) {
+                for (i = 0; i < count; i++) {
+                    uint32_t v = p[i];
+                    hist[v > last_bin ? last_bin : v]++;
+                }
+            } else {
+                for (i = 0; i < count; i++) {
+                    uint32_t v = p[i];
+                    hist[((i % planes) * bins) + (v > last_bin ? last_bin : v)]++;
+                }
+            }
+        } else {
+            const uint16_t *p = data;
+            if (planes == 1) {
+                for (i = 0; i < count; i++) {
+                    uint32_t v = p[i];
+                    hist[v > last_bin ? last_bin : v]++;
+                }
+            } else {
+                for (i = 0; i < count; i++) {
+                    uint32_t v = p[i];
+                    hist[((i % planes) * bins) + (v > last_bin ? last_bin : v)]++;
+                }
+            }
+        }
+        if (++processed == SCORE_PROGRESS_STEP) {
+            pthread_mutex_lock(&ctx->lock);
+            ctx->done += processed;
+            SERLogProgress("Reading frames", ctx->done, ctx->frames);
+            pthread_mutex_unlock(&ctx->lock);
+            processed = 0;
+        }
+    }
+    if (!SERFrameIteratorEnd(it)) goto fail;
+    if (samples != NULL) free(samples);
+    pthread_mutex_lock(&ctx->lock);
+    ctx->done += processed;
+    SERLogProgress("Reading frames", ctx->done, ctx->frames);
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+fail:
+    if (samples != NULL) free(samples);
+    pthread_mutex_lock(&ctx->lock);
+    ctx->failed = 1;
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+/* Compute statistics of `count` frames starting from `from` into
+ * ctx->stats, by using one thread per job, and add their histogram to
+ * the movie histogram. Return 1 on success, 0 otherwise (and set `err`). */
+static int computeFrameRangeStats(StatsContext *ctx, uint32_t from,
+    uint32_t count, char **err)
+{
+    StatsWorker workers[MAX_SCORE_JOBS];
+    pthread_t threads[MAX_SCORE_JOBS];
+    MovieStats *stats = ctx->stats;
+    size_t j, nbins = (size_t) stats->planes * stats->bins;
+    int i, jobs = getWorkerJobs(), started = 0, ok = 0;
+    if ((uint32_t) jobs > count) jobs = (int) count;
+    memset(workers, 0, sizeof(workers));
+    for (i = 0; i < jobs; i++) {
+        workers[i].histogram = calloc(nbins, sizeof(uint64_t));
+        if (workers[i].histogram == NULL) {
+            *err = "out-of-memory";
+            goto cleanup;
+        }
+    }
+    ctx->from = from;
+    ctx->frames = count;
+    ctx->jobs = jobs;
+    ctx->done = 0;
+    ctx->failed = 0;
+    for (i = 0; i < jobs; i++) {
+        workers[i].ctx = ctx;
+        workers[i].index = i;
+        if (pthread_create(threads + i, NULL, statsWorker, workers + i) != 0)
+            break;
+        started++;
+    }
+    if (started < jobs) {
+        /* Not every thread could be started: process all the frames here */
+        for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+        started = 0;
+        for (i = 0; i < jobs; i++)
+            memset(workers[i].histogram, 0, nbins * sizeof(uint64_t));
+        ctx->jobs = 1;
+        ctx->done = 0;
+        ctx->failed = 0;
+        workers[0].index = 0;
+        statsWorker(workers);
+    }
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    if (ctx->failed) {
+        *err = "failed to read frames";
+        goto cleanup;
+    }
+    for (i = 0; i < jobs; i++) {
+        for (j = 0; j < nbins; j++)
+            stats->histogram[j] += workers[i].histogram[j];
+    }
+    ok = 1;
+cleanup:
+    for (i = 0; i < jobs; i++) {
+        if (workers[i].histogram != NULL) free(workers[i].histogram);
+    }
+    return ok;
+}
+
+/* Follow callback of computeMovieStats: compute statistics of the new
+ * frames and print a summary of them. */
+static int computeNewFrameStats(SERMovie *movie, uint32_t from,
+    uint32_t count, void *privdata)
+{
+    StatsContext *ctx = privdata;
+    MovieStats *stats = ctx->stats;
+    char *err = NULL;
+    (void) movie;
+    FrameStats *frames = realloc(stats->frames,
+                                 ((size_t) from + count) * sizeof(FrameStats));
+    if (frames == NULL) {
+        SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+        return 0;
+    }
+    memset(frames + from, 0, (size_t) count * sizeof(FrameStats));
+    stats->frames = frames;
+    if (!computeFrameRangeStats(ctx, from, count, &err)) {
+        printf("\n");
+        SERLogErr(LOG_TAG_ERR "Could not compute statistics of new frames: "
+            "%s\n", err);
+        return 0;
+    }
+    stats->frame_count = from + count;
+    uint32_t max = 0, i;
+    uint64_t saturated = 0;
+    double mean = 0;
+    for (i = from; i < from + count; i++) {
+        if (frames[i].max > max) max = frames[i].max;
+        saturated += frames[i].saturated;
+        mean += frames[i].mean;
+    }
+    printf("\nFrames %u..%u: mean %.2f, max %u, %" PRIu64 " saturated "
+        "sample(s)\n", from + 1, from + count, mean / count, max, saturated);
+    fflush(stdout);
+    return 1;
+}
+
+/* Compute per-frame statistics and the histogram of the whole movie into
+ * the `movie_stats` global, in a single pass over the movie, by using
+ * `conf.jobs` threads (or one per CPU). With --follow, frames written
+ * after the movie has been opened are added as they come. */
+static int computeMovieStats(SERMovie *movie) {
+    char *err = NULL;
+    StatsContext ctx = {0};
+    MovieStats *stats = NULL;
+    SERHeader *header = movie->header;
+    uint32_t frame_count = SERGetFrameCount(movie), available_frames;
+    int jobs = getWorkerJobs(), lock_initialized = 0;
+    if ((frame_count == 0 && !conf.follow) || SERGetFrameSize(header) == 0) {
+        err = "movie has no frames";
+        goto fail;
+    }
+    /* Incomplete frames are skipped */
+    available_frames = frame_count;
+    if ((movie->warnings & WARN_INCOMPLETE_FRAMES) &&
+        SERGetRealFrameCount(movie) < frame_count)
+        available_frames = SERGetRealFrameCount(movie);
+    if (available_frames == 0 && !conf.follow) {
+        err = "movie has no complete frames";
+        goto fail;
+    }
+    stats = calloc(1, sizeof(*stats));
+    if (stats == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    int bps = SERGetBytesPerPixel(header) / SERGetNumberOfPlanes(header);
+    int depth = (int) header->uiPixelDepth;
+    if (bps == 1 && (depth < 1 || depth > 8)) depth = 8;
+    else if (bps == 2 && (depth <= 8 || depth > 16)) depth = 16;
+    stats->planes = SERGetNumberOfPlanes(header);
+    stats->depth = depth;
+    stats->bins = (1u << depth);
+    stats->saturation = stats->bins - 1;
+    stats->frame_count = available_frames;
+    if (frame_count > 0) {
+        stats->frames = calloc(frame_count, sizeof(FrameStats));
+        if (stats->frames == NULL) {
+            err = "out-of-memory";
+            goto fail;
+        }
+    }
+    stats->histogram = calloc((size_t) stats->planes * stats->bins,
+                              sizeof(uint64_t));
+    if (stats->histogram == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    if ((uint32_t) jobs > available_frames && available_frames > 0)
+        jobs = (int) available_frames;
+    if (pthread_mutex_init(&ctx.lock, NULL) != 0) {
+        err = "could not initialize lock";
+        goto fail;
+    }
+    lock_initialized = 1;
+    ctx.movie = movie;
+    ctx.stats = stats;
+    ctx.bytes_per_sample = bps;
+    ctx.swap = (bps == 2 && SERIsBigEndian(movie) != IS_BIG_ENDIAN);
+    SERPrintHeader("MOVIE STATISTICS");
+    const FrameStats *frames = getIndexedFrameData(movie,
+        SER_INDEX_FRAME_STATS, (size_t) frame_count * sizeof(FrameStats));
+    const uint64_t *histogram = getIndexedFrameData(movie,
+        SER_INDEX_HISTOGRAM,
+        (size_t) stats->planes * stats->bins * sizeof(uint64_t));
+    int indexed = (frames != NULL && histogram != NULL);
+    if (indexed) {
+        memcpy(stats->frames, frames, frame_count * sizeof(FrameStats));
+        memcpy(stats->histogram, histogram,
+            (size_t) stats->planes * stats->bins * sizeof(uint64_t));
+        printf("Statistics of %u frame(s) loaded from movie index\n\n",
+            available_frames);
+    } else {
+        printf("Reading %u frame(s) using %d job(s)\n", available_frames,
+            jobs);
+    }
+    fflush(stdout);
+    SIMDGetLevel();
+    if (available_frames > 0 && !indexed) {
+        int ok = computeFrameRangeStats(&ctx, 0, available_frames, &err);
+        printf("\n\n");
+        if (!ok) goto fail;
+    }
+    if (conf.follow) {
+        if (!followMovie(movie, computeNewFrameStats, &ctx)) {
+            err = "failed to follow movie";
+            goto fail;
+        }
+        if (stats->frame_count == 0) {
+            err = "movie has no complete frames";
+            goto fail;
+        }
+    }
+    pthread_mutex_destroy(&ctx.lock);
+    movie_stats = stats;
+    return 1;
+fail:
+    if (lock_initialized) pthread_mutex_destroy(&ctx.lock);
+    freeMovieStats(stats);
+    SERLogErr(LOG_TAG_ERR "Could not compute movie statistics");
+    if (err != NULL) SERLogErr(": %s", err);
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+static void printMovieStats(SERMovie *movie, MovieStats *stats) {
+    uint32_t frame_count = stats->frame_count, i;
+    int p;
+    printFieldValuePair("Depth", "%d bit(s), saturation at %u", stats->depth,
+        stats->saturation);
+    for (p = 0; p < stats->planes; p++) {
+        FrameStats ch;
+        uint64_t n = 0;
+        getChannelStats(stats, p, &ch, &n);
+        if (stats->planes > 1)
+            printf("\nChannel %s:\n", getChannelName(movie->header, p));
+        printFieldValuePair("Min", "%u", ch.min);
+        printFieldValuePair("Max", "%u", ch.max);
+        printFieldValuePair("Mean", "%.3f", ch.mean);
+        printFieldValuePair("Stddev", "%.3f", ch.stddev);
+        printFieldValuePair("Saturated", "%llu (%.4f%%)",
+            (unsigned long long) ch.saturated,
+            (n > 0 ? (100.0 * ch.saturated) / n : 0));
+        /* Coarse histogram */
+        uint32_t bucket_size = stats->bins / STATS_HISTOGRAM_BUCKETS, b;
+        uint64_t buckets[STATS_HISTOGRAM_BUCKETS] = {0}, max_bucket = 0;
+        uint64_t *hist = stats->histogram + ((size_t) p * stats->bins);
+        if (bucket_size == 0) bucket_size = 1;
+        for (i = 0; i < stats->bins; i++) {
+            b = i / bucket_size;
+            if (b >= STATS_HISTOGRAM_BUCKETS) b = STATS_HISTOGRAM_BUCKETS - 1;
+            buckets[b] += hist[i];
+        }
+        for (b = 0; b < STATS_HISTOGRAM_BUCKETS; b++) {
+            if (buckets[b] > max_bucket) max_bucket = buckets[b];
+        }
+        printf("\n");
+        for (b = 0; b < STATS_HISTOGRAM_BUCKETS; b++) {
+            int len = (max_bucket > 0 ?
+                (int) ((buckets[b] * STATS_HISTOGRAM_BAR_LEN) / max_bucket) :
+                0), k;
+            printf("%6u - %6u | ", b * bucket_size,
+                (b + 1) * bucket_size - 1);
+            for (k = 0; k < len; k++) printf("#");
+            printf(" %.2f%%\n", (n > 0 ? (100.0 * buckets[b]) / n : 0));
+        }
+    }
+    double min_mean = 0, max_mean = 0;
+    uint32_t saturated_frames = 0, min_mean_idx = 0, max_mean_idx = 0;
+    for (i = 0; i < frame_count; i++) {
+        FrameStats *fs = stats->frames + i;
+        if (i == 0 || fs->mean < min_mean) {
+            min_mean = fs->mean;
+            min_mean_idx = i;
+        }
+        if (i == 0 || fs->mean > max_mean) {
+            max_mean = fs->mean;
+            max_mean_idx = i;
+        }
+        if (fs->saturated > 0) saturated_frames++;
+    }
+    printf("\n");
+    printFieldValuePair("Darkest frame", "%u (mean: %.3f)", min_mean_idx + 1,
+        min_mean);
+    printFieldValuePair("Brightest frame", "%u (mean: %.3f)",
+        max_mean_idx + 1, max_mean);
+    printFieldValuePair("Saturated frames", "%u", saturated_frames);
+    printf("\n");
+}
+
+/* Binning (--bin, --to-8bit) */
+
+typedef struct {
+    SERMovie *movie;
+    int factor;
+    int bayer;
+    int step;               /* Interleaved samples (see SIMDBinRow) */
+    int bytes_per_sample;
+    int out_bytes_per_sample;
+    int swap;               /* Samples are not in host byte order */
+    uint32_t divisor;       /* Samples per bin (mean), or 1 (sum) */
+    uint32_t maxval;        /* Max. binned value */
+    uint8_t *lut;           /* Binned values to 8-bit (--to-8bit) */
+    uint32_t width;         /* Size of binned frames */
+    uint32_t height;
+    size_t out_frame_size;
+    char *frames;           /* Binned frames of the range being binned */
+    int jobs;
+    uint32_t from;          /* First frame of the range being binned */
+    uint32_t count;         /* Frames in the range being binned */
+    int failed;
+    pthread_mutex_t lock;
+} BinContext;
+
+typedef struct {
+    BinContext *ctx;
+    int index;
+    void *samples;          /* Frame samples in host byte order */
+    uint32_t *rows;         /* Sums of the rows of a bin */
+    uint32_t *bins;         /* Sums of the bins of a binned row */
+} BinWorker;
+
+/* Map binned values (0 - `maxval`) to 8-bit samples, by using `gamma` as
+ * the display gamma (values greater than 1 brighten faint details). */
+static uint8_t *createBinLUT(uint32_t maxval, double gamma) {
+    uint8_t *lut = malloc((size_t) maxval + 1);
+    if (lut == NULL) return NULL;
+    double exponent = 1.0 / gamma;
+    uint32_t v;
+    for (v = 0; v <= maxval; v++)
+        lut[v] = (uint8_t) (255.0 * pow((double) v / maxval, exponent) + 0.5);
+    return lut;
+}
+
+/* Bin the frame `pixels` (host byte order) into `dst`. Bins of Bayer
+ * frames only contain pixels of the same color, and binned pixels keep
+ * the color pattern of the movie, so that binned frames can still be
+ * debayered. */
+static void binFrame(BinContext *ctx, BinWorker *worker, const void *pixels,
+    char *dst)
+{
+    SERHeader *header = ctx->movie->header;
+    int planes = SERGetNumberOfPlanes(header), factor = ctx->factor, j;
+    size_t row_size = (size_t) header->uiImageWidth * planes *
+                      ctx->bytes_per_sample,
+           out_samples = (size_t) ctx->width * planes,
+           in_samples = out_samples * factor,
+           out_row_size = out_samples * (ctx->lut != NULL ? 1 :
+                                         ctx->out_bytes_per_sample);
+    uint32_t y;
+    for (y = 0; y < ctx->height; y++) {
+        memset(worker->rows, 0, in_samples * sizeof(uint32_t));
+        for (j = 0; j < factor; j++) {
+            size_t src_y;
+            if (ctx->bayer)
+                src_y = (size_t) 2 * factor * (y >> 1) + (y & 1) + 2 * j;
+            else
+                src_y = (size_t) y * factor + j;
+            SIMDAccumulateSamples((const char *) pixels + src_y * row_size,
+                worker->rows, in_samples, ctx->bytes_per_sample);
+        }
+        SIMDBinRow(worker->rows, worker->bins, out_samples, factor,
+            ctx->step);
+        SIMDPackBins(worker->bins, dst + y * out_row_size, out_samples,
+            ctx->divisor, ctx->maxval, ctx->lut, ctx->out_bytes_per_sample);
+    }
+    /* 16-bit binned frames keep the byte order of the movie */
+    if (ctx->swap && ctx->lut == NULL && ctx->out_bytes_per_sample == 2)
+        SIMDConvertPixels(dst, dst, ctx->out_frame_size, 16, 1, 0, 1);
+}
+
+/* Bin worker thread: every worker bins one frame out of `jobs` (see
+ * scoreWorker) into ctx->frames. */
+static void *binWorker(void *arg) {
+    BinWorker *worker = arg;
+    BinContext *ctx = worker->ctx;
+    SERMovie *movie = ctx->movie;
+    size_t frame_size = SERGetFrameSize(movie->header);
+    SERFrameIterator *it = SERFrameIteratorBegin(movie,
+        ctx->from + worker->index, ctx->count - worker->index, ctx->jobs, 0);
+    if (it == NULL) goto fail;
+    const SERFrame *frame;
+    while ((frame = SERFrameIteratorNext(it)) != NULL) {
+        const void *pixels = frame->data;
+        if (ctx->swap) {
+            /* Only swap bytes (depth 16 means no rescaling) */
+            SIMDConvertPixels(pixels, worker->samples, frame_size, 16, 1,
+                0, 1);
+            pixels = worker->samples;
+        }
+        binFrame(ctx, worker, pixels, ctx->frames +
+            (size_t) (frame->index - ctx->from) * ctx->out_frame_size);
+    }
+    if (!SERFrameIteratorEnd(it)) goto fail;
+    return NULL;
+fail:
+    pthread_mutex_lock(&ctx->lock);
+    ctx->failed = 1;
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+/* Bin `count` frames starting from `from` into ctx->frames, by using one
+ * thread per job. Return 1 on success, 0 otherwise. */
+static int binFrameRange(BinContext *ctx, BinWorker *workers, uint32_t from,
+    uint32_t count)
+{
+    pthread_t threads[MAX_SCORE_JOBS];
+    int i, jobs = ctx->jobs, started = 0;
+    if ((uint32_t) jobs > count) jobs = (int) count;
+    ctx->from = from;
+    ctx->count = count;
+    ctx->jobs = jobs;
+    ctx->failed = 0;
+    for (i = 0; i < jobs; i++) {
+        workers[i].ctx = ctx;
+        workers[i].index = i;
+        if (pthread_create(threads + i, NULL, binWorker, workers + i) != 0)
+            break;
+        started++;
+    }
+    if (started < jobs) {
+        /* Not every thread could be started: bin all the frames here */
+        for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+        started = 0;
+        ctx->jobs = 1;
+        ctx->failed = 0;
+        workers[0].index = 0;
+        binWorker(workers);
+    }
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    return !ctx->failed;
+}
+
+/* Write a binned copy of the movie (--bin), that can also be reduced to
+ * 8-bit (--to-8bit), in order to get small preview movies.
+ * Frames are binned in ranges by using `conf.jobs` threads (or one per
+ * CPU), and every range is written in order as soon as it has been
+ * binned. The original trailer is copied to the new movie.
+ * Return 1 on success, 0 otherwise. */
+static int binMovie(SERMovie *movie) {
+    char *err = NULL;
+    char outpath[PATH_MAX + 1];
+    SERHeader *header = movie->header, *new_header = NULL;
+    BinContext ctx;
+    BinWorker workers[MAX_SCORE_JOBS];
+    FILE *out = NULL;
+    int i, lock_initialized = 0, result = 0;
+    memset(&ctx, 0, sizeof(ctx));
+    memset(workers, 0, sizeof(workers));
+    uint32_t count = SERGetFrameCount(movie), done = 0;
+    if (SERGetRealFrameCount(movie) < count)
+        count = SERGetRealFrameCount(movie);
+    size_t frame_size = SERGetFrameSize(header);
+    if (count == 0 || frame_size == 0) {
+        err = "movie has no frames";
+        goto fail;
+    }
+    int planes = SERGetNumberOfPlanes(header),
+        bytes_per_sample = SERGetBytesPerPixel(header) / planes,
+        depth = (int) header->uiPixelDepth, out_depth;
+    if (bytes_per_sample == 1 && (depth < 1 || depth > 8)) depth = 8;
+    else if (bytes_per_sample == 2 && (depth <= 8 || depth > 16)) depth = 16;
+    ctx.movie = movie;
+    ctx.factor = conf.bin_factor;
+    ctx.bayer = isBayerMovie(movie);
+    ctx.step = (ctx.bayer ? 2 : planes);
+    ctx.bytes_per_sample = ctx.out_bytes_per_sample = bytes_per_sample;
+    ctx.swap = (bytes_per_sample == 2 &&
+                SERIsBigEndian(movie) != IS_BIG_ENDIAN);
+    if (ctx.bayer) {
+        ctx.width = (header->uiImageWidth / (2 * ctx.factor)) * 2;
+        ctx.height = (header->uiImageHeight / (2 * ctx.factor)) * 2;
+    } else {
+        ctx.width = header->uiImageWidth / ctx.factor;
+        ctx.height = header->uiImageHeight / ctx.factor;
+    }
+    if (ctx.width == 0 || ctx.height == 0) {
+        err = "frames are too small for the binning factor";
+        goto fail;
+    }
+    uint32_t bin_size = (uint32_t) (ctx.factor * ctx.factor);
+    out_depth = depth;
+    if (conf.bin_sum) {
+        /* Sums get the bits they need, up to the size of samples */
+        ctx.divisor = 1;
+        while (out_depth < 8 * bytes_per_sample &&
+               (1u << (out_depth - depth)) < bin_size) out_depth++;
+    } else ctx.divisor = bin_size;
+    ctx.maxval = (1u << out_depth) - 1;
+    if (conf.bin_8bit) {
+        ctx.lut = createBinLUT(ctx.maxval, conf.bin_gamma);
+        if (ctx.lut == NULL) {
+            err = "out-of-memory";
+            goto fail;
+        }
+        ctx.out_bytes_per_sample = 1;
+        out_depth = 8;
+    }
+    ctx.out_frame_size = (size_t) ctx.width * ctx.height * planes *
+                         ctx.out_bytes_per_sample;
+    ctx.jobs = getWorkerJobs();
+    /* Frames binned before every write */
+    uint32_t frames_per_range = COPY_STEP_SIZE / ctx.out_frame_size;
+    if (frames_per_range < (uint32_t) ctx.jobs)
+        frames_per_range = (uint32_t) ctx.jobs;
+    if (frames_per_range > count) frames_per_range = count;
+    ctx.frames = malloc((size_t) frames_per_range * ctx.out_frame_size);
+    if (ctx.frames == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    size_t row_samples = (size_t) ctx.width * planes;
+    for (i = 0; i < ctx.jobs; i++) {
+        if (ctx.swap) workers[i].samples = malloc(frame_size);
+        workers[i].rows = malloc(row_samples * ctx.factor * sizeof(uint32_t));
+        workers[i].bins = malloc(row_samples * sizeof(uint32_t));
+        if ((ctx.swap && workers[i].samples == NULL) ||
+            workers[i].rows == NULL || workers[i].bins == NULL)
+        {
+            err = "out-of-memory";
+            goto fail;
+        }
+    }
+    if (pthread_mutex_init(&ctx.lock, NULL) != 0) {
+        err = "failed to initialize lock";
+        goto fail;
+    }
+    lock_initialized = 1;
+    new_header = SERDuplicateHeader(header);
+    if (new_header == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    new_header->uiImageWidth = ctx.width;
+    new_header->uiImageHeight = ctx.height;
+    new_header->uiPixelDepth = (uint32_t) out_depth;
+    new_header->uiFrameCount = count;
+    char *outputpath = conf.output_path;
+    if (conf.use_winjupos_filename) outputpath = NULL;
+    if (outputpath == NULL) {
+        if (makeMovieOutputPath(outpath, movie, NULL, NULL) <= 0) {
+            err = "could not make output path";
+            goto fail;
+        }
+    } else {
+        strncpy(outpath, outputpath, PATH_MAX);
+        outpath[PATH_MAX] = '\0';
+    }
+    if (fileExists(outpath) && !conf.overwrite) {
+        int overwrite = askForFileOverwrite(outpath);
+        if (!overwrite) goto cleanup;
+    }
+    out = openOutputVideo(outpath);
+    if (out == NULL) {
+        SERLogErr(LOG_TAG_ERR "Failed to open %s for writing\n", outpath);
+        err = "could not open movie for writing";
+        goto fail;
+    }
+    SERPrintHeader("BIN FRAMES");
+    printf("Binning %u frame(s): %ux%u (%d-bit) -> %ux%u (%d-bit), "
+        "%dx%d %s%s\n", count, header->uiImageWidth, header->uiImageHeight,
+        depth, ctx.width, ctx.height, out_depth, ctx.factor, ctx.factor,
+        (conf.bin_sum ? "sum" : "mean"), (ctx.bayer ? ", Bayer" : ""));
+    printf("Using %d job(s)\n", ctx.jobs);
+    fflush(stdout);
+    if (!writeHeaderToVideo(out, new_header)) {
+        err = "failed to write header";
+        goto fail;
+    }
+    uint64_t written = 0;
+    while (done < count) {
+        uint32_t frames = count - done;
+        if (frames > frames_per_range) frames = frames_per_range;
+        if (!binFrameRange(&ctx, workers, done, frames)) {
+            err = "failed to read frames";
+            goto fail;
+        }
+        ctx.jobs = getWorkerJobs();
+        size_t size = (size_t) frames * ctx.out_frame_size;
+        if (writeFileData(out, ctx.frames, size) != size) {
+            err = "failed to write movie";
+            goto fail;
+        }
+        done += frames;
+        written += size;
+        SERLogProgressBytes("Binning frames", done, count, written);
+    }
+    uint32_t dates_count = 0;
+    const uint64_t *dates = SERGetFrameDates(movie, &dates_count);
+    if (dates != NULL && dates_count >= count) {
+        printf("\nWriting frame datetimes trailer");
+        if (!writeTrailerToVideo(out, (uint64_t *) dates,
+            count * sizeof(uint64_t)))
+        {
+            err = "failed to write frame datetimes trailer";
+            goto fail;
+        }
+    }
+    printf("\n");
+    int ok = (closeOutputVideo(out) == 0);
+    out = NULL;
+    if (!ok) {
+        err = "failed to write movie";
+        remove(outpath);
+        goto fail;
+    }
+    printf("New video written to:\n%s\n\n", outpath);
+    fflush(stdout);
+    result = 1;
+    goto cleanup;
+fail:
+    if (out != NULL) {
+        closeOutputVideo(out);
+        remove(outpath);
+    }
+    printf("\n");
+    SERLogErr(LOG_TAG_ERR "Could not bin movie");
+    if (err != NULL) SERLogErr(": %s", err);
+    fprintf(stderr, "\n");
+cleanup:
+    if (lock_initialized) pthread_mutex_destroy(&ctx.lock);
+    for (i = 0; i < MAX_SCORE_JOBS; i++) {
+        if (workers[i].samples != NULL) free(workers[i].samples);
+        if (workers[i].rows != NULL) free(workers[i].rows);
+        if (workers[i].bins != NULL) free(workers[i].bins);
+    }
+    if (ctx.frames != NULL) free(ctx.frames);
+    if (ctx.lut != NULL) free(ctx.lut);
+    if (new_header != NULL) free(new_header);
+    return result;
+}
+
+/* Check that frames of `movie` can be appended to the ones of `first`:
+ * geometry, color, pixel depth and byte order must match, and every frame
+ * must be complete. */
+static int checkJoinedMovie(SERMovie *first, SERMovie *movie, char **err) {
+    SERHeader *a = first->header, *b = movie->header;
+    if (a->uiImageWidth != b->uiImageWidth ||
+        a->uiImageHeight != b->uiImageHeight)
+    {
+        SERLogErr(LOG_TAG_ERR "'%s': frame size %ux%u doesn't match %ux%u\n",
+            movie->filepath, b->uiImageWidth, b->uiImageHeight,
+            a->uiImageWidth, a->uiImageHeight);
+        *err = "frame size mismatch";
+        return 0;
+    }
+    if (a->uiColorID != b->uiColorID) {
+        SERLogErr(LOG_TAG_ERR "'%s': color %s doesn't match %s\n",
+            movie->filepath, SERGetColorString(b->uiColorID),
+            SERGetColorString(a->uiColorID));
+        *err = "color mismatch";
+        return 0;
+    }
+    if (a->uiPixelDepth != b->uiPixelDepth) {
+        SERLogErr(LOG_TAG_ERR "'%s': pixel depth %u doesn't match %u\n",
+            movie->filepath, b->uiPixelDepth, a->uiPixelDepth);
+        *err = "pixel depth mismatch";
+        return 0;
+    }
+    if (SERIsBigEndian(first) != SERIsBigEndian(movie)) {
+        SERLogErr(LOG_TAG_ERR "'%s': byte order doesn't match\n",
+            movie->filepath);
+        *err = "byte order mismatch";
+        return 0;
+    }
+    if (SERGetRealFrameCount(movie) < SERGetFrameCount(movie)) {
+        SERLogErr(LOG_TAG_ERR "'%s': movie frames incomplete, use --fix "
+            "first\n", movie->filepath);
+        *err = "incomplete frames";
+        return 0;
+    }
+    return 1;
+}
+
+/* Join the movies at `paths` into a single movie, in the given order.
+ * The new header is a copy of the first movie's header with the total
+ * frame count, frames are copied with the same range copies used by
+ * --extract (frames are never loaded into memory), and trailers are
+ * merged in order. The trailer is omitted if any movie has no frame
+ * dates. Movies whose dates overlap the ones of the previous movie are
+ * reported.
+ * Return 1 on success, 0 otherwise. */
+static int joinMovies(char **paths, int count) {
+    char *err = NULL, *outputpath = conf.output_path;
+    char opath[PATH_MAX + 1];
+    SERMovie **movies = NULL;
+    SERHeader *new_header = NULL;
+    FILE *ofile = NULL;
+    uint64_t tot_frames = 0;
+    int i, has_dates = 1, overlaps = 0;
+    if (count < 2) {
+        err = "at least two movies are needed";
+        goto fail;
+    }
+    movies = calloc(count, sizeof(*movies));
+    if (movies == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    for (i = 0; i < count; i++) {
+        SERMovie *movie = SEROpenMovie(paths[i]);
+        if (movie == NULL) {
+            SERLogErr(LOG_TAG_ERR "Could not open movie at: '%s'\n",
+                paths[i]);
+            err = "could not open movie";
+            goto fail;
+        }
+        movie->invert_endianness = conf.invert_endianness;
+        if (conf.direct_io) SERAdviseMovieAccess(movie, SER_ACCESS_NOREUSE);
+        movies[i] = movie;
+        if (!checkJoinedMovie(movies[0], movie, &err)) goto fail;
+        tot_frames += SERGetFrameCount(movie);
+        uint32_t dates_count = 0;
+        SERGetFrameDates(movie, &dates_count);
+        if (dates_count < SERGetFrameCount(movie)) {
+            if (has_dates) {
+                SERLogWarn(LOG_TAG_WARN "'%s' has no frame dates, the "
+                    "joined movie will have no trailer\n", movie->filepath);
+            }
+            has_dates = 0;
+        }
+    }
+    if (tot_frames > UINT32_MAX) {
+        err = "too many frames";
+        goto fail;
+    }
+    if (conf.profile) stats_movie = movies[0];
+    new_header = SERDuplicateHeader(movies[0]->header);
+    if (new_header == NULL) {
+        err = "out-of-memory";
+        goto fail;
+    }
+    if (isDebayering(movies[0])) setDebayeredHeader(new_header);
+    new_header->uiFrameCount = (uint32_t) tot_frames;
+    if (outputpath == NULL) {
+        SERMovie dummy_movie = {0};
+        dummy_movie.filepath = movies[0]->filepath;
+        dummy_movie.header = new_header;
+        dummy_movie.firstFrameDate = SERGetFirstFrameDate(movies[0]);
+        dummy_movie.lastFrameDate = SERGetLastFrameDate(movies[count - 1]);
+        if (makeMovieOutputPath(opath, &dummy_movie, NULL, NULL) <= 0)
+            goto fail;
+        outputpath = opath;
+    }
+    for (i = 0; i < count; i++) {
+        struct stat src_st, dst_st;
+        if (stat(movies[i]->filepath, &src_st) == 0 &&
+            stat(outputpath, &dst_st) == 0 && src_st.st_dev == dst_st.st_dev &&
+            src_st.st_ino == dst_st.st_ino)
+        {
+            err = "output path is one of the joined movies";
+            goto fail;
+        }
+    }
+    SERPrintHeader("JOIN MOVIES");
+    for (i = 0; i < count; i++) {
+        SERMovie *movie = movies[i];
+        uint32_t frames = SERGetFrameCount(movie);
+        printf("%s: %u frame(s)\n", movie->filepath, frames);
+        if (i == 0 || !has_dates || frames == 0) continue;
+        uint32_t prev_count = 0, dates_count = 0, j;
+        /* Previous non-empty movie */
+        for (j = i; j > 0 && prev_count == 0; j--)
+            SERGetFrameDates(movies[j - 1], &prev_count);
+        if (prev_count == 0) continue;
+        const uint64_t *prev = SERGetFrameDates(movies[j], &prev_count),
+                       *dates = SERGetFrameDates(movie, &dates_count);
+        if (dates[0] <= prev[prev_count - 1]) {
+            SERLogWarn(LOG_TAG_WARN "frame dates of '%s' overlap the ones "
+                "of '%s' by %.3f sec.\n", movie->filepath,
+                movies[j]->filepath, (double) (prev[prev_count - 1] -
+                dates[0]) / FRAME_DATE_UNITS_PER_SEC);
+            overlaps++;
+        }
+    }
+    if (fileExists(outputpath) && !conf.overwrite) {
+        int overwrite = askForFileOverwrite(outputpath);
+        if (!overwrite) goto fail;
+    }
+    ofile = openOutputVideo(outputpath);
+    if (ofile == NULL) {
+        SERLogErr(LOG_TAG_ERR "Failed to open %s for writing\n", outputpath);
+        err = "could not open output video for writing";
+        goto fail;
+    }
+    printf("Joining %d movie(s), total output frames: %u\n", count,
+        new_header->uiFrameCount);
+    printf("Writing movie header\n");
+    if (!writeHeaderToVideo(ofile, new_header)) {
+        err = "failed to write header";
+        goto fail;
+    }
+    CopyProgress progress = {0, new_header->uiFrameCount, NULL};
+    for (i = 0; i < count; i++) {
+        if (!appendFramesToVideo(ofile, movies[i], 0,
+            SERGetFrameCount(movies[i]), &progress, &copy_buffer, &err))
+            goto fail;
+    }
+    if (has_dates && tot_frames > 0) {
+        printf("\nWriting frame datetimes trailer");
+        for (i = 0; i < count; i++) {
+            uint32_t frames = SERGetFrameCount(movies[i]), dates_count = 0;
+            const uint64_t *dates = SERGetFrameDates(movies[i], &dates_count);
+            if (frames == 0) continue;
+            if (!writeTrailerToVideo(ofile, (uint64_t *) dates,
+                frames * sizeof(uint64_t)))
+            {
+                err = "failed to write frame datetimes trailer";
+                goto fail;
+            }
+        }
+    }
+    printf("\n");
+    if (closeOutputVideo(ofile) != 0) {
+        ofile = NULL;
+        err = "failed to write movie";
+        goto fail;
+    }
+    ofile = NULL;
+    if (overlaps > 0) {
+        SERLogWarn(LOG_TAG_WARN "%d movie(s) with overlapping frame dates, "
+            "frame dates of the joined movie are not in order\n", overlaps);
+    }
+    printf("New video written to:\n%s\n\n", outputpath);
+    fflush(stdout);
+    if (conf.profile && stats_movie != NULL) printMovieProfile(stats_movie);
+    stats_movie = NULL;
+    free(new_header);
+    for (i = 0; i < count; i++) SERCloseMovie(movies[i]);
+    free(movies);
+    return 1;
+fail:
+    stats_movie = NULL;
+    if (ofile != NULL) {
+        closeOutputVideo(ofile);
+        remove(outputpath);
+    }
+    if (new_header != NULL) free(new_header);
+    if (movies != NULL) {
+        for (i = 0; i < count; i++) {
+            if (movies[i] != NULL) SERCloseMovie(movies[i]);
+        }
+        free(movies);
+    }
+    SERLogErr(LOG_TAG_ERR "Could not join movies");
+    if (err != NULL) SERLogErr(": %s", err);
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+/* Save movie's JSON (--json) and index (--index) once the action has
+ * been performed. Return 1 on success, 0 otherwise. */
+static int logMovieResults(SERMovie *movie, char *filepath) {
+    if (conf.log_to_json) {
+        char json_filename[PATH_MAX + 1];
+        char *dir = (conf.output_dir != NULL ? conf.output_dir : "/tmp/");
+        makeFilepath(json_filename, filepath, dir, NULL, ".json");
+        int do_log = 1;
+        if (fileExists(json_filename) && !conf.overwrite)
+            do_log = askForFileOverwrite(json_filename);
+        if (do_log) {
+            FILE *json = fopen(json_filename, "w");
+            if (json == NULL) {
+                SERLogErr(LOG_TAG_ERR "Could not open '%s' for writing!\n",
+                    json_filename);
+                return 0;
+            }
+            logToJSON(json, movie);
+            fclose(json);
+            printf("JSON saved to: '%s'\n", json_filename);
+        }
     }
+    if (conf.save_index && !saveMovieIndex(movie)) return 0;
+    return 1;
+}
+
+/* Process a single movie by performing the action specified in `conf`.
+ * If `result` is not NULL, movie's info are stored into it.
+ * Return 1 on success, 0 otherwise. */
+static int processMovie(char *filepath, BatchResult *result) {
+    if (conf.action == ACTION_UNDO_FIX) return undoMovieFix(filepath);
     SERMovie *movie = SEROpenMovie(filepath);
     if (movie == NULL) {
         SERLogErr(LOG_TAG_ERR "Could not open movie at: '%s'\n", filepath);
         goto err;
     }
     movie->invert_endianness = conf.invert_endianness;
+    if (conf.follow && !SERFollowMovie(movie)) goto err;
+    if (conf.direct_io) SERAdviseMovieAccess(movie, SER_ACCESS_NOREUSE);
+    if (conf.profile) stats_movie = movie;
+    if (result != NULL) {
+        result->opened = 1;
+        result->warnings = movie->warnings;
+        result->frames = SERGetFrameCount(movie);
+    }
     printMovieInfo(movie);
+    if (conf.debayer_method > 0 && !SERCanDebayer(movie)) {
+        SERLogWarn(LOG_TAG_WARN "Cannot debayer %s movies, --debayer will "
+            "be ignored\n", SERGetColorString(movie->header->uiColorID));
+    }
     if (movie->warnings > 0 && !conf.do_check)
         printMovieWarnings(movie);
     int check_succeded = 1;
-    if (conf.do_check) check_succeded = performMovieCheck(movie, NULL);
-    SERHeader *header = movie->header;
+    if (conf.do_check) {
+        SERSetMovieStatsPhase(movie, SER_STATS_PHASE_CHECK);
+        check_succeded = performMovieCheck(movie, NULL);
+        SERSetMovieStatsPhase(movie, SER_STATS_PHASE_COPY);
+    }
     int action = conf.action;
     if (action == ACTION_FIX) {
-        if (!fixMovie(movie)) goto err;
+        if (!fixMovie(movie) || !logMovieResults(movie, filepath)) goto err;
         goto final;
     }
     if (action < ACTION_SPLIT && action != ACTION_NONE && check_succeded) {
         /* Split or cut action */
-        int from = conf.frames_from, to = conf.frames_to,
-            count = conf.frames_count;
         SERFrameRange range;
         char *errmsg = NULL;
-        if (!determineFrameRange(header, &range, from, to, count, &errmsg)) {
+        if (!determineConfFrameRange(movie, &range, &errmsg)) {
             SERLogErr(LOG_TAG_ERR "Invalid frame range: ");
             if (errmsg == NULL) errmsg = "could not determine frame range";
             SERLogErr("%s\n", errmsg);
@@ -1973,7 +6804,7 @@ int main(int argc, char **argv) {
             ok = extractFramesFromVideo(movie, output_path, &range);
         else if (conf.action == ACTION_CUT)
             ok = cutFramesFromVideo(movie, output_path, &range);
-        if (!ok) goto err;
+        if (!ok || !logMovieResults(movie, filepath)) goto err;
         goto final;
     } else if (conf.action == ACTION_SPLIT && check_succeded) {
         if (!determineSplitRanges(movie)) {
@@ -1981,33 +6812,502 @@ int main(int argc, char **argv) {
             goto err;
         }
         if (!splitMovie(movie)) goto err;
+    } else if (conf.action == ACTION_SCORE && check_succeded) {
+        if (!scoreMovie(movie)) goto err;
+    } else if (conf.action == ACTION_STATS) {
+        if (!computeMovieStats(movie)) goto err;
+        printMovieStats(movie, movie_stats);
+    } else if (conf.action == ACTION_COMPRESS) {
+        if (!compressMovie(movie)) goto err;
+    } else if (conf.action == ACTION_DECOMPRESS) {
+        if (!decompressMovie(movie)) goto err;
+    } else if (conf.action == ACTION_BIN) {
+        if (!binMovie(movie)) goto err;
     } else if (conf.action == ACTION_SAVE_FRAME) {
         if (!saveFrame(movie, conf.save_frame_id)) {
             SERLogErr("Failed to save frame\n");
             goto err;
         }
-    }
-    if (conf.log_to_json) {
-        char json_filename[PATH_MAX + 1];
-        makeFilepath(json_filename, filepath, "/tmp/", NULL, ".json");
-        int do_log = 1;
-        if (fileExists(json_filename) && !conf.overwrite)
-            do_log = askForFileOverwrite(json_filename);
-        if (do_log) {
-            FILE *json = fopen(json_filename, "w");
-            if (json == NULL) {
-                SERLogErr(LOG_TAG_ERR "Could not open '%s' for writing!\n",
-                    json_filename);
-                return 1;
-            }
-            logToJSON(json, movie);
-            printf("JSON saved to: '%s'\n", json_filename);
+    } else if (conf.action == ACTION_SAVE_FRAMES ||
+               conf.action == ACTION_SAVE_CUBE ||
+               conf.action == ACTION_STACK)
+    {
+        SERFrameRange range;
+        char *errmsg = NULL;
+        if (!determineConfFrameRange(movie, &range, &errmsg)) {
+            SERLogErr(LOG_TAG_ERR "Invalid frame range: ");
+            if (errmsg == NULL) errmsg = "could not determine frame range";
+            SERLogErr("%s\n", errmsg);
+            goto err;
+        }
+        int ok = 0;
+        if (conf.action == ACTION_SAVE_CUBE)
+            ok = saveFramesCube(movie, &range);
+        else if (conf.action == ACTION_STACK)
+            ok = stackFrames(movie, &range);
+        else ok = saveFrames(movie, &range);
+        if (!ok) {
+            SERLogErr("Failed to save frames\n");
+            goto err;
         }
     }
+    if (!logMovieResults(movie, filepath)) goto err;
 final:
+    if (conf.profile) printMovieProfile(movie);
     SERCloseMovie(movie);
-    return 0;
+    stats_movie = NULL;
+    if (frame_scores != NULL) free(frame_scores);
+    frame_scores = NULL;
+    freeMovieStats(movie_stats);
+    movie_stats = NULL;
+    freeDeepCheck(deep_check);
+    deep_check = NULL;
+    return 1;
 err:
     SERCloseMovie(movie);
+    stats_movie = NULL;
+    if (frame_scores != NULL) free(frame_scores);
+    frame_scores = NULL;
+    freeMovieStats(movie_stats);
+    movie_stats = NULL;
+    freeDeepCheck(deep_check);
+    deep_check = NULL;
+    return 0;
+}
+
+#if IS_UNIX
+
+static int compareFilepaths(const void *a, const void *b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* Add `path` to the `files` array (growing it if needed). If `path` is a
+ * directory, add all the SER movies it contains (sorted by name).
+ * Return 1 on success, 0 otherwise. */
+static int addBatchFiles(char ***files, int *count, int *capacity,
+    char *path)
+{
+    char **dir_files = NULL;
+    int dir_count = 0, dir_capacity = 0, i;
+    if (isDirectory(path)) {
+        DIR *dir = opendir(path);
+        struct dirent *entry;
+        if (dir == NULL) {
+            SERLogErr(LOG_TAG_ERR "Could not open directory '%s'\n", path);
+            return 0;
+        }
+        size_t pathlen = strlen(path);
+        int has_sep = (pathlen > 0 && path[pathlen - 1] == '/');
+        while ((entry = readdir(dir)) != NULL) {
+            char *ext = strrchr(entry->d_name, '.');
+            if (ext == NULL || (strcasecmp(ext, ".ser") != 0 &&
+                strcasecmp(ext, SER_ARCHIVE_EXT) != 0)) continue;
+            char *fpath = malloc(pathlen + strlen(entry->d_name) + 2);
+            if (fpath == NULL) {
+                closedir(dir);
+                goto oom;
+            }
+            sprintf(fpath, "%s%s%s", path, (has_sep ? "" : "/"),
+                entry->d_name);
+            if (isDirectory(fpath) ||
+                !addBatchFiles(&dir_files, &dir_count, &dir_capacity, fpath))
+            {
+                free(fpath);
+                continue;
+            }
+            free(fpath);
+        }
+        closedir(dir);
+        if (dir_count > 0)
+            qsort(dir_files, dir_count, sizeof(char *), compareFilepaths);
+        for (i = 0; i < dir_count; i++) {
+            if (*count == *capacity) {
+                int new_capacity = (*capacity > 0 ? *capacity * 2 : 16);
+                char **p = realloc(*files, new_capacity * sizeof(char *));
+                if (p == NULL) goto oom;
+                *files = p;
+                *capacity = new_capacity;
+            }
+            (*files)[(*count)++] = dir_files[i];
+            dir_files[i] = NULL;
+        }
+        free(dir_files);
+        return 1;
+    }
+    if (*count == *capacity) {
+        int new_capacity = (*capacity > 0 ? *capacity * 2 : 16);
+        char **p = realloc(*files, new_capacity * sizeof(char *));
+        if (p == NULL) goto oom;
+        *files = p;
+        *capacity = new_capacity;
+    }
+    (*files)[*count] = strdup(path);
+    if ((*files)[*count] == NULL) goto oom;
+    (*count)++;
+    return 1;
+oom:
+    SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+    if (dir_files != NULL) {
+        for (i = 0; i < dir_count; i++) {
+            if (dir_files[i] != NULL) free(dir_files[i]);
+        }
+        free(dir_files);
+    }
+    return 0;
+}
+
+static double getElapsedSeconds(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) +
+           (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Tell whether the movies at `a` and `b` have the same name (extension
+ * excluded), so that files written for them would have the same names. */
+static int haveSameMovieName(char *a, char *b) {
+    char *fa = basename(a), *fb = basename(b),
+         *dot_a = strrchr(fa, '.'), *dot_b = strrchr(fb, '.');
+    size_t len_a = (dot_a != NULL ? (size_t) (dot_a - fa) : strlen(fa)),
+           len_b = (dot_b != NULL ? (size_t) (dot_b - fb) : strlen(fb));
+    return (len_a == len_b && strncasecmp(fa, fb, len_a) == 0);
+}
+
+/* Outputs and logs of batch movies are named after the movies, so movies
+ * having the same name (ie. in different directories) get their number in
+ * the batch appended to the names of their files. Return the number of
+ * tagged movies. */
+static int tagBatchItemNames(BatchItem *items, int count) {
+    int tagged = 0, i, j;
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < count; j++) {
+            if (j != i && haveSameMovieName(items[i].path, items[j].path))
+                break;
+        }
+        if (j == count) continue;
+        snprintf(items[i].name_tag, sizeof(items[i].name_tag), "_%d", i + 1);
+        tagged++;
+    }
+    return tagged;
+}
+
+/* Start a worker process for `item`: the worker's output is redirected to
+ * item's log file and its BatchResult is sent back through a pipe.
+ * Return 1 on success, 0 otherwise. */
+static int startBatchWorker(BatchItem *item) {
+    int fds[2];
+    char *logdir = (conf.output_dir != NULL ? conf.output_dir : "/tmp/");
+    output_name_tag = (item->name_tag[0] != '\0' ? item->name_tag : NULL);
+    if (!makeFilepath(item->log_path, item->path, logdir, NULL, ".log") ||
+        pipe(fds) != 0)
+    {
+        output_name_tag = NULL;
+        return 0;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    clock_gettime(CLOCK_MONOTONIC, &item->start);
+    pid_t pid = fork();
+    /* The worker keeps the tag for the files it writes */
+    if (pid != 0) output_name_tag = NULL;
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    if (pid == 0) {
+        BatchResult result = {0};
+        close(fds[0]);
+        int logfd = open(item->log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int nullfd = open("/dev/null", O_RDONLY);
+        if (logfd >= 0) {
+            dup2(logfd, STDOUT_FILENO);
+            dup2(logfd, STDERR_FILENO);
+            close(logfd);
+        }
+        if (nullfd >= 0) {
+            dup2(nullfd, STDIN_FILENO);
+            close(nullfd);
+        }
+        SERLogUseColors = 0;
+        int ok = processMovie(item->path, &result);
+        if (write(fds[1], &result, sizeof(result)) != sizeof(result))
+            ok = 0;
+        close(fds[1]);
+        if (copy_buffer != NULL) free(copy_buffer);
+        if (splitRanges != NULL) free(splitRanges);
+        fflush(stdout);
+        fflush(stderr);
+        exit(ok ? 0 : 1);
+    }
+    close(fds[1]);
+    item->pid = pid;
+    item->result_fd = fds[0];
     return 1;
 }
+
+static void printBatchResult(BatchItem *item, int idx, int count) {
+    int ok = (item->exit_code == 0);
+    if (ok && item->result.warnings == 0)
+        SERLogSuccess("[%d/%d] OK ", idx, count);
+    else if (ok)
+        SERLogWarn("[%d/%d] OK ", idx, count);
+    else
+        SERLogErr("[%d/%d] FAILED ", idx, count);
+    printf("%s (frames: %u, warnings: %d, %.2fs, log: %s)\n",
+        item->path, item->result.frames,
+        SERCountMovieWarnings(item->result.warnings), item->elapsed,
+        item->log_path);
+    fflush(stdout);
+}
+
+static void logBatchSummaryToJSON(FILE *json_file, BatchItem *items,
+    int count, int failed, int with_warnings, uint64_t tot_frames,
+    double elapsed)
+{
+    int i;
+    fprintf(json_file, "{\n");
+    fprintf(json_file, "    \"files\": %d,\n", count);
+    fprintf(json_file, "    \"succeeded\": %d,\n", count - failed);
+    fprintf(json_file, "    \"failed\": %d,\n", failed);
+    fprintf(json_file, "    \"withWarnings\": %d,\n", with_warnings);
+    fprintf(json_file, "    \"frames\": %llu,\n",
+        (unsigned long long) tot_frames);
+    fprintf(json_file, "    \"elapsed\": %.3f,\n", elapsed);
+    fprintf(json_file, "    \"jobs\": %d,\n", conf.jobs);
+    fprintf(json_file, "    \"movies\": [");
+    for (i = 0; i < count; i++) {
+        BatchItem *item = items + i;
+        char *abspath = realpath(item->path, NULL);
+        fprintf(json_file, "%s\n        {\n", (i > 0 ? "," : ""));
+        fprintf(json_file, "            \"path\": \"%s\",\n",
+            (abspath != NULL ? abspath : item->path));
+        fprintf(json_file, "            \"success\": %s,\n",
+            (item->exit_code == 0 ? "true" : "false"));
+        fprintf(json_file, "            \"frames\": %u,\n",
+            item->result.frames);
+        fprintf(json_file, "            \"elapsed\": %.3f,\n",
+            item->elapsed);
+        fprintf(json_file, "            \"log\": \"%s\",\n", item->log_path);
+        fprintf(json_file, "            \"warnings\": [");
+        size_t wlen = sizeof(item->result.warnings),
+               msgcount = sizeof(warn_messages) / sizeof(char *), j;
+        int wcount = 0;
+        for (j = 0; j < wlen; j++) {
+            if (j >= msgcount) break;
+            if (item->result.warnings & (1 << j)) {
+                char *wmsg = warn_messages[j];
+                if (wmsg == NULL) break;
+                fprintf(json_file, "%s\n                \"%s\"",
+                    (wcount++ > 0 ? "," : ""), wmsg);
+            }
+        }
+        if (wcount > 0) fprintf(json_file, "\n            ");
+        fprintf(json_file, "]\n        }");
+        if (abspath != NULL) free(abspath);
+    }
+    fprintf(json_file, "\n    ]\n");
+    fprintf(json_file, "}\n");
+}
+
+/* Process all the movies in `paths` by using a pool of `conf.jobs` worker
+ * processes (every worker processes a single movie), then print a summary.
+ * Return 1 if every movie has been successfully processed, 0 otherwise. */
+static int processMovieBatch(char **paths, int npaths) {
+    char **files = NULL;
+    BatchItem *items = NULL;
+    int count = 0, capacity = 0, i, ok = 0;
+    for (i = 0; i < npaths; i++) {
+        if (!addBatchFiles(&files, &count, &capacity, paths[i])) goto cleanup;
+    }
+    if (count == 0) {
+        SERLogErr(LOG_TAG_ERR "No SER movies found\n");
+        goto cleanup;
+    }
+    items = calloc(count, sizeof(*items));
+    if (items == NULL) {
+        SERLogErr(LOG_TAG_FATAL "Out-of-memory\n");
+        goto cleanup;
+    }
+    for (i = 0; i < count; i++) {
+        items[i].path = files[i];
+        items[i].result_fd = -1;
+        items[i].exit_code = -1;
+    }
+    if (conf.jobs <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        conf.jobs = (ncpu > 0 ? (int) ncpu : 1);
+    }
+    if (conf.jobs > count) conf.jobs = count;
+    int batch_jobs = conf.jobs;
+    /* Movies are already processed in parallel, so every worker will
+     * split movies by using a single thread. */
+    if (batch_jobs > 1) conf.jobs = 1;
+    SERPrintHeader("BATCH");
+    printf("Processing %d movie(s) using %d job(s)\n\n", count, batch_jobs);
+    int tagged = tagBatchItemNames(items, count);
+    if (tagged > 0) {
+        SERLogWarn(LOG_TAG_WARN "%d movie(s) having the same name: their "
+            "number in the batch is\nappended to the names of their files "
+            "(ie. _1)\n\n", tagged);
+    }
+    fflush(stdout);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int next = 0, running = 0, finished = 0, failed = 0, with_warnings = 0;
+    uint64_t tot_frames = 0;
+    while (finished < count) {
+        while (running < batch_jobs && next < count) {
+            BatchItem *item = items + next++;
+            if (!startBatchWorker(item)) {
+                SERLogErr(LOG_TAG_ERR "Could not start worker for '%s'\n",
+                    item->path);
+                item->done = 1;
+                finished++;
+                failed++;
+                printBatchResult(item, finished, count);
+                continue;
+            }
+            running++;
+        }
+        if (running == 0) continue;
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            SERLogErr(LOG_TAG_ERR "waitpid failed: %s\n", strerror(errno));
+            break;
+        }
+        BatchItem *item = NULL;
+        for (i = 0; i < count; i++) {
+            if (items[i].pid == pid && !items[i].done) {
+                item = items + i;
+                break;
+            }
+        }
+        if (item == NULL) continue;
+        running--;
+        finished++;
+        item->done = 1;
+        item->elapsed = getElapsedSeconds(&item->start);
+        item->exit_code = (WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        if (read(item->result_fd, &item->result, sizeof(item->result)) !=
+            sizeof(item->result))
+        {
+            memset(&item->result, 0, sizeof(item->result));
+            if (item->exit_code == 0) item->exit_code = -1;
+        }
+        close(item->result_fd);
+        item->result_fd = -1;
+        if (item->exit_code != 0) failed++;
+        if (item->result.warnings) with_warnings++;
+        tot_frames += item->result.frames;
+        printBatchResult(item, finished, count);
+    }
+    double elapsed = getElapsedSeconds(&start);
+    conf.jobs = batch_jobs;
+    printf("\n");
+    SERPrintHeader("BATCH SUMMARY");
+    printFieldValuePair("Movies", "%d", count);
+    printFieldValuePair("Succeeded", "%d", count - failed);
+    printFieldValuePair("Failed", "%d", failed);
+    printFieldValuePair("With warnings", "%d", with_warnings);
+    printFieldValuePair("Frames", "%llu", (unsigned long long) tot_frames);
+    printFieldValuePair("Elapsed", "%.2fs", elapsed);
+    printf("\n");
+    if (failed > 0) {
+        printf("Failed movies:\n\n");
+        for (i = 0; i < count; i++) {
+            if (items[i].exit_code != 0)
+                printf("%s (log: %s)\n", items[i].path, items[i].log_path);
+        }
+        printf("\n");
+    }
+    if (conf.log_to_json) {
+        char json_filename[PATH_MAX + 1];
+        char *dir = (conf.output_dir != NULL ? conf.output_dir : "/tmp/");
+        size_t dirlen = strlen(dir);
+        snprintf(json_filename, PATH_MAX, "%s%s%s", dir,
+            (dirlen > 0 && dir[dirlen - 1] == '/' ? "" : "/"),
+            BATCH_SUMMARY_FILENAME);
+        FILE *json = fopen(json_filename, "w");
+        if (json == NULL) {
+            SERLogErr(LOG_TAG_ERR "Could not open '%s' for writing!\n",
+                json_filename);
+            failed++;
+        } else {
+            logBatchSummaryToJSON(json, items, count, failed, with_warnings,
+                tot_frames, elapsed);
+            fclose(json);
+            printf("JSON saved to: '%s'\n", json_filename);
+        }
+    }
+    ok = (failed == 0 && finished == count);
+cleanup:
+    if (items != NULL) free(items);
+    if (files != NULL) {
+        for (i = 0; i < count; i++) free(files[i]);
+        free(files);
+    }
+    return ok;
+}
+
+#endif /* IS_UNIX */
+
+int main(int argc, char **argv) {
+    initConfig();
+    int filepath_idx = parseOptions(argc, argv);
+    if (filepath_idx >= argc) {
+        printHelp(argv);
+        return 1;
+    }
+    char *filepath = argv[filepath_idx];
+    int ok = 0, is_batch = (argc - filepath_idx > 1 || isDirectory(filepath));
+    if (conf.output_path != NULL && isDirectory(conf.output_path)) {
+        conf.output_dir = conf.output_path;
+        conf.output_path = NULL;
+    }
+    if (conf.crop_width > 0 && conf.action != ACTION_EXTRACT) {
+        SERLogErr(LOG_TAG_ERR "--crop can only be used with --extract\n");
+        return 1;
+    }
+    if (conf.crop_track && conf.crop_width == 0) {
+        SERLogErr(LOG_TAG_ERR "--crop-track needs a --crop region\n");
+        return 1;
+    }
+    if (conf.crop_width > 0 && conf.debayer_method > 0) {
+        SERLogErr(LOG_TAG_ERR "--crop cannot be used with --debayer\n");
+        return 1;
+    }
+    if (conf.action == ACTION_BIN && conf.debayer_method > 0) {
+        SERLogErr(LOG_TAG_ERR "--bin and --to-8bit cannot be used with "
+                              "--debayer\n");
+        return 1;
+    }
+    if (conf.follow && (is_batch || (conf.action != ACTION_SCORE &&
+                                     conf.action != ACTION_STATS)))
+    {
+        SERLogErr(LOG_TAG_ERR "--follow can only be used with --score or "
+                              "--stats on a single movie\n");
+        return 1;
+    }
+    if (conf.action == ACTION_JOIN) {
+        if (conf.use_winjupos_filename) conf.output_path = NULL;
+        ok = joinMovies(argv + filepath_idx, argc - filepath_idx);
+    } else if (is_batch) {
+#if IS_UNIX
+        if (conf.output_path != NULL) {
+            SERLogErr(LOG_TAG_ERR "--output must be an existing directory in "
+                                  "batch mode\n");
+            return 1;
+        }
+        ok = processMovieBatch(argv + filepath_idx, argc - filepath_idx);
+#else
+        SERLogErr(LOG_TAG_ERR "Batch mode not supported on this platform\n");
+#endif
+    } else ok = processMovie(filepath, NULL);
+    if (copy_buffer != NULL) free(copy_buffer);
+    if (splitRanges != NULL) free(splitRanges);
+    DirectIOFreeBuffers();
+    return (ok ? 0 : 1);
+}
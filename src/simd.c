@@ -0,0 +1,1855 @@
+/*
+ *  SERUtils - A command line utility for processing SER movie files
+ *  Copyright (C) 2020  Giuseppe Fabio Nicotra <artix2 at gmail dot com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Pixel conversion kernels (byte swapping, pixel depth scaling and
+ * BGR -> RGB reordering, optionally into planes) used by
+ * SERGetFramePixels & co, and sample
+ * statistics reductions (min, max, sum, sum of squares and saturated
+ * samples) used by frame statistics, sample accumulation used by
+ * stacking and binning, bin reduction and packing used by binning
+ * (--bin) and bilinear demosaicing of Bayer rows used by the debayering
+ * engine (debayer.c).
+ * Every kernel has a scalar version and SSE2/SSSE3/AVX2 (x86) or NEON (ARM)
+ * versions giving bit-identical output. The best kernel supported by the
+ * CPU is selected at runtime. */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include "simd.h"
+
+#if SIMD_X86 && defined(__GNUC__)
+    #define SIMD_X86_KERNELS 1
+    #include <immintrin.h>
+    #define TARGET_SSE2     __attribute__((target("sse2")))
+    #define TARGET_SSSE3    __attribute__((target("ssse3")))
+    #define TARGET_AVX2     __attribute__((target("avx2")))
+#else
+    #define SIMD_X86_KERNELS 0
+#endif
+#if SIMD_NEON
+    #include <arm_neon.h>
+#endif
+
+/* Sample statistics kernels reduce vectors in blocks of STATS_BLOCK_ITER
+ * iterations, so that narrow lane accumulators can't overflow before
+ * being widened into 64-bit accumulators. */
+#define STATS_BLOCK_ITER 4096
+
+static int simd_level = -1;
+static pthread_once_t simd_level_once = PTHREAD_ONCE_INIT;
+
+static const char *simd_level_names[] = {
+    "scalar",
+    "sse2",
+    "ssse3",
+    "avx2",
+    "neon"
+};
+
+/* Scalar kernels */
+
+static uint16_t getTruncatedUInt16(uint16_t value, uint32_t pixel_size) {
+    if (pixel_size >= 16) return value;
+    uint32_t lshift = 16 - pixel_size,
+             rshift = pixel_size - lshift;
+    return (value << lshift) + (value >> rshift);
+}
+
+static void reverseChannels8Scalar(const uint8_t *src, uint8_t *dst,
+    size_t count)
+{
+    size_t i;
+    for (i = 0; i < count; i++) {
+        uint8_t c1 = src[0], c2 = src[1], c3 = src[2];
+        dst[0] = c3;
+        dst[1] = c2;
+        dst[2] = c1;
+        src += 3;
+        dst += 3;
+    }
+}
+
+static void convert16Scalar(const uint16_t *src, uint16_t *dst, size_t count,
+    int depth, int swap)
+{
+    size_t i;
+    for (i = 0; i < count; i++) {
+        uint16_t pixel = src[i];
+        if (swap) pixel = (uint16_t)((pixel >> 8) | (pixel << 8));
+        if (depth < 16) pixel = getTruncatedUInt16(pixel, depth);
+        dst[i] = pixel;
+    }
+}
+
+static void convertRGB16Scalar(const uint16_t *src, uint16_t *dst,
+    size_t count, int depth, int swap)
+{
+    size_t i;
+    for (i = 0; i < count; i++) {
+        uint16_t c[3];
+        convert16Scalar(src, c, 3, depth, swap);
+        dst[0] = c[2];
+        dst[1] = c[1];
+        dst[2] = c[0];
+        src += 3;
+        dst += 3;
+    }
+}
+
+/* Store the `count` 3-channel pixels of `src` as three planes (`count`
+ * samples each) starting from `dst`, in RGB order: `first` is the channel
+ * of source pixels that goes into the first plane (0 or 2). */
+static void toPlanes8Scalar(const uint8_t *src, uint8_t *dst, size_t count,
+    size_t plane, int first)
+{
+    uint8_t *r = dst, *g = dst + plane, *b = dst + (2 * plane);
+    size_t i;
+    for (i = 0; i < count; i++) {
+        r[i] = src[first];
+        g[i] = src[1];
+        b[i] = src[2 - first];
+        src += 3;
+    }
+}
+
+static void toPlanes16Scalar(const uint16_t *src, uint16_t *dst,
+    size_t count, size_t plane, int first, int depth, int swap)
+{
+    uint16_t *r = dst, *g = dst + plane, *b = dst + (2 * plane);
+    size_t i;
+    for (i = 0; i < count; i++) {
+        uint16_t c[3];
+        convert16Scalar(src, c, 3, depth, swap);
+        r[i] = c[first];
+        g[i] = c[1];
+        b[i] = c[2 - first];
+        src += 3;
+    }
+}
+
+static void sampleStats8Scalar(const uint8_t *src, size_t count,
+    uint32_t saturation, SIMDSampleStats *stats)
+{
+    size_t i;
+    for (i = 0; i < count; i++) {
+        uint32_t v = src[i];
+        if (v < stats->min) stats->min = v;
+        if (v > stats->max) stats->max = v;
+        stats->sum += v;
+        stats->sumsq += (uint64_t) v * v;
+        stats->saturated += (v >= saturation);
+    }
+    stats->count += count;
+}
+
+static void sampleStats16Scalar(const uint16_t *src, size_t count,
+    uint32_t saturation, SIMDSampleStats *stats)
+{
+    size_t i;
+    for (i = 0; i < count; i++) {
+        uint32_t v = src[i];
+        if (v < stats->min) stats->min = v;
+        if (v > stats->max) stats->max = v;
+        stats->sum += v;
+        stats->sumsq += (uint64_t) v * v;
+        stats->saturated += (v >= saturation);
+    }
+    stats->count += count;
+}
+
+static void accumulate8Scalar(const uint8_t *src, uint32_t *acc,
+    size_t count)
+{
+    size_t i;
+    for (i = 0; i < count; i++) acc[i] += src[i];
+}
+
+static void accumulate16Scalar(const uint16_t *src, uint32_t *acc,
+    size_t count)
+{
+    size_t i;
+    for (i = 0; i < count; i++) acc[i] += src[i];
+}
+
+/* Horizontal binning (see SIMDBinRow) */
+static void binRowScalar(const uint32_t *src, uint32_t *dst, size_t count,
+    int factor, int step)
+{
+    size_t groups = count / step, g;
+    int c, i;
+    for (g = 0; g < groups; g++) {
+        const uint32_t *s = src + (g * factor * step);
+        for (c = 0; c < step; c++) {
+            uint32_t sum = 0;
+            for (i = 0; i < factor; i++) sum += s[(i * step) + c];
+            dst[(g * step) + c] = sum;
+        }
+    }
+}
+
+/* Bin packing (see SIMDPackBins). SIMD versions divide by the bin size
+ * by multiplying by its reciprocal `recip`, which gives the same
+ * quotients for every possible bin sum. */
+static inline uint32_t packBinValue(uint32_t v, uint32_t divisor,
+    uint32_t maxval)
+{
+    if (divisor > 1) v = (v + (divisor / 2)) / divisor;
+    return (v > maxval ? maxval : v);
+}
+
+static void packBinsScalar(const uint32_t *src, void *dst, size_t count,
+    uint32_t divisor, uint32_t maxval, const uint8_t *lut,
+    int bytes_per_sample)
+{
+    size_t i;
+    if (lut != NULL) {
+        uint8_t *d = dst;
+        for (i = 0; i < count; i++)
+            d[i] = lut[packBinValue(src[i], divisor, maxval)];
+    } else if (bytes_per_sample == 1) {
+        uint8_t *d = dst;
+        for (i = 0; i < count; i++)
+            d[i] = (uint8_t) packBinValue(src[i], divisor, maxval);
+    } else {
+        uint16_t *d = dst;
+        for (i = 0; i < count; i++)
+            d[i] = (uint16_t) packBinValue(src[i], divisor, maxval);
+    }
+}
+
+/* Bilinear demosaicing of a row of a Bayer mosaic (see
+ * SIMDDebayerBilinearRow). Averages are always computed as nested
+ * rounded halving averages, so that SIMD versions (using PAVG & co.)
+ * give bit-identical results. */
+#define DEBAYER_AVG(a, b) (((uint32_t) (a) + (uint32_t) (b) + 1) >> 1)
+
+#define DEBAYER_BILINEAR_PIXEL(up, cur, dn, x, dst, k, cp) do {\
+    uint32_t C = cur[x], H = DEBAYER_AVG(cur[x - 1], cur[x + 1]),\
+             V = DEBAYER_AVG(up[x], dn[x]);\
+    if (((x) & 1) == (size_t) (cp)) {\
+        dst[k] = C;\
+        dst[1] = DEBAYER_AVG(H, V);\
+        dst[2 - (k)] = DEBAYER_AVG(DEBAYER_AVG(up[x - 1], up[x + 1]),\
+                                   DEBAYER_AVG(dn[x - 1], dn[x + 1]));\
+    } else {\
+        dst[k] = H;\
+        dst[1] = C;\
+        dst[2 - (k)] = V;\
+    }\
+} while (0)
+
+static void debayerRow8Scalar(const uint8_t *up, const uint8_t *cur,
+    const uint8_t *dn, uint8_t *dst, size_t from, size_t to, int k, int cp)
+{
+    size_t x;
+    for (x = from; x < to; x++) {
+        uint8_t *o = dst + (x * 3);
+        DEBAYER_BILINEAR_PIXEL(up, cur, dn, x, o, k, cp);
+    }
+}
+
+static void debayerRow16Scalar(const uint16_t *up, const uint16_t *cur,
+    const uint16_t *dn, uint16_t *dst, size_t from, size_t to, int k, int cp)
+{
+    size_t x;
+    for (x = from; x < to; x++) {
+        uint16_t *o = dst + (x * 3);
+        DEBAYER_BILINEAR_PIXEL(up, cur, dn, x, o, k, cp);
+    }
+}
+
+/* Store the `n` pixels of the planar `r`, `g`, `b` vectors stored into
+ * temporary arrays to the interleaved (RGB) row `dst`. */
+#define DEBAYER_STORE_RGB(dst, kv, gv, ov, k, n) do {\
+    const __typeof__(kv[0]) *r = ((k) == 0 ? kv : ov),\
+                            *b = ((k) == 0 ? ov : kv);\
+    int l;\
+    for (l = 0; l < (n); l++) {\
+        dst[0] = r[l];\
+        dst[1] = gv[l];\
+        dst[2] = b[l];\
+        dst += 3;\
+    }\
+} while (0)
+
+/* x86 kernels */
+
+#if SIMD_X86_KERNELS
+
+/* Shuffle masks used to permute 48-byte blocks (three SSE registers) with
+ * PSHUFB: masks[k][j] picks bytes of input register `j` that go into
+ * output register `k`. */
+typedef uint8_t Shuffle48Masks[3][3][16];
+
+static Shuffle48Masks bgr8_masks, bgr16_masks, bgr16_swap_masks;
+/* Split pixels into planes (output register `k` gets 16 8-bit or 8 16-bit
+ * samples of plane `k`), indexed by [reverse channels][swap bytes] */
+static Shuffle48Masks planes8_masks[2], planes16_masks[2][2];
+
+static void buildShuffle48Masks(const uint8_t *perm, Shuffle48Masks masks) {
+    int k, j, b;
+    for (k = 0; k < 3; k++) {
+        for (j = 0; j < 3; j++) {
+            for (b = 0; b < 16; b++) {
+                int src = perm[(k * 16) + b];
+                masks[k][j][b] = ((src / 16) == j ? (src % 16) : 0x80);
+            }
+        }
+    }
+}
+
+static void initShuffle48Masks(void) {
+    uint8_t perm[48];
+    int i;
+    /* 8-bit BGR pixels: 3 bytes per pixel, reverse every pixel */
+    for (i = 0; i < 48; i++) perm[i] = (i / 3) * 3 + (2 - (i % 3));
+    buildShuffle48Masks(perm, bgr8_masks);
+    /* 16-bit BGR pixels: reverse channels (2-byte words) */
+    for (i = 0; i < 48; i++)
+        perm[i] = (i / 6) * 6 + (2 - ((i % 6) / 2)) * 2 + (i % 2);
+    buildShuffle48Masks(perm, bgr16_masks);
+    /* 16-bit BGR pixels with byte swapping: reverse all the 6 bytes */
+    for (i = 0; i < 48; i++) perm[i] = (i / 6) * 6 + (5 - (i % 6));
+    buildShuffle48Masks(perm, bgr16_swap_masks);
+    int reverse, swap;
+    for (reverse = 0; reverse < 2; reverse++) {
+        /* Plane `i / 16` of pixel `i % 16` (8-bit), or of pixel
+         * `(i % 16) / 2` (16-bit) */
+        for (i = 0; i < 48; i++) {
+            int c = (reverse ? 2 - (i / 16) : i / 16);
+            perm[i] = (i % 16) * 3 + c;
+        }
+        buildShuffle48Masks(perm, planes8_masks[reverse]);
+        for (swap = 0; swap < 2; swap++) {
+            for (i = 0; i < 48; i++) {
+                int c = (reverse ? 2 - (i / 16) : i / 16), b = i % 2;
+                perm[i] = ((i % 16) / 2) * 6 + c * 2 + (swap ? 1 - b : b);
+            }
+            buildShuffle48Masks(perm, planes16_masks[reverse][swap]);
+        }
+    }
+}
+
+TARGET_SSSE3
+static inline void shuffle48SSSE3(const uint8_t *src, uint8_t *dst,
+    Shuffle48Masks masks)
+{
+    __m128i in[3], out;
+    int k, j;
+    for (j = 0; j < 3; j++)
+        in[j] = _mm_loadu_si128((const __m128i *) (src + (j * 16)));
+    for (k = 0; k < 3; k++) {
+        out = _mm_setzero_si128();
+        for (j = 0; j < 3; j++) {
+            __m128i m = _mm_loadu_si128((const __m128i *) masks[k][j]);
+            out = _mm_or_si128(out, _mm_shuffle_epi8(in[j], m));
+        }
+        _mm_storeu_si128((__m128i *) (dst + (k * 16)), out);
+    }
+}
+
+TARGET_SSSE3
+static void reverseChannels8SSSE3(const uint8_t *src, uint8_t *dst,
+    size_t count)
+{
+    size_t i = 0;
+    /* 16 pixels per block */
+    for (; i + 16 <= count; i += 16) {
+        shuffle48SSSE3(src, dst, bgr8_masks);
+        src += 48;
+        dst += 48;
+    }
+    reverseChannels8Scalar(src, dst, count - i);
+}
+
+/* Same as shuffle48SSSE3, but output register `k` is stored into
+ * `planes[k]` */
+TARGET_SSSE3
+static inline void shuffle48ToPlanesSSSE3(const uint8_t *src,
+    uint8_t *planes[3], Shuffle48Masks masks)
+{
+    __m128i in[3], out;
+    int k, j;
+    for (j = 0; j < 3; j++)
+        in[j] = _mm_loadu_si128((const __m128i *) (src + (j * 16)));
+    for (k = 0; k < 3; k++) {
+        out = _mm_setzero_si128();
+        for (j = 0; j < 3; j++) {
+            __m128i m = _mm_loadu_si128((const __m128i *) masks[k][j]);
+            out = _mm_or_si128(out, _mm_shuffle_epi8(in[j], m));
+        }
+        _mm_storeu_si128((__m128i *) planes[k], out);
+    }
+}
+
+TARGET_SSSE3
+static void toPlanes8SSSE3(const uint8_t *src, uint8_t *dst, size_t count,
+    size_t plane, int first)
+{
+    size_t i = 0;
+    uint8_t *planes[3];
+    Shuffle48Masks *masks = &planes8_masks[first != 0];
+    /* 16 pixels per block */
+    for (; i + 16 <= count; i += 16) {
+        planes[0] = dst + i;
+        planes[1] = dst + plane + i;
+        planes[2] = dst + (2 * plane) + i;
+        shuffle48ToPlanesSSSE3(src, planes, *masks);
+        src += 48;
+    }
+    toPlanes8Scalar(src, dst + i, count - i, plane, first);
+}
+
+TARGET_SSE2
+static inline __m128i convert16SSE2Vec(__m128i v, int swap, int rescale,
+    __m128i lshift, __m128i rshift)
+{
+    if (swap) v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    if (rescale) {
+        v = _mm_add_epi16(_mm_sll_epi16(v, lshift), _mm_srl_epi16(v, rshift));
+    }
+    return v;
+}
+
+TARGET_SSE2
+static void convert16SSE2(const uint16_t *src, uint16_t *dst, size_t count,
+    int depth, int swap)
+{
+    size_t i = 0;
+    int rescale = (depth < 16);
+    __m128i lshift = _mm_cvtsi32_si128(rescale ? 16 - depth : 0),
+            rshift = _mm_cvtsi32_si128(rescale ? depth - (16 - depth) : 0);
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        v = convert16SSE2Vec(v, swap, rescale, lshift, rshift);
+        _mm_storeu_si128((__m128i *) (dst + i), v);
+    }
+    convert16Scalar(src + i, dst + i, count - i, depth, swap);
+}
+
+TARGET_SSSE3
+static void convertRGB16SSSE3(const uint16_t *src, uint16_t *dst,
+    size_t count, int depth, int swap)
+{
+    size_t i = 0;
+    int rescale = (depth < 16), k;
+    __m128i lshift = _mm_cvtsi32_si128(rescale ? 16 - depth : 0),
+            rshift = _mm_cvtsi32_si128(rescale ? depth - (16 - depth) : 0);
+    uint8_t (*masks)[3][16] = (swap ? bgr16_swap_masks : bgr16_masks);
+    /* 8 pixels (24 words) per block: reorder channels (and swap bytes)
+     * with a single shuffle, then rescale */
+    for (; i + 8 <= count; i += 8) {
+        shuffle48SSSE3((const uint8_t *) src, (uint8_t *) dst, masks);
+        if (rescale) {
+            for (k = 0; k < 3; k++) {
+                __m128i *p = (__m128i *) (dst + (k * 8));
+                __m128i v = _mm_loadu_si128(p);
+                v = convert16SSE2Vec(v, 0, 1, lshift, rshift);
+                _mm_storeu_si128(p, v);
+            }
+        }
+        src += 24;
+        dst += 24;
+    }
+    convertRGB16Scalar(src, dst, count - i, depth, swap);
+}
+
+TARGET_SSSE3
+static void toPlanes16SSSE3(const uint16_t *src, uint16_t *dst,
+    size_t count, size_t plane, int first, int depth, int swap)
+{
+    size_t i = 0;
+    int rescale = (depth < 16), k;
+    __m128i lshift = _mm_cvtsi32_si128(rescale ? 16 - depth : 0),
+            rshift = _mm_cvtsi32_si128(rescale ? depth - (16 - depth) : 0);
+    uint8_t *planes[3];
+    Shuffle48Masks *masks = &planes16_masks[first != 0][swap != 0];
+    /* 8 pixels per block: split channels (and swap bytes) with a single
+     * shuffle, then rescale */
+    for (; i + 8 <= count; i += 8) {
+        for (k = 0; k < 3; k++)
+            planes[k] = (uint8_t *) (dst + (k * plane) + i);
+        shuffle48ToPlanesSSSE3((const uint8_t *) src, planes, *masks);
+        if (rescale) {
+            for (k = 0; k < 3; k++) {
+                __m128i *p = (__m128i *) planes[k];
+                __m128i v = _mm_loadu_si128(p);
+                v = convert16SSE2Vec(v, 0, 1, lshift, rshift);
+                _mm_storeu_si128(p, v);
+            }
+        }
+        src += 24;
+    }
+    toPlanes16Scalar(src, dst + i, count - i, plane, first, depth, swap);
+}
+
+TARGET_AVX2
+static void convert16AVX2(const uint16_t *src, uint16_t *dst, size_t count,
+    int depth, int swap)
+{
+    size_t i = 0;
+    int rescale = (depth < 16);
+    __m128i lshift = _mm_cvtsi32_si128(rescale ? 16 - depth : 0),
+            rshift = _mm_cvtsi32_si128(rescale ? depth - (16 - depth) : 0);
+    for (; i + 16 <= count; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (src + i));
+        if (swap) {
+            v = _mm256_or_si256(_mm256_slli_epi16(v, 8),
+                                _mm256_srli_epi16(v, 8));
+        }
+        if (rescale) {
+            v = _mm256_add_epi16(_mm256_sll_epi16(v, lshift),
+                                 _mm256_srl_epi16(v, rshift));
+        }
+        _mm256_storeu_si256((__m256i *) (dst + i), v);
+    }
+    convert16SSE2(src + i, dst + i, count - i, depth, swap);
+}
+
+TARGET_SSE2
+static inline uint64_t sumEpi64SSE2(__m128i v) {
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *) lanes, v);
+    return lanes[0] + lanes[1];
+}
+
+TARGET_SSE2
+static inline __m128i widenEpu32SSE2(__m128i v) {
+    __m128i zero = _mm_setzero_si128();
+    return _mm_add_epi64(_mm_unpacklo_epi32(v, zero),
+                         _mm_unpackhi_epi32(v, zero));
+}
+
+TARGET_SSE2
+static void sampleStats8SSE2(const uint8_t *src, size_t count,
+    uint32_t saturation, SIMDSampleStats *stats)
+{
+    size_t i = 0;
+    __m128i zero = _mm_setzero_si128(),
+            vmin = _mm_set1_epi8((char) 0xFF),
+            vmax = zero,
+            vsat = _mm_set1_epi8((char) (saturation > 255 ? 255 : saturation)),
+            sum64 = zero, sumsq64 = zero, sat64 = zero;
+    /* With a saturation value greater than 255 nothing is saturated */
+    int check_sat = (saturation <= 255);
+    while (i + 16 <= count) {
+        __m128i sumsq32 = zero, sat8 = zero;
+        size_t iter = 0;
+        for (; i + 16 <= count && iter < STATS_BLOCK_ITER; i += 16, iter++) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+            vmin = _mm_min_epu8(vmin, v);
+            vmax = _mm_max_epu8(vmax, v);
+            sum64 = _mm_add_epi64(sum64, _mm_sad_epu8(v, zero));
+            __m128i lo = _mm_unpacklo_epi8(v, zero),
+                    hi = _mm_unpackhi_epi8(v, zero);
+            sumsq32 = _mm_add_epi32(sumsq32, _mm_madd_epi16(lo, lo));
+            sumsq32 = _mm_add_epi32(sumsq32, _mm_madd_epi16(hi, hi));
+            if (check_sat) {
+                __m128i mask = _mm_cmpeq_epi8(_mm_max_epu8(v, vsat), v);
+                sat8 = _mm_sub_epi8(sat8, mask);
+            }
+            /* 8-bit saturation counters are flushed every 255 iterations */
+            if ((iter % 255) == 254) {
+                sat64 = _mm_add_epi64(sat64, _mm_sad_epu8(sat8, zero));
+                sat8 = zero;
+            }
+        }
+        sumsq64 = _mm_add_epi64(sumsq64, widenEpu32SSE2(sumsq32));
+        sat64 = _mm_add_epi64(sat64, _mm_sad_epu8(sat8, zero));
+    }
+    uint8_t mins[16], maxs[16];
+    int k;
+    _mm_storeu_si128((__m128i *) mins, vmin);
+    _mm_storeu_si128((__m128i *) maxs, vmax);
+    if (i > 0) {
+        for (k = 0; k < 16; k++) {
+            if (mins[k] < stats->min) stats->min = mins[k];
+            if (maxs[k] > stats->max) stats->max = maxs[k];
+        }
+    }
+    stats->sum += sumEpi64SSE2(sum64);
+    stats->sumsq += sumEpi64SSE2(sumsq64);
+    stats->saturated += sumEpi64SSE2(sat64);
+    stats->count += i;
+    sampleStats8Scalar(src + i, count - i, saturation, stats);
+}
+
+/* 16-bit samples are biased by 0x8000, so that signed SSE2 instructions
+ * can be used: min/max are computed on biased values and the sum of
+ * squares is derived from the sum of squared biased values:
+ * sum(v^2) = sum((v - 32768)^2) + 65536 * sum(v) - n * 2^30 */
+TARGET_SSE2
+static void sampleStats16SSE2(const uint16_t *src, size_t count,
+    uint32_t saturation, SIMDSampleStats *stats)
+{
+    size_t i = 0;
+    __m128i zero = _mm_setzero_si128(),
+            bias = _mm_set1_epi16((short) 0x8000),
+            vmin = _mm_set1_epi16(0x7FFF),
+            vmax = _mm_set1_epi16((short) 0x8000),
+            ones = _mm_set1_epi16(1),
+            sum64 = zero, sqb64 = zero, sat64 = zero;
+    int check_sat = (saturation <= 0xFFFF);
+    __m128i vsat = _mm_set1_epi16((short) (((saturation - 1) & 0xFFFF) ^
+                                           0x8000));
+    if (saturation == 0) check_sat = 0;
+    while (i + 8 <= count) {
+        __m128i sum32 = zero, sat16 = zero;
+        size_t iter = 0;
+        for (; i + 8 <= count && iter < STATS_BLOCK_ITER; i += 8, iter++) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (src + i)),
+                    b = _mm_xor_si128(v, bias);
+            vmin = _mm_min_epi16(vmin, b);
+            vmax = _mm_max_epi16(vmax, b);
+            sum32 = _mm_add_epi32(sum32, _mm_unpacklo_epi16(v, zero));
+            sum32 = _mm_add_epi32(sum32, _mm_unpackhi_epi16(v, zero));
+            /* Pairs of squared biased values fit into unsigned 32 bits */
+            sqb64 = _mm_add_epi64(sqb64, widenEpu32SSE2(_mm_madd_epi16(b, b)));
+            if (check_sat) {
+                __m128i mask = _mm_cmpgt_epi16(b, vsat);
+                sat16 = _mm_sub_epi16(sat16, mask);
+            }
+        }
+        sum64 = _mm_add_epi64(sum64, widenEpu32SSE2(sum32));
+        sat64 = _mm_add_epi64(sat64,
+            widenEpu32SSE2(_mm_madd_epi16(sat16, ones)));
+    }
+    if (i > 0) {
+        int16_t mins[8], maxs[8];
+        int k;
+        _mm_storeu_si128((__m128i *) mins, vmin);
+        _mm_storeu_si128((__m128i *) maxs, vmax);
+        for (k = 0; k < 8; k++) {
+            uint32_t mn = (uint16_t) mins[k] ^ 0x8000,
+                     mx = (uint16_t) maxs[k] ^ 0x8000;
+            if (mn < stats->min) stats->min = mn;
+            if (mx > stats->max) stats->max = mx;
+        }
+    }
+    uint64_t sum = sumEpi64SSE2(sum64);
+    stats->sum += sum;
+    stats->sumsq += sumEpi64SSE2(sqb64) + (sum << 16) -
+                    ((uint64_t) i << 30);
+    stats->saturated += sumEpi64SSE2(sat64);
+    stats->count += i;
+    sampleStats16Scalar(src + i, count - i, saturation, stats);
+}
+
+TARGET_AVX2
+static inline __m256i widenEpu32AVX2(__m256i v) {
+    __m256i zero = _mm256_setzero_si256();
+    return _mm256_add_epi64(_mm256_unpacklo_epi32(v, zero),
+                            _mm256_unpackhi_epi32(v, zero));
+}
+
+TARGET_AVX2
+static inline uint64_t sumEpi64AVX2(__m256i v) {
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, v);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+TARGET_AVX2
+static void sampleStats8AVX2(const uint8_t *src, size_t count,
+    uint32_t saturation, SIMDSampleStats *stats)
+{
+    size_t i = 0;
+    __m256i zero = _mm256_setzero_si256(),
+            vmin = _mm256_set1_epi8((char) 0xFF),
+            vmax = zero,
+            vsat = _mm256_set1_epi8((char) (saturation > 255 ? 255 :
+                                            saturation)),
+            sum64 = zero, sumsq64 = zero, sat64 = zero;
+    int check_sat = (saturation <= 255);
+    while (i + 32 <= count) {
+        __m256i sumsq32 = zero, sat8 = zero;
+        size_t iter = 0;
+        for (; i + 32 <= count && iter < STATS_BLOCK_ITER; i += 32, iter++) {
+            __m256i v = _mm256_loadu_si256((const __m256i *) (src + i));
+            vmin = _mm256_min_epu8(vmin, v);
+            vmax = _mm256_max_epu8(vmax, v);
+            sum64 = _mm256_add_epi64(sum64, _mm256_sad_epu8(v, zero));
+            __m256i lo = _mm256_unpacklo_epi8(v, zero),
+                    hi = _mm256_unpackhi_epi8(v, zero);
+            sumsq32 = _mm256_add_epi32(sumsq32, _mm256_madd_epi16(lo, lo));
+            sumsq32 = _mm256_add_epi32(sumsq32, _mm256_madd_epi16(hi, hi));
+            if (check_sat) {
+                __m256i mask = _mm256_cmpeq_epi8(_mm256_max_epu8(v, vsat), v);
+                sat8 = _mm256_sub_epi8(sat8, mask);
+            }
+            if ((iter % 255) == 254) {
+                sat64 = _mm256_add_epi64(sat64, _mm256_sad_epu8(sat8, zero));
+                sat8 = zero;
+            }
+        }
+        sumsq64 = _mm256_add_epi64(sumsq64, widenEpu32AVX2(sumsq32));
+        sat64 = _mm256_add_epi64(sat64, _mm256_sad_epu8(sat8, zero));
+    }
+    if (i > 0) {
+        uint8_t mins[32], maxs[32];
+        int k;
+        _mm256_storeu_si256((__m256i *) mins, vmin);
+        _mm256_storeu_si256((__m256i *) maxs, vmax);
+        for (k = 0; k < 32; k++) {
+            if (mins[k] < stats->min) stats->min = mins[k];
+            if (maxs[k] > stats->max) stats->max = maxs[k];
+        }
+    }
+    stats->sum += sumEpi64AVX2(sum64);
+    stats->sumsq += sumEpi64AVX2(sumsq64);
+    stats->saturated += sumEpi64AVX2(sat64);
+    stats->count += i;
+    sampleStats8SSE2(src + i, count - i, saturation, stats);
+}
+
+TARGET_AVX2
+static void sampleStats16AVX2(const uint16_t *src, size_t count,
+    uint32_t saturation, SIMDSampleStats *stats)
+{
+    size_t i = 0;
+    __m256i zero = _mm256_setzero_si256(),
+            bias = _mm256_set1_epi16((short) 0x8000),
+            vmin = _mm256_set1_epi16((short) 0xFFFF),
+            vmax = zero,
+            ones = _mm256_set1_epi16(1),
+            vsat = _mm256_set1_epi16((short) (saturation > 0xFFFF ? 0xFFFF :
+                                              saturation)),
+            sum64 = zero, sqb64 = zero, sat64 = zero;
+    int check_sat = (saturation <= 0xFFFF);
+    while (i + 16 <= count) {
+        __m256i sum32 = zero, sat16 = zero;
+        size_t iter = 0;
+        for (; i + 16 <= count && iter < STATS_BLOCK_ITER; i += 16, iter++) {
+            __m256i v = _mm256_loadu_si256((const __m256i *) (src + i)),
+                    b = _mm256_xor_si256(v, bias);
+            vmin = _mm256_min_epu16(vmin, v);
+            vmax = _mm256_max_epu16(vmax, v);
+            sum32 = _mm256_add_epi32(sum32, _mm256_unpacklo_epi16(v, zero));
+            sum32 = _mm256_add_epi32(sum32, _mm256_unpackhi_epi16(v, zero));
+            sqb64 = _mm256_add_epi64(sqb64,
+                widenEpu32AVX2(_mm256_madd_epi16(b, b)));
+            if (check_sat) {
+                __m256i mask = _mm256_cmpeq_epi16(
+                    _mm256_max_epu16(v, vsat), v);
+                sat16 = _mm256_sub_epi16(sat16, mask);
+            }
+        }
+        sum64 = _mm256_add_epi64(sum64, widenEpu32AVX2(sum32));
+        sat64 = _mm256_add_epi64(sat64,
+            widenEpu32AVX2(_mm256_madd_epi16(sat16, ones)));
+    }
+    if (i > 0) {
+        uint16_t mins[16], maxs[16];
+        int k;
+        _mm256_storeu_si256((__m256i *) mins, vmin);
+        _mm256_storeu_si256((__m256i *) maxs, vmax);
+        for (k = 0; k < 16; k++) {
+            if (mins[k] < stats->min) stats->min = mins[k];
+            if (maxs[k] > stats->max) stats->max = maxs[k];
+        }
+    }
+    uint64_t sum = sumEpi64AVX2(sum64);
+    stats->sum += sum;
+    stats->sumsq += sumEpi64AVX2(sqb64) + (sum << 16) -
+                    ((uint64_t) i << 30);
+    stats->saturated += sumEpi64AVX2(sat64);
+    stats->count += i;
+    sampleStats16SSE2(src + i, count - i, saturation, stats);
+}
+
+TARGET_SSE2
+static inline void accumulateEpu32SSE2(uint32_t *acc, __m128i v) {
+    __m128i *p = (__m128i *) acc;
+    _mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), v));
+}
+
+TARGET_SSE2
+static void accumulate8SSE2(const uint8_t *src, uint32_t *acc, size_t count) {
+    size_t i = 0;
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i)),
+                lo = _mm_unpacklo_epi8(v, zero),
+                hi = _mm_unpackhi_epi8(v, zero);
+        accumulateEpu32SSE2(acc + i, _mm_unpacklo_epi16(lo, zero));
+        accumulateEpu32SSE2(acc + i + 4, _mm_unpackhi_epi16(lo, zero));
+        accumulateEpu32SSE2(acc + i + 8, _mm_unpacklo_epi16(hi, zero));
+        accumulateEpu32SSE2(acc + i + 12, _mm_unpackhi_epi16(hi, zero));
+    }
+    accumulate8Scalar(src + i, acc + i, count - i);
+}
+
+TARGET_SSE2
+static void accumulate16SSE2(const uint16_t *src, uint32_t *acc,
+    size_t count)
+{
+    size_t i = 0;
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        accumulateEpu32SSE2(acc + i, _mm_unpacklo_epi16(v, zero));
+        accumulateEpu32SSE2(acc + i + 4, _mm_unpackhi_epi16(v, zero));
+    }
+    accumulate16Scalar(src + i, acc + i, count - i);
+}
+
+TARGET_AVX2
+static void accumulate8AVX2(const uint8_t *src, uint32_t *acc, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_cvtepu8_epi32(
+            _mm_loadl_epi64((const __m128i *)(src + i)));
+        __m256i *p = (__m256i *)(acc + i);
+        _mm256_storeu_si256(p, _mm256_add_epi32(_mm256_loadu_si256(p), v));
+    }
+    accumulate8Scalar(src + i, acc + i, count - i);
+}
+
+TARGET_AVX2
+static void accumulate16AVX2(const uint16_t *src, uint32_t *acc,
+    size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_cvtepu16_epi32(
+            _mm_loadu_si128((const __m128i *)(src + i)));
+        __m256i *p = (__m256i *)(acc + i);
+        _mm256_storeu_si256(p, _mm256_add_epi32(_mm256_loadu_si256(p), v));
+    }
+    accumulate16Scalar(src + i, acc + i, count - i);
+}
+
+/* Select lanes of `a` where `mask` is set, and lanes of `b` elsewhere */
+TARGET_SSE2
+static inline __m128i selectSSE2(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/* Sum adjacent pairs of samples (factor 2) of rows with 1 or 2 samples
+ * per group (mono and Bayer rows) */
+TARGET_SSE2
+static void binRow2SSE2(const uint32_t *src, uint32_t *dst, size_t count,
+    int step)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 a = _mm_castsi128_ps(_mm_loadu_si128(
+                       (const __m128i *)(src + (i * 2)))),
+               b = _mm_castsi128_ps(_mm_loadu_si128(
+                       (const __m128i *)(src + (i * 2) + 4)));
+        __m128i lo, hi;
+        if (step == 1) {
+            lo = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)));
+            hi = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1)));
+        } else {
+            lo = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1,0,1,0)));
+            hi = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3,2,3,2)));
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_add_epi32(lo, hi));
+    }
+    binRowScalar(src + (i * 2), dst + i, count - i, 2, step);
+}
+
+/* Rounded division of the 32-bit lanes of `v` by the bin size, by using
+ * its reciprocal (see getBinReciprocal) */
+TARGET_SSE2
+static inline __m128i divideBinsSSE2(__m128i v, __m128i half, __m128i recip) {
+    v = _mm_add_epi32(v, half);
+    __m128i even = _mm_srli_epi64(_mm_mul_epu32(v, recip), 32),
+            odd = _mm_mul_epu32(_mm_srli_epi64(v, 32), recip);
+    return _mm_or_si128(even,
+        _mm_and_si128(odd, _mm_set_epi32(-1, 0, -1, 0)));
+}
+
+TARGET_SSE2
+static void packBinsSSE2(const uint32_t *src, void *dst, size_t count,
+    uint32_t divisor, uint32_t recip, uint32_t maxval, const uint8_t *lut,
+    int bytes_per_sample)
+{
+    size_t i = 0;
+    __m128i half = _mm_set1_epi32((int) (divisor / 2)),
+            rv = _mm_set1_epi32((int) recip),
+            maxv = _mm_set1_epi32((int) maxval),
+            bias = _mm_set1_epi32(32768), bias16 = _mm_set1_epi16(-32768);
+    uint32_t values[8];
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i)),
+                b = _mm_loadu_si128((const __m128i *)(src + i + 4));
+        if (divisor > 1) {
+            a = divideBinsSSE2(a, half, rv);
+            b = divideBinsSSE2(b, half, rv);
+        }
+        /* Sums are less than 2^31, so signed comparisons can be used */
+        a = selectSSE2(_mm_cmpgt_epi32(a, maxv), maxv, a);
+        b = selectSSE2(_mm_cmpgt_epi32(b, maxv), maxv, b);
+        if (lut != NULL) {
+            int l;
+            _mm_storeu_si128((__m128i *) values, a);
+            _mm_storeu_si128((__m128i *)(values + 4), b);
+            for (l = 0; l < 8; l++) ((uint8_t *) dst)[i + l] = lut[values[l]];
+        } else if (bytes_per_sample == 1) {
+            __m128i w = _mm_packs_epi32(a, b);
+            _mm_storel_epi64((__m128i *)((uint8_t *) dst + i),
+                _mm_packus_epi16(w, w));
+        } else {
+            /* No unsigned 32 -> 16 bits pack in SSE2: pack biased values */
+            __m128i w = _mm_packs_epi32(_mm_sub_epi32(a, bias),
+                                        _mm_sub_epi32(b, bias));
+            _mm_storeu_si128((__m128i *)((uint16_t *) dst + i),
+                _mm_xor_si128(w, bias16));
+        }
+    }
+    if (bytes_per_sample == 1 || lut != NULL) {
+        packBinsScalar(src + i, (uint8_t *) dst + i, count - i, divisor,
+            maxval, lut, bytes_per_sample);
+    } else {
+        packBinsScalar(src + i, (uint16_t *) dst + i, count - i, divisor,
+            maxval, lut, bytes_per_sample);
+    }
+}
+
+TARGET_AVX2
+static inline __m256i divideBinsAVX2(__m256i v, __m256i half, __m256i recip) {
+    v = _mm256_add_epi32(v, half);
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(v, recip), 32),
+            odd = _mm256_mul_epu32(_mm256_srli_epi64(v, 32), recip);
+    return _mm256_blend_epi32(even, odd, 0xAA);
+}
+
+TARGET_AVX2
+static void packBinsAVX2(const uint32_t *src, void *dst, size_t count,
+    uint32_t divisor, uint32_t recip, uint32_t maxval, const uint8_t *lut,
+    int bytes_per_sample)
+{
+    size_t i = 0;
+    __m256i half = _mm256_set1_epi32((int) (divisor / 2)),
+            rv = _mm256_set1_epi32((int) recip),
+            maxv = _mm256_set1_epi32((int) maxval);
+    if (lut != NULL) {
+        packBinsSSE2(src, dst, count, divisor, recip, maxval, lut,
+            bytes_per_sample);
+        return;
+    }
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + i)),
+                b = _mm256_loadu_si256((const __m256i *)(src + i + 8));
+        if (divisor > 1) {
+            a = divideBinsAVX2(a, half, rv);
+            b = divideBinsAVX2(b, half, rv);
+        }
+        a = _mm256_min_epu32(a, maxv);
+        b = _mm256_min_epu32(b, maxv);
+        /* Packing works within 128-bit lanes: restore the order */
+        __m256i w = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8);
+        if (bytes_per_sample == 1) {
+            _mm_storeu_si128((__m128i *)((uint8_t *) dst + i),
+                _mm_packus_epi16(_mm256_castsi256_si128(w),
+                                 _mm256_extracti128_si256(w, 1)));
+        } else {
+            _mm256_storeu_si256((__m256i *)((uint16_t *) dst + i), w);
+        }
+    }
+    if (bytes_per_sample == 1) {
+        packBinsSSE2(src + i, (uint8_t *) dst + i, count - i, divisor, recip,
+            maxval, lut, bytes_per_sample);
+    } else {
+        packBinsSSE2(src + i, (uint16_t *) dst + i, count - i, divisor,
+            recip, maxval, lut, bytes_per_sample);
+    }
+}
+
+TARGET_SSE2
+static void debayerRow8SSE2(const uint8_t *up, const uint8_t *cur,
+    const uint8_t *dn, uint8_t *dst, size_t from, size_t to, int k, int cp)
+{
+    uint8_t kt[16], gt[16], ot[16];
+    size_t x = from;
+    /* Lanes holding a non-green sample */
+    __m128i mask = _mm_set1_epi16(0x00FF);
+    if ((from & 1) != (size_t) cp) mask = _mm_xor_si128(mask,
+        _mm_set1_epi8(-1));
+    uint8_t *o = dst + (x * 3);
+    for (; x + 16 <= to; x += 16) {
+        __m128i C = _mm_loadu_si128((const __m128i *)(cur + x)),
+                H = _mm_avg_epu8(
+                    _mm_loadu_si128((const __m128i *)(cur + x - 1)),
+                    _mm_loadu_si128((const __m128i *)(cur + x + 1))),
+                V = _mm_avg_epu8(
+                    _mm_loadu_si128((const __m128i *)(up + x)),
+                    _mm_loadu_si128((const __m128i *)(dn + x))),
+                D = _mm_avg_epu8(
+                    _mm_avg_epu8(
+                        _mm_loadu_si128((const __m128i *)(up + x - 1)),
+                        _mm_loadu_si128((const __m128i *)(up + x + 1))),
+                    _mm_avg_epu8(
+                        _mm_loadu_si128((const __m128i *)(dn + x - 1)),
+                        _mm_loadu_si128((const __m128i *)(dn + x + 1))));
+        _mm_storeu_si128((__m128i *) kt, selectSSE2(mask, C, H));
+        _mm_storeu_si128((__m128i *) gt,
+            selectSSE2(mask, _mm_avg_epu8(H, V), C));
+        _mm_storeu_si128((__m128i *) ot, selectSSE2(mask, D, V));
+        DEBAYER_STORE_RGB(o, kt, gt, ot, k, 16);
+    }
+    debayerRow8Scalar(up, cur, dn, dst, x, to, k, cp);
+}
+
+TARGET_SSE2
+static void debayerRow16SSE2(const uint16_t *up, const uint16_t *cur,
+    const uint16_t *dn, uint16_t *dst, size_t from, size_t to, int k, int cp)
+{
+    uint16_t kt[8], gt[8], ot[8];
+    size_t x = from;
+    /* Lanes holding a non-green sample */
+    __m128i mask = _mm_set1_epi32(0x0000FFFF);
+    if ((from & 1) != (size_t) cp) mask = _mm_xor_si128(mask,
+        _mm_set1_epi8(-1));
+    uint16_t *o = dst + (x * 3);
+    for (; x + 8 <= to; x += 8) {
+        __m128i C = _mm_loadu_si128((const __m128i *)(cur + x)),
+                H = _mm_avg_epu16(
+                    _mm_loadu_si128((const __m128i *)(cur + x - 1)),
+                    _mm_loadu_si128((const __m128i *)(cur + x + 1))),
+                V = _mm_avg_epu16(
+                    _mm_loadu_si128((const __m128i *)(up + x)),
+                    _mm_loadu_si128((const __m128i *)(dn + x))),
+                D = _mm_avg_epu16(
+                    _mm_avg_epu16(
+                        _mm_loadu_si128((const __m128i *)(up + x - 1)),
+                        _mm_loadu_si128((const __m128i *)(up + x + 1))),
+                    _mm_avg_epu16(
+                        _mm_loadu_si128((const __m128i *)(dn + x - 1)),
+                        _mm_loadu_si128((const __m128i *)(dn + x + 1))));
+        _mm_storeu_si128((__m128i *) kt, selectSSE2(mask, C, H));
+        _mm_storeu_si128((__m128i *) gt,
+            selectSSE2(mask, _mm_avg_epu16(H, V), C));
+        _mm_storeu_si128((__m128i *) ot, selectSSE2(mask, D, V));
+        DEBAYER_STORE_RGB(o, kt, gt, ot, k, 8);
+    }
+    debayerRow16Scalar(up, cur, dn, dst, x, to, k, cp);
+}
+
+TARGET_AVX2
+static void debayerRow8AVX2(const uint8_t *up, const uint8_t *cur,
+    const uint8_t *dn, uint8_t *dst, size_t from, size_t to, int k, int cp)
+{
+    uint8_t kt[32], gt[32], ot[32];
+    size_t x = from;
+    __m256i mask = _mm256_set1_epi16(0x00FF);
+    if ((from & 1) != (size_t) cp) mask = _mm256_xor_si256(mask,
+        _mm256_set1_epi8(-1));
+    uint8_t *o = dst + (x * 3);
+    for (; x + 32 <= to; x += 32) {
+        __m256i C = _mm256_loadu_si256((const __m256i *)(cur + x)),
+                H = _mm256_avg_epu8(
+                    _mm256_loadu_si256((const __m256i *)(cur + x - 1)),
+                    _mm256_loadu_si256((const __m256i *)(cur + x + 1))),
+                V = _mm256_avg_epu8(
+                    _mm256_loadu_si256((const __m256i *)(up + x)),
+                    _mm256_loadu_si256((const __m256i *)(dn + x))),
+                D = _mm256_avg_epu8(
+                    _mm256_avg_epu8(
+                        _mm256_loadu_si256((const __m256i *)(up + x - 1)),
+                        _mm256_loadu_si256((const __m256i *)(up + x + 1))),
+                    _mm256_avg_epu8(
+                        _mm256_loadu_si256((const __m256i *)(dn + x - 1)),
+                        _mm256_loadu_si256((const __m256i *)(dn + x + 1))));
+        _mm256_storeu_si256((__m256i *) kt, _mm256_blendv_epi8(H, C, mask));
+        _mm256_storeu_si256((__m256i *) gt,
+            _mm256_blendv_epi8(C, _mm256_avg_epu8(H, V), mask));
+        _mm256_storeu_si256((__m256i *) ot, _mm256_blendv_epi8(V, D, mask));
+        DEBAYER_STORE_RGB(o, kt, gt, ot, k, 32);
+    }
+    debayerRow8SSE2(up, cur, dn, dst, x, to, k, cp);
+}
+
+TARGET_AVX2
+static void debayerRow16AVX2(const uint16_t *up, const uint16_t *cur,
+    const uint16_t *dn, uint16_t *dst, size_t from, size_t to, int k, int cp)
+{
+    uint16_t kt[16], gt[16], ot[16];
+    size_t x = from;
+    __m256i mask = _mm256_set1_epi32(0x0000FFFF);
+    if ((from & 1) != (size_t) cp) mask = _mm256_xor_si256(mask,
+        _mm256_set1_epi8(-1));
+    uint16_t *o = dst + (x * 3);
+    for (; x + 16 <= to; x += 16) {
+        __m256i C = _mm256_loadu_si256((const __m256i *)(cur + x)),
+                H = _mm256_avg_epu16(
+                    _mm256_loadu_si256((const __m256i *)(cur + x - 1)),
+                    _mm256_loadu_si256((const __m256i *)(cur + x + 1))),
+                V = _mm256_avg_epu16(
+                    _mm256_loadu_si256((const __m256i *)(up + x)),
+                    _mm256_loadu_si256((const __m256i *)(dn + x))),
+                D = _mm256_avg_epu16(
+                    _mm256_avg_epu16(
+                        _mm256_loadu_si256((const __m256i *)(up + x - 1)),
+                        _mm256_loadu_si256((const __m256i *)(up + x + 1))),
+                    _mm256_avg_epu16(
+                        _mm256_loadu_si256((const __m256i *)(dn + x - 1)),
+                        _mm256_loadu_si256((const __m256i *)(dn + x + 1))));
+        _mm256_storeu_si256((__m256i *) kt, _mm256_blendv_epi8(H, C, mask));
+        _mm256_storeu_si256((__m256i *) gt,
+            _mm256_blendv_epi8(C, _mm256_avg_epu16(H, V), mask));
+        _mm256_storeu_si256((__m256i *) ot, _mm256_blendv_epi8(V, D, mask));
+        DEBAYER_STORE_RGB(o, kt, gt, ot, k, 16);
+    }
+    debayerRow16SSE2(up, cur, dn, dst, x, to, k, cp);
+}
+
+static int detectX86Level(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SIMD_LEVEL_AVX2;
+    if (__builtin_cpu_supports("ssse3")) return SIMD_LEVEL_SSSE3;
+    if (__builtin_cpu_supports("sse2")) return SIMD_LEVEL_SSE2;
+    return SIMD_LEVEL_SCALAR;
+}
+
+#endif /* SIMD_X86_KERNELS */
+
+/* NEON kernels */
+
+#if SIMD_NEON
+
+static inline uint16x8_t convert16NEONVec(uint16x8_t v, int swap,
+    int rescale, int16x8_t lshift, int16x8_t rshift)
+{
+    if (swap) v = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(v)));
+    if (rescale) v = vaddq_u16(vshlq_u16(v, lshift), vshlq_u16(v, rshift));
+    return v;
+}
+
+static void reverseChannels8NEON(const uint8_t *src, uint8_t *dst,
+    size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x3_t v = vld3q_u8(src);
+        uint8x16_t t = v.val[0];
+        v.val[0] = v.val[2];
+        v.val[2] = t;
+        vst3q_u8(dst, v);
+        src += 48;
+        dst += 48;
+    }
+    reverseChannels8Scalar(src, dst, count - i);
+}
+
+static void convert16NEON(const uint16_t *src, uint16_t *dst, size_t count,
+    int depth, int swap)
+{
+    size_t i = 0;
+    int rescale = (depth < 16);
+    /* Negative shift counts shift to the right */
+    int16x8_t lshift = vdupq_n_s16(rescale ? 16 - depth : 0),
+              rshift = vdupq_n_s16(rescale ? -(depth - (16 - depth)) : 0);
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t v = vld1q_u16(src + i);
+        v = convert16NEONVec(v, swap, rescale, lshift, rshift);
+        vst1q_u16(dst + i, v);
+    }
+    convert16Scalar(src + i, dst + i, count - i, depth, swap);
+}
+
+static void convertRGB16NEON(const uint16_t *src, uint16_t *dst,
+    size_t count, int depth, int swap)
+{
+    size_t i = 0;
+    int rescale = (depth < 16);
+    int16x8_t lshift = vdupq_n_s16(rescale ? 16 - depth : 0),
+              rshift = vdupq_n_s16(rescale ? -(depth - (16 - depth)) : 0);
+    for (; i + 8 <= count; i += 8) {
+        uint16x8x3_t v = vld3q_u16(src), out;
+        out.val[0] = convert16NEONVec(v.val[2], swap, rescale, lshift, rshift);
+        out.val[1] = convert16NEONVec(v.val[1], swap, rescale, lshift, rshift);
+        out.val[2] = convert16NEONVec(v.val[0], swap, rescale, lshift, rshift);
+        vst3q_u16(dst, out);
+        src += 24;
+        dst += 24;
+    }
+    convertRGB16Scalar(src, dst, count - i, depth, swap);
+}
+
+static void toPlanes8NEON(const uint8_t *src, uint8_t *dst, size_t count,
+    size_t plane, int first)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x3_t v = vld3q_u8(src);
+        vst1q_u8(dst + i, (first ? v.val[2] : v.val[0]));
+        vst1q_u8(dst + plane + i, v.val[1]);
+        vst1q_u8(dst + (2 * plane) + i, (first ? v.val[0] : v.val[2]));
+        src += 48;
+    }
+    toPlanes8Scalar(src, dst + i, count - i, plane, first);
+}
+
+static void toPlanes16NEON(const uint16_t *src, uint16_t *dst,
+    size_t count, size_t plane, int first, int depth, int swap)
+{
+    size_t i = 0;
+    int rescale = (depth < 16);
+    int16x8_t lshift = vdupq_n_s16(rescale ? 16 - depth : 0),
+              rshift = vdupq_n_s16(rescale ? -(depth - (16 - depth)) : 0);
+    for (; i + 8 <= count; i += 8) {
+        uint16x8x3_t v = vld3q_u16(src);
+        vst1q_u16(dst + i, convert16NEONVec((first ? v.val[2] : v.val[0]), swap, rescale,
+            lshift, rshift));
+        vst1q_u16(dst + plane + i, convert16NEONVec(v.val[1], swap, rescale,
+            lshift, rshift));
+        vst1q_u16(dst + (2 * plane) + i, convert16NEONVec((first ? v.val[0] : v.val[2]),
+            swap, rescale, lshift, rshift));
+        src += 24;
+    }
+    toPlanes16Scalar(src, dst + i, count - i, plane, first, depth, swap);
+}
+
+static inline uint64_t sumU64NEON(uint64x2_t v) {
+    return vgetq_lane_u64(v, 0) + vgetq_lane_u64(v, 1);
+}
+
+static void sampleStats8NEON(const uint8_t *src, size_t count,
+    uint32_t saturation, SIMDSampleStats *stats)
+{
+    size_t i = 0;
+    uint8x16_t vmin = vdupq_n_u8(0xFF), vmax = vdupq_n_u8(0),
+               vsat = vdupq_n_u8(saturation > 255 ? 255 : saturation);
+    uint64x2_t sum64 = vdupq_n_u64(0), sumsq64 = vdupq_n_u64(0),
+               sat64 = vdupq_n_u64(0);
+    int check_sat = (saturation <= 255);
+    while (i + 16 <= count) {
+        uint32x4_t sum32 = vdupq_n_u32(0), sumsq32 = vdupq_n_u32(0),
+                   sat32 = vdupq_n_u32(0);
+        size_t iter = 0;
+        for (; i + 16 <= count && iter < STATS_BLOCK_ITER; i += 16, iter++) {
+            uint8x16_t v = vld1q_u8(src + i);
+            vmin = vminq_u8(vmin, v);
+            vmax = vmaxq_u8(vmax, v);
+            sum32 = vpadalq_u16(sum32, vpaddlq_u8(v));
+            uint16x8_t lo = vmull_u8(vget_low_u8(v), vget_low_u8(v)),
+                       hi = vmull_u8(vget_high_u8(v), vget_high_u8(v));
+            sumsq32 = vpadalq_u16(sumsq32, lo);
+            sumsq32 = vpadalq_u16(sumsq32, hi);
+            if (check_sat) {
+                uint8x16_t ones = vshrq_n_u8(vcgeq_u8(v, vsat), 7);
+                sat32 = vpadalq_u16(sat32, vpaddlq_u8(ones));
+            }
+        }
+        sum64 = vpadalq_u32(sum64, sum32);
+        sumsq64 = vpadalq_u32(sumsq64, sumsq32);
+        sat64 = vpadalq_u32(sat64, sat32);
+    }
+    if (i > 0) {
+        uint8_t mins[16], maxs[16];
+        int k;
+        vst1q_u8(mins, vmin);
+        vst1q_u8(maxs, vmax);
+        for (k = 0; k < 16; k++) {
+            if (mins[k] < stats->min) stats->min = mins[k];
+            if (maxs[k] > stats->max) stats->max = maxs[k];
+        }
+    }
+    stats->sum += sumU64NEON(sum64);
+    stats->sumsq += sumU64NEON(sumsq64);
+    stats->saturated += sumU64NEON(sat64);
+    stats->count += i;
+    sampleStats8Scalar(src + i, count - i, saturation, stats);
+}
+
+static void sampleStats16NEON(const uint16_t *src, size_t count,
+    uint32_t saturation, SIMDSampleStats *stats)
+{
+    size_t i = 0;
+    uint16x8_t vmin = vdupq_n_u16(0xFFFF), vmax = vdupq_n_u16(0),
+               vsat = vdupq_n_u16(saturation > 0xFFFF ? 0xFFFF : saturation);
+    uint64x2_t sum64 = vdupq_n_u64(0), sumsq64 = vdupq_n_u64(0),
+               sat64 = vdupq_n_u64(0);
+    int check_sat = (saturation <= 0xFFFF);
+    while (i + 8 <= count) {
+        uint32x4_t sum32 = vdupq_n_u32(0), sat32 = vdupq_n_u32(0);
+        size_t iter = 0;
+        for (; i + 8 <= count && iter < STATS_BLOCK_ITER; i += 8, iter++) {
+            uint16x8_t v = vld1q_u16(src + i);
+            vmin = vminq_u16(vmin, v);
+            vmax = vmaxq_u16(vmax, v);
+            sum32 = vpadalq_u16(sum32, v);
+            uint32x4_t lo = vmull_u16(vget_low_u16(v), vget_low_u16(v)),
+                       hi = vmull_u16(vget_high_u16(v), vget_high_u16(v));
+            sumsq64 = vpadalq_u32(sumsq64, lo);
+            sumsq64 = vpadalq_u32(sumsq64, hi);
+            if (check_sat)
+                sat32 = vpadalq_u16(sat32, vshrq_n_u16(vcgeq_u16(v, vsat), 15));
+        }
+        sum64 = vpadalq_u32(sum64, sum32);
+        sat64 = vpadalq_u32(sat64, sat32);
+    }
+    if (i > 0) {
+        uint16_t mins[8], maxs[8];
+        int k;
+        vst1q_u16(mins, vmin);
+        vst1q_u16(maxs, vmax);
+        for (k = 0; k < 8; k++) {
+            if (mins[k] < stats->min) stats->min = mins[k];
+            if (maxs[k] > stats->max) stats->max = maxs[k];
+        }
+    }
+    stats->sum += sumU64NEON(sum64);
+    stats->sumsq += sumU64NEON(sumsq64);
+    stats->saturated += sumU64NEON(sat64);
+    stats->count += i;
+    sampleStats16Scalar(src + i, count - i, saturation, stats);
+}
+
+static void accumulate8NEON(const uint8_t *src, uint32_t *acc, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t v = vmovl_u8(vld1_u8(src + i));
+        vst1q_u32(acc + i, vaddw_u16(vld1q_u32(acc + i), vget_low_u16(v)));
+        vst1q_u32(acc + i + 4,
+            vaddw_u16(vld1q_u32(acc + i + 4), vget_high_u16(v)));
+    }
+    accumulate8Scalar(src + i, acc + i, count - i);
+}
+
+static void accumulate16NEON(const uint16_t *src, uint32_t *acc,
+    size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t v = vld1q_u16(src + i);
+        vst1q_u32(acc + i, vaddw_u16(vld1q_u32(acc + i), vget_low_u16(v)));
+        vst1q_u32(acc + i + 4,
+            vaddw_u16(vld1q_u32(acc + i + 4), vget_high_u16(v)));
+    }
+    accumulate16Scalar(src + i, acc + i, count - i);
+}
+
+static void binRow2NEON(const uint32_t *src, uint32_t *dst, size_t count,
+    int step)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t sum;
+        if (step == 1) {
+            uint32x4x2_t v = vld2q_u32(src + (i * 2));
+            sum = vaddq_u32(v.val[0], v.val[1]);
+        } else {
+            uint32x4_t a = vld1q_u32(src + (i * 2)),
+                       b = vld1q_u32(src + (i * 2) + 4);
+            sum = vaddq_u32(vcombine_u32(vget_low_u32(a), vget_low_u32(b)),
+                            vcombine_u32(vget_high_u32(a), vget_high_u32(b)));
+        }
+        vst1q_u32(dst + i, sum);
+    }
+    binRowScalar(src + (i * 2), dst + i, count - i, 2, step);
+}
+
+static inline uint32x4_t divideBinsNEON(uint32x4_t v, uint32x4_t half,
+    uint32x2_t recip)
+{
+    v = vaddq_u32(v, half);
+    uint64x2_t lo = vmull_u32(vget_low_u32(v), recip),
+               hi = vmull_u32(vget_high_u32(v), recip);
+    return vcombine_u32(vshrn_n_u64(lo, 32), vshrn_n_u64(hi, 32));
+}
+
+static void packBinsNEON(const uint32_t *src, void *dst, size_t count,
+    uint32_t divisor, uint32_t recip, uint32_t maxval, const uint8_t *lut,
+    int bytes_per_sample)
+{
+    size_t i = 0;
+    uint32x4_t half = vdupq_n_u32(divisor / 2), maxv = vdupq_n_u32(maxval);
+    uint32x2_t rv = vdup_n_u32(recip);
+    uint16_t values[8];
+    for (; i + 8 <= count; i += 8) {
+        uint32x4_t a = vld1q_u32(src + i), b = vld1q_u32(src + i + 4);
+        if (divisor > 1) {
+            a = divideBinsNEON(a, half, rv);
+            b = divideBinsNEON(b, half, rv);
+        }
+        a = vminq_u32(a, maxv);
+        b = vminq_u32(b, maxv);
+        uint16x8_t w = vcombine_u16(vmovn_u32(a), vmovn_u32(b));
+        if (lut != NULL) {
+            int l;
+            vst1q_u16(values, w);
+            for (l = 0; l < 8; l++) ((uint8_t *) dst)[i + l] = lut[values[l]];
+        } else if (bytes_per_sample == 1) {
+            vst1_u8((uint8_t *) dst + i, vmovn_u16(w));
+        } else {
+            vst1q_u16((uint16_t *) dst + i, w);
+        }
+    }
+    if (bytes_per_sample == 1 || lut != NULL) {
+        packBinsScalar(src + i, (uint8_t *) dst + i, count - i, divisor,
+            maxval, lut, bytes_per_sample);
+    } else {
+        packBinsScalar(src + i, (uint16_t *) dst + i, count - i, divisor,
+            maxval, lut, bytes_per_sample);
+    }
+}
+
+static void debayerRow8NEON(const uint8_t *up, const uint8_t *cur,
+    const uint8_t *dn, uint8_t *dst, size_t from, size_t to, int k, int cp)
+{
+    size_t x = from;
+    uint8x16_t mask = vreinterpretq_u8_u16(vdupq_n_u16(0x00FF));
+    if ((from & 1) != (size_t) cp) mask = vmvnq_u8(mask);
+    for (; x + 16 <= to; x += 16) {
+        uint8x16_t C = vld1q_u8(cur + x),
+                   H = vrhaddq_u8(vld1q_u8(cur + x - 1),
+                                  vld1q_u8(cur + x + 1)),
+                   V = vrhaddq_u8(vld1q_u8(up + x), vld1q_u8(dn + x)),
+                   D = vrhaddq_u8(
+                       vrhaddq_u8(vld1q_u8(up + x - 1),
+                                  vld1q_u8(up + x + 1)),
+                       vrhaddq_u8(vld1q_u8(dn + x - 1),
+                                  vld1q_u8(dn + x + 1)));
+        uint8x16_t K = vbslq_u8(mask, C, H), O = vbslq_u8(mask, D, V);
+        uint8x16x3_t rgb;
+        rgb.val[0] = (k == 0 ? K : O);
+        rgb.val[1] = vbslq_u8(mask, vrhaddq_u8(H, V), C);
+        rgb.val[2] = (k == 0 ? O : K);
+        vst3q_u8(dst + (x * 3), rgb);
+    }
+    debayerRow8Scalar(up, cur, dn, dst, x, to, k, cp);
+}
+
+static void debayerRow16NEON(const uint16_t *up, const uint16_t *cur,
+    const uint16_t *dn, uint16_t *dst, size_t from, size_t to, int k, int cp)
+{
+    size_t x = from;
+    uint16x8_t mask = vreinterpretq_u16_u32(vdupq_n_u32(0x0000FFFF));
+    if ((from & 1) != (size_t) cp) mask = vmvnq_u16(mask);
+    for (; x + 8 <= to; x += 8) {
+        uint16x8_t C = vld1q_u16(cur + x),
+                   H = vrhaddq_u16(vld1q_u16(cur + x - 1),
+                                   vld1q_u16(cur + x + 1)),
+                   V = vrhaddq_u16(vld1q_u16(up + x), vld1q_u16(dn + x)),
+                   D = vrhaddq_u16(
+                       vrhaddq_u16(vld1q_u16(up + x - 1),
+                                   vld1q_u16(up + x + 1)),
+                       vrhaddq_u16(vld1q_u16(dn + x - 1),
+                                   vld1q_u16(dn + x + 1)));
+        uint16x8_t K = vbslq_u16(mask, C, H), O = vbslq_u16(mask, D, V);
+        uint16x8x3_t rgb;
+        rgb.val[0] = (k == 0 ? K : O);
+        rgb.val[1] = vbslq_u16(mask, vrhaddq_u16(H, V), C);
+        rgb.val[2] = (k == 0 ? O : K);
+        vst3q_u16(dst + (x * 3), rgb);
+    }
+    debayerRow16Scalar(up, cur, dn, dst, x, to, k, cp);
+}
+
+#endif /* SIMD_NEON */
+
+/* Dispatch */
+
+static int detectLevel(void) {
+#if SIMD_X86_KERNELS
+    return detectX86Level();
+#elif SIMD_NEON
+    return SIMD_LEVEL_NEON;
+#else
+    return SIMD_LEVEL_SCALAR;
+#endif
+}
+
+static void initLevel(void) {
+    int level = detectLevel(), i;
+    char *forced = getenv(SIMD_LEVEL_ENV);
+    if (forced != NULL) {
+        int nlevels = (int) (sizeof(simd_level_names) / sizeof(char *));
+        for (i = 0; i < nlevels; i++) {
+            if (strcasecmp(forced, simd_level_names[i]) != 0) continue;
+            /* Only lower levels can be forced */
+            if (i == SIMD_LEVEL_SCALAR || (i <= level &&
+                (i == SIMD_LEVEL_NEON) == (level == SIMD_LEVEL_NEON)))
+                level = i;
+            break;
+        }
+    }
+#if SIMD_X86_KERNELS
+    initShuffle48Masks();
+#endif
+    simd_level = level;
+}
+
+/* Get the SIMD level (SIMD_LEVEL_*) used by conversion kernels. */
+int SIMDGetLevel(void) {
+    pthread_once(&simd_level_once, initLevel);
+    return simd_level;
+}
+
+/* Force a SIMD level, which must be supported by the CPU.
+ * Return the active level. */
+int SIMDSetLevel(int level) {
+    int supported = detectLevel();
+    pthread_once(&simd_level_once, initLevel);
+    if (level == SIMD_LEVEL_SCALAR || (level <= supported &&
+        (level == SIMD_LEVEL_NEON) == (supported == SIMD_LEVEL_NEON)))
+        simd_level = level;
+    return simd_level;
+}
+
+const char *SIMDGetLevelName(int level) {
+    int nlevels = (int) (sizeof(simd_level_names) / sizeof(char *));
+    if (level < 0 || level >= nlevels) return "unknown";
+    return simd_level_names[level];
+}
+
+/* Convert `size` bytes of raw SER pixels from `src` to `dst` (they can be
+ * the same buffer).
+ * `depth` is the pixel depth and `planes` the number of channels; if
+ * `reverse_channels` is not zero, the channel order of 3-channel pixels
+ * gets reversed (BGR -> RGB) and if `swap_bytes` is not zero the byte
+ * order of 16-bit pixels gets swapped. Pixels whose depth is between 9 and
+ * 15 bits are also scaled to 16 bits. */
+void SIMDConvertPixels(const void *src, void *dst, size_t size, int depth,
+    int planes, int reverse_channels, int swap_bytes)
+{
+    int level = SIMDGetLevel();
+    (void) level;
+    if (depth <= 8) {
+        if (planes != 3 || !reverse_channels) {
+            if (dst != src) memmove(dst, src, size);
+            return;
+        }
+        size_t count = size / 3;
+#if SIMD_X86_KERNELS
+        if (level >= SIMD_LEVEL_SSSE3) {
+            reverseChannels8SSSE3(src, dst, count);
+            return;
+        }
+#endif
+#if SIMD_NEON
+        if (level == SIMD_LEVEL_NEON) {
+            reverseChannels8NEON(src, dst, count);
+            return;
+        }
+#endif
+        reverseChannels8Scalar(src, dst, count);
+        return;
+    }
+    if (planes == 3 && reverse_channels) {
+        size_t count = size / 6;
+#if SIMD_X86_KERNELS
+        if (level >= SIMD_LEVEL_SSSE3) {
+            convertRGB16SSSE3(src, dst, count, depth, swap_bytes);
+            return;
+        }
+#endif
+#if SIMD_NEON
+        if (level == SIMD_LEVEL_NEON) {
+            convertRGB16NEON(src, dst, count, depth, swap_bytes);
+            return;
+        }
+#endif
+        convertRGB16Scalar(src, dst, count, depth, swap_bytes);
+        return;
+    }
+    /* Mono or RGB without reordering: every 16-bit value is converted
+     * in the same way */
+    size_t count = size / 2;
+    if (!swap_bytes && depth >= 16) {
+        if (dst != src) memmove(dst, src, size);
+        return;
+    }
+#if SIMD_X86_KERNELS
+    if (level >= SIMD_LEVEL_AVX2) {
+        convert16AVX2(src, dst, count, depth, swap_bytes);
+        return;
+    }
+    if (level >= SIMD_LEVEL_SSE2) {
+        convert16SSE2(src, dst, count, depth, swap_bytes);
+        return;
+    }
+#endif
+#if SIMD_NEON
+    if (level == SIMD_LEVEL_NEON) {
+        convert16NEON(src, dst, count, depth, swap_bytes);
+        return;
+    }
+#endif
+    convert16Scalar(src, dst, count, depth, swap_bytes);
+}
+
+/* Compute min, max, sum, sum of squares and the number of samples whose
+ * value is greater than or equal to `saturation` of the `count` samples
+ * in `src` (8-bit samples if `bytes_per_sample` is 1, 16-bit otherwise,
+ * in host byte order), and store them into `stats`. */
+void SIMDComputeSampleStats(const void *src, size_t count,
+    int bytes_per_sample, uint32_t saturation, SIMDSampleStats *stats)
+{
+    int level = SIMDGetLevel();
+    (void) level;
+    memset(stats, 0, sizeof(*stats));
+    stats->min = UINT32_MAX;
+    if (bytes_per_sample == 1) {
+#if SIMD_X86_KERNELS
+        if (level >= SIMD_LEVEL_AVX2) {
+            sampleStats8AVX2(src, count, saturation, stats);
+            goto done;
+        }
+        if (level >= SIMD_LEVEL_SSE2) {
+            sampleStats8SSE2(src, count, saturation, stats);
+            goto done;
+        }
+#endif
+#if SIMD_NEON
+        if (level == SIMD_LEVEL_NEON) {
+            sampleStats8NEON(src, count, saturation, stats);
+            goto done;
+        }
+#endif
+        sampleStats8Scalar(src, count, saturation, stats);
+        goto done;
+    }
+#if SIMD_X86_KERNELS
+    if (level >= SIMD_LEVEL_AVX2) {
+        sampleStats16AVX2(src, count, saturation, stats);
+        goto done;
+    }
+    if (level >= SIMD_LEVEL_SSE2) {
+        sampleStats16SSE2(src, count, saturation, stats);
+        goto done;
+    }
+#endif
+#if SIMD_NEON
+    if (level == SIMD_LEVEL_NEON) {
+        sampleStats16NEON(src, count, saturation, stats);
+        goto done;
+    }
+#endif
+    sampleStats16Scalar(src, count, saturation, stats);
+done:
+    if (count == 0) stats->min = 0;
+}
+
+/* Bilinear demosaicing of the pixels `from` - `to - 1` of the Bayer row
+ * `cur` (whose neighbour rows are `up` and `dn`): RGB pixels are stored
+ * into `dst`, that is the whole destination row (interleaved RGB).
+ * Samples are 8-bit if `bytes_per_sample` is 1, 16-bit otherwise (host
+ * byte order). Non green samples of the row are of color `channel` (0 for
+ * red, 2 for blue) and are in columns whose parity is `color_parity`.
+ * The neighbours of every pixel must be inside the row (ie. 1 <= `from`
+ * and `to` <= width - 1). */
+void SIMDDebayerBilinearRow(const void *up, const void *cur, const void *dn,
+    void *dst, size_t from, size_t to, int bytes_per_sample, int channel,
+    int color_parity)
+{
+    int level = SIMDGetLevel();
+    (void) level;
+    if (to <= from) return;
+    if (bytes_per_sample == 1) {
+#if SIMD_X86_KERNELS
+        if (level >= SIMD_LEVEL_AVX2) {
+            debayerRow8AVX2(up, cur, dn, dst, from, to, channel, color_parity);
+            return;
+        }
+        if (level >= SIMD_LEVEL_SSE2) {
+            debayerRow8SSE2(up, cur, dn, dst, from, to, channel, color_parity);
+            return;
+        }
+#endif
+#if SIMD_NEON
+        if (level == SIMD_LEVEL_NEON) {
+            debayerRow8NEON(up, cur, dn, dst, from, to, channel, color_parity);
+            return;
+        }
+#endif
+        debayerRow8Scalar(up, cur, dn, dst, from, to, channel, color_parity);
+        return;
+    }
+#if SIMD_X86_KERNELS
+    if (level >= SIMD_LEVEL_AVX2) {
+        debayerRow16AVX2(up, cur, dn, dst, from, to, channel, color_parity);
+        return;
+    }
+    if (level >= SIMD_LEVEL_SSE2) {
+        debayerRow16SSE2(up, cur, dn, dst, from, to, channel, color_parity);
+        return;
+    }
+#endif
+#if SIMD_NEON
+    if (level == SIMD_LEVEL_NEON) {
+        debayerRow16NEON(up, cur, dn, dst, from, to, channel, color_parity);
+        return;
+    }
+#endif
+    debayerRow16Scalar(up, cur, dn, dst, from, to, channel, color_parity);
+}
+
+/* Add the `count` samples of `src` (8-bit samples if `bytes_per_sample`
+ * is 1, 16-bit otherwise, in host byte order) to the 32-bit accumulators
+ * `acc`. Callers must take care of accumulator overflows (at least 65537
+ * 16-bit samples can be added to every accumulator). */
+void SIMDAccumulateSamples(const void *src, uint32_t *acc, size_t count,
+    int bytes_per_sample)
+{
+    int level = SIMDGetLevel();
+    (void) level;
+    if (bytes_per_sample == 1) {
+#if SIMD_X86_KERNELS
+        if (level >= SIMD_LEVEL_AVX2) {
+            accumulate8AVX2(src, acc, count);
+            return;
+        }
+        if (level >= SIMD_LEVEL_SSE2) {
+            accumulate8SSE2(src, acc, count);
+            return;
+        }
+#endif
+#if SIMD_NEON
+        if (level == SIMD_LEVEL_NEON) {
+            accumulate8NEON(src, acc, count);
+            return;
+        }
+#endif
+        accumulate8Scalar(src, acc, count);
+        return;
+    }
+#if SIMD_X86_KERNELS
+    if (level >= SIMD_LEVEL_AVX2) {
+        accumulate16AVX2(src, acc, count);
+        return;
+    }
+    if (level >= SIMD_LEVEL_SSE2) {
+        accumulate16SSE2(src, acc, count);
+        return;
+    }
+#endif
+#if SIMD_NEON
+    if (level == SIMD_LEVEL_NEON) {
+        accumulate16NEON(src, acc, count);
+        return;
+    }
+#endif
+    accumulate16Scalar(src, acc, count);
+}
+
+/* Same as SIMDConvertPixels, but the `count` 3-channel pixels of `src`
+ * are stored as three planes of `count` samples starting from `dst`,
+ * whose first plane gets the last channel if `reverse_channels` is not
+ * zero (BGR -> RGB). `src` and `dst` must not overlap. */
+void SIMDConvertPixelsToPlanes(const void *src, void *dst, size_t count,
+    int depth, int reverse_channels, int swap_bytes)
+{
+    int level = SIMDGetLevel(), first = (reverse_channels ? 2 : 0);
+    (void) level;
+    if (depth <= 8) {
+#if SIMD_X86_KERNELS
+        if (level >= SIMD_LEVEL_SSSE3) {
+            toPlanes8SSSE3(src, dst, count, count, first);
+            return;
+        }
+#endif
+#if SIMD_NEON
+        if (level == SIMD_LEVEL_NEON) {
+            toPlanes8NEON(src, dst, count, count, first);
+            return;
+        }
+#endif
+        toPlanes8Scalar(src, dst, count, count, first);
+        return;
+    }
+#if SIMD_X86_KERNELS
+    if (level >= SIMD_LEVEL_SSSE3) {
+        toPlanes16SSSE3(src, dst, count, count, first, depth, swap_bytes);
+        return;
+    }
+#endif
+#if SIMD_NEON
+    if (level == SIMD_LEVEL_NEON) {
+        toPlanes16NEON(src, dst, count, count, first, depth, swap_bytes);
+        return;
+    }
+#endif
+    toPlanes16Scalar(src, dst, count, count, first, depth, swap_bytes);
+}
+
+/* Horizontal binning of a row of 32-bit sums (ie. sums of binned rows
+ * computed by SIMDAccumulateSamples): samples are made of groups of `step`
+ * interleaved samples (ie. the channels of RGB pixels, or the two colors
+ * of Bayer rows), and every sample of `dst` is the sum of the samples of
+ * the same channel of `factor` contiguous groups of `src`.
+ * `count` is the number of samples of `dst` and it must be a multiple of
+ * `step`; `src` must contain `count` * `factor` samples. */
+void SIMDBinRow(const uint32_t *src, uint32_t *dst, size_t count,
+    int factor, int step)
+{
+    int level = SIMDGetLevel();
+    (void) level;
+    if (factor == 2 && (step == 1 || step == 2)) {
+#if SIMD_X86_KERNELS
+        if (level >= SIMD_LEVEL_SSE2) {
+            binRow2SSE2(src, dst, count, step);
+            return;
+        }
+#endif
+#if SIMD_NEON
+        if (level == SIMD_LEVEL_NEON) {
+            binRow2NEON(src, dst, count, step);
+            return;
+        }
+#endif
+    }
+    binRowScalar(src, dst, count, factor, step);
+}
+
+/* Convert the `count` bin sums of `src` into samples of `dst`: every sum
+ * is divided by `divisor` (rounding to nearest, 1 keeps sums as they are)
+ * and clamped to `maxval`, then stored as 8-bit samples if
+ * `bytes_per_sample` is 1, 16-bit otherwise (host byte order). If `lut`
+ * is not NULL, clamped values are mapped through it (it must contain
+ * `maxval` + 1 entries) and stored as 8-bit samples.
+ * Divisors up to 64 are supported, with sums of 16-bit samples. */
+void SIMDPackBins(const uint32_t *src, void *dst, size_t count,
+    uint32_t divisor, uint32_t maxval, const uint8_t *lut,
+    int bytes_per_sample)
+{
+    int level = SIMDGetLevel();
+    (void) level;
+    if (divisor == 0) divisor = 1;
+    /* Sums are less than 2^32 / divisor, so that multiplying them by this
+     * reciprocal gives exact quotients. */
+    uint32_t recip = 0;
+    if (divisor > 1) recip = (uint32_t) ((UINT64_C(1) << 32) / divisor) + 1;
+    (void) recip;
+#if SIMD_X86_KERNELS
+    if (level >= SIMD_LEVEL_AVX2) {
+        packBinsAVX2(src, dst, count, divisor, recip, maxval, lut,
+            bytes_per_sample);
+        return;
+    }
+    if (level >= SIMD_LEVEL_SSE2) {
+        packBinsSSE2(src, dst, count, divisor, recip, maxval, lut,
+            bytes_per_sample);
+        return;
+    }
+#endif
+#if SIMD_NEON
+    if (level == SIMD_LEVEL_NEON) {
+        packBinsNEON(src, dst, count, divisor, recip, maxval, lut,
+            bytes_per_sample);
+        return;
+    }
+#endif
+    packBinsScalar(src, dst, count, divisor, maxval, lut, bytes_per_sample);
+}
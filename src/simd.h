@@ -0,0 +1,79 @@
+/*
+ *  SERUtils - A command line utility for processing SER movie files
+ *  Copyright (C) 2020  Giuseppe Fabio Nicotra <artix2 at gmail dot com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SER_SIMD_H__
+#define __SER_SIMD_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define SIMD_X86 1
+#else
+    #define SIMD_X86 0
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define SIMD_NEON 1
+#else
+    #define SIMD_NEON 0
+#endif
+
+#define SIMD_LEVEL_SCALAR   0
+#define SIMD_LEVEL_SSE2     1
+#define SIMD_LEVEL_SSSE3    2
+#define SIMD_LEVEL_AVX2     3
+#define SIMD_LEVEL_NEON     4
+
+/* Environment variable that can be used to force a lower SIMD level
+ * (ie. SERUTILS_SIMD=scalar), mainly for testing and benchmarking. */
+#define SIMD_LEVEL_ENV      "SERUTILS_SIMD"
+
+typedef struct {
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint64_t sumsq;
+    uint64_t saturated;
+    uint64_t count;
+} SIMDSampleStats;
+
+int         SIMDGetLevel(void);
+int         SIMDSetLevel(int level);
+const char *SIMDGetLevelName(int level);
+void        SIMDConvertPixels(const void *src, void *dst, size_t size,
+                              int depth, int planes, int reverse_channels,
+                              int swap_bytes);
+void        SIMDConvertPixelsToPlanes(const void *src, void *dst,
+                                      size_t count, int depth,
+                                      int reverse_channels, int swap_bytes);
+void        SIMDComputeSampleStats(const void *src, size_t count,
+                                   int bytes_per_sample, uint32_t saturation,
+                                   SIMDSampleStats *stats);
+void        SIMDAccumulateSamples(const void *src, uint32_t *acc,
+                                  size_t count, int bytes_per_sample);
+void        SIMDBinRow(const uint32_t *src, uint32_t *dst, size_t count,
+                       int factor, int step);
+void        SIMDPackBins(const uint32_t *src, void *dst, size_t count,
+                         uint32_t divisor, uint32_t maxval,
+                         const uint8_t *lut, int bytes_per_sample);
+void        SIMDDebayerBilinearRow(const void *up, const void *cur,
+                                   const void *dn, void *dst, size_t from,
+                                   size_t to, int bytes_per_sample,
+                                   int channel, int color_parity);
+
+#endif /* __SER_SIMD_H__ */
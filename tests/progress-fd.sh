@@ -0,0 +1,59 @@
+#!/bin/bash
+# Copyright (C) 2019  Giuseppe Fabio Nicotra <artix2 at gmail dot com>
+#
+# Check that serutils survives a --progress-fd whose reader has gone away:
+# the action must succeed and write the whole movie.
+#
+# Usage: progress-fd.sh SERUTILS_PATH
+
+SERUTILS=${1:-bin/serutils}
+TMPDIR=$(mktemp -d /tmp/serutils-test.XXXXXX) || exit 1
+trap 'rm -rf "$TMPDIR"' EXIT
+
+WIDTH=64
+HEIGHT=64
+FRAMES=500
+
+fail() {
+    echo "FAIL: $*" >&2
+    exit 1
+}
+
+le32() {
+    printf '\\x%02x\\x%02x\\x%02x\\x%02x' $(($1 & 255)) $((($1 >> 8) & 255)) \
+        $((($1 >> 16) & 255)) $((($1 >> 24) & 255))
+}
+
+# 8-bit MONO movie without frame dates
+makeMovie() {
+    printf "LUCAM-RECORDER"
+    printf "$(le32 0)$(le32 0)$(le32 0)"
+    printf "$(le32 $WIDTH)$(le32 $HEIGHT)$(le32 8)$(le32 $FRAMES)"
+    head -c 120 /dev/zero
+    head -c 16 /dev/zero
+    head -c $((WIDTH * HEIGHT * FRAMES)) /dev/urandom
+}
+
+makeMovie > "$TMPDIR/movie.ser" || fail "could not create test movie"
+
+# Open a pipe and wait for its reader to exit
+exec 3> >(:)
+reader=$!
+while kill -0 $reader 2>/dev/null; do sleep 0.1; done
+
+"$SERUTILS" --no-colors --overwrite --progress-rate 0 --progress-fd 3 \
+    --extract 1..$FRAMES -o "$TMPDIR/out.ser" "$TMPDIR/movie.ser" \
+    > "$TMPDIR/log.txt" 2>&1 < /dev/null
+status=$?
+exec 3>&-
+[ $status -eq 0 ] || { cat "$TMPDIR/log.txt" >&2; fail "exit status $status"; }
+
+"$SERUTILS" --no-colors "$TMPDIR/out.ser" > "$TMPDIR/info.txt" 2>&1 ||
+    fail "could not open output movie"
+grep -q "Frames: $FRAMES\$" "$TMPDIR/info.txt" ||
+    fail "output movie is incomplete"
+expected=$((178 + WIDTH * HEIGHT * FRAMES))
+size=$(wc -c < "$TMPDIR/out.ser")
+[ $size -ge $expected ] || fail "output movie is truncated ($size bytes)"
+
+echo "OK: progress-fd"